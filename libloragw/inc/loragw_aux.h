@@ -20,6 +20,8 @@ Maintainer: Sylvain Miermont
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+#include <stdint.h>     /* C99 types */
+
 #include "config.h"    /* library configuration options (dynamically generated) */
 
 /* -------------------------------------------------------------------------- */
@@ -43,6 +45,12 @@ Maintainer: Sylvain Miermont
 */
 void wait_ms(unsigned long t);
 
+/**
+@brief Read the monotonic clock (microsecond resolution)
+@return time elapsed since an arbitrary origin, in microseconds
+*/
+uint64_t monotonic_us(void);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,188 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Command queue giving the concentrator to a single owner thread
+
+    Any number of threads submit register accesses and function calls to a
+    lock-free queue and get a completion back. The owner thread takes all the
+    pending commands at once, runs the register accesses of each page one
+    after the other inside a single SPI batch, and runs the calls (eg. lgw_send
+    or lgw_get_trigcnt) in between, so the submitting threads never touch the
+    SPI link nor wait for the concentrator lock.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAGW_CMDQ_H
+#define _LORAGW_CMDQ_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <semaphore.h>  /* sem_t */
+
+#include "config.h"    /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_CMDQ_SUCCESS    0
+#define LGW_CMDQ_ERROR      -1
+#define LGW_CMDQ_TIMEOUT    1   /* returned by lgw_cmdq_wait when the command is not completed yet */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@enum lgw_cmd_type_e
+@brief Operation of a queued command
+*/
+enum lgw_cmd_type_e {
+    LGW_CMD_REG_W,      /*!> lgw_reg_w(reg_id, value) */
+    LGW_CMD_REG_R,      /*!> lgw_reg_r(reg_id, &value) */
+    LGW_CMD_REG_WB,     /*!> lgw_reg_wb(reg_id, data, size) */
+    LGW_CMD_REG_RB,     /*!> lgw_reg_rb(reg_id, data, size) */
+    LGW_CMD_CALL        /*!> fn(arg), also orders the register accesses submitted before and after it */
+};
+
+/**
+@struct lgw_cmd_s
+@brief Command submitted to the owner thread, owned by the queue until it is completed
+*/
+struct lgw_cmd_s {
+    enum lgw_cmd_type_e type;           /*!> operation */
+    uint16_t            reg_id;         /*!> register, for LGW_CMD_REG_* */
+    int32_t             value;          /*!> value to write, or value read */
+    uint8_t             *data;          /*!> burst buffer, for LGW_CMD_REG_WB and LGW_CMD_REG_RB */
+    uint16_t            size;           /*!> burst size */
+    int                 (*fn)(void *arg); /*!> function run by the owner thread, for LGW_CMD_CALL */
+    void                *arg;           /*!> argument of fn */
+    void                (*done)(struct lgw_cmd_s *cmd); /*!> if not NULL, called by the owner thread on completion instead of waking up lgw_cmdq_wait */
+    int                 status;         /*!> result of the lgw_reg_* function or of fn, valid once completed */
+    /* private to the queue */
+    struct lgw_cmd_s    *next;
+    sem_t               sem;
+};
+
+/**
+@struct lgw_cmdq_stats_s
+@brief Structure containing the command queue counters
+*/
+struct lgw_cmdq_stats_s {
+    uint32_t    nb_cmd;         /*!> number of commands completed */
+    uint32_t    nb_batch;       /*!> number of times the owner thread took the pending commands */
+    uint32_t    nb_page_group;  /*!> number of groups of register accesses run on a single page */
+    uint16_t    batch_max;      /*!> largest number of commands taken at once */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Start the owner thread, the concentrator must already be started
+@return LGW_CMDQ_ERROR id the operation failed, LGW_CMDQ_SUCCESS else
+
+The thread drives the concentrator of the context of the calling thread. It
+holds the concentrator lock while it runs commands, so other threads can keep
+calling HAL functions directly (eg. through loragw_rxq).
+*/
+int lgw_cmdq_start(void);
+
+/**
+@brief Stop the owner thread, must be called before lgw_stop
+@return LGW_CMDQ_ERROR id the operation failed, LGW_CMDQ_SUCCESS else
+
+Stops the queue of the context of the calling thread. Commands the thread did
+not run, including those submitted while it stops, are completed with
+LGW_CMDQ_ERROR.
+*/
+int lgw_cmdq_stop(void);
+
+/**
+@brief Submit a command to the owner thread, without waiting for it
+@param cmd command to run, must stay valid until it is completed
+@return LGW_CMDQ_ERROR id the owner thread is not running or the command is not valid, LGW_CMDQ_SUCCESS else
+
+Lock-free, can be called from any thread working on the context the queue was
+started on. Register accesses on different
+pages submitted in a row may be run in any order: wait for a command, or
+submit a LGW_CMD_CALL, to order them. If cmd->done is NULL, lgw_cmdq_wait must
+be called once for the command.
+*/
+int lgw_cmdq_submit(struct lgw_cmd_s *cmd);
+
+/**
+@brief Wait for a command submitted without a done function to complete
+@param cmd command passed to lgw_cmdq_submit
+@param timeout_ms time to wait in milliseconds, 0 to return immediately, -1 to wait forever
+@return LGW_CMDQ_ERROR id the operation failed, LGW_CMDQ_TIMEOUT if the command is not completed yet, LGW_CMDQ_SUCCESS else
+
+On LGW_CMDQ_SUCCESS, cmd->status holds the result of the command and cmd can
+be reused. On LGW_CMDQ_TIMEOUT, the command is still owned by the queue.
+*/
+int lgw_cmdq_wait(struct lgw_cmd_s *cmd, int timeout_ms);
+
+/**
+@brief Write a register through the owner thread and wait for it
+@param register_id register number in the data structure describing registers
+@param reg_value signed value to write in the register
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_cmdq_reg_w(uint16_t register_id, int32_t reg_value);
+
+/**
+@brief Read a register through the owner thread and wait for it
+@param register_id register number in the data structure describing registers
+@param reg_value pointer to a variable where to write register read value
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_cmdq_reg_r(uint16_t register_id, int32_t *reg_value);
+
+/**
+@brief Burst write a register through the owner thread and wait for it
+@param register_id register number in the data structure describing registers
+@param data pointer to byte array that will be sent to the LoRa concentrator
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_cmdq_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size);
+
+/**
+@brief Burst read a register through the owner thread and wait for it
+@param register_id register number in the data structure describing registers
+@param data pointer to byte array that will be written from the LoRa concentrator
+@param size size of the transfer, in byte(s)
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_cmdq_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size);
+
+/**
+@brief Run a function in the owner thread and wait for it
+@param fn function to run, may call any lgw_* function
+@param arg argument passed to fn
+@return value returned by fn, LGW_CMDQ_ERROR if it could not be run
+
+Called from the owner thread itself (ie. from fn), the function is run
+immediately.
+*/
+int lgw_cmdq_call(int (*fn)(void *arg), void *arg);
+
+/**
+@brief Get the command queue counters
+@param stats pointer to the structure that will receive the counters
+@param reset if true, the counters are cleared after being read
+@return LGW_CMDQ_ERROR id the operation failed, LGW_CMDQ_SUCCESS else
+*/
+int lgw_cmdq_get_stats(struct lgw_cmdq_stats_s *stats, bool reset);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,162 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Concentrator contexts, to drive several concentrators from one process.
+    A context holds the whole state of the HAL for one concentrator: SPI link,
+    register page and shadow copy, radio and modem configuration, LBT, RX and
+    TX bookkeeping, GPS parsing. Each thread works on the context it selected with
+    lgw_ctx_use. A thread that selected none works on the default context as
+    long as lgw_ctx_new created no other one, so the lgw_* API is unchanged.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+#ifndef _LORAGW_CTX_H
+#define _LORAGW_CTX_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_spi.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_CTX_SUCCESS     0
+#define LGW_CTX_ERROR       -1
+
+#define LGW_CTX_PATH_SIZE   64 /* longest SPI device path, including the terminating null */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/* state of each module, private to that module */
+struct lgw_hal_state_s;
+struct lgw_reg_state_s;
+struct lgw_fpga_state_s;
+struct lgw_lbt_state_s;
+struct lgw_cmdq_state_s;
+struct lgw_gps_state_s;
+
+/**
+@struct lgw_context
+@brief State of the HAL for one concentrator, members are private to the library
+*/
+struct lgw_context {
+    char                    spi_path[LGW_CTX_PATH_SIZE];    /*!> SPI device of the concentrator, empty for the backend default */
+    void                    *spi_target;                    /*!> SPI link, NULL while the concentrator is not connected */
+    uint8_t                 spi_mux_mode;                   /*!> SPI mux mode detected by lgw_connect */
+    struct lgw_spi_stats_s  spi_stats;                      /*!> SPI transfer statistics of this concentrator */
+    struct lgw_reg_state_s  *reg;                           /*!> register page, shadow copy, image and statistics */
+    struct lgw_fpga_state_s *fpga;                          /*!> FPGA features */
+    struct lgw_lbt_state_s  *lbt;                           /*!> LBT configuration */
+    struct lgw_hal_state_s  *hal;                           /*!> HAL configuration, RX and TX state */
+    struct lgw_cmdq_state_s *cmdq;                          /*!> command queue and its owner thread */
+    struct lgw_gps_state_s  *gps;                           /*!> GPS time and position parsed from the GNSS module */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Create a context for one more concentrator
+@param spi_path SPI device of the concentrator (eg. "/dev/spidev0.1"), NULL for the backend default
+@return pointer to the new context, NULL if it could not be created
+
+The context starts with the same default configuration as a freshly loaded
+library. It is not selected by any thread.
+*/
+struct lgw_context *lgw_ctx_new(const char *spi_path);
+
+/**
+@brief Free a context created by lgw_ctx_new
+@param ctx context to free, its concentrator must be stopped
+@return LGW_CTX_ERROR if the concentrator is still connected or ctx is the default context, LGW_CTX_SUCCESS else
+
+No thread may still use the context, threads that selected it must first
+select another one. A command queue still running is stopped.
+*/
+int lgw_ctx_free(struct lgw_context *ctx);
+
+/**
+@brief Select the context the calling thread works on
+@param ctx context to select, NULL for the default context
+@return LGW_CTX_ERROR if ctx is not a context, LGW_CTX_SUCCESS else
+
+All lgw_* functions called by the thread afterwards use that context. A
+context can be used by several threads, its HAL calls are serialized by a lock
+of its own: two threads working on two contexts run in parallel. Once a
+context was created by lgw_ctx_new, a thread must call lgw_ctx_use, even with
+NULL, to drive a concentrator.
+*/
+int lgw_ctx_use(struct lgw_context *ctx);
+
+/**
+@brief Get the context the calling thread works on
+@return pointer to the selected context, or to the default context
+
+A thread that never called lgw_ctx_use while contexts created by lgw_ctx_new
+exist gets a context of its own that cannot connect a concentrator: its
+configuration calls are discarded and lgw_connect, lgw_start or lgw_gps_enable
+fail, instead of silently driving the default concentrator.
+*/
+struct lgw_context *lgw_ctx_current(void);
+
+/**
+@brief Check the calling thread can drive a concentrator
+@return LGW_CTX_ERROR if the thread never called lgw_ctx_use while contexts created by lgw_ctx_new exist, LGW_CTX_SUCCESS else
+*/
+int lgw_ctx_check(void);
+
+/**
+@brief Take the lock serializing the HAL calls of the selected context
+@return LGW_CTX_SUCCESS
+
+The lock is recursive. Hold it to run several lgw_reg_* accesses with no HAL
+call of another thread in between, eg. no page switch.
+*/
+int lgw_ctx_lock(void);
+
+/**
+@brief Release the lock taken by lgw_ctx_lock
+@return LGW_CTX_SUCCESS
+*/
+int lgw_ctx_unlock(void);
+
+/* -------------------------------------------------------------------------- */
+/* --- MODULE STATE, ONLY USED BY loragw_ctx.c ------------------------------ */
+
+/* dflt: state of the default context, statically allocated, else allocated */
+struct lgw_hal_state_s *lgw_hal_state_new(bool dflt);
+void lgw_hal_state_free(struct lgw_hal_state_s *state);
+void lgw_hal_state_lock(struct lgw_hal_state_s *state);
+void lgw_hal_state_unlock(struct lgw_hal_state_s *state);
+
+struct lgw_reg_state_s *lgw_reg_state_new(bool dflt);
+void lgw_reg_state_free(struct lgw_reg_state_s *state);
+
+struct lgw_fpga_state_s *lgw_fpga_state_new(bool dflt);
+void lgw_fpga_state_free(struct lgw_fpga_state_s *state);
+
+struct lgw_lbt_state_s *lgw_lbt_state_new(bool dflt);
+void lgw_lbt_state_free(struct lgw_lbt_state_s *state);
+
+struct lgw_cmdq_state_s *lgw_cmdq_state_new(bool dflt);
+void lgw_cmdq_state_free(struct lgw_cmdq_state_s *state);
+
+struct lgw_gps_state_s *lgw_gps_state_new(bool dflt);
+void lgw_gps_state_free(struct lgw_gps_state_s *state);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
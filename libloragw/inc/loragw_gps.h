@@ -10,6 +10,8 @@ Description:
     Library of functions to manage a GNSS module (typically GPS) for accurate
     timestamping of packets and synchronisation of gateways.
     A limited set of module brands/models are supported.
+    The parsing results belong to the concentrator context of the calling
+    thread (see loragw_ctx.h): parse and get them from the same context.
 
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Michael Coracin
@@ -50,6 +50,7 @@ Maintainer: Sylvain Miermont
 #define LGW_XTAL_FREQU      32000000            /* frequency of the RF reference oscillator */
 #define LGW_RF_CHAIN_NB     2                   /* number of RF chains */
 #define LGW_RF_RX_BANDWIDTH {1000000, 1000000}  /* bandwidth of the radios */
+#define LGW_RETUNE_RANGE_HZ 1000000             /* lgw_rxrf_retune keeps the calibration results within that distance of the calibrated frequency */
 
 /* type of if_chain + modem */
 #define IF_UNDEFINED        0
@@ -61,6 +62,7 @@ Maintainer: Sylvain Miermont
 /* to use array parameters, declare a local const and use 'if_chain' as index */
 #define LGW_IF_CHAIN_NB     10    /* number of IF+modem RX chains */
 #define LGW_PKT_FIFO_SIZE   16    /* depth of the RX packet FIFO */
+#define LGW_RX_POOL_SIZE    32    /* number of payload buffers lgw_receive_ref can hand out (64 max) */
 #define LGW_DATABUFF_SIZE   1024    /* size in bytes of the RX data buffer (contains payload & metadata) */
 #define LGW_REF_BW          125000    /* typical bandwidth of data channel */
 #define LGW_MULTI_NB        8    /* number of LoRa 'multi SF' chains */
@@ -198,6 +200,17 @@ struct lgw_conf_lbt_s {
     uint8_t                     nb_channel;         /*!> number of LBT channels */
     struct lgw_conf_lbt_chan_s  channels[LBT_CHANNEL_FREQ_NB];
     int8_t                      rssi_offset;        /*!> RSSI offset to be applied to SX127x RSSI values */
+    uint32_t                    snapshot_max_age_us; /*!> time the channel timestamps read for a TX are reused for the next ones, 0 to read them for each TX */
+};
+
+/**
+@struct lgw_conf_calcache_s
+@brief Configuration structure for the calibration cache used by lgw_start
+*/
+struct lgw_conf_calcache_s {
+    bool        enable;         /*!> reuse calibration results stored in the file when the radio configuration matches */
+    char        path[64];       /*!> file keeping the calibration results across lgw_start calls and processes */
+    uint32_t    max_age_s;      /*!> results older than that are recomputed, 0 for no limit */
 };
 
 /**
@@ -250,6 +263,30 @@ struct lgw_pkt_rx_s {
     uint8_t     payload[256];   /*!> buffer containing the payload */
 };
 
+/**
+@struct lgw_pkt_rx_ref_s
+@brief Structure containing the metadata of a packet that was received and a pointer to its payload in the RX buffer pool
+*/
+struct lgw_pkt_rx_ref_s {
+    uint32_t    freq_hz;        /*!> central frequency of the IF chain */
+    uint8_t     if_chain;       /*!> by which IF chain was packet received */
+    uint8_t     status;         /*!> status of the received packet */
+    uint32_t    count_us;       /*!> internal concentrator counter for timestamping, 1 microsecond resolution */
+    uint8_t     rf_chain;       /*!> through which RF chain the packet was received */
+    uint8_t     modulation;     /*!> modulation used by the packet */
+    uint8_t     bandwidth;      /*!> modulation bandwidth (LoRa only) */
+    uint32_t    datarate;       /*!> RX datarate of the packet (SF for LoRa) */
+    uint8_t     coderate;       /*!> error-correcting code of the packet (LoRa only) */
+    float       rssi;           /*!> average packet RSSI in dB */
+    float       snr;            /*!> average packet SNR, in dB (LoRa only) */
+    float       snr_min;        /*!> minimum packet SNR, in dB (LoRa only) */
+    float       snr_max;        /*!> maximum packet SNR, in dB (LoRa only) */
+    uint16_t    crc;            /*!> CRC that was received in the payload */
+    uint16_t    size;           /*!> payload size in bytes */
+    const uint8_t *payload;     /*!> payload in the RX buffer pool, valid until the descriptor is released */
+    uint8_t     pool_idx;       /*!> RX buffer pool entry holding the payload, reserved for the HAL */
+};
+
 /**
 @struct lgw_pkt_tx_s
 @brief Structure containing the configuration of a packet to send and a pointer to the payload
@@ -294,6 +331,22 @@ struct lgw_tx_gain_lut_s {
     uint8_t                 size;                       /*!> Number of LUT indexes */
 };
 
+/**
+@struct lgw_rx_stats_s
+@brief Structure containing the RX FIFO drain statistics accumulated by lgw_receive
+*/
+struct lgw_rx_stats_s {
+    uint32_t    nb_call;        /*!> number of lgw_receive calls */
+    uint32_t    nb_pkt;         /*!> number of packets fetched */
+    uint32_t    nb_spi_msg;     /*!> number of SPI transactions (system calls) done by lgw_receive */
+    uint32_t    time_us;        /*!> time spent in lgw_receive, in microseconds */
+    uint32_t    time_max_us;    /*!> longest lgw_receive call, in microseconds */
+    uint8_t     fifo_max;       /*!> highest number of packets seen waiting in the RX FIFO */
+    uint32_t    nb_fifo_full;   /*!> number of calls that found the RX FIFO full (packets may have been lost) */
+    uint32_t    nb_empty_poll;  /*!> number of polls done by lgw_receive_wait that found the RX FIFO empty */
+    uint32_t    nb_pool_empty;  /*!> number of lgw_receive_ref calls stopped because no RX pool buffer was free */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
@@ -311,6 +364,19 @@ int lgw_board_setconf(struct lgw_conf_board_s conf);
 */
 int lgw_lbt_setconf(struct lgw_conf_lbt_s conf);
 
+/**
+@brief Configure the calibration cache (disabled by default)
+@param conf structure containing the configuration parameters
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+When enabled, lgw_start skips the calibration firmware (about 2.3 s) if the
+file holds results obtained on the same concentrator (SPI device of the
+context) with the same radios, clock source and RX frequencies, and saves the
+results of every calibration it runs. Several concentrators can share a file.
+A file written with another layout of the results is ignored and replaced.
+*/
+int lgw_calcache_setconf(struct lgw_conf_calcache_s conf);
+
 /**
 @brief Configure an RF chain (must configure before start)
 @param rf_chain number of the RF chain to configure [0, LGW_RF_CHAIN_NB - 1]
@@ -319,6 +385,20 @@ int lgw_lbt_setconf(struct lgw_conf_lbt_s conf);
 */
 int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf);
 
+/**
+@brief Change the RX frequency of an enabled RF chain while the concentrator is running
+@param rf_chain number of the RF chain to retune [0, LGW_RF_CHAIN_NB - 1]
+@param freq_hz new center frequency of the radio in Hz
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+Only the radio PLL is reprogrammed when the new frequency is within
+LGW_RETUNE_RANGE_HZ of the frequency the radio was calibrated at, and no TX is
+pending. Otherwise the concentrator is restarted with the new frequency, which
+includes a calibration (see lgw_calcache_setconf). Packets still in the RX
+FIFO are reported with the new frequency, fetch them before retuning.
+*/
+int lgw_rxrf_retune(uint8_t rf_chain, uint32_t freq_hz);
+
 /**
 @brief Configure an IF chain + modem (must configure before start)
 @param if_chain number of the IF chain + modem to configure [0, LGW_IF_CHAIN_NB - 1]
@@ -354,6 +434,95 @@ int lgw_stop(void);
 */
 int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data);
 
+/**
+@brief Get the RX FIFO drain statistics
+@param stats pointer to a structure where to copy the statistics
+@param reset if true, the statistics are cleared after being copied
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+SPI transactions and time per packet are nb_spi_msg/nb_pkt and time_us/nb_pkt.
+*/
+int lgw_get_rx_stats(struct lgw_rx_stats_s *stats, bool reset);
+
+/**
+@brief A non-blocking function that will fetch up to 'max_pkt' packets without copying their payload
+@param max_pkt maximum number of packet that must be retrieved (equal to the size of the array of struct)
+@param pkt_data pointer to an array of descriptors that will receive the packet metadata and payload pointers
+@return LGW_HAL_ERROR id the operation failed, else the number of packets retrieved
+
+The payload of each packet is read straight from the concentrator into an RX
+buffer pool entry, which stays valid until lgw_rx_ref_release is called on the
+descriptor. When the pool is exhausted the remaining packets stay in the
+concentrator FIFO until buffers are released.
+*/
+int lgw_receive_ref(uint8_t max_pkt, struct lgw_pkt_rx_ref_s *pkt_data);
+
+/**
+@brief Take one more reference on the pool buffer of a packet, to hand it to another consumer
+@param pkt packet descriptor filled by lgw_receive_ref
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+Each reference must be dropped with lgw_rx_ref_release (on a copy of the descriptor).
+Can be called from any thread, whatever the context it selected.
+*/
+int lgw_rx_ref_hold(struct lgw_pkt_rx_ref_s *pkt);
+
+/**
+@brief Drop a reference on the pool buffer of a packet, the buffer is recycled when the last one is dropped
+@param pkt packet descriptor filled by lgw_receive_ref, its payload pointer is cleared
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+Can be called from any thread, whatever the context it selected: the buffer
+goes back to the pool of the concentrator that received the packet.
+*/
+int lgw_rx_ref_release(struct lgw_pkt_rx_ref_s *pkt);
+
+/**
+@brief Wait for packets received by the concentrator, polling its FIFO at an adaptive interval
+@param max_pkt maximum number of packets that will be returned
+@param pkt_data pointer to an array of struct that will receive the packet metadata and payload pointers
+@param timeout_ms time to wait for the first packet in milliseconds, 0 to poll once, -1 to wait forever
+@return LGW_HAL_ERROR id the operation failed, else the number of packets retrieved (0 on timeout)
+
+The FIFO is polled again after 1 ms when packets were just fetched. The
+interval then doubles on each empty poll, up to the time the FIFO needs to fill
+up with the shortest packets of the channel plan (computed by lgw_start). The
+empty polls are counted in the RX statistics.
+*/
+int lgw_receive_wait(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, int timeout_ms);
+
+/**
+@brief Wait for packets received by the concentrator like lgw_receive_wait, without copying their payload
+@param max_pkt maximum number of packets that will be returned
+@param pkt_data pointer to an array of descriptors that will receive the packet metadata and payload pointers
+@param timeout_ms time to wait for the first packet in milliseconds, 0 to poll once, -1 to wait forever
+@return LGW_HAL_ERROR id the operation failed, else the number of packets retrieved (0 on timeout)
+
+Each descriptor returned must be given back with lgw_rx_ref_release. While the
+RX buffer pool is empty, the packets stay in the FIFO and the call keeps polling.
+*/
+int lgw_receive_ref_wait(uint8_t max_pkt, struct lgw_pkt_rx_ref_s *pkt_data, int timeout_ms);
+
+/**
+@brief Build the tables used by lgw_receive to correct packet timestamps
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+Called by lgw_start. Offline tools can call it after lgw_rxrf_setconf and
+lgw_rxif_setconf, without a concentrator, to use lgw_tstamp_correction.
+*/
+int lgw_rx_tables_setup(void);
+
+/**
+@brief Get the correction lgw_receive subtracts from the raw 'RX finished' timestamp of a packet
+@param if_chain IF chain the packet was received on
+@param datarate datarate of the packet (DR_LORA_SF7 to DR_LORA_SF12), ignored for FSK
+@param coderate coding rate of the packet (CR_LORA_4_5 to CR_LORA_4_8), ignored for FSK
+@param crc_en true if the packet carries a CRC (status STAT_CRC_OK or STAT_CRC_BAD)
+@param size payload size in bytes
+@return the correction in microseconds, 0 if it does not apply or the tables are not built
+*/
+uint32_t lgw_tstamp_correction(uint8_t if_chain, uint32_t datarate, uint8_t coderate, bool crc_en, uint16_t size);
+
 /**
 @brief Schedule a packet to be send immediately or after a delay depending on tx_mode
 @param pkt_data structure containing the data and metadata for the packet to send
@@ -380,6 +549,44 @@ the protocol.
 */
 int lgw_send(struct lgw_pkt_tx_s pkt_data);
 
+/**
+@brief Wait for the end of the packet loaded by the last lgw_send
+@param timeout_ms longest time to wait in milliseconds, -1 to wait forever
+@return LGW_HAL_ERROR id the operation failed or timed out, LGW_HAL_SUCCESS when the TX buffer is free
+
+Sleeps until the end of the packet computed from its time on air, then reads
+the TX status to confirm. The status is only polled again if the TX is not over
+yet, or if its start time was unknown: ON_GPS mode, or TIMESTAMPED mode when
+the counter was not read by lgw_get_instcnt or lgw_get_instcnt_est in the last
+10 seconds.
+*/
+int lgw_send_wait(int timeout_ms);
+
+/**
+@brief Get a file descriptor that becomes readable at the expected end of each packet sent
+@return the file descriptor, -1 if it could not be created
+
+The descriptor is a non-blocking timerfd, rearmed by every lgw_send call, that
+can be added to a poll/select/epoll loop. Read it to clear the event, then
+call lgw_send_wait(0) to confirm the TX buffer is free. It is not armed when
+the end of the packet is unknown (see lgw_send_wait).
+*/
+int lgw_tx_notify_fd(void);
+
+/**
+@brief Choose, among candidate frequencies, the one LBT allows a packet on with the longest clear margin
+@param pkt_data pointer to the packet to be sent, its freq_hz is ignored
+@param freq_hz array of candidate TX frequencies
+@param nb_freq number of candidates
+@param index pointer to receive the index of the chosen frequency, -1 if the channel of every candidate is busy
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+Set pkt_data->freq_hz to the chosen frequency and call lgw_send, which checks
+LBT again (from the same timestamps if snapshot_max_age_us is set, see
+lgw_conf_lbt_s). Without LBT, the first candidate is chosen.
+*/
+int lgw_lbt_pick_channel(struct lgw_pkt_tx_s *pkt_data, const uint32_t *freq_hz, uint8_t nb_freq, int *index);
+
 /**
 @brief Give the the status of different part of the LoRa concentrator
 @param select is used to select what status we want to know
@@ -401,6 +608,29 @@ int lgw_abort_tx(void);
 */
 int lgw_get_trigcnt(uint32_t* trig_cnt_us);
 
+/**
+@brief Return current value of internal counter
+@param inst_cnt_us pointer to receive timestamp value
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+GPS event capture is briefly disabled to read the counter, the value returned
+by lgw_get_trigcnt is only valid again after the next GPS pulse.
+*/
+int lgw_get_instcnt(uint32_t* inst_cnt_us);
+
+/**
+@brief Estimate the current value of internal counter, reading it as seldom as possible
+@param inst_cnt_us pointer to receive timestamp value
+@param max_age_us age of the last counter reading above which a new one is taken
+@return LGW_HAL_ERROR id the operation failed, LGW_HAL_SUCCESS else
+
+The last reading of lgw_get_instcnt is extrapolated with the host clock. A new
+reading, which disables GPS event capture, is only taken when the last one is
+older than max_age_us and no GPS pulse is expected within 100 ms, or when it is
+older than 10 seconds. Meant for loops that need the counter often.
+*/
+int lgw_get_instcnt_est(uint32_t* inst_cnt_us, uint32_t max_age_us);
+
 /**
 @brief Allow user to check the version/options of the library once compiled
 @return pointer on a human-readable null terminated string
@@ -30,6 +30,9 @@ Maintainer: Michael Coracin
 #define LGW_LBT_SUCCESS 0
 #define LGW_LBT_ERROR -1
 
+#define LBT_READY_TIMEOUT_MS    8400 /* longest wait for the first scan of all the LBT channels */
+#define LBT_READY_POLL_MS       10 /* interval between two checks of the LBT channels */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
@@ -60,6 +63,52 @@ int lbt_start(void);
 */
 int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay, bool * tx_allowed);
 
+/**
+@brief Read the time each active LBT channel was last free, in a single SPI batch
+@param last_free array of LBT_CHANNEL_FREQ_NB values receiving the timestamps in us (1 LSB of the FPGA counter is 256 us), may be NULL
+@return LGW_LBT_ERROR id the operation failed, LGW_LBT_SUCCESS else
+
+The timestamps are kept as a snapshot: lbt_is_channel_free uses them instead of
+reading the channels again while they are not older than snapshot_max_age_us
+(see lgw_conf_lbt_s). A channel timestamp only moves forward, so a snapshot can
+only make the check stricter.
+*/
+int lbt_snapshot(uint32_t *last_free);
+
+/**
+@brief Pick the candidate frequency with the longest LBT clear margin for a packet
+@param pkt_data pointer to downlink packet to be transmitted, its freq_hz is ignored
+@param tx_start_delay TX start delay in us, used for ON_GPS packets
+@param freq_hz array of candidate TX frequencies
+@param nb_freq number of candidates
+@param index pointer to receive the index of the chosen candidate, -1 if LBT allows none of them
+@return LGW_LBT_ERROR id the operation failed, LGW_LBT_SUCCESS else
+
+The 125kHz single channel and 250kHz channel pair rules of lbt_is_channel_free
+apply to each candidate. The timestamps of all the active channels are read in
+one batch, or taken from the snapshot if it is recent enough. If LBT is
+disabled, the first candidate is chosen.
+*/
+int lbt_pick_channel(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay, const uint32_t * freq_hz, uint8_t nb_freq, int * index);
+
+/**
+@brief Wait until every active LBT channel has been scanned free once
+@param timeout_ms longest time to wait, from the call
+@param ready pointer to receive true if all the channels were scanned, false on timeout
+@return LGW_LBT_ERROR id the operation failed, LGW_LBT_SUCCESS else
+
+A channel is scanned once its LBT timestamp is not 0 any more. The time from
+lbt_start to the channels being ready is kept, see lbt_get_ready_time.
+*/
+int lbt_wait_ready(uint32_t timeout_ms, bool * ready);
+
+/**
+@brief Get the time the LBT channels took to be ready after the last lbt_start
+@param ready_ms pointer to receive the time in milliseconds
+@return LGW_LBT_ERROR if the channels were not found ready since the last lbt_start, LGW_LBT_SUCCESS else
+*/
+int lbt_get_ready_time(uint32_t * ready_ms);
+
 /**
 @brief Check if LBT is enabled
 @return true if enabled, false otherwise
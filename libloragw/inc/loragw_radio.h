@@ -64,6 +64,14 @@ int lgw_setup_sx125x(uint8_t rf_chain, uint8_t rf_clkout, bool rf_enable, uint8_
 
 int lgw_setup_sx127x(uint32_t frequency, uint8_t modulation, enum lgw_sx127x_rxbw_e rxbw_khz, int8_t rssi_offset);
 
+int lgw_sx127x_set_rx_freq(uint32_t frequency);
+
+int lgw_sx127x_wait_pll_lock(uint32_t timeout_ms);
+
+int lgw_sx125x_set_rx_freq(uint8_t rf_chain, uint8_t rf_radio_type, uint32_t freq_hz);
+
+int lgw_sx125x_wait_pll_lock(uint8_t rf_chain, uint32_t timeout_ms);
+
 int lgw_sx127x_reg_w(uint8_t address, uint8_t reg_value);
 
 int lgw_sx127x_reg_r(uint8_t address, uint8_t *reg_value);
@@ -39,6 +39,7 @@ struct lgw_reg_s {
     uint8_t leng;        /*!< number of bits in the register */
     bool    rdon;        /*!< 1 indicates a read-only register */
     int32_t dflt;        /*!< register default value */
+    bool    vola;        /*!< 1 indicates a register changed by the hardware (never cached) */
 };
 
 /* -------------------------------------------------------------------------- */
@@ -46,6 +47,8 @@ struct lgw_reg_s {
 
 int reg_w_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, struct lgw_reg_s r, int32_t reg_value);
 int reg_r_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, struct lgw_reg_s r, int32_t *reg_value);
+void reg_cache_invalidate(uint8_t spi_mux_target);
+void reg_cache_invalidate_burst(uint8_t spi_mux_target, struct lgw_reg_s r, uint16_t size);
 
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC CONSTANTS ----------------------------------------------------- */
@@ -53,6 +56,22 @@ int reg_r_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target
 #define LGW_REG_SUCCESS  0
 #define LGW_REG_ERROR    -1
 
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_reg_stats_s
+@brief Access statistics of one register, page switches and read-modify-write cycles included
+*/
+struct lgw_reg_stats_s {
+    uint32_t    nb_r;       /*!> number of lgw_reg_r calls */
+    uint32_t    nb_w;       /*!> number of lgw_reg_w calls */
+    uint32_t    nb_rb;      /*!> number of lgw_reg_rb calls */
+    uint32_t    nb_wb;      /*!> number of lgw_reg_wb calls */
+    uint64_t    nb_byte;    /*!> number of register bytes read or written */
+    uint64_t    time_us;    /*!> time spent in the calls, in microseconds */
+};
+
 /*
 auto generated register mapping for C code : 11-Jul-2013 13:20:40
 this file contains autogenerated C struct used to access the LORA registers
@@ -455,6 +474,73 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size);
 */
 int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size);
 
+/**
+@brief Start queuing register writes (including page switches) on the SPI link
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Queued writes are sent as a single SPI message, by the next register read or
+by the outermost lgw_reg_batch_end. Do not wait on a register write effect
+inside a batch.
+*/
+int lgw_reg_batch_begin(void);
+
+/**
+@brief Stop queuing register writes and send the queued ones
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_batch_end(void);
+
+/**
+@brief Start building an image of the register pages instead of writing fields one by one
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Until the outermost lgw_reg_image_end, lgw_reg_w of a register whose bytes hold
+no read-only or volatile (vola) field is merged at byte level in the image and
+not sent. Any other register access first writes the pending image, so the
+order is kept where it matters. Inside the image, fields are written in address
+order, not in call order: only use it for static configuration, and write the
+registers with a side effect (modem enables...) after lgw_reg_image_end.
+*/
+int lgw_reg_image_begin(void);
+
+/**
+@brief Write the register image, one burst per contiguous range of written bytes
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Bytes only partly written are completed from the shadow copy, or the range is
+read back in one burst first.
+*/
+int lgw_reg_image_end(void);
+
+/**
+@brief Enable or disable the shadow copy of the registers (enabled by default)
+@param enable true to skip the read of read-modify-write when the register byte is known
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Bytes holding a read-only or volatile (vola) field are never cached. The copy is
+dropped on connect, soft reset and when the MCU is given access to the registers.
+*/
+int lgw_reg_cache_enable(bool enable);
+
+/**
+@brief Get the read-modify-write statistics of the register shadow copy
+@param nb_skipped pointer to a variable where to write the number of reads served by the cache
+@param nb_read pointer to a variable where to write the number of reads sent on the SPI link
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+*/
+int lgw_reg_cache_stats(uint32_t *nb_skipped, uint32_t *nb_read);
+
+/**
+@brief Get the per-register access statistics
+@param stats pointer to an array of LGW_TOTALREGS structures, indexed by register number
+@param nb_page_switch pointer to a variable where to write the number of register page switches
+@param reset if true, the statistics are cleared after being read
+@return status of register operation (LGW_REG_SUCCESS/LGW_REG_ERROR)
+
+Only the SX1301 registers accessed by name are counted, not the FPGA ones.
+*/
+int lgw_reg_get_stats(struct lgw_reg_stats_s *stats, uint32_t *nb_page_switch, bool reset);
+
 
 #endif
 
@@ -0,0 +1,99 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Background RX thread draining the concentrator FIFO into a packet ring
+
+    The thread is the only caller of lgw_receive while it runs, the
+    application is the only reader of the ring (single producer, single
+    consumer). Packets arriving while the ring is full are dropped and counted
+    as overruns.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAGW_RXQ_H
+#define _LORAGW_RXQ_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_hal.h"
+
+#include "config.h"    /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_RXQ_SUCCESS     0
+#define LGW_RXQ_ERROR       -1
+
+#define LGW_RXQ_SIZE        64  /* number of packets in the ring, must be a power of 2 */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_rxq_stats_s
+@brief Structure containing the RX ring counters
+*/
+struct lgw_rxq_stats_s {
+    uint32_t    nb_pkt_in;      /*!> number of packets pushed in the ring by the RX thread */
+    uint32_t    nb_pkt_out;     /*!> number of packets read from the ring by the application */
+    uint32_t    nb_overrun;     /*!> number of packets dropped because the ring was full */
+    uint32_t    nb_error;       /*!> number of lgw_receive calls that failed */
+    uint16_t    depth_max;      /*!> highest number of packets seen waiting in the ring */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Start the background RX thread, the concentrator must already be started
+@return LGW_RXQ_ERROR id the operation failed, LGW_RXQ_SUCCESS else
+
+The thread polls the concentrator with lgw_receive_wait, on the context of the
+calling thread. Packets still in the ring from a previous run are discarded.
+*/
+int lgw_rxq_start(void);
+
+/**
+@brief Stop the background RX thread, must be called before lgw_stop
+@return LGW_RXQ_ERROR id the operation failed, LGW_RXQ_SUCCESS else
+
+A consumer blocked in lgw_rxq_receive is woken up. Packets already in the ring
+can still be read after the thread is stopped.
+*/
+int lgw_rxq_stop(void);
+
+/**
+@brief Read packets drained by the background RX thread
+@param max_pkt maximum number of packets that will be returned
+@param pkt_data pointer to an array of struct that will receive the packet metadata and payload
+@param timeout_ms time to wait for the first packet in milliseconds, 0 to return immediately, -1 to wait forever
+@return LGW_RXQ_ERROR id the operation failed, else the number of packets retrieved (0 on timeout)
+
+Must be called from a single thread. The payload of each packet is copied in
+the structure, so the ring slot is released as soon as the call returns.
+*/
+int lgw_rxq_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, int timeout_ms);
+
+/**
+@brief Get the RX ring counters
+@param stats pointer to the structure that will receive the counters
+@param reset if true, the counters are cleared after being read
+@return LGW_RXQ_ERROR id the operation failed, LGW_RXQ_SUCCESS else
+*/
+int lgw_rxq_get_stats(struct lgw_rxq_stats_s *stats, bool reset);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -12,6 +12,8 @@ Description:
     Single-byte read/write and burst read/write.
     Does not handle pagination.
     Could be used with multiple SPI ports in parallel (explicit file descriptor)
+    Single-byte writes and small burst writes can be queued in a batch and sent
+    to the spidev driver as a single multi-transfer message.
 
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Sylvain Miermont
@@ -25,6 +27,7 @@ Maintainer: Sylvain Miermont
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
 #include <stdint.h>        /* C99 types*/
+#include <stdbool.h>       /* bool type */
 
 #include "config.h"    /* library configuration options (dynamically generated) */
 
@@ -33,7 +36,16 @@ Maintainer: Sylvain Miermont
 
 #define LGW_SPI_SUCCESS     0
 #define LGW_SPI_ERROR       -1
-#define LGW_BURST_CHUNK     1024
+#define LGW_BURST_CHUNK     1024 /* default largest burst sent in one SPI message */
+
+#define LGW_SPI_SPEED_DEFAULT       8000000 /* default SPI clock, in Hz */
+#define LGW_SPI_SPEED_MIN           500000
+#define LGW_SPI_SPEED_MAX           32000000
+#define LGW_BURST_CHUNK_MIN         16
+#define LGW_BURST_CHUNK_MAX         4094 /* spidev default buffer (4096 bytes) less the command bytes */
+
+#define LGW_SPI_LINK_ENV            "LORAGW_SPI_LINK" /* environment variable naming the SPI link settings file */
+#define LGW_SPI_LINK_PATH           "/etc/loragw_spi_link.conf" /* SPI link settings file used when LGW_SPI_LINK_ENV is not set */
 
 #define LGW_SPI_MUX_MODE0   0x0     /* No FPGA */
 #define LGW_SPI_MUX_MODE1   0x1     /* FPGA, with spi mux header */
@@ -43,16 +55,256 @@ Maintainer: Sylvain Miermont
 #define LGW_SPI_MUX_TARGET_EEPROM   0x2
 #define LGW_SPI_MUX_TARGET_SX127X   0x3
 
+#define LGW_SPI_BACKEND_ENV         "LORAGW_SPI_BACKEND" /* environment variable naming the backend used when none was selected */
+
+#define LGW_SPI_SIM_RX_FLOOD        0xFFFFFFFF /* simulator RX rate keeping the RX FIFO full */
+
+#define LGW_SPI_TRACE_ENV           "LORAGW_SPI_TRACE" /* environment variable naming a file recording all SPI transfers */
+#define LGW_SPI_REPLAY_ENV          "LORAGW_SPI_REPLAY" /* environment variable naming the trace played by the replay backend */
+
+/*
+SPI trace file format, all fields little endian:
+    header: "LGWT" magic, 1 byte version, 3 reserved bytes
+    records: 1 byte operation (LGW_SPI_TRACE_OP_*, bit 7 set for mux mode 1),
+             1 byte mux target, 1 byte register address, 2 bytes data size,
+             4 bytes time since the previous record in us, then the data
+             written, or the data read back
+*/
+#define LGW_SPI_TRACE_MAGIC         "LGWT"
+#define LGW_SPI_TRACE_VERSION       1
+#define LGW_SPI_TRACE_HDR_SIZE      8
+#define LGW_SPI_TRACE_REC_SIZE      9 /* record size without data */
+#define LGW_SPI_TRACE_OP_W          0x01
+#define LGW_SPI_TRACE_OP_R          0x02
+#define LGW_SPI_TRACE_OP_MUX1       0x80
+
+#define LGW_SPI_OP_W                0 /* index of each kind of transfer in the SPI statistics */
+#define LGW_SPI_OP_R                1
+#define LGW_SPI_OP_WB               2
+#define LGW_SPI_OP_RB               3
+#define LGW_SPI_OP_BATCH            4 /* lgw_spi_batch_end and lgw_spi_batch_flush */
+#define LGW_SPI_OP_NB               5
+#define LGW_SPI_HIST_NB             24 /* latency histogram bins: [0] below 1 us, [i] from 2^(i-1) to 2^i us, last one above */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_spi_link_s
+@brief SPI link settings, used by the native backend when it opens the device
+*/
+struct lgw_spi_link_s {
+    uint32_t    speed_hz;       /*!> SPI clock */
+    uint16_t    burst_chunk;    /*!> largest burst sent in one SPI message, longer bursts are cut */
+};
+
+/**
+@struct lgw_spi_backend_s
+@brief Set of functions implementing the lgw_spi_* interface on one kind of link
+*/
+struct lgw_spi_backend_s {
+    const char  *name;      /*!> backend name, as given in LGW_SPI_BACKEND_ENV */
+    int (*open)(const char *path, void **spi_target_ptr);
+    int (*close)(void *spi_target);
+    int (*w)(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data);
+    int (*r)(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data);
+    int (*wb)(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
+    int (*rb)(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
+    int (*batch_begin)(void *spi_target);
+    int (*batch_end)(void *spi_target);
+    int (*batch_flush)(void *spi_target);
+    int (*get_msg_cnt)(void *spi_target, uint32_t *msg_cnt);
+};
+
+/**
+@struct lgw_spi_sim_conf_s
+@brief Configuration of the simulator synthetic traffic
+*/
+struct lgw_spi_sim_conf_s {
+    uint32_t    rx_pkt_rate;    /*!> packets received per second, 0 for none, LGW_SPI_SIM_RX_FLOOD to keep the RX FIFO full */
+    uint8_t     rx_if_chain;    /*!> IF chain reporting the packets */
+    uint8_t     rx_sf;          /*!> LoRa spreading factor reported [7..12] */
+    uint8_t     rx_size;        /*!> payload size in bytes, the first 4 bytes hold the packet sequence number (little endian) */
+    uint8_t     rx_crc_bad_pct; /*!> percentage of packets reported with a bad CRC */
+    uint32_t    tx_time_us;     /*!> time a triggered TX stays emitting */
+};
+
+/**
+@struct lgw_spi_sim_stats_s
+@brief Simulator counters, cleared when the link is opened
+*/
+struct lgw_spi_sim_stats_s {
+    uint32_t    nb_rx_gen;      /*!> number of packets put in the RX FIFO */
+    uint32_t    nb_rx_lost;     /*!> number of packets lost because the RX FIFO was full (not counted in flood mode) */
+    uint32_t    nb_rx_read;     /*!> number of packets removed from the RX FIFO by the host */
+    uint32_t    nb_tx;          /*!> number of TX triggered */
+    uint32_t    tx_last_start;  /*!> counter value at which the last TX triggered starts, on whichever concentrator */
+    uint8_t     tx_last_id;     /*!> first payload byte of that TX, to tell packets apart */
+};
+
+/**
+@struct lgw_spi_replay_conf_s
+@brief Configuration of the replay backend
+*/
+struct lgw_spi_replay_conf_s {
+    char        path[64];       /*!> trace file to play */
+    bool        paced;          /*!> if true, transfers are served at the pace they were recorded, else at full speed */
+};
+
+/**
+@struct lgw_spi_replay_stats_s
+@brief Replay backend counters, cleared when the link is opened
+*/
+struct lgw_spi_replay_stats_s {
+    uint32_t    nb_rec;         /*!> number of trace records played */
+    uint32_t    nb_skip;        /*!> number of trace records skipped to follow the HAL after a divergence */
+    uint32_t    nb_mismatch;    /*!> number of transfers not found in the trace, or writing other data than recorded */
+    bool        end;            /*!> true when the end of the trace was reached */
+};
+
+/**
+@struct lgw_spi_stats_s
+@brief SPI transfer counters and latency histograms, per kind of transfer (LGW_SPI_OP_*)
+*/
+struct lgw_spi_stats_s {
+    uint32_t    nb[LGW_SPI_OP_NB];          /*!> number of calls */
+    uint64_t    nb_byte[LGW_SPI_OP_NB];     /*!> number of data bytes transferred */
+    uint64_t    time_us[LGW_SPI_OP_NB];     /*!> total time spent in the backend */
+    uint32_t    max_us[LGW_SPI_OP_NB];      /*!> longest call */
+    uint32_t    hist[LGW_SPI_OP_NB][LGW_SPI_HIST_NB]; /*!> log2 latency histogram */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC VARIABLES ----------------------------------------------------- */
+
+extern const struct lgw_spi_backend_s lgw_spi_native; /*! Linux spidev device */
+extern const struct lgw_spi_backend_s lgw_spi_sim; /*! in-memory SX1301 register file, no hardware needed */
+extern const struct lgw_spi_backend_s lgw_spi_replay; /*! plays back an SPI trace, no hardware needed */
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
 
+/**
+@brief Select the backend used by the lgw_spi_* functions
+@param backend lgw_spi_native, lgw_spi_sim or an application-defined backend
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+Must be called while the SPI link is closed. When no backend was selected,
+the first lgw_spi_open uses the one named by the LGW_SPI_BACKEND_ENV
+environment variable, the native one by default.
+*/
+int lgw_spi_set_backend(const struct lgw_spi_backend_s *backend);
+
+/**
+@brief Set the SPI link settings used by the next lgw_spi_open
+@param link pointer to the settings, NULL to go back to the settings file
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+When no settings were set, lgw_spi_open reads the settings of the device it
+opens in the file named by the LGW_SPI_LINK_ENV environment variable, or
+LGW_SPI_LINK_PATH, as written by util_spi_stress -a; without valid settings for
+that device, the link runs at LGW_SPI_SPEED_DEFAULT with LGW_BURST_CHUNK bytes
+bursts.
+*/
+int lgw_spi_set_link(const struct lgw_spi_link_s *link);
+
+/**
+@brief Get the SPI link settings used by the last lgw_spi_open
+@param link pointer to the structure that will receive the settings
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_get_link(struct lgw_spi_link_s *link);
+
+/**
+@brief Read the SPI link settings of one device from a file
+@param path name of the settings file
+@param spi_path SPI device the settings were tuned on, NULL for the backend default
+@param link pointer to the structure that will receive the settings
+@return LGW_SPI_ERROR if the file cannot be read or holds no valid settings for that device, LGW_SPI_SUCCESS else
+
+The file holds one "name value" pair per line (device, speed_hz, burst_chunk),
+lines starting with # are ignored. The settings after a "device" line belong
+to that device, the ones before the first "device" line to the backend default
+device.
+*/
+int lgw_spi_link_load(const char *path, const char *spi_path, struct lgw_spi_link_s *link);
+
+/**
+@brief Write the SPI link settings of one device to a file, in the format read by lgw_spi_link_load
+@param path name of the settings file, the settings of the other devices are kept
+@param spi_path SPI device the settings were tuned on, NULL for the backend default
+@param link pointer to the settings
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_link_save(const char *path, const char *spi_path, const struct lgw_spi_link_s *link);
+
+/**
+@brief Configure the traffic generated by the simulator backend
+@param conf pointer to the configuration, taken into account immediately
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_sim_setconf(const struct lgw_spi_sim_conf_s *conf);
+
+/**
+@brief Get the simulator counters, summed over all the simulated concentrators
+@param stats pointer to the structure that will receive the counters
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_sim_get_stats(struct lgw_spi_sim_stats_s *stats);
+
+/**
+@brief Start recording all SPI transfers, whatever the backend, to a trace file
+@param path name of the trace file, overwritten
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+When no trace was started, the first lgw_spi_open starts one if the
+LGW_SPI_TRACE_ENV environment variable names a file; that trace is then
+stopped by the last lgw_spi_close.
+*/
+int lgw_spi_trace_start(const char *path);
+
+/**
+@brief Stop recording SPI transfers and close the trace file
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_trace_stop(void);
+
+/**
+@brief Get the SPI transfer counters and latency histograms, whatever the backend
+@param stats pointer to the structure that will receive the statistics
+@param reset if true, the statistics are cleared after being read
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+Transfers are counted per concentrator context, see loragw_ctx.h; these are
+the ones of the context selected by the calling thread.
+*/
+int lgw_spi_get_stats(struct lgw_spi_stats_s *stats, bool reset);
+
+/**
+@brief Configure the replay backend, must be called before the link is opened
+@param conf pointer to the configuration
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+Without configuration, the trace named by the LGW_SPI_REPLAY_ENV environment
+variable is played at full speed.
+*/
+int lgw_spi_replay_setconf(const struct lgw_spi_replay_conf_s *conf);
+
+/**
+@brief Get the replay backend counters
+@param stats pointer to the structure that will receive the counters
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_replay_get_stats(struct lgw_spi_replay_stats_s *stats);
+
 /**
 @brief LoRa concentrator SPI setup (configure I/O and peripherals)
+@param path SPI device of the concentrator, NULL for the backend default
 @param spi_target_ptr pointer on a generic pointer to SPI target (implementation dependant)
 @return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
 */
 
-int lgw_spi_open(void **spi_target_ptr);
+int lgw_spi_open(const char *path, void **spi_target_ptr);
 
 /**
 @brief LoRa concentrator SPI close
@@ -100,6 +352,40 @@ int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
 */
 int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
 
+/**
+@brief Start queuing single-byte writes and small burst writes instead of sending them
+@param spi_target generic pointer to SPI target (implementation dependant)
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+
+Batches can be nested, the queue is sent by the outermost lgw_spi_batch_end.
+Any read (or large burst write) sends the queue ahead of itself in the same
+message, so a read always returns a value written earlier in the batch.
+Errors on queued writes are reported by the call that sends the queue.
+*/
+int lgw_spi_batch_begin(void *spi_target);
+
+/**
+@brief Stop queuing writes, send the queue if leaving the outermost batch
+@param spi_target generic pointer to SPI target (implementation dependant)
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_batch_end(void *spi_target);
+
+/**
+@brief Send the queued writes now, without leaving the batch
+@param spi_target generic pointer to SPI target (implementation dependant)
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_batch_flush(void *spi_target);
+
+/**
+@brief Get the number of SPI messages (system calls) sent since the link was opened
+@param spi_target generic pointer to SPI target (implementation dependant)
+@param msg_cnt pointer to a variable where to write the message count
+@return status of register operation (LGW_SPI_SUCCESS/LGW_SPI_ERROR)
+*/
+int lgw_spi_get_msg_cnt(void *spi_target, uint32_t *msg_cnt);
+
 #endif
 
 /* --- EOF ------------------------------------------------------------------ */
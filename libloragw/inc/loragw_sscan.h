@@ -0,0 +1,172 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Spectral scan results published in shared memory
+
+    A single writer (eg. util_spectral_scan in monitor mode) keeps the latest
+    RSSI histogram of each scanned frequency in a POSIX shared memory object,
+    one slot per frequency. Any number of processes map it read-only and copy
+    a slot without taking a lock: each slot is protected by a sequence counter
+    (seqlock), the reader retries when the writer updated the slot during the
+    copy.
+
+    Also computes the RSSI levels of a batch of histograms, eg. read from the
+    shared memory or from a binary log of util_spectral_scan.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAGW_SSCAN_H
+#define _LORAGW_SSCAN_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "config.h"    /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_SSCAN_SUCCESS       0
+#define LGW_SSCAN_ERROR         -1
+#define LGW_SSCAN_EMPTY         1   /* returned by lgw_sscan_read when the slot was never published */
+
+#define LGW_SSCAN_NAME          "/loragw_sscan" /* default shared memory object */
+#define LGW_SSCAN_VERSION       1   /* layout version, bumped on any change of the structures below */
+#define LGW_SSCAN_RSSI_RANGE    256 /* number of histogram bins, 0.5dB each, bin i is -i/2 dBm */
+#define LGW_SSCAN_FREQ_MAX      256 /* most frequencies in one object */
+
+#define LGW_SSCAN_LEVEL_NB      5   /* percentiles computed by lgw_sscan_levels */
+#define LGW_SSCAN_LEVEL_PCT     {10, 30, 50, 80, 100} /* their values, in % */
+#define LGW_SSCAN_NO_LEVEL      -128.0 /* level not reached, below the lowest bin */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_sscan_entry_s
+@brief Histogram of one frequency, as published by the writer
+*/
+struct lgw_sscan_entry_s {
+    uint32_t    freq_hz;                        /*!> scanned frequency */
+    uint32_t    nb_pts;                         /*!> number of RSSI points the histogram was computed on */
+    uint32_t    sweep;                          /*!> number of the sweep that produced the histogram, from 0 */
+    uint64_t    time_us;                        /*!> CLOCK_MONOTONIC time when the histogram was read, in us (see monotonic_us) */
+    uint16_t    histo[LGW_SSCAN_RSSI_RANGE];    /*!> number of RSSI points in each bin */
+};
+
+/**
+@struct lgw_sscan_level_s
+@brief RSSI levels of one histogram
+*/
+struct lgw_sscan_level_s {
+    uint32_t    nb_pts;                         /*!> number of RSSI points in the histogram */
+    float       pct_dbm[LGW_SSCAN_LEVEL_NB];    /*!> RSSI reached by at least 10%, 30%, 50%, 80% and 100% of the points, in dBm */
+    float       floor_dbm;                      /*!> RSSI of the most populated bin, noise floor estimate of a mostly idle channel, in dBm */
+};
+
+/**
+@struct lgw_sscan_s
+@brief Mapping of a shared memory object, members are private to the library
+*/
+struct lgw_sscan_s;
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Create (or replace) the shared memory object and map it for writing
+@param name name of the object (eg. LGW_SSCAN_NAME), must start with '/'
+@param nb_freq number of frequencies (slots) [1..LGW_SSCAN_FREQ_MAX]
+@return pointer to the mapping, NULL if it could not be created
+
+An object left by a previous writer is unlinked first: readers still mapping
+it see it closed and have to open the new one.
+*/
+struct lgw_sscan_s *lgw_sscan_create(const char *name, uint16_t nb_freq);
+
+/**
+@brief Map an existing shared memory object for reading
+@param name name of the object passed to lgw_sscan_create
+@return pointer to the mapping, NULL if the object does not exist or has an unknown layout version
+*/
+struct lgw_sscan_s *lgw_sscan_open(const char *name);
+
+/**
+@brief Unmap an object, and mark it closed if the mapping was created by lgw_sscan_create
+@param sscan mapping returned by lgw_sscan_create or lgw_sscan_open
+@return LGW_SSCAN_ERROR id the operation failed, LGW_SSCAN_SUCCESS else
+
+Closing the writer mapping marks the object closed, readers then get
+LGW_SSCAN_ERROR and have to wait for a new writer to create it again. The name
+is left in place.
+*/
+int lgw_sscan_close(struct lgw_sscan_s *sscan);
+
+/**
+@brief Get the number of slots of an object
+@param sscan mapping returned by lgw_sscan_create or lgw_sscan_open
+@param nb_freq pointer to a variable that will receive the number of slots
+@param sweep pointer to a variable that will receive the number of complete sweeps, may be NULL
+@return LGW_SSCAN_ERROR if the writer closed the object, LGW_SSCAN_SUCCESS else
+*/
+int lgw_sscan_info(const struct lgw_sscan_s *sscan, uint16_t *nb_freq, uint32_t *sweep);
+
+/**
+@brief Publish the histogram of one frequency
+@param sscan mapping returned by lgw_sscan_create
+@param index slot of the frequency [0..nb_freq-1]
+@param entry histogram to copy in the slot
+@return LGW_SSCAN_ERROR id the operation failed, LGW_SSCAN_SUCCESS else
+
+Wait-free, must only be called by the writer.
+*/
+int lgw_sscan_publish(struct lgw_sscan_s *sscan, uint16_t index, const struct lgw_sscan_entry_s *entry);
+
+/**
+@brief Count one more complete sweep, once every slot was published for it
+@param sscan mapping returned by lgw_sscan_create
+@return LGW_SSCAN_ERROR id the operation failed, LGW_SSCAN_SUCCESS else
+*/
+int lgw_sscan_sweep_done(struct lgw_sscan_s *sscan);
+
+/**
+@brief Copy the latest histogram of one frequency
+@param sscan mapping returned by lgw_sscan_open (or lgw_sscan_create)
+@param index slot of the frequency [0..nb_freq-1]
+@param entry pointer to the structure that will receive the histogram
+@return LGW_SSCAN_ERROR if the writer closed the object or kept the slot busy, LGW_SSCAN_EMPTY if the slot was never published, LGW_SSCAN_SUCCESS else
+
+Lock-free, can be called from any thread of any process, never blocks the
+writer. The copy is consistent: it is never a mix of two publications.
+*/
+int lgw_sscan_read(const struct lgw_sscan_s *sscan, uint16_t index, struct lgw_sscan_entry_s *entry);
+
+/**
+@brief Compute the RSSI levels of a batch of histograms
+@param histo array of nb_histo histograms of LGW_SSCAN_RSSI_RANGE bins each, one after the other
+@param nb_histo number of histograms
+@param nb_pts number of RSSI points the percentiles refer to, 0 to use the number of points of each histogram
+@param level array of nb_histo structures that will receive the levels
+@return LGW_SSCAN_ERROR id the operation failed, LGW_SSCAN_SUCCESS else
+
+A percentile is the RSSI of the first bin, from 0dBm down, where the
+cumulated number of points reaches that percentage of nb_pts, or
+LGW_SSCAN_NO_LEVEL if it is never reached (also the noise floor of an empty
+histogram). The cumulated sums are computed 4 bins at a time with GCC vector
+extensions, then each percentile is a binary search in them.
+*/
+int lgw_sscan_levels(const uint16_t *histo, uint32_t nb_histo, uint32_t nb_pts, struct lgw_sscan_level_s *level);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,106 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Background TX thread loading queued packets just in time in the single
+    concentrator TX buffer
+
+    Any number of threads can queue TIMESTAMPED and IMMEDIATE packets. The
+    thread keeps them ordered by count_us and loads the next one with lgw_send
+    as soon as the TX buffer is free and the packet start is close enough.
+    IMMEDIATE packets are sent in arrival order, in the gaps left between
+    TIMESTAMPED packets. Packets overlapping one already queued are refused,
+    packets that can no longer be loaded in time are dropped and counted.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+#ifndef _LORAGW_TXQ_H
+#define _LORAGW_TXQ_H
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+
+#include "loragw_hal.h"
+
+#include "config.h"    /* library configuration options (dynamically generated) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC CONSTANTS ----------------------------------------------------- */
+
+#define LGW_TXQ_SUCCESS     0
+#define LGW_TXQ_ERROR       -1
+#define LGW_TXQ_FULL        -2  /* no room left in the queue */
+#define LGW_TXQ_COLLISION   -3  /* packet overlaps a TIMESTAMPED packet already queued */
+#define LGW_TXQ_TOO_LATE    -4  /* packet start is too close to be loaded in time */
+
+#define LGW_TXQ_SIZE        32  /* number of packets waiting in the queue */
+#define LGW_TXQ_GUARD_US    3000 /* shortest delay to load a packet and start it, also the gap required between 2 packets */
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC TYPES --------------------------------------------------------- */
+
+/**
+@struct lgw_txq_stats_s
+@brief Structure containing the TX queue counters
+*/
+struct lgw_txq_stats_s {
+    uint32_t    nb_pkt_in;      /*!> number of packets accepted in the queue */
+    uint32_t    nb_pkt_sent;    /*!> number of packets loaded in the concentrator by the TX thread */
+    uint32_t    nb_collision;   /*!> number of packets refused because they overlapped another one */
+    uint32_t    nb_late;        /*!> number of packets refused or dropped because their start was too close */
+    uint32_t    nb_error;       /*!> number of lgw_send calls that failed */
+    uint16_t    depth;          /*!> number of packets currently waiting in the queue, not affected by reset */
+    uint16_t    depth_max;      /*!> highest number of packets seen waiting in the queue */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS PROTOTYPES ------------------------------------------ */
+
+/**
+@brief Start the background TX thread, the concentrator must already be started
+@return LGW_TXQ_ERROR id the operation failed, LGW_TXQ_SUCCESS else
+
+The thread drives the concentrator of the context of the calling thread.
+*/
+int lgw_txq_start(void);
+
+/**
+@brief Stop the background TX thread, must be called before lgw_stop
+@return LGW_TXQ_ERROR id the operation failed, LGW_TXQ_SUCCESS else
+
+Packets still waiting in the queue are discarded, a packet already loaded in
+the concentrator is still sent.
+*/
+int lgw_txq_stop(void);
+
+/**
+@brief Queue a packet for transmission
+@param pkt_data pointer to the packet to send, copied in the queue (ON_GPS mode is not supported)
+@return LGW_TXQ_ERROR id the operation failed, LGW_TXQ_FULL, LGW_TXQ_COLLISION or LGW_TXQ_TOO_LATE if the packet was refused, LGW_TXQ_SUCCESS else
+
+A TIMESTAMPED packet must start at least LGW_TXQ_GUARD_US after the end of any
+TIMESTAMPED packet queued before it, and must end at least LGW_TXQ_GUARD_US
+before the start of the next one.
+*/
+int lgw_txq_enqueue(const struct lgw_pkt_tx_s *pkt_data);
+
+/**
+@brief Get the TX queue counters
+@param stats pointer to the structure that will receive the counters
+@param reset if true, the counters are cleared after being read
+@return LGW_TXQ_ERROR id the operation failed, LGW_TXQ_SUCCESS else
+*/
+int lgw_txq_get_stats(struct lgw_txq_stats_s *stats, bool reset);
+
+#endif
+
+/* --- EOF ------------------------------------------------------------------ */
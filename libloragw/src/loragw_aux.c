@@ -25,7 +25,8 @@ Maintainer: Sylvain Miermont
 #endif
 
 #include <stdio.h>  /* printf fprintf */
-#include <time.h>   /* clock_nanosleep */
+#include <stdint.h> /* C99 types */
+#include <time.h>   /* clock_nanosleep clock_gettime */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -58,4 +59,13 @@ void wait_ms(unsigned long a) {
     return;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint64_t monotonic_us(void) {
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return ((uint64_t)now.tv_sec * 1000000) + ((uint64_t)now.tv_nsec / 1000);
+}
+
 /* --- EOF ------------------------------------------------------------------ */
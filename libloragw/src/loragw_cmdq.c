@@ -0,0 +1,516 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Command queue giving the concentrator to a single owner thread
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc free */
+#include <string.h>     /* memset */
+#include <errno.h>      /* EINTR ETIMEDOUT */
+#include <time.h>       /* clock_gettime */
+#include <pthread.h>    /* pthread_create pthread_join pthread_self */
+#include <semaphore.h>  /* sem_wait sem_timedwait sem_post */
+
+#include "loragw_cmdq.h"
+#include "loragw_ctx.h"
+#include "loragw_reg.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_HAL == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                 if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_CMDQ_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                 if(a==NULL){return LGW_CMDQ_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define CMDQ_GROUP_MAX      64 /* register accesses sorted by page at once, longer runs are cut */
+#define CMDQ_PAGE_NB        4  /* SX1301 register pages */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* command queue of one context */
+struct lgw_cmdq_state_s {
+    struct lgw_cmd_s        *head;      /* last submitted command, each one links to the previous one */
+    sem_t                   sem;        /* posted when a command is pushed in an empty queue, and by lgw_cmdq_stop */
+    bool                    sem_init;
+    pthread_t               thread;
+    bool                    running;
+    struct lgw_cmdq_stats_s stats;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
+
+extern const struct lgw_reg_s loregs[LGW_TOTALREGS]; /*! register map, gives the page of each register */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_cmdq_state_s cmdq_state_dflt; /* state of the default context */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void cmdq_complete(struct lgw_cmdq_state_s *q, struct lgw_cmd_s *cmd, int status);
+
+static void cmdq_fail(struct lgw_cmdq_state_s *q);
+
+static int cmdq_reg_run(struct lgw_cmd_s *cmd);
+
+static struct lgw_cmd_s *cmdq_run_regs(struct lgw_cmdq_state_s *q, struct lgw_cmd_s *list);
+
+static void cmdq_run(struct lgw_cmdq_state_s *q, struct lgw_cmd_s *list);
+
+static int cmdq_stop(struct lgw_cmdq_state_s *q);
+
+static int cmdq_exec(struct lgw_cmd_s *cmd);
+
+static void *cmdq_thread_main(void *arg);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* the submitter may free the command as soon as it is completed */
+static void cmdq_complete(struct lgw_cmdq_state_s *q, struct lgw_cmd_s *cmd, int status) {
+    cmd->status = status;
+    __atomic_fetch_add(&q->stats.nb_cmd, 1, __ATOMIC_RELAXED);
+    if (cmd->done != NULL) {
+        cmd->done(cmd);
+    } else {
+        sem_post(&cmd->sem);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* complete the commands left in a stopped queue, they are never run */
+static void cmdq_fail(struct lgw_cmdq_state_s *q) {
+    struct lgw_cmd_s *list, *next;
+
+    list = __atomic_exchange_n(&q->head, NULL, __ATOMIC_SEQ_CST);
+    while (list != NULL) {
+        next = list->next;
+        cmdq_complete(q, list, LGW_CMDQ_ERROR);
+        list = next;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int cmdq_reg_run(struct lgw_cmd_s *cmd) {
+    switch (cmd->type) {
+        case LGW_CMD_REG_W:
+            return lgw_reg_w(cmd->reg_id, cmd->value);
+        case LGW_CMD_REG_R:
+            return lgw_reg_r(cmd->reg_id, &cmd->value);
+        case LGW_CMD_REG_WB:
+            return lgw_reg_wb(cmd->reg_id, cmd->data, cmd->size);
+        case LGW_CMD_REG_RB:
+            return lgw_reg_rb(cmd->reg_id, cmd->data, cmd->size);
+        default:
+            return LGW_REG_ERROR;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* run the register accesses at the head of list in one SPI batch, one page after the other, return the rest of the list */
+static struct lgw_cmd_s *cmdq_run_regs(struct lgw_cmdq_state_s *q, struct lgw_cmd_s *list) {
+    struct lgw_cmd_s *group[CMDQ_GROUP_MAX];
+    int status[CMDQ_GROUP_MAX];
+    int8_t order[CMDQ_PAGE_NB] = {-1};
+    bool seen[CMDQ_PAGE_NB] = {false};
+    int nb_cmd = 0;
+    int nb_page = 0;
+    int8_t page;
+    int i, p;
+
+    while ((list != NULL) && (list->type != LGW_CMD_CALL) && (nb_cmd < CMDQ_GROUP_MAX)) {
+        page = loregs[list->reg_id].page;
+        if ((page >= 0) && (seen[page] == false)) {
+            seen[page] = true;
+            order[nb_page++] = page;
+        }
+        status[nb_cmd] = LGW_REG_ERROR;
+        group[nb_cmd++] = list;
+        list = list->next;
+    }
+
+    /* registers present on all pages go with the first page, the others are
+    run page by page in order of appearance: accesses to different pages touch
+    different registers, so only the page switches change */
+    lgw_ctx_lock();
+    lgw_reg_batch_begin();
+    for (p = 0; p < ((nb_page > 0) ? nb_page : 1); ++p) {
+        for (i = 0; i < nb_cmd; ++i) {
+            page = loregs[group[i]->reg_id].page;
+            if ((page == order[p]) || ((p == 0) && (page < 0))) {
+                status[i] = cmdq_reg_run(group[i]);
+            }
+        }
+    }
+    lgw_reg_batch_end();
+    lgw_ctx_unlock();
+    __atomic_fetch_add(&q->stats.nb_page_group, (nb_page > 0) ? nb_page : 1, __ATOMIC_RELAXED);
+
+    for (i = 0; i < nb_cmd; ++i) {
+        cmdq_complete(q, group[i], status[i]);
+    }
+    return list;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* list in submission order */
+static void cmdq_run(struct lgw_cmdq_state_s *q, struct lgw_cmd_s *list) {
+    struct lgw_cmd_s *next;
+    int status;
+
+    while (list != NULL) {
+        if (list->type == LGW_CMD_CALL) {
+            next = list->next;
+            lgw_ctx_lock();
+            status = list->fn(list->arg);
+            lgw_ctx_unlock();
+            cmdq_complete(q, list, status);
+            list = next;
+        } else {
+            list = cmdq_run_regs(q, list);
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* submit and wait, or run directly if called by the owner thread */
+static int cmdq_exec(struct lgw_cmd_s *cmd) {
+    struct lgw_cmdq_state_s *q = lgw_ctx_current()->cmdq;
+
+    if ((__atomic_load_n(&q->running, __ATOMIC_ACQUIRE) == true) && (pthread_equal(pthread_self(), q->thread) != 0)) {
+        return (cmd->type == LGW_CMD_CALL) ? cmd->fn(cmd->arg) : cmdq_reg_run(cmd);
+    }
+    cmd->done = NULL;
+    if (lgw_cmdq_submit(cmd) != LGW_CMDQ_SUCCESS) {
+        return LGW_CMDQ_ERROR;
+    }
+    if (lgw_cmdq_wait(cmd, -1) != LGW_CMDQ_SUCCESS) {
+        return LGW_CMDQ_ERROR;
+    }
+    return cmd->status;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void *cmdq_thread_main(void *arg) {
+    struct lgw_context *ctx = arg;
+    struct lgw_cmdq_state_s *q = ctx->cmdq;
+    struct lgw_cmd_s *list, *prev, *next;
+    uint16_t nb_cmd;
+
+    lgw_ctx_use(ctx); /* drive the concentrator of the thread that started the queue */
+
+    while (__atomic_load_n(&q->running, __ATOMIC_ACQUIRE)) {
+        while ((sem_wait(&q->sem) != 0) && (errno == EINTR));
+
+        /* take all the pending commands, newest first, and put them back in submission order */
+        list = __atomic_exchange_n(&q->head, NULL, __ATOMIC_ACQUIRE);
+        prev = NULL;
+        nb_cmd = 0;
+        while (list != NULL) {
+            next = list->next;
+            list->next = prev;
+            prev = list;
+            list = next;
+            nb_cmd += 1;
+        }
+        if (nb_cmd == 0) {
+            continue;
+        }
+
+        __atomic_fetch_add(&q->stats.nb_batch, 1, __ATOMIC_RELAXED);
+        if (nb_cmd > __atomic_load_n(&q->stats.batch_max, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&q->stats.batch_max, nb_cmd, __ATOMIC_RELAXED);
+        }
+        cmdq_run(q, prev);
+    }
+
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int cmdq_stop(struct lgw_cmdq_state_s *q) {
+    if (__atomic_load_n(&q->running, __ATOMIC_ACQUIRE) == false) {
+        DEBUG_MSG("Note: command queue thread not running\n");
+        return LGW_CMDQ_SUCCESS;
+    }
+
+    /* pairs with the check lgw_cmdq_submit does after its push: either the
+    submitter sees the queue stopped, or the drain below sees its command */
+    __atomic_store_n(&q->running, false, __ATOMIC_SEQ_CST);
+    sem_post(&q->sem);
+    if (pthread_join(q->thread, NULL) != 0) {
+        DEBUG_MSG("ERROR: FAILED TO JOIN COMMAND QUEUE THREAD\n");
+        return LGW_CMDQ_ERROR;
+    }
+
+    /* release the submitters of the commands left behind */
+    cmdq_fail(q);
+
+    return LGW_CMDQ_SUCCESS;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+struct lgw_cmdq_state_s *lgw_cmdq_state_new(bool dflt) {
+    struct lgw_cmdq_state_s *state;
+
+    state = (dflt == true) ? &cmdq_state_dflt : malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
+    }
+    memset(state, 0, sizeof *state);
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_cmdq_state_free(struct lgw_cmdq_state_s *state) {
+    if ((state == NULL) || (state == &cmdq_state_dflt)) {
+        return;
+    }
+    cmdq_stop(state);
+    if (state->sem_init == true) {
+        sem_destroy(&state->sem);
+    }
+    free(state);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cmdq_start(void) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_cmdq_state_s *q = ctx->cmdq;
+
+    if (__atomic_load_n(&q->running, __ATOMIC_ACQUIRE) == true) {
+        DEBUG_MSG("ERROR: COMMAND QUEUE ALREADY RUNNING\n");
+        return LGW_CMDQ_ERROR;
+    }
+
+    if (q->sem_init == true) {
+        sem_destroy(&q->sem);
+        q->sem_init = false;
+    }
+    if (sem_init(&q->sem, 0, 0) != 0) {
+        DEBUG_MSG("ERROR: FAILED TO INITIALIZE COMMAND QUEUE SEMAPHORE\n");
+        return LGW_CMDQ_ERROR;
+    }
+    q->sem_init = true;
+    __atomic_store_n(&q->head, NULL, __ATOMIC_RELAXED);
+
+    __atomic_store_n(&q->running, true, __ATOMIC_RELEASE);
+    if (pthread_create(&q->thread, NULL, cmdq_thread_main, ctx) != 0) {
+        DEBUG_MSG("ERROR: FAILED TO CREATE COMMAND QUEUE THREAD\n");
+        __atomic_store_n(&q->running, false, __ATOMIC_RELEASE);
+        return LGW_CMDQ_ERROR;
+    }
+
+    DEBUG_MSG("Note: command queue thread started\n");
+    return LGW_CMDQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cmdq_stop(void) {
+    return cmdq_stop(lgw_ctx_current()->cmdq);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cmdq_submit(struct lgw_cmd_s *cmd) {
+    struct lgw_cmdq_state_s *q = lgw_ctx_current()->cmdq;
+    struct lgw_cmd_s *head;
+
+    /* check input variables */
+    CHECK_NULL(cmd);
+    if (cmd->type == LGW_CMD_CALL) {
+        CHECK_NULL(cmd->fn);
+    } else if ((cmd->type > LGW_CMD_CALL) || (cmd->reg_id >= LGW_TOTALREGS)) {
+        DEBUG_MSG("ERROR: NOT A VALID COMMAND\n");
+        return LGW_CMDQ_ERROR;
+    } else if ((cmd->type == LGW_CMD_REG_WB) || (cmd->type == LGW_CMD_REG_RB)) {
+        CHECK_NULL(cmd->data);
+    }
+    if (__atomic_load_n(&q->running, __ATOMIC_ACQUIRE) == false) {
+        DEBUG_MSG("ERROR: COMMAND QUEUE NOT RUNNING\n");
+        return LGW_CMDQ_ERROR;
+    }
+
+    if ((cmd->done == NULL) && (sem_init(&cmd->sem, 0, 0) != 0)) {
+        DEBUG_MSG("ERROR: FAILED TO INITIALIZE COMMAND SEMAPHORE\n");
+        return LGW_CMDQ_ERROR;
+    }
+
+    /* push, the owner thread is only woken up by the command that finds the queue empty */
+    head = __atomic_load_n(&q->head, __ATOMIC_RELAXED);
+    do {
+        cmd->next = head;
+    } while (!__atomic_compare_exchange_n(&q->head, &head, cmd, true, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED));
+    if (head == NULL) {
+        sem_post(&q->sem);
+    }
+
+    /* lgw_cmdq_stop may have drained the queue between the check above and
+    the push: nobody would ever run the command, complete it here */
+    if (__atomic_load_n(&q->running, __ATOMIC_SEQ_CST) == false) {
+        cmdq_fail(q);
+    }
+
+    return LGW_CMDQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cmdq_wait(struct lgw_cmd_s *cmd, int timeout_ms) {
+    struct timespec deadline;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(cmd);
+    if (cmd->done != NULL) {
+        DEBUG_MSG("ERROR: COMMAND COMPLETED THROUGH ITS DONE FUNCTION\n");
+        return LGW_CMDQ_ERROR;
+    }
+
+    if (timeout_ms == 0) {
+        while (((i = sem_trywait(&cmd->sem)) != 0) && (errno == EINTR));
+    } else if (timeout_ms < 0) {
+        while (((i = sem_wait(&cmd->sem)) != 0) && (errno == EINTR));
+    } else {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (((i = sem_timedwait(&cmd->sem, &deadline)) != 0) && (errno == EINTR));
+    }
+    if (i != 0) {
+        if ((errno == EAGAIN) || (errno == ETIMEDOUT)) {
+            return LGW_CMDQ_TIMEOUT;
+        }
+        DEBUG_PRINTF("ERROR: FAILED TO WAIT FOR COMMAND (errno %d)\n", errno);
+        return LGW_CMDQ_ERROR;
+    }
+
+    sem_destroy(&cmd->sem);
+    return LGW_CMDQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cmdq_reg_w(uint16_t register_id, int32_t reg_value) {
+    struct lgw_cmd_s cmd = { .type = LGW_CMD_REG_W, .reg_id = register_id, .value = reg_value };
+
+    return cmdq_exec(&cmd);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cmdq_reg_r(uint16_t register_id, int32_t *reg_value) {
+    struct lgw_cmd_s cmd = { .type = LGW_CMD_REG_R, .reg_id = register_id };
+    int x;
+
+    /* check input variables */
+    CHECK_NULL(reg_value);
+
+    x = cmdq_exec(&cmd);
+    *reg_value = cmd.value;
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cmdq_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
+    struct lgw_cmd_s cmd = { .type = LGW_CMD_REG_WB, .reg_id = register_id, .data = data, .size = size };
+
+    return cmdq_exec(&cmd);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cmdq_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
+    struct lgw_cmd_s cmd = { .type = LGW_CMD_REG_RB, .reg_id = register_id, .data = data, .size = size };
+
+    return cmdq_exec(&cmd);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cmdq_call(int (*fn)(void *arg), void *arg) {
+    struct lgw_cmd_s cmd = { .type = LGW_CMD_CALL, .fn = fn, .arg = arg };
+
+    /* check input variables */
+    CHECK_NULL(fn);
+
+    return cmdq_exec(&cmd);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_cmdq_get_stats(struct lgw_cmdq_stats_s *stats, bool reset) {
+    struct lgw_cmdq_state_s *q = lgw_ctx_current()->cmdq;
+
+    /* check input variables */
+    CHECK_NULL(stats);
+
+    stats->nb_cmd = __atomic_load_n(&q->stats.nb_cmd, __ATOMIC_RELAXED);
+    stats->nb_batch = __atomic_load_n(&q->stats.nb_batch, __ATOMIC_RELAXED);
+    stats->nb_page_group = __atomic_load_n(&q->stats.nb_page_group, __ATOMIC_RELAXED);
+    stats->batch_max = __atomic_load_n(&q->stats.batch_max, __ATOMIC_RELAXED);
+
+    if (reset == true) {
+        /* subtract what was read, so that increments done meanwhile by the owner thread are kept */
+        __atomic_fetch_sub(&q->stats.nb_cmd, stats->nb_cmd, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&q->stats.nb_batch, stats->nb_batch, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&q->stats.nb_page_group, stats->nb_page_group, __ATOMIC_RELAXED);
+        __atomic_store_n(&q->stats.batch_max, 0, __ATOMIC_RELAXED);
+    }
+
+    return LGW_CMDQ_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
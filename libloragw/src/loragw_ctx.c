@@ -0,0 +1,211 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Concentrator contexts: default context, creation of more contexts and
+    selection of the context each thread works on.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* fprintf */
+#include <stdlib.h>     /* calloc free */
+#include <string.h>     /* strncpy memset */
+#include <pthread.h>    /* pthread_once */
+
+#include "loragw_ctx.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_HAL == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_context ctx_dflt; /* used by the threads that did not select a context, while it is the only one */
+static pthread_once_t ctx_dflt_once = PTHREAD_ONCE_INIT;
+
+static struct lgw_context ctx_none; /* used by the threads that did not select a context, while there are several: cannot connect */
+static pthread_once_t ctx_none_once = PTHREAD_ONCE_INIT;
+
+static int ctx_nb = 0; /* contexts created by lgw_ctx_new and not freed yet */
+
+static __thread struct lgw_context *ctx_cur = NULL; /* context selected by the thread, NULL for the default one */
+static __thread bool ctx_selected = false; /* the thread called lgw_ctx_use */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void ctx_dflt_init(void) {
+    ctx_dflt.reg = lgw_reg_state_new(true);
+    ctx_dflt.fpga = lgw_fpga_state_new(true);
+    ctx_dflt.lbt = lgw_lbt_state_new(true);
+    ctx_dflt.hal = lgw_hal_state_new(true);
+    ctx_dflt.cmdq = lgw_cmdq_state_new(true);
+    ctx_dflt.gps = lgw_gps_state_new(true);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool ctx_states_alloc(struct lgw_context *ctx) {
+    ctx->reg = lgw_reg_state_new(false);
+    ctx->fpga = lgw_fpga_state_new(false);
+    ctx->lbt = lgw_lbt_state_new(false);
+    ctx->hal = lgw_hal_state_new(false);
+    ctx->cmdq = lgw_cmdq_state_new(false);
+    ctx->gps = lgw_gps_state_new(false);
+    return (ctx->reg != NULL) && (ctx->fpga != NULL) && (ctx->lbt != NULL) && (ctx->hal != NULL) && (ctx->cmdq != NULL) && (ctx->gps != NULL);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void ctx_states_free(struct lgw_context *ctx) {
+    lgw_gps_state_free(ctx->gps);
+    lgw_cmdq_state_free(ctx->cmdq);
+    lgw_hal_state_free(ctx->hal);
+    lgw_lbt_state_free(ctx->lbt);
+    lgw_fpga_state_free(ctx->fpga);
+    lgw_reg_state_free(ctx->reg);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void ctx_none_init(void) {
+    if (ctx_states_alloc(&ctx_none) == false) {
+        ctx_states_free(&ctx_none);
+        memset(&ctx_none, 0, sizeof ctx_none);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static struct lgw_context *ctx_default(void) {
+    pthread_once(&ctx_dflt_once, ctx_dflt_init);
+    return &ctx_dflt;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+struct lgw_context *lgw_ctx_new(const char *spi_path) {
+    struct lgw_context *ctx;
+
+    /* the threads that do not select a context need one they cannot drive a concentrator with */
+    pthread_once(&ctx_none_once, ctx_none_init);
+    if (ctx_none.hal == NULL) {
+        DEBUG_MSG("ERROR: FAILED TO ALLOCATE A CONTEXT\n");
+        return NULL;
+    }
+
+    ctx = calloc(1, sizeof *ctx);
+    if (ctx == NULL) {
+        DEBUG_MSG("ERROR: FAILED TO ALLOCATE A CONTEXT\n");
+        return NULL;
+    }
+    if (spi_path != NULL) {
+        strncpy(ctx->spi_path, spi_path, sizeof ctx->spi_path - 1);
+    }
+    if (ctx_states_alloc(ctx) == false) {
+        DEBUG_MSG("ERROR: FAILED TO ALLOCATE A CONTEXT\n");
+        ctx_states_free(ctx);
+        free(ctx);
+        return NULL;
+    }
+    __atomic_add_fetch(&ctx_nb, 1, __ATOMIC_RELEASE);
+    return ctx;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_free(struct lgw_context *ctx) {
+    if ((ctx == NULL) || (ctx == &ctx_dflt) || (ctx == &ctx_none)) {
+        DEBUG_MSG("ERROR: NOT A CONTEXT CREATED BY lgw_ctx_new\n");
+        return LGW_CTX_ERROR;
+    }
+    if (ctx->spi_target != NULL) {
+        DEBUG_MSG("ERROR: CONCENTRATOR STILL CONNECTED, STOP IT FIRST\n");
+        return LGW_CTX_ERROR;
+    }
+    if (ctx_cur == ctx) {
+        ctx_cur = NULL;
+    }
+    ctx_states_free(ctx);
+    free(ctx);
+    __atomic_sub_fetch(&ctx_nb, 1, __ATOMIC_RELEASE);
+    return LGW_CTX_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_use(struct lgw_context *ctx) {
+    if (ctx == &ctx_none) {
+        DEBUG_MSG("ERROR: NOT A CONTEXT CREATED BY lgw_ctx_new\n");
+        return LGW_CTX_ERROR;
+    }
+    ctx_cur = (ctx == &ctx_dflt) ? NULL : ctx;
+    ctx_selected = true;
+    return LGW_CTX_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct lgw_context *lgw_ctx_current(void) {
+    if (ctx_cur != NULL) {
+        return ctx_cur;
+    }
+    if ((ctx_selected == false) && (__atomic_load_n(&ctx_nb, __ATOMIC_ACQUIRE) > 0)) {
+        return &ctx_none;
+    }
+    return ctx_default();
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_check(void) {
+    if (lgw_ctx_current() == &ctx_none) {
+        DEBUG_MSG("ERROR: SEVERAL CONTEXTS EXIST, THE THREAD MUST SELECT ONE WITH lgw_ctx_use\n");
+        return LGW_CTX_ERROR;
+    }
+    return LGW_CTX_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_lock(void) {
+    lgw_hal_state_lock(lgw_ctx_current()->hal);
+    return LGW_CTX_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_ctx_unlock(void) {
+    lgw_hal_state_unlock(lgw_ctx_current()->hal);
+    return LGW_CTX_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -22,12 +22,14 @@ Maintainer: Michael Coracin
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
 #include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc free */
 
 #include "loragw_spi.h"
 #include "loragw_aux.h"
 #include "loragw_hal.h"
 #include "loragw_reg.h"
 #include "loragw_fpga.h"
+#include "loragw_ctx.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -53,56 +55,59 @@ this file is autogenerated from registers description
 293 registers are defined
 */
 const struct lgw_reg_s fpga_regs[LGW_FPGA_TOTALREGS] = {
-    {-1,0,0,0,1,0,0}, /* SOFT_RESET */
-    {-1,0,1,0,4,1,0}, /* FPGA_FEATURE */
-    {-1,0,5,0,3,1,0}, /* LBT_INITIAL_FREQ */
-    {-1,1,0,0,8,1,0}, /* VERSION */
-    {-1,2,0,0,8,1,0}, /* FPGA_STATUS */
-    {-1,3,0,0,1,0,0}, /* FPGA_CTRL_FEATURE_START */
-    {-1,3,1,0,1,0,0}, /* FPGA_CTRL_RADIO_RESET */
-    {-1,3,2,0,1,0,0}, /* FPGA_CTRL_INPUT_SYNC_I */
-    {-1,3,3,0,1,0,0}, /* FPGA_CTRL_INPUT_SYNC_Q */
-    {-1,3,4,0,1,0,0}, /* FPGA_CTRL_OUTPUT_SYNC */
-    {-1,3,5,0,1,0,0}, /* FPGA_CTRL_INVERT_IQ */
-    {-1,3,6,0,1,0,0}, /* FPGA_CTRL_ACCESS_HISTO_MEM */
-    {-1,3,7,0,1,0,0}, /* FPGA_CTRL_CLEAR_HISTO_MEM */
-    {-1,4,0,0,8,0,0}, /* HISTO_RAM_ADDR */
-    {-1,5,0,0,8,1,0}, /* HISTO_RAM_DATA */
-    {-1,8,0,0,16,0,1000}, /* HISTO_NB_READ */
-    {-1,14,0,0,16,1,0}, /* LBT_TIMESTAMP_CH */
-    {-1,17,0,0,4,0,0}, /* LBT_TIMESTAMP_SELECT_CH */
-    {-1,18,0,0,8,0,0}, /* LBT_CH0_FREQ_OFFSET */
-    {-1,19,0,0,8,0,0}, /* LBT_CH1_FREQ_OFFSET */
-    {-1,20,0,0,8,0,0}, /* LBT_CH2_FREQ_OFFSET */
-    {-1,21,0,0,8,0,0}, /* LBT_CH3_FREQ_OFFSET */
-    {-1,22,0,0,8,0,0}, /* LBT_CH4_FREQ_OFFSET */
-    {-1,23,0,0,8,0,0}, /* LBT_CH5_FREQ_OFFSET */
-    {-1,24,0,0,8,0,0}, /* LBT_CH6_FREQ_OFFSET */
-    {-1,25,0,0,8,0,0}, /* LBT_CH7_FREQ_OFFSET */
-    {-1,26,0,0,8,0,0}, /* SCAN_FREQ_OFFSET */
-    {-1,28,0,0,1,0,0}, /* LBT_SCAN_TIME_CH0 */
-    {-1,28,1,0,1,0,0}, /* LBT_SCAN_TIME_CH1 */
-    {-1,28,2,0,1,0,0}, /* LBT_SCAN_TIME_CH2 */
-    {-1,28,3,0,1,0,0}, /* LBT_SCAN_TIME_CH3 */
-    {-1,28,4,0,1,0,0}, /* LBT_SCAN_TIME_CH4 */
-    {-1,28,5,0,1,0,0}, /* LBT_SCAN_TIME_CH5 */
-    {-1,28,6,0,1,0,0}, /* LBT_SCAN_TIME_CH6 */
-    {-1,28,7,0,1,0,0}, /* LBT_SCAN_TIME_CH7 */
-    {-1,30,0,0,8,0,160}, /* RSSI_TARGET */
-    {-1,31,0,0,24,0,0}, /* HISTO_SCAN_FREQ */
-    {-1,34,0,0,6,0,0} /* NOTCH_FREQ_OFFSET */
+    {-1,0,0,0,1,0,0,1}, /* SOFT_RESET */
+    {-1,0,1,0,4,1,0,0}, /* FPGA_FEATURE */
+    {-1,0,5,0,3,1,0,0}, /* LBT_INITIAL_FREQ */
+    {-1,1,0,0,8,1,0,0}, /* VERSION */
+    {-1,2,0,0,8,1,0,0}, /* FPGA_STATUS */
+    {-1,3,0,0,1,0,0,0}, /* FPGA_CTRL_FEATURE_START */
+    {-1,3,1,0,1,0,0,0}, /* FPGA_CTRL_RADIO_RESET */
+    {-1,3,2,0,1,0,0,0}, /* FPGA_CTRL_INPUT_SYNC_I */
+    {-1,3,3,0,1,0,0,0}, /* FPGA_CTRL_INPUT_SYNC_Q */
+    {-1,3,4,0,1,0,0,0}, /* FPGA_CTRL_OUTPUT_SYNC */
+    {-1,3,5,0,1,0,0,0}, /* FPGA_CTRL_INVERT_IQ */
+    {-1,3,6,0,1,0,0,0}, /* FPGA_CTRL_ACCESS_HISTO_MEM */
+    {-1,3,7,0,1,0,0,1}, /* FPGA_CTRL_CLEAR_HISTO_MEM */
+    {-1,4,0,0,8,0,0,1}, /* HISTO_RAM_ADDR */
+    {-1,5,0,0,8,1,0,0}, /* HISTO_RAM_DATA */
+    {-1,8,0,0,16,0,1000,0}, /* HISTO_NB_READ */
+    {-1,14,0,0,16,1,0,0}, /* LBT_TIMESTAMP_CH */
+    {-1,17,0,0,4,0,0,0}, /* LBT_TIMESTAMP_SELECT_CH */
+    {-1,18,0,0,8,0,0,0}, /* LBT_CH0_FREQ_OFFSET */
+    {-1,19,0,0,8,0,0,0}, /* LBT_CH1_FREQ_OFFSET */
+    {-1,20,0,0,8,0,0,0}, /* LBT_CH2_FREQ_OFFSET */
+    {-1,21,0,0,8,0,0,0}, /* LBT_CH3_FREQ_OFFSET */
+    {-1,22,0,0,8,0,0,0}, /* LBT_CH4_FREQ_OFFSET */
+    {-1,23,0,0,8,0,0,0}, /* LBT_CH5_FREQ_OFFSET */
+    {-1,24,0,0,8,0,0,0}, /* LBT_CH6_FREQ_OFFSET */
+    {-1,25,0,0,8,0,0,0}, /* LBT_CH7_FREQ_OFFSET */
+    {-1,26,0,0,8,0,0,0}, /* SCAN_FREQ_OFFSET */
+    {-1,28,0,0,1,0,0,0}, /* LBT_SCAN_TIME_CH0 */
+    {-1,28,1,0,1,0,0,0}, /* LBT_SCAN_TIME_CH1 */
+    {-1,28,2,0,1,0,0,0}, /* LBT_SCAN_TIME_CH2 */
+    {-1,28,3,0,1,0,0,0}, /* LBT_SCAN_TIME_CH3 */
+    {-1,28,4,0,1,0,0,0}, /* LBT_SCAN_TIME_CH4 */
+    {-1,28,5,0,1,0,0,0}, /* LBT_SCAN_TIME_CH5 */
+    {-1,28,6,0,1,0,0,0}, /* LBT_SCAN_TIME_CH6 */
+    {-1,28,7,0,1,0,0,0}, /* LBT_SCAN_TIME_CH7 */
+    {-1,30,0,0,8,0,160,0}, /* RSSI_TARGET */
+    {-1,31,0,0,24,0,0,0}, /* HISTO_SCAN_FREQ */
+    {-1,34,0,0,6,0,0,0} /* NOTCH_FREQ_OFFSET */
 };
 
 /* -------------------------------------------------------------------------- */
-/* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
 
-extern void *lgw_spi_target; /*! generic pointer to the SPI device */
-extern uint8_t lgw_spi_mux_mode; /*! current SPI mux mode used */
+/* FPGA features of one concentrator context, see loragw_ctx.h */
+struct lgw_fpga_state_s {
+    bool        tx_notch_support;
+    uint8_t     tx_notch_offset;
+};
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
-static bool tx_notch_support = false;
-static uint8_t tx_notch_offset;
+
+static struct lgw_fpga_state_s fpga_state_dflt; /* state of the default context */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
@@ -113,15 +118,38 @@ static uint8_t tx_notch_offset;
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
+struct lgw_fpga_state_s *lgw_fpga_state_new(bool dflt) {
+    struct lgw_fpga_state_s *state;
+
+    state = (dflt == true) ? &fpga_state_dflt : malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
+    }
+    state->tx_notch_support = false;
+    state->tx_notch_offset = 0;
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_fpga_state_free(struct lgw_fpga_state_s *state) {
+    if ((state != NULL) && (state != &fpga_state_dflt)) {
+        free(state);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 float lgw_fpga_get_tx_notch_delay(void) {
+    struct lgw_fpga_state_s *fpga = lgw_ctx_current()->fpga;
     float tx_notch_delay;
 
-    if (tx_notch_support == false) {
+    if (fpga->tx_notch_support == false) {
         return 0;
     }
 
     /* Notch filtering performed by FPGA adds a constant delay (group delay) that we need to compensate */
-    tx_notch_delay = (31.25 * ((64 + tx_notch_offset) / 2)) / 1E3; /* 32MHz => 31.25ns */
+    tx_notch_delay = (31.25 * ((64 + fpga->tx_notch_offset) / 2)) / 1E3; /* 32MHz => 31.25ns */
 
     return tx_notch_delay;
 }
@@ -129,6 +157,7 @@ float lgw_fpga_get_tx_notch_delay(void) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_fpga_configure(uint32_t tx_notch_freq) {
+    struct lgw_fpga_state_s *fpga = lgw_ctx_current()->fpga;
     int x;
     int32_t val;
     bool spectral_scan_support, lbt_support;
@@ -142,8 +171,8 @@ int lgw_fpga_configure(uint32_t tx_notch_freq) {
     /* Get supported FPGA features */
     printf("INFO: FPGA supported features:");
     lgw_fpga_reg_r(LGW_FPGA_FEATURE, &val);
-    tx_notch_support = TAKE_N_BITS_FROM((uint8_t)val, 0, 1);
-    if (tx_notch_support == true) {
+    fpga->tx_notch_support = TAKE_N_BITS_FROM((uint8_t)val, 0, 1);
+    if (fpga->tx_notch_support == true) {
         printf(" [TX filter] ");
     }
     spectral_scan_support = TAKE_N_BITS_FROM((uint8_t)val, 1, 1);
@@ -172,9 +201,9 @@ int lgw_fpga_configure(uint32_t tx_notch_freq) {
     }
 
     /* Configure TX notch filter */
-    if (tx_notch_support == true) {
-        tx_notch_offset = (32E6 / (2*tx_notch_freq)) - 64;
-        x = lgw_fpga_reg_w(LGW_FPGA_NOTCH_FREQ_OFFSET, (int32_t)tx_notch_offset);
+    if (fpga->tx_notch_support == true) {
+        fpga->tx_notch_offset = (32E6 / (2*tx_notch_freq)) - 64;
+        x = lgw_fpga_reg_w(LGW_FPGA_NOTCH_FREQ_OFFSET, (int32_t)fpga->tx_notch_offset);
         if (x != LGW_REG_SUCCESS) {
             DEBUG_MSG("ERROR: Failed to configure FPGA TX notch filter\n");
             return LGW_REG_ERROR;
@@ -186,10 +215,10 @@ int lgw_fpga_configure(uint32_t tx_notch_freq) {
             DEBUG_MSG("ERROR: Failed to read FPGA TX notch frequency\n");
             return LGW_REG_ERROR;
         }
-        if (val != tx_notch_offset) {
+        if (val != fpga->tx_notch_offset) {
             DEBUG_MSG("WARNING: TX notch filter frequency is not programmable (check your FPGA image)\n");
         } else {
-            DEBUG_PRINTF("INFO: TX notch filter frequency set to %u (%i)\n", tx_notch_freq, tx_notch_offset);
+            DEBUG_PRINTF("INFO: TX notch filter frequency set to %u (%i)\n", tx_notch_freq, fpga->tx_notch_offset);
         }
     }
 
@@ -200,6 +229,7 @@ int lgw_fpga_configure(uint32_t tx_notch_freq) {
 
 /* Write to a register addressed by name */
 int lgw_fpga_reg_w(uint16_t register_id, int32_t reg_value) {
+    struct lgw_context *ctx = lgw_ctx_current();
     int spi_stat = LGW_SPI_SUCCESS;
     struct lgw_reg_s r;
 
@@ -210,7 +240,7 @@ int lgw_fpga_reg_w(uint16_t register_id, int32_t reg_value) {
     }
 
     /* check if SPI is initialised */
-    if (lgw_spi_target == NULL) {
+    if (ctx->spi_target == NULL) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
@@ -224,7 +254,12 @@ int lgw_fpga_reg_w(uint16_t register_id, int32_t reg_value) {
         return LGW_REG_ERROR;
     }
 
-    spi_stat += reg_w_align32(lgw_spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA, r, reg_value);
+    spi_stat += reg_w_align32(ctx->spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA, r, reg_value);
+
+    /* FPGA soft reset puts all registers back to their default value */
+    if ((register_id == LGW_FPGA_SOFT_RESET) && (reg_value != 0)) {
+        reg_cache_invalidate(LGW_SPI_MUX_TARGET_FPGA);
+    }
 
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
@@ -238,6 +273,7 @@ int lgw_fpga_reg_w(uint16_t register_id, int32_t reg_value) {
 
 /* Read to a register addressed by name */
 int lgw_fpga_reg_r(uint16_t register_id, int32_t *reg_value) {
+    struct lgw_context *ctx = lgw_ctx_current();
     int spi_stat = LGW_SPI_SUCCESS;
     struct lgw_reg_s r;
 
@@ -249,7 +285,7 @@ int lgw_fpga_reg_r(uint16_t register_id, int32_t *reg_value) {
     }
 
     /* check if SPI is initialised */
-    if (lgw_spi_target == NULL) {
+    if (ctx->spi_target == NULL) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
@@ -257,7 +293,7 @@ int lgw_fpga_reg_r(uint16_t register_id, int32_t *reg_value) {
     /* get register struct from the struct array */
     r = fpga_regs[register_id];
 
-    spi_stat += reg_r_align32(lgw_spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA, r, reg_value);
+    spi_stat += reg_r_align32(ctx->spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA, r, reg_value);
 
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
@@ -271,6 +307,7 @@ int lgw_fpga_reg_r(uint16_t register_id, int32_t *reg_value) {
 
 /* Point to a register by name and do a burst write */
 int lgw_fpga_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
+    struct lgw_context *ctx = lgw_ctx_current();
     int spi_stat = LGW_SPI_SUCCESS;
     struct lgw_reg_s r;
 
@@ -286,7 +323,7 @@ int lgw_fpga_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
     }
 
     /* check if SPI is initialised */
-    if (lgw_spi_target == NULL) {
+    if (ctx->spi_target == NULL) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
@@ -301,7 +338,8 @@ int lgw_fpga_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
     }
 
     /* do the burst write */
-    spi_stat += lgw_spi_wb(lgw_spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA, r.addr, data, size);
+    spi_stat += lgw_spi_wb(ctx->spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA, r.addr, data, size);
+    reg_cache_invalidate_burst(LGW_SPI_MUX_TARGET_FPGA, r, size);
 
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BURST WRITE\n");
@@ -315,6 +353,7 @@ int lgw_fpga_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
 
 /* Point to a register by name and do a burst read */
 int lgw_fpga_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
+    struct lgw_context *ctx = lgw_ctx_current();
     int spi_stat = LGW_SPI_SUCCESS;
     struct lgw_reg_s r;
 
@@ -330,7 +369,7 @@ int lgw_fpga_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
     }
 
     /* check if SPI is initialised */
-    if (lgw_spi_target == NULL) {
+    if (ctx->spi_target == NULL) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
@@ -339,7 +378,7 @@ int lgw_fpga_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
     r = fpga_regs[register_id];
 
     /* do the burst read */
-    spi_stat += lgw_spi_rb(lgw_spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA, r.addr, data, size);
+    spi_stat += lgw_spi_rb(ctx->spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA, r.addr, data, size);
 
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BURST READ\n");
@@ -33,6 +33,7 @@ Maintainer: Michael Coracin
 #include <stdlib.h>
 
 #include "loragw_gps.h"
+#include "loragw_ctx.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -49,6 +50,39 @@ Maintainer: Michael Coracin
 #endif
 #define TRACE()         fprintf(stderr, "@ %s %d\n", __FUNCTION__, __LINE__);
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* GPS parsing results of one concentrator context, see loragw_ctx.h */
+struct lgw_gps_state_s {
+    /* result of the NMEA parsing */
+    short       gps_yea;        /* year (2 or 4 digits) */
+    short       gps_mon;        /* month (1-12) */
+    short       gps_day;        /* day of the month (1-31) */
+    short       gps_hou;        /* hours (0-23) */
+    short       gps_min;        /* minutes (0-59) */
+    short       gps_sec;        /* seconds (0-60)(60 is for leap second) */
+    float       gps_fra;        /* fractions of seconds (<1) */
+    bool        gps_time_ok;
+    int16_t     gps_week;       /* GPS week number of the navigation epoch */
+    uint32_t    gps_iTOW;       /* GPS time of week in milliseconds */
+    int32_t     gps_fTOW;       /* Fractional part of iTOW (+/-500000) in nanosec */
+
+    short       gps_dla;        /* degrees of latitude */
+    double      gps_mla;        /* minutes of latitude */
+    char        gps_ola;        /* orientation (N-S) of latitude */
+    short       gps_dlo;        /* degrees of longitude */
+    double      gps_mlo;        /* minutes of longitude */
+    char        gps_olo;        /* orientation (E-W) of longitude */
+    short       gps_alt;        /* altitude */
+    bool        gps_pos_ok;
+
+    char        gps_mod;        /* GPS mode (N no fix, A autonomous, D differential) */
+    short       gps_sat;        /* number of satellites used for fix */
+
+    struct termios ttyopt_restore; /* serial port settings restored by lgw_gps_disable */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
@@ -62,33 +96,7 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-
-/* result of the NMEA parsing */
-static short gps_yea = 0; /* year (2 or 4 digits) */
-static short gps_mon = 0; /* month (1-12) */
-static short gps_day = 0; /* day of the month (1-31) */
-static short gps_hou = 0; /* hours (0-23) */
-static short gps_min = 0; /* minutes (0-59) */
-static short gps_sec = 0; /* seconds (0-60)(60 is for leap second) */
-static float gps_fra = 0.0; /* fractions of seconds (<1) */
-static bool gps_time_ok = false;
-static int16_t gps_week = 0; /* GPS week number of the navigation epoch */
-static uint32_t gps_iTOW = 0; /* GPS time of week in milliseconds */
-static int32_t gps_fTOW = 0; /* Fractional part of iTOW (+/-500000) in nanosec */
-
-static short gps_dla = 0; /* degrees of latitude */
-static double gps_mla = 0.0; /* minutes of latitude */
-static char gps_ola = 0; /* orientation (N-S) of latitude */
-static short gps_dlo = 0; /* degrees of longitude */
-static double gps_mlo = 0.0; /* minutes of longitude */
-static char gps_olo = 0; /* orientation (E-W) of longitude */
-static short gps_alt = 0; /* altitude */
-static bool gps_pos_ok = false;
-
-static char gps_mod = 'N'; /* GPS mode (N no fix, A autonomous, D differential) */
-static short gps_sat = 0; /* number of satellites used for fix */
-
-static struct termios ttyopt_restore;
+static struct lgw_gps_state_s gps_state_dflt; /* state of the default context */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
@@ -251,7 +259,30 @@ int str_chop(char *s, int buff_size, char separator, int *idx_ary, int max_idx)
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
+struct lgw_gps_state_s *lgw_gps_state_new(bool dflt) {
+    struct lgw_gps_state_s *state;
+
+    state = (dflt == true) ? &gps_state_dflt : malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
+    }
+    memset(state, 0, sizeof *state);
+    state->gps_mod = 'N';
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_gps_state_free(struct lgw_gps_state_s *state) {
+    if ((state != NULL) && (state != &gps_state_dflt)) {
+        free(state);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_gps_enable(char *tty_path, char *gps_family, speed_t target_brate, int *fd_ptr) {
+    struct lgw_gps_state_s *gps = lgw_ctx_current()->gps;
     int i;
     struct termios ttyopt; /* serial port options */
     int gps_tty_dev; /* file descriptor to the serial port of the GNSS module */
@@ -266,6 +297,10 @@ int lgw_gps_enable(char *tty_path, char *gps_family, speed_t target_brate, int *
     /* check input parameters */
     CHECK_NULL(tty_path);
     CHECK_NULL(fd_ptr);
+    if (lgw_ctx_check() != LGW_CTX_SUCCESS) {
+        DEBUG_MSG("ERROR: NO CONTEXT SELECTED, CALL lgw_ctx_use\n");
+        return LGW_GPS_ERROR;
+    }
 
     /* open TTY device */
     gps_tty_dev = open(tty_path, O_RDWR | O_NOCTTY);
@@ -300,7 +335,7 @@ int lgw_gps_enable(char *tty_path, char *gps_family, speed_t target_brate, int *
     }
 
     /* Save current serial port configuration for restoring later */
-    memcpy(&ttyopt_restore, &ttyopt, sizeof ttyopt);
+    memcpy(&gps->ttyopt_restore, &ttyopt, sizeof ttyopt);
 
     /* update baudrates */
     cfsetispeed(&ttyopt, DEFAULT_BAUDRATE);
@@ -359,9 +394,9 @@ int lgw_gps_enable(char *tty_path, char *gps_family, speed_t target_brate, int *
     tzset();
 
     /* initialize global variables */
-    gps_time_ok = false;
-    gps_pos_ok = false;
-    gps_mod = 'N';
+    gps->gps_time_ok = false;
+    gps->gps_pos_ok = false;
+    gps->gps_mod = 'N';
 
     return LGW_GPS_SUCCESS;
 }
@@ -369,10 +404,11 @@ int lgw_gps_enable(char *tty_path, char *gps_family, speed_t target_brate, int *
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_gps_disable(int fd) {
+    struct lgw_gps_state_s *gps = lgw_ctx_current()->gps;
     int i;
 
     /* restore serial ports parameters */
-    i = tcsetattr(fd, TCSANOW, &ttyopt_restore);
+    i = tcsetattr(fd, TCSANOW, &gps->ttyopt_restore);
     if (i != 0){
         DEBUG_MSG("ERROR: IMPOSSIBLE TO RESTORE TTY PORT CONFIGURATION\n");
         return LGW_GPS_ERROR;
@@ -391,6 +427,7 @@ int lgw_gps_disable(int fd) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 enum gps_msg lgw_parse_ubx(const char *serial_buff, size_t buff_size, size_t *msg_size) {
+    struct lgw_gps_state_s *gps = lgw_ctx_current()->gps;
     bool valid = 0;    /* iTOW, fTOW and week validity */
     unsigned int payload_length;
     uint8_t ck_a, ck_b;
@@ -444,20 +481,20 @@ enum gps_msg lgw_parse_ubx(const char *serial_buff, size_t buff_size, size_t *ms
                     if (valid) {
                         /* Parse buffer to extract GPS time */
                         /* Warning: payload byte ordering is Little Endian */
-                        gps_iTOW =  (uint8_t)serial_buff[6];
-                        gps_iTOW |= (uint8_t)serial_buff[7] << 8;
-                        gps_iTOW |= (uint8_t)serial_buff[8] << 16;
-                        gps_iTOW |= (uint8_t)serial_buff[9] << 24; /* GPS time of week, in ms */
+                        gps->gps_iTOW =  (uint8_t)serial_buff[6];
+                        gps->gps_iTOW |= (uint8_t)serial_buff[7] << 8;
+                        gps->gps_iTOW |= (uint8_t)serial_buff[8] << 16;
+                        gps->gps_iTOW |= (uint8_t)serial_buff[9] << 24; /* GPS time of week, in ms */
 
-                        gps_fTOW =  (uint8_t)serial_buff[10];
-                        gps_fTOW |= (uint8_t)serial_buff[11] << 8;
-                        gps_fTOW |= (uint8_t)serial_buff[12] << 16;
-                        gps_fTOW |= (uint8_t)serial_buff[13] << 24; /* Fractional part of iTOW, in ns */
+                        gps->gps_fTOW =  (uint8_t)serial_buff[10];
+                        gps->gps_fTOW |= (uint8_t)serial_buff[11] << 8;
+                        gps->gps_fTOW |= (uint8_t)serial_buff[12] << 16;
+                        gps->gps_fTOW |= (uint8_t)serial_buff[13] << 24; /* Fractional part of iTOW, in ns */
 
-                        gps_week =  (uint8_t)serial_buff[14];
-                        gps_week |= (uint8_t)serial_buff[15] << 8; /* GPS week number */
+                        gps->gps_week =  (uint8_t)serial_buff[14];
+                        gps->gps_week |= (uint8_t)serial_buff[15] << 8; /* GPS week number */
 
-                        gps_time_ok = true;
+                        gps->gps_time_ok = true;
 #if 0
                         /* For debug */
                         {
@@ -466,14 +503,14 @@ enum gps_msg lgw_parse_ubx(const char *serial_buff, size_t buff_size, size_t *ms
                             short ubx_gps_sec = 0; /* seconds (0-59) */
 
                             /* Format GPS time in hh:mm:ss based on iTOW */
-                            ubx_gps_sec = (gps_iTOW / 1000) % 60;
-                            ubx_gps_min = (gps_iTOW / 1000 / 60) % 60;
-                            ubx_gps_hou = (gps_iTOW / 1000 / 60 / 60) % 24;
+                            ubx_gps_sec = (gps->gps_iTOW / 1000) % 60;
+                            ubx_gps_min = (gps->gps_iTOW / 1000 / 60) % 60;
+                            ubx_gps_hou = (gps->gps_iTOW / 1000 / 60 / 60) % 24;
                             printf("  GPS time = %02d:%02d:%02d\n", ubx_gps_hou, ubx_gps_min, ubx_gps_sec);
                         }
 #endif
                     } else { /* valid */
-                        gps_time_ok = false;
+                        gps->gps_time_ok = false;
                     }
 
                     return UBX_NAV_TIMEGPS;
@@ -504,6 +541,7 @@ enum gps_msg lgw_parse_ubx(const char *serial_buff, size_t buff_size, size_t *ms
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 enum gps_msg lgw_parse_nmea(const char *serial_buff, int buff_size) {
+    struct lgw_gps_state_s *gps = lgw_ctx_current()->gps;
     int i, j, k;
     int str_index[30]; /* string index from the string chopping */
     int nb_fields; /* number of strings detected by string chopping */
@@ -540,25 +578,25 @@ enum gps_msg lgw_parse_nmea(const char *serial_buff, int buff_size) {
             return IGNORED;
         }
         /* parse GPS status */
-        gps_mod = *(parser_buf + str_index[12]); /* get first character, no need to bother with sscanf */
-        if ((gps_mod != 'N') && (gps_mod != 'A') && (gps_mod != 'D')) {
-            gps_mod = 'N';
+        gps->gps_mod = *(parser_buf + str_index[12]); /* get first character, no need to bother with sscanf */
+        if ((gps->gps_mod != 'N') && (gps->gps_mod != 'A') && (gps->gps_mod != 'D')) {
+            gps->gps_mod = 'N';
         }
         /* parse complete time */
-        i = sscanf(parser_buf + str_index[1], "%2hd%2hd%2hd%4f", &gps_hou, &gps_min, &gps_sec, &gps_fra);
-        j = sscanf(parser_buf + str_index[9], "%2hd%2hd%2hd", &gps_day, &gps_mon, &gps_yea);
+        i = sscanf(parser_buf + str_index[1], "%2hd%2hd%2hd%4f", &gps->gps_hou, &gps->gps_min, &gps->gps_sec, &gps->gps_fra);
+        j = sscanf(parser_buf + str_index[9], "%2hd%2hd%2hd", &gps->gps_day, &gps->gps_mon, &gps->gps_yea);
         if ((i == 4) && (j == 3)) {
-            if ((gps_mod == 'A') || (gps_mod == 'D')) {
-                gps_time_ok = true;
-                DEBUG_MSG("Note: Valid RMC sentence, GPS locked, date: 20%02d-%02d-%02dT%02d:%02d:%06.3fZ\n", gps_yea, gps_mon, gps_day, gps_hou, gps_min, gps_fra + (float)gps_sec);
+            if ((gps->gps_mod == 'A') || (gps->gps_mod == 'D')) {
+                gps->gps_time_ok = true;
+                DEBUG_MSG("Note: Valid RMC sentence, GPS locked, date: 20%02d-%02d-%02dT%02d:%02d:%06.3fZ\n", gps->gps_yea, gps->gps_mon, gps->gps_day, gps->gps_hou, gps->gps_min, gps->gps_fra + (float)gps->gps_sec);
             } else {
-                gps_time_ok = false;
-                DEBUG_MSG("Note: Valid RMC sentence, no satellite fix, estimated date: 20%02d-%02d-%02dT%02d:%02d:%06.3fZ\n", gps_yea, gps_mon, gps_day, gps_hou, gps_min, gps_fra + (float)gps_sec);
+                gps->gps_time_ok = false;
+                DEBUG_MSG("Note: Valid RMC sentence, no satellite fix, estimated date: 20%02d-%02d-%02dT%02d:%02d:%06.3fZ\n", gps->gps_yea, gps->gps_mon, gps->gps_day, gps->gps_hou, gps->gps_min, gps->gps_fra + (float)gps->gps_sec);
             }
         } else {
             /* could not get a valid hour AND date */
-            gps_time_ok = false;
-            DEBUG_MSG("Note: Valid RMC sentence, mode %c, no date\n", gps_mod);
+            gps->gps_time_ok = false;
+            DEBUG_MSG("Note: Valid RMC sentence, mode %c, no date\n", gps->gps_mod);
         }
         return NMEA_RMC;
     } else if (match_label(serial_buff, "$G?GGA", 6, '?')) {
@@ -574,20 +612,20 @@ enum gps_msg lgw_parse_nmea(const char *serial_buff, int buff_size) {
             return IGNORED;
         }
         /* parse number of satellites used for fix */
-        sscanf(parser_buf + str_index[7], "%hd", &gps_sat);
+        sscanf(parser_buf + str_index[7], "%hd", &gps->gps_sat);
         /* parse 3D coordinates */
-        i = sscanf(parser_buf + str_index[2], "%2hd%10lf", &gps_dla, &gps_mla);
-        gps_ola = *(parser_buf + str_index[3]);
-        j = sscanf(parser_buf + str_index[4], "%3hd%10lf", &gps_dlo, &gps_mlo);
-        gps_olo = *(parser_buf + str_index[5]);
-        k = sscanf(parser_buf + str_index[9], "%hd", &gps_alt);
-        if ((i == 2) && (j == 2) && (k == 1) && ((gps_ola=='N')||(gps_ola=='S')) && ((gps_olo=='E')||(gps_olo=='W'))) {
-            gps_pos_ok = true;
-            DEBUG_MSG("Note: Valid GGA sentence, %d sat, lat %02ddeg %06.3fmin %c, lon %03ddeg%06.3fmin %c, alt %d\n", gps_sat, gps_dla, gps_mla, gps_ola, gps_dlo, gps_mlo, gps_olo, gps_alt);
+        i = sscanf(parser_buf + str_index[2], "%2hd%10lf", &gps->gps_dla, &gps->gps_mla);
+        gps->gps_ola = *(parser_buf + str_index[3]);
+        j = sscanf(parser_buf + str_index[4], "%3hd%10lf", &gps->gps_dlo, &gps->gps_mlo);
+        gps->gps_olo = *(parser_buf + str_index[5]);
+        k = sscanf(parser_buf + str_index[9], "%hd", &gps->gps_alt);
+        if ((i == 2) && (j == 2) && (k == 1) && ((gps->gps_ola=='N')||(gps->gps_ola=='S')) && ((gps->gps_olo=='E')||(gps->gps_olo=='W'))) {
+            gps->gps_pos_ok = true;
+            DEBUG_MSG("Note: Valid GGA sentence, %d sat, lat %02ddeg %06.3fmin %c, lon %03ddeg%06.3fmin %c, alt %d\n", gps->gps_sat, gps->gps_dla, gps->gps_mla, gps->gps_ola, gps->gps_dlo, gps->gps_mlo, gps->gps_olo, gps->gps_alt);
         } else {
             /* could not get a valid latitude, longitude AND altitude */
-            gps_pos_ok = false;
-            DEBUG_MSG("Note: Valid GGA sentence, %d sat, no coordinates\n", gps_sat);
+            gps->gps_pos_ok = false;
+            DEBUG_MSG("Note: Valid GGA sentence, %d sat, no coordinates\n", gps->gps_sat);
         }
         return NMEA_GGA;
     } else {
@@ -599,55 +637,56 @@ enum gps_msg lgw_parse_nmea(const char *serial_buff, int buff_size) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_gps_get(struct timespec *utc, struct timespec *gps_time, struct coord_s *loc, struct coord_s *err) {
+    struct lgw_gps_state_s *gps = lgw_ctx_current()->gps;
     struct tm x;
     time_t y;
     double intpart, fractpart;
 
     if (utc != NULL) {
-        if (!gps_time_ok) {
+        if (!gps->gps_time_ok) {
             DEBUG_MSG("ERROR: NO VALID TIME TO RETURN\n");
             return LGW_GPS_ERROR;
         }
         memset(&x, 0, sizeof(x));
-        if (gps_yea < 100) { /* 2-digits year, 20xx */
-            x.tm_year = gps_yea + 100; /* 100 years offset to 1900 */
+        if (gps->gps_yea < 100) { /* 2-digits year, 20xx */
+            x.tm_year = gps->gps_yea + 100; /* 100 years offset to 1900 */
         } else { /* 4-digits year, Gregorian calendar */
-            x.tm_year = gps_yea - 1900;
+            x.tm_year = gps->gps_yea - 1900;
         }
-        x.tm_mon = gps_mon - 1; /* tm_mon is [0,11], gps_mon is [1,12] */
-        x.tm_mday = gps_day;
-        x.tm_hour = gps_hou;
-        x.tm_min = gps_min;
-        x.tm_sec = gps_sec;
+        x.tm_mon = gps->gps_mon - 1; /* tm_mon is [0,11], gps->gps_mon is [1,12] */
+        x.tm_mday = gps->gps_day;
+        x.tm_hour = gps->gps_hou;
+        x.tm_min = gps->gps_min;
+        x.tm_sec = gps->gps_sec;
         y = mktime(&x) - timezone; /* need to substract timezone bc mktime assumes time vector is local time */
         if (y == (time_t)(-1)) {
             DEBUG_MSG("ERROR: FAILED TO CONVERT BROKEN-DOWN TIME\n");
             return LGW_GPS_ERROR;
         }
         utc->tv_sec = y;
-        utc->tv_nsec = (int32_t)(gps_fra * 1e9);
+        utc->tv_nsec = (int32_t)(gps->gps_fra * 1e9);
     }
     if (gps_time != NULL) {
-        if (!gps_time_ok) {
+        if (!gps->gps_time_ok) {
             DEBUG_MSG("ERROR: NO VALID TIME TO RETURN\n");
             return LGW_GPS_ERROR;
         }
-        fractpart = modf(((double)gps_iTOW / 1E3) + ((double)gps_fTOW / 1E9), &intpart);
+        fractpart = modf(((double)gps->gps_iTOW / 1E3) + ((double)gps->gps_fTOW / 1E9), &intpart);
         /* Number of seconds since beginning on current GPS week */
         gps_time->tv_sec = (time_t)intpart;
         /* Number of seconds since GPS epoch 06.Jan.1980 */
-        gps_time->tv_sec += (time_t)gps_week * 604800; /* day*hours*minutes*secondes: 7*24*60*60; */
+        gps_time->tv_sec += (time_t)gps->gps_week * 604800; /* day*hours*minutes*secondes: 7*24*60*60; */
         /* Fractional part in nanoseconds */
         gps_time->tv_nsec = (long)(fractpart * 1E9);
     }
     if (loc != NULL) {
-        if (!gps_pos_ok) {
+        if (!gps->gps_pos_ok) {
             DEBUG_MSG("ERROR: NO VALID POSITION TO RETURN\n");
             return LGW_GPS_ERROR;
         }
-        loc->lat = ((double)gps_dla + (gps_mla/60.0)) * ((gps_ola == 'N')?1.0:-1.0);
-        loc->lon = ((double)gps_dlo + (gps_mlo/60.0)) * ((gps_olo == 'E')?1.0:-1.0);
-        loc->alt = gps_alt;
+        loc->lat = ((double)gps->gps_dla + (gps->gps_mla/60.0)) * ((gps->gps_ola == 'N')?1.0:-1.0);
+        loc->lon = ((double)gps->gps_dlo + (gps->gps_mlo/60.0)) * ((gps->gps_olo == 'E')?1.0:-1.0);
+        loc->alt = gps->gps_alt;
     }
     if (err != NULL) {
         DEBUG_MSG("Warning: localization error processing not implemented yet\n");
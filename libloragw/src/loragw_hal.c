@@ -17,11 +17,24 @@ Maintainer: Sylvain Miermont
 /* -------------------------------------------------------------------------- */
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
 #include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc free */
+#include <stddef.h>     /* offsetof */
 #include <string.h>     /* memcpy */
+#include <unistd.h>     /* close */
+#include <time.h>       /* time */
 #include <math.h>       /* pow, cell */
+#include <pthread.h>    /* recursive mutex serializing the public functions */
+#include <sys/timerfd.h> /* timerfd_create timerfd_settime */
 
 #include "loragw_reg.h"
 #include "loragw_hal.h"
@@ -30,6 +43,7 @@ Maintainer: Sylvain Miermont
 #include "loragw_radio.h"
 #include "loragw_fpga.h"
 #include "loragw_lbt.h"
+#include "loragw_ctx.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -87,9 +101,162 @@ Maintainer: Sylvain Miermont
 
 #define TX_START_DELAY_DEFAULT  1497 /* Calibrated value for 500KHz BW and notch filter disabled */
 
+#define TSTAMP_SF_MIN       6 /* lowest spreading factor the LoRa timestamp correction applies to */
+#define TSTAMP_SF_NB        7 /* SF6 to SF12 */
+#define TSTAMP_LEN_NB       (255 + 2 + 1) /* payload size plus 2 CRC bytes, from 0 to 257 */
+#define TSTAMP_LORA_MULTI   0 /* index in timestamp correction tables: 'multi' modems */
+#define TSTAMP_LORA_STD     1 /* index in timestamp correction tables: stand-alone modem */
+
+#if LGW_RX_POOL_SIZE == 64
+    #define RX_POOL_ALL_FREE    0xFFFFFFFFFFFFFFFFULL
+#elif LGW_RX_POOL_SIZE < 64
+    #define RX_POOL_ALL_FREE    ((1ULL << LGW_RX_POOL_SIZE) - 1)
+#else
+    #error "LGW_RX_POOL_SIZE must not exceed 64"
+#endif
+
+#define RX_POLL_MIN_MS      1 /* lgw_receive_wait poll interval right after packets were fetched */
+#define RX_POLL_MAX_MS      100 /* upper bound of the idle poll interval, whatever the channel plan */
+#define RX_POLL_MIN_PAYLOAD 12 /* shortest uplink considered: LoRaWAN MAC header, frame header and MIC */
+
+#define TX_WAIT_POLL_MS     1 /* lgw_send_wait poll interval once the expected end of TX is past */
+#define TX_WAIT_POLL_ANY_MS 5 /* lgw_send_wait poll interval when the end of TX is unknown */
+#define CNT_SYNC_MAX_AGE_US 10000000 /* counter/host time pair older than that is not trusted to locate a TIMESTAMPED packet */
+#define CNT_SYNC_PPS_GUARD_US 100000 /* lgw_get_instcnt_est does not read the counter closer than that to an expected GPS pulse */
+
+#define CALCACHE_MAGIC      0x4C43414C /* "LCAL", starts a calibration cache file */
+#define CALCACHE_VERSION    2 /* calibration cache file layout, to bump whenever calcache_entry_s changes */
+#define CALCACHE_NB         8 /* radio configurations kept in the calibration cache file */
+#define CALCACHE_IQ_NB      5 /* RX IQ mismatch compensation registers set by the calibration */
+
+#define RADIO_READY_MIN_MS  5 /* radios are not polled before that delay after being switched on (power-on reset) */
+#define RADIO_READY_MAX_MS  500 /* former fixed delay, the radio reset goes on after it even if the PLL did not lock */
+
+#define CAL_POLL_MS         10 /* calibration status polling period */
+#define CAL_TIME_MAX_MS     3000 /* calibration measured between 2.1 and 2.2 sec with 1 TX, given up after that */
+
 /* constant arrays defining hardware capability */
 const uint8_t ifmod_config[LGW_IF_CHAIN_NB] = LGW_IFMODEM_CONFIG;
 
+/* constant arrays decoding RX metadata fields */
+static const uint8_t rx_stat_lut[8] = { STAT_UNDEFINED, STAT_NO_CRC, STAT_UNDEFINED, STAT_UNDEFINED, STAT_UNDEFINED, STAT_CRC_OK, STAT_UNDEFINED, STAT_CRC_BAD }; /* indexed by FIFO CRC status */
+static const uint8_t rx_crc_en_lut[8] = { 0, 0, 0, 0, 0, 1, 0, 1 }; /* CRC bytes present, indexed by FIFO CRC status */
+static const uint8_t rx_lora_dr_lut[16] = { DR_UNDEFINED, DR_UNDEFINED, DR_UNDEFINED, DR_UNDEFINED, DR_UNDEFINED, DR_UNDEFINED, DR_UNDEFINED, DR_LORA_SF7, DR_LORA_SF8, DR_LORA_SF9, DR_LORA_SF10, DR_LORA_SF11, DR_LORA_SF12, DR_UNDEFINED, DR_UNDEFINED, DR_UNDEFINED }; /* indexed by SF */
+static const uint8_t rx_lora_cr_lut[8] = { CR_UNDEFINED, CR_LORA_4_5, CR_LORA_4_6, CR_LORA_4_7, CR_LORA_4_8, CR_UNDEFINED, CR_UNDEFINED, CR_UNDEFINED }; /* indexed by CR */
+
+/* LoRa timestamp correction for one modem type, see lgw_rx_tables_setup */
+struct tstamp_lora_s {
+    bool        valid;                              /* false if the modem bandwidth is not supported */
+    uint8_t     bw_shift;                           /* log2(bandwidth / 125kHz), replaces the division */
+    uint16_t    base[TSTAMP_SF_NB];                 /* base + preamble delay, payload longer than the first 8 symbols */
+    uint16_t    base_short[TSTAMP_SF_NB];           /* base + preamble delay, payload within the first 8 symbols */
+    uint8_t     sym[TSTAMP_SF_NB][TSTAMP_LEN_NB];   /* symbols in the last interleaving block, 0 if payload within the first 8 symbols */
+};
+
+/* header of the calibration cache file, followed by nb entries */
+struct calcache_head_s {
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    entry_size;                 /* sizeof (struct calcache_entry_s) of the writer */
+    uint32_t    nb;
+};
+
+/* calibration results of one radio configuration, as stored in the calibration cache file */
+struct calcache_entry_s {
+    char        board[LGW_CTX_PATH_SIZE];   /* SPI device of the concentrator, several ones may share the file */
+    uint8_t     fw_version;                 /* calibration firmware that produced the results */
+    uint8_t     cal_cmd;                    /* calibration command: radios, TX calibration, radio type */
+    uint8_t     clksrc;
+    uint8_t     status;                     /* calibration status */
+    uint32_t    rx_freq[LGW_RF_CHAIN_NB];   /* absolute, in Hz */
+    int64_t     time;                       /* when the calibration ran, seconds since the Epoch */
+    int8_t      offset_a_i[8];              /* TX DC offsets */
+    int8_t      offset_a_q[8];
+    int8_t      offset_b_i[8];
+    int8_t      offset_b_q[8];
+    int32_t     iq_mismatch[CALCACHE_IQ_NB];
+};
+
+/*
+The following members are the configuration set that the user can modify using
+rxrf_setconf, rxif_setconf and txgain_setconf functions. The functions _start
+and _send then use that set to configure the hardware.
+
+Parameters validity and coherency is verified by the _setconf functions and
+the _start and _send functions assume they are valid.
+
+One set per concentrator context, see loragw_ctx.h.
+*/
+struct lgw_hal_state_s {
+    bool        lgw_is_started;
+
+    bool        rf_enable[LGW_RF_CHAIN_NB];
+    uint32_t    rf_rx_freq[LGW_RF_CHAIN_NB];            /* absolute, in Hz */
+    float       rf_rssi_offset[LGW_RF_CHAIN_NB];
+    bool        rf_tx_enable[LGW_RF_CHAIN_NB];
+    uint32_t    rf_tx_notch_freq[LGW_RF_CHAIN_NB];
+    enum lgw_radio_type_e rf_radio_type[LGW_RF_CHAIN_NB];
+
+    bool        if_enable[LGW_IF_CHAIN_NB];
+    bool        if_rf_chain[LGW_IF_CHAIN_NB];           /* for each IF, 0 -> radio A, 1 -> radio B */
+    int32_t     if_freq[LGW_IF_CHAIN_NB];               /* relative to radio frequency, +/- in Hz */
+
+    uint8_t     lora_multi_sfmask[LGW_MULTI_NB];        /* enables SF for LoRa 'multi' modems */
+
+    uint8_t     lora_rx_bw;                             /* bandwidth setting for LoRa standalone modem */
+    uint8_t     lora_rx_sf;                             /* spreading factor setting for LoRa standalone modem */
+    bool        lora_rx_ppm_offset;
+
+    uint8_t     fsk_rx_bw;                              /* bandwidth setting of FSK modem */
+    uint32_t    fsk_rx_dr;                              /* FSK modem datarate in bauds */
+    uint8_t     fsk_sync_word_size;                     /* number of bytes for FSK sync word */
+    uint64_t    fsk_sync_word;                          /* FSK sync word (ALIGNED RIGHT, MSbit first) */
+
+    bool        lorawan_public;
+    uint8_t     rf_clkout;
+
+    struct lgw_tx_gain_lut_s txgain_lut;
+
+    /* TX I/Q imbalance coefficients for mixer gain = 8 to 15 */
+    int8_t      cal_offset_a_i[8];                      /* TX I offset for radio A */
+    int8_t      cal_offset_a_q[8];                      /* TX Q offset for radio A */
+    int8_t      cal_offset_b_i[8];                      /* TX I offset for radio B */
+    int8_t      cal_offset_b_q[8];                      /* TX Q offset for radio B */
+
+    uint32_t    cal_rx_freq[LGW_RF_CHAIN_NB];           /* RX frequency of each radio at the last calibration, absolute, in Hz */
+
+    struct lgw_conf_calcache_s calcache_conf;           /* calibration cache, disabled unless lgw_calcache_setconf is called */
+
+    struct lgw_rx_stats_s rx_stats;                     /* RX FIFO drain statistics */
+
+    bool        rx_tables_ready;
+    struct tstamp_lora_s tstamp_lora[2];                /* indexed by TSTAMP_LORA_MULTI or TSTAMP_LORA_STD */
+    uint32_t    tstamp_fsk;                             /* FSK modem timestamp correction */
+
+    /* zero-copy RX buffer pool, a buffer is free when its bit is set */
+    uint8_t     rx_pool_data[LGW_RX_POOL_SIZE][255+RX_METADATA_NB];
+    uint8_t     rx_pool_ref[LGW_RX_POOL_SIZE];
+    uint64_t    rx_pool_free;
+
+    bool        tx_end_valid;                           /* false if the end of the last TX is unknown (ON_GPS) */
+    uint64_t    tx_end_us;                              /* expected end of the last TX, monotonic host time */
+    int         tx_notify_fd;                           /* timerfd armed on the expected end of each TX */
+
+    bool        cnt_sync_valid;                         /* concentrator counter read by the last lgw_get_instcnt, and host time then */
+    uint32_t    cnt_sync_us;
+    uint64_t    cnt_sync_host_us;
+
+    uint32_t    rx_poll_ms;                             /* current lgw_receive_wait poll interval */
+    uint32_t    rx_poll_max_ms;                         /* idle poll interval, computed from the channel plan by lgw_start */
+
+    /* the RX thread and the application may call the HAL concurrently, the SPI
+    link, the register cache and the page register are shared by all calls */
+    pthread_mutex_t hal_mutex;
+};
+
+/* registers written by the calibration firmware, in calcache_entry_s.iq_mismatch order */
+static const uint16_t calcache_iq_reg[CALCACHE_IQ_NB] = { LGW_IQ_MISMATCH_A_AMP_COEFF, LGW_IQ_MISMATCH_A_PHI_COEFF, LGW_IQ_MISMATCH_B_AMP_COEFF, LGW_IQ_MISMATCH_B_SEL_I, LGW_IQ_MISMATCH_B_PHI_COEFF };
+
 /* Version string, used to identify the library version/options once compiled */
 const char lgw_version_string[] = "Version: " LIBLORAGW_VERSION ";";
 
@@ -100,64 +267,38 @@ const char lgw_version_string[] = "Version: " LIBLORAGW_VERSION ";";
 #include "agc_fw.var" /* external definition of the variable */
 #include "cal_fw.var" /* external definition of the variable */
 
-/*
-The following static variables are the configuration set that the user can
-modify using rxrf_setconf, rxif_setconf and txgain_setconf functions.
-The functions _start and _send then use that set to configure the hardware.
-
-Parameters validity and coherency is verified by the _setconf functions and
-the _start and _send functions assume they are valid.
-*/
-
-static bool lgw_is_started;
-
-static bool rf_enable[LGW_RF_CHAIN_NB];
-static uint32_t rf_rx_freq[LGW_RF_CHAIN_NB]; /* absolute, in Hz */
-static float rf_rssi_offset[LGW_RF_CHAIN_NB];
-static bool rf_tx_enable[LGW_RF_CHAIN_NB];
-static uint32_t rf_tx_notch_freq[LGW_RF_CHAIN_NB];
-static enum lgw_radio_type_e rf_radio_type[LGW_RF_CHAIN_NB];
-
-static bool if_enable[LGW_IF_CHAIN_NB];
-static bool if_rf_chain[LGW_IF_CHAIN_NB]; /* for each IF, 0 -> radio A, 1 -> radio B */
-static int32_t if_freq[LGW_IF_CHAIN_NB]; /* relative to radio frequency, +/- in Hz */
-
-static uint8_t lora_multi_sfmask[LGW_MULTI_NB]; /* enables SF for LoRa 'multi' modems */
-
-static uint8_t lora_rx_bw; /* bandwidth setting for LoRa standalone modem */
-static uint8_t lora_rx_sf; /* spreading factor setting for LoRa standalone modem */
-static bool lora_rx_ppm_offset;
-
-static uint8_t fsk_rx_bw; /* bandwidth setting of FSK modem */
-static uint32_t fsk_rx_dr; /* FSK modem datarate in bauds */
-static uint8_t fsk_sync_word_size = 3; /* default number of bytes for FSK sync word */
-static uint64_t fsk_sync_word= 0xC194C1; /* default FSK sync word (ALIGNED RIGHT, MSbit first) */
-
-static bool lorawan_public = false;
-static uint8_t rf_clkout = 0;
-
-static struct lgw_tx_gain_lut_s txgain_lut = {
-    .size = 2,
-    .lut[0] = {
-        .dig_gain = 0,
-        .pa_gain = 2,
-        .dac_gain = 3,
-        .mix_gain = 10,
-        .rf_power = 14
-    },
-    .lut[1] = {
-        .dig_gain = 0,
-        .pa_gain = 3,
-        .dac_gain = 3,
-        .mix_gain = 14,
-        .rf_power = 27
-    }};
-
-/* TX I/Q imbalance coefficients for mixer gain = 8 to 15 */
-static int8_t cal_offset_a_i[8]; /* TX I offset for radio A */
-static int8_t cal_offset_a_q[8]; /* TX Q offset for radio A */
-static int8_t cal_offset_b_i[8]; /* TX I offset for radio B */
-static int8_t cal_offset_b_q[8]; /* TX Q offset for radio B */
+/* initial HAL state of each concentrator context */
+static const struct lgw_hal_state_s hal_state_init = {
+    .fsk_sync_word_size = 3, /* default number of bytes for FSK sync word */
+    .fsk_sync_word = 0xC194C1, /* default FSK sync word (ALIGNED RIGHT, MSbit first) */
+    .lorawan_public = false,
+    .rf_clkout = 0,
+    .txgain_lut = {
+        .size = 2,
+        .lut[0] = {
+            .dig_gain = 0,
+            .pa_gain = 2,
+            .dac_gain = 3,
+            .mix_gain = 10,
+            .rf_power = 14
+        },
+        .lut[1] = {
+            .dig_gain = 0,
+            .pa_gain = 3,
+            .dac_gain = 3,
+            .mix_gain = 14,
+            .rf_power = 27
+        }},
+    .rx_tables_ready = false,
+    .rx_pool_free = RX_POOL_ALL_FREE,
+    .tx_end_valid = false,
+    .tx_notify_fd = -1,
+    .cnt_sync_valid = false,
+    .rx_poll_ms = RX_POLL_MIN_MS,
+    .rx_poll_max_ms = RX_POLL_MAX_MS
+};
+
+static struct lgw_hal_state_s hal_state_dflt; /* state of the default context */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
@@ -169,9 +310,54 @@ void lgw_constant_adjust(void);
 int32_t lgw_sf_getval(int x);
 int32_t lgw_bw_getval(int x);
 
+static void hal_lock(void);
+static void hal_unlock(void);
+
+static void lgw_rx_poll_setup(void);
+
+static int cnt_sync_read(struct lgw_hal_state_s *hal);
+
+static void tx_preamble_adjust(struct lgw_pkt_tx_s *pkt);
+
+static void lgw_tx_end_setup(struct lgw_pkt_tx_s *pkt);
+static void lgw_tx_notify_arm(void);
+
+static uint32_t tstamp_lora_correction(const struct tstamp_lora_s *t, uint32_t sf, uint32_t cr, uint32_t len);
+
+static void lgw_radio_wait_ready(void);
+static void calcache_key(struct calcache_entry_s *e, uint8_t cal_cmd);
+static bool calcache_match(const struct calcache_entry_s *a, const struct calcache_entry_s *b);
+static int calcache_read(const char *path, struct calcache_entry_s *table);
+static bool calcache_load(uint8_t cal_cmd);
+static void calcache_save(uint8_t cal_cmd, uint8_t cal_status);
+static int lgw_calibrate(uint8_t cal_cmd, uint8_t *status);
+
+static void lgw_freq_drift_setup(void);
+static int lgw_start_nolock(void);
+static bool rx_decode(const uint8_t *buff, unsigned sz, int stat_fifo, struct lgw_pkt_rx_ref_s *p);
+static void rx_meta_copy(struct lgw_pkt_rx_s *p, const struct lgw_pkt_rx_ref_s *m);
+static int rx_pool_alloc(void);
+static void rx_pool_put(struct lgw_hal_state_s *hal, int i);
+static struct lgw_hal_state_s *rx_pool_owner(const struct lgw_pkt_rx_ref_s *pkt);
+static int rx_fetch(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, struct lgw_pkt_rx_ref_s *ref_data);
+static int rx_wait(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, struct lgw_pkt_rx_ref_s *ref_data, int timeout_ms);
+static int lgw_send_nolock(struct lgw_pkt_tx_s pkt_data);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+static void hal_lock(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    pthread_mutex_lock(&hal->hal_mutex);
+}
+
+static void hal_unlock(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    pthread_mutex_unlock(&hal->hal_mutex);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* size is the firmware size in bytes (not 14b words) */
 int load_firmware(uint8_t target, uint8_t *firmware, uint16_t size) {
     int reg_rst;
@@ -227,6 +413,7 @@ int load_firmware(uint8_t target, uint8_t *firmware, uint16_t size) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 void lgw_constant_adjust(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
 
     /* I/Q path setup */
     // lgw_reg_w(LGW_RX_INVERT_IQ,0); /* default 0 */
@@ -270,7 +457,7 @@ void lgw_constant_adjust(void) {
     // lgw_reg_w(LGW_SYNCH_DETECT_TH,1); /* default 1 */
     // lgw_reg_w(LGW_ZERO_PAD,0); /* default 0 */
     lgw_reg_w(LGW_SNR_AVG_CST,3); /* default 2 */
-    if (lorawan_public) { /* LoRa network */
+    if (hal->lorawan_public) { /* LoRa network */
         lgw_reg_w(LGW_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
         lgw_reg_w(LGW_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
     } else { /* private network */
@@ -292,7 +479,7 @@ void lgw_constant_adjust(void) {
     // lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_GAIN,1); /* default 1 */
     // lgw_reg_w(LGW_MBWSSF_SYNCH_DETECT_TH,1); /* default 1 */
     // lgw_reg_w(LGW_MBWSSF_ZERO_PAD,0); /* default 0 */
-    if (lorawan_public) { /* LoRa network */
+    if (hal->lorawan_public) { /* LoRa network */
         lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
         lgw_reg_w(LGW_MBWSSF_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
     } else {
@@ -333,7 +520,7 @@ void lgw_constant_adjust(void) {
     /* TX LoRa */
     // lgw_reg_w(LGW_TX_MODE,0); /* default 0 */
     lgw_reg_w(LGW_TX_SWAP_IQ,1); /* "normal" polarity; default 0 */
-    if (lorawan_public) { /* LoRa network */
+    if (hal->lorawan_public) { /* LoRa network */
         lgw_reg_w(LGW_TX_FRAME_SYNCH_PEAK1_POS,3); /* default 1 */
         lgw_reg_w(LGW_TX_FRAME_SYNCH_PEAK2_POS,4); /* default 2 */
     } else { /* Private network */
@@ -409,22 +596,294 @@ uint16_t lgw_get_tx_start_delay(bool tx_notch_enable, uint8_t bw) {
     return (uint16_t)tx_start_delay; /* keep truncating instead of rounding: better behaviour measured */
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint32_t tstamp_lora_correction(const struct tstamp_lora_s *t, uint32_t sf, uint32_t cr, uint32_t len) {
+    uint32_t i = sf - TSTAMP_SF_MIN; /* wraps for SF below the minimum */
+    uint32_t nb_sym;
+
+    if ((t->valid == false) || (i >= TSTAMP_SF_NB) || (len >= TSTAMP_LEN_NB)) {
+        DEBUG_MSG("WARNING: invalid packet, no timestamp correction\n");
+        return 0;
+    }
+
+    nb_sym = t->sym[i][len];
+    if (nb_sym == 0) { /* payload fits entirely in first 8 symbols */
+        return t->base_short[i] + ((32 * (2*len + 5)) >> t->bw_shift);
+    } else {
+        return t->base[i] + (((16 + 4*cr) * nb_sym) >> t->bw_shift);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool rx_decode(const uint8_t *buff, unsigned sz, int stat_fifo, struct lgw_pkt_rx_ref_s *p) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    int ifmod; /* type of if_chain/modem a packet was received by */
+    uint32_t raw_timestamp; /* timestamp when internal 'RX finished' was triggered */
+    uint32_t timestamp_correction; /* correction to account for processing delay */
+    uint32_t sf, cr; /* used to calculate timestamp correction */
+
+    p->size = sz;
+
+    /* process metadata */
+    p->if_chain = buff[sz+0];
+    if (p->if_chain >= LGW_IF_CHAIN_NB) {
+        DEBUG_PRINTF("WARNING: %u NOT A VALID IF_CHAIN NUMBER, ABORTING\n", p->if_chain);
+        return false;
+    }
+    ifmod = ifmod_config[p->if_chain];
+    DEBUG_PRINTF("[%d %d]\n", p->if_chain, ifmod);
+
+    p->rf_chain = (uint8_t)hal->if_rf_chain[p->if_chain];
+    p->freq_hz = (uint32_t)((int32_t)hal->rf_rx_freq[p->rf_chain] + hal->if_freq[p->if_chain]);
+    p->rssi = (float)buff[sz+5] + hal->rf_rssi_offset[p->rf_chain];
+
+    if ((ifmod == IF_LORA_MULTI) || (ifmod == IF_LORA_STD)) {
+        DEBUG_MSG("Note: LoRa packet\n");
+        p->status = rx_stat_lut[stat_fifo & 0x07];
+        p->modulation = MOD_LORA;
+        p->snr = ((float)((int8_t)buff[sz+2]))/4;
+        p->snr_min = ((float)((int8_t)buff[sz+3]))/4;
+        p->snr_max = ((float)((int8_t)buff[sz+4]))/4;
+        if (ifmod == IF_LORA_MULTI) {
+            p->bandwidth = BW_125KHZ; /* fixed in hardware */
+        } else {
+            p->bandwidth = hal->lora_rx_bw; /* get the parameter from the config variable */
+        }
+        sf = (buff[sz+1] >> 4) & 0x0F;
+        p->datarate = rx_lora_dr_lut[sf];
+        cr = (buff[sz+1] >> 1) & 0x07;
+        p->coderate = rx_lora_cr_lut[cr];
+
+        /* timestamp correction, CRC bytes count as payload */
+        timestamp_correction = tstamp_lora_correction(&hal->tstamp_lora[(ifmod == IF_LORA_STD) ? TSTAMP_LORA_STD : TSTAMP_LORA_MULTI], sf, cr, sz + 2*rx_crc_en_lut[stat_fifo & 0x07]);
+
+        /* RSSI correction */
+        if (ifmod == IF_LORA_MULTI) {
+            p->rssi -= RSSI_MULTI_BIAS;
+        }
+
+    } else if (ifmod == IF_FSK_STD) {
+        DEBUG_MSG("Note: FSK packet\n");
+        p->status = rx_stat_lut[stat_fifo & 0x07];
+        p->modulation = MOD_FSK;
+        p->snr = -128.0;
+        p->snr_min = -128.0;
+        p->snr_max = -128.0;
+        p->bandwidth = hal->fsk_rx_bw;
+        p->datarate = hal->fsk_rx_dr;
+        p->coderate = CR_UNDEFINED;
+        timestamp_correction = hal->tstamp_fsk;
+
+        /* RSSI correction, not tabulated: pow(x, 2) compiles to a multiply and
+           a 256-entry table per RF chain measured no faster (~0.5 ns per packet) */
+        p->rssi = RSSI_FSK_POLY_0 + RSSI_FSK_POLY_1 * p->rssi + RSSI_FSK_POLY_2 * pow(p->rssi, 2);
+    } else {
+        DEBUG_MSG("ERROR: UNEXPECTED PACKET ORIGIN\n");
+        p->status = STAT_UNDEFINED;
+        p->modulation = MOD_UNDEFINED;
+        p->rssi = -128.0;
+        p->snr = -128.0;
+        p->snr_min = -128.0;
+        p->snr_max = -128.0;
+        p->bandwidth = BW_UNDEFINED;
+        p->datarate = DR_UNDEFINED;
+        p->coderate = CR_UNDEFINED;
+        timestamp_correction = 0;
+    }
+
+    raw_timestamp = (uint32_t)buff[sz+6] + ((uint32_t)buff[sz+7] << 8) + ((uint32_t)buff[sz+8] << 16) + ((uint32_t)buff[sz+9] << 24);
+    p->count_us = raw_timestamp - timestamp_correction;
+    p->crc = (uint16_t)buff[sz+10] + ((uint16_t)buff[sz+11] << 8);
+
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void rx_meta_copy(struct lgw_pkt_rx_s *p, const struct lgw_pkt_rx_ref_s *m) {
+    p->freq_hz = m->freq_hz;
+    p->if_chain = m->if_chain;
+    p->status = m->status;
+    p->count_us = m->count_us;
+    p->rf_chain = m->rf_chain;
+    p->modulation = m->modulation;
+    p->bandwidth = m->bandwidth;
+    p->datarate = m->datarate;
+    p->coderate = m->coderate;
+    p->rssi = m->rssi;
+    p->snr = m->snr;
+    p->snr_min = m->snr_min;
+    p->snr_max = m->snr_max;
+    p->crc = m->crc;
+    p->size = m->size;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int rx_pool_alloc(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    uint64_t mask;
+    int i;
+
+    /* only called with the HAL lock held: a single allocator, releases only set bits */
+    mask = __atomic_load_n(&hal->rx_pool_free, __ATOMIC_ACQUIRE);
+    if (mask == 0) {
+        return -1;
+    }
+    i = __builtin_ctzll(mask);
+    __atomic_fetch_and(&hal->rx_pool_free, ~(1ULL << i), __ATOMIC_ACQ_REL);
+    __atomic_store_n(&hal->rx_pool_ref[i], 1, __ATOMIC_RELAXED);
+    return i;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void rx_pool_put(struct lgw_hal_state_s *hal, int i) {
+    if (__atomic_sub_fetch(&hal->rx_pool_ref[i], 1, __ATOMIC_ACQ_REL) == 0) {
+        __atomic_fetch_or(&hal->rx_pool_free, 1ULL << i, __ATOMIC_RELEASE);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* the HAL state whose pool holds the payload, not the context selected by the
+   calling thread: a consumer thread may release packets of any concentrator */
+static struct lgw_hal_state_s *rx_pool_owner(const struct lgw_pkt_rx_ref_s *pkt) {
+    const uint8_t *row = pkt->payload - (size_t)pkt->pool_idx * (255+RX_METADATA_NB); /* rx_pool_data[0] */
+
+    return (struct lgw_hal_state_s *)(row - offsetof(struct lgw_hal_state_s, rx_pool_data));
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void lgw_rx_poll_setup(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    struct lgw_pkt_tx_s pkt;
+    uint32_t toa;
+    uint32_t toa_min = 0;
+    int nb_modem = 0;
+    int i;
+
+    /* find the shortest packet any enabled modem can receive */
+    memset(&pkt, 0, sizeof pkt);
+    pkt.coderate = CR_LORA_4_5;
+    pkt.size = RX_POLL_MIN_PAYLOAD;
+    for (i = 0; i < LGW_IF_CHAIN_NB; ++i) {
+        if (hal->if_enable[i] == false) {
+            continue;
+        }
+        switch (ifmod_config[i]) {
+            case IF_LORA_MULTI:
+                pkt.modulation = MOD_LORA;
+                pkt.bandwidth = BW_125KHZ;
+                pkt.datarate = (uint8_t)(hal->lora_multi_sfmask[i] & -hal->lora_multi_sfmask[i]); /* lowest enabled SF */
+                pkt.preamble = STD_LORA_PREAMBLE;
+                break;
+            case IF_LORA_STD:
+                pkt.modulation = MOD_LORA;
+                pkt.bandwidth = hal->lora_rx_bw;
+                pkt.datarate = hal->lora_rx_sf;
+                pkt.preamble = STD_LORA_PREAMBLE;
+                break;
+            case IF_FSK_STD:
+                pkt.modulation = MOD_FSK;
+                pkt.datarate = hal->fsk_rx_dr;
+                pkt.preamble = STD_FSK_PREAMBLE;
+                break;
+            default:
+                continue;
+        }
+        toa = lgw_time_on_air(&pkt);
+        if (toa == 0) {
+            continue;
+        }
+        nb_modem += 1;
+        if ((toa_min == 0) || (toa < toa_min)) {
+            toa_min = toa;
+        }
+    }
+
+    /* time for the FIFO to fill up if all modems complete packets back-to-back, halved for margin */
+    if (nb_modem > 0) {
+        hal->rx_poll_max_ms = (toa_min * LGW_PKT_FIFO_SIZE) / (2 * nb_modem);
+    } else {
+        hal->rx_poll_max_ms = RX_POLL_MAX_MS;
+    }
+    if (hal->rx_poll_max_ms < RX_POLL_MIN_MS) {
+        hal->rx_poll_max_ms = RX_POLL_MIN_MS;
+    } else if (hal->rx_poll_max_ms > RX_POLL_MAX_MS) {
+        hal->rx_poll_max_ms = RX_POLL_MAX_MS;
+    }
+    hal->rx_poll_ms = RX_POLL_MIN_MS;
+
+    DEBUG_PRINTF("Note: shortest packet %u ms on %d modem(s), idle RX poll interval %u ms\n", toa_min, nb_modem, hal->rx_poll_max_ms);
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
+struct lgw_hal_state_s *lgw_hal_state_new(bool dflt) {
+    struct lgw_hal_state_s *state;
+    pthread_mutexattr_t attr;
+
+    state = (dflt == true) ? &hal_state_dflt : malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
+    }
+    *state = hal_state_init;
+
+    /* recursive: lgw_send calls lgw_abort_tx and, through LBT, lgw_get_trigcnt */
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&state->hal_mutex, &attr);
+    pthread_mutexattr_destroy(&attr);
+
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_hal_state_free(struct lgw_hal_state_s *state) {
+    if ((state == NULL) || (state == &hal_state_dflt)) {
+        return;
+    }
+    if (state->tx_notify_fd >= 0) {
+        close(state->tx_notify_fd);
+    }
+    pthread_mutex_destroy(&state->hal_mutex);
+    free(state);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_hal_state_lock(struct lgw_hal_state_s *state) {
+    pthread_mutex_lock(&state->hal_mutex);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_hal_state_unlock(struct lgw_hal_state_s *state) {
+    pthread_mutex_unlock(&state->hal_mutex);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_board_setconf(struct lgw_conf_board_s conf) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
 
     /* check if the concentrator is running */
-    if (lgw_is_started == true) {
+    if (hal->lgw_is_started == true) {
         DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
         return LGW_HAL_ERROR;
     }
 
     /* set internal config according to parameters */
-    lorawan_public = conf.lorawan_public;
-    rf_clkout = conf.clksrc;
+    hal->lorawan_public = conf.lorawan_public;
+    hal->rf_clkout = conf.clksrc;
 
-    DEBUG_PRINTF("Note: board configuration; lorawan_public:%d, clksrc:%d\n", lorawan_public, rf_clkout);
+    DEBUG_PRINTF("Note: board configuration; lorawan_public:%d, clksrc:%d\n", hal->lorawan_public, hal->rf_clkout);
 
     return LGW_HAL_SUCCESS;
 }
@@ -432,10 +891,11 @@ int lgw_board_setconf(struct lgw_conf_board_s conf) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_lbt_setconf(struct lgw_conf_lbt_s conf) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
     int x;
 
     /* check if the concentrator is running */
-    if (lgw_is_started == true) {
+    if (hal->lgw_is_started == true) {
         DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
         return LGW_HAL_ERROR;
     }
@@ -451,10 +911,35 @@ int lgw_lbt_setconf(struct lgw_conf_lbt_s conf) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_calcache_setconf(struct lgw_conf_calcache_s conf) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+
+    /* check if the concentrator is running */
+    if (hal->lgw_is_started == true) {
+        DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
+        return LGW_HAL_ERROR;
+    }
+
+    /* check input parameters */
+    if ((conf.enable == true) && ((conf.path[0] == '\0') || (memchr(conf.path, '\0', sizeof conf.path) == NULL))) {
+        DEBUG_MSG("ERROR: NOT A VALID CALIBRATION CACHE FILE PATH\n");
+        return LGW_HAL_ERROR;
+    }
+
+    hal->calcache_conf = conf;
+
+    DEBUG_PRINTF("Note: calibration cache configuration; enable:%d, path:%s, max_age_s:%u\n", conf.enable, conf.enable ? conf.path : "", conf.max_age_s);
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
 
     /* check if the concentrator is running */
-    if (lgw_is_started == true) {
+    if (hal->lgw_is_started == true) {
         DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
         return LGW_HAL_ERROR;
     }
@@ -478,14 +963,14 @@ int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
     }
 
     /* set internal config according to parameters */
-    rf_enable[rf_chain] = conf.enable;
-    rf_rx_freq[rf_chain] = conf.freq_hz;
-    rf_rssi_offset[rf_chain] = conf.rssi_offset;
-    rf_radio_type[rf_chain] = conf.type;
-    rf_tx_enable[rf_chain] = conf.tx_enable;
-    rf_tx_notch_freq[rf_chain] = conf.tx_notch_freq;
+    hal->rf_enable[rf_chain] = conf.enable;
+    hal->rf_rx_freq[rf_chain] = conf.freq_hz;
+    hal->rf_rssi_offset[rf_chain] = conf.rssi_offset;
+    hal->rf_radio_type[rf_chain] = conf.type;
+    hal->rf_tx_enable[rf_chain] = conf.tx_enable;
+    hal->rf_tx_notch_freq[rf_chain] = conf.tx_notch_freq;
 
-    DEBUG_PRINTF("Note: rf_chain %d configuration; en:%d freq:%d rssi_offset:%f radio_type:%d tx_enable:%d tx_notch_freq:%u\n", rf_chain, rf_enable[rf_chain], rf_rx_freq[rf_chain], rf_rssi_offset[rf_chain], rf_radio_type[rf_chain], rf_tx_enable[rf_chain], rf_tx_notch_freq[rf_chain]);
+    DEBUG_PRINTF("Note: rf_chain %d configuration; en:%d freq:%d rssi_offset:%f radio_type:%d tx_enable:%d tx_notch_freq:%u\n", rf_chain, hal->rf_enable[rf_chain], hal->rf_rx_freq[rf_chain], hal->rf_rssi_offset[rf_chain], hal->rf_radio_type[rf_chain], hal->rf_tx_enable[rf_chain], hal->rf_tx_notch_freq[rf_chain]);
 
     return LGW_HAL_SUCCESS;
 }
@@ -493,11 +978,12 @@ int lgw_rxrf_setconf(uint8_t rf_chain, struct lgw_conf_rxrf_s conf) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
     int32_t bw_hz;
     uint32_t rf_rx_bandwidth;
 
     /* check if the concentrator is running */
-    if (lgw_is_started == true) {
+    if (hal->lgw_is_started == true) {
         DEBUG_MSG("ERROR: CONCENTRATOR IS RUNNING, STOP IT BEFORE TOUCHING CONFIGURATION\n");
         return LGW_HAL_ERROR;
     }
@@ -510,8 +996,8 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
 
     /* if chain is disabled, don't care about most parameters */
     if (conf.enable == false) {
-        if_enable[if_chain] = false;
-        if_freq[if_chain] = 0;
+        hal->if_enable[if_chain] = false;
+        hal->if_freq[if_chain] = 0;
         DEBUG_PRINTF("Note: if_chain %d disabled\n", if_chain);
         return LGW_HAL_SUCCESS;
     }
@@ -567,18 +1053,18 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
                 return LGW_HAL_ERROR;
             }
             /* set internal configuration  */
-            if_enable[if_chain] = conf.enable;
-            if_rf_chain[if_chain] = conf.rf_chain;
-            if_freq[if_chain] = conf.freq_hz;
-            lora_rx_bw = conf.bandwidth;
-            lora_rx_sf = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
+            hal->if_enable[if_chain] = conf.enable;
+            hal->if_rf_chain[if_chain] = conf.rf_chain;
+            hal->if_freq[if_chain] = conf.freq_hz;
+            hal->lora_rx_bw = conf.bandwidth;
+            hal->lora_rx_sf = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
             if (SET_PPM_ON(conf.bandwidth, conf.datarate)) {
-                lora_rx_ppm_offset = true;
+                hal->lora_rx_ppm_offset = true;
             } else {
-                lora_rx_ppm_offset = false;
+                hal->lora_rx_ppm_offset = false;
             }
 
-            DEBUG_PRINTF("Note: LoRa 'std' if_chain %d configuration; en:%d freq:%d bw:%d dr:%d\n", if_chain, if_enable[if_chain], if_freq[if_chain], lora_rx_bw, lora_rx_sf);
+            DEBUG_PRINTF("Note: LoRa 'std' if_chain %d configuration; en:%d freq:%d bw:%d dr:%d\n", if_chain, hal->if_enable[if_chain], hal->if_freq[if_chain], hal->lora_rx_bw, hal->lora_rx_sf);
             break;
 
         case IF_LORA_MULTI:
@@ -599,12 +1085,12 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
                 return LGW_HAL_ERROR;
             }
             /* set internal configuration  */
-            if_enable[if_chain] = conf.enable;
-            if_rf_chain[if_chain] = conf.rf_chain;
-            if_freq[if_chain] = conf.freq_hz;
-            lora_multi_sfmask[if_chain] = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
+            hal->if_enable[if_chain] = conf.enable;
+            hal->if_rf_chain[if_chain] = conf.rf_chain;
+            hal->if_freq[if_chain] = conf.freq_hz;
+            hal->lora_multi_sfmask[if_chain] = (uint8_t)(DR_LORA_MULTI & conf.datarate); /* filter SF out of the 7-12 range */
 
-            DEBUG_PRINTF("Note: LoRa 'multi' if_chain %d configuration; en:%d freq:%d SF_mask:0x%02x\n", if_chain, if_enable[if_chain], if_freq[if_chain], lora_multi_sfmask[if_chain]);
+            DEBUG_PRINTF("Note: LoRa 'multi' if_chain %d configuration; en:%d freq:%d SF_mask:0x%02x\n", if_chain, hal->if_enable[if_chain], hal->if_freq[if_chain], hal->lora_multi_sfmask[if_chain]);
             break;
 
         case IF_FSK_STD:
@@ -625,16 +1111,16 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
                 return LGW_HAL_ERROR;
             }
             /* set internal configuration  */
-            if_enable[if_chain] = conf.enable;
-            if_rf_chain[if_chain] = conf.rf_chain;
-            if_freq[if_chain] = conf.freq_hz;
-            fsk_rx_bw = conf.bandwidth;
-            fsk_rx_dr = conf.datarate;
+            hal->if_enable[if_chain] = conf.enable;
+            hal->if_rf_chain[if_chain] = conf.rf_chain;
+            hal->if_freq[if_chain] = conf.freq_hz;
+            hal->fsk_rx_bw = conf.bandwidth;
+            hal->fsk_rx_dr = conf.datarate;
             if (conf.sync_word > 0) {
-                fsk_sync_word_size = conf.sync_word_size;
-                fsk_sync_word = conf.sync_word;
+                hal->fsk_sync_word_size = conf.sync_word_size;
+                hal->fsk_sync_word = conf.sync_word;
             }
-            DEBUG_PRINTF("Note: FSK if_chain %d configuration; en:%d freq:%d bw:%d dr:%d (%d real dr) sync:0x%0*llX\n", if_chain, if_enable[if_chain], if_freq[if_chain], fsk_rx_bw, fsk_rx_dr, LGW_XTAL_FREQU/(LGW_XTAL_FREQU/fsk_rx_dr), 2*fsk_sync_word_size, fsk_sync_word);
+            DEBUG_PRINTF("Note: FSK if_chain %d configuration; en:%d freq:%d bw:%d dr:%d (%d real dr) sync:0x%0*llX\n", if_chain, hal->if_enable[if_chain], hal->if_freq[if_chain], hal->fsk_rx_bw, hal->fsk_rx_dr, LGW_XTAL_FREQU/(LGW_XTAL_FREQU/hal->fsk_rx_dr), 2*hal->fsk_sync_word_size, hal->fsk_sync_word);
             break;
 
         default:
@@ -648,6 +1134,7 @@ int lgw_rxif_setconf(uint8_t if_chain, struct lgw_conf_rxif_s conf) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
     int i;
 
     /* Check LUT size */
@@ -656,9 +1143,9 @@ int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf) {
         return LGW_HAL_ERROR;
     }
 
-    txgain_lut.size = conf->size;
+    hal->txgain_lut.size = conf->size;
 
-    for (i = 0; i < txgain_lut.size; i++) {
+    for (i = 0; i < hal->txgain_lut.size; i++) {
         /* Check gain range */
         if (conf->lut[i].dig_gain > 3) {
             DEBUG_MSG("ERROR: TX gain LUT: SX1301 digital gain must be between 0 and 3\n");
@@ -681,11 +1168,11 @@ int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf) {
         }
 
         /* Set internal LUT */
-        txgain_lut.lut[i].dig_gain = conf->lut[i].dig_gain;
-        txgain_lut.lut[i].dac_gain = conf->lut[i].dac_gain;
-        txgain_lut.lut[i].mix_gain = conf->lut[i].mix_gain;
-        txgain_lut.lut[i].pa_gain  = conf->lut[i].pa_gain;
-        txgain_lut.lut[i].rf_power = conf->lut[i].rf_power;
+        hal->txgain_lut.lut[i].dig_gain = conf->lut[i].dig_gain;
+        hal->txgain_lut.lut[i].dac_gain = conf->lut[i].dac_gain;
+        hal->txgain_lut.lut[i].mix_gain = conf->lut[i].mix_gain;
+        hal->txgain_lut.lut[i].pa_gain  = conf->lut[i].pa_gain;
+        hal->txgain_lut.lut[i].rf_power = conf->lut[i].rf_power;
     }
 
     return LGW_HAL_SUCCESS;
@@ -693,113 +1180,284 @@ int lgw_txgain_setconf(struct lgw_tx_gain_lut_s *conf) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_start(void) {
-    int i, err;
-    int reg_stat;
-    unsigned x;
-    uint8_t radio_select;
-    int32_t read_val;
-    uint8_t load_val;
-    uint8_t fw_version;
-    uint8_t cal_cmd;
-    uint16_t cal_time;
-    uint8_t cal_status;
-
-    uint64_t fsk_sync_word_reg;
+/* called with the HAL lock held, reads the counter with GPS event capture disabled and records the host time */
+static int cnt_sync_read(struct lgw_hal_state_s *hal) {
+    int i;
+    int32_t val;
 
-    if (lgw_is_started == true) {
-        DEBUG_MSG("Note: LoRa concentrator already started, restarting it now\n");
+    /* with GPS event capture disabled, the timestamp register follows the counter */
+    i = lgw_reg_w(LGW_GPS_EN, 0);
+    i |= lgw_reg_r(LGW_TIMESTAMP, &val);
+    i |= lgw_reg_w(LGW_GPS_EN, 1);
+    if (i == LGW_REG_SUCCESS) {
+        hal->cnt_sync_us = (uint32_t)val;
+        hal->cnt_sync_host_us = monotonic_us();
+        hal->cnt_sync_valid = true;
     }
+    return i;
+}
 
-    reg_stat = lgw_connect(false, rf_tx_notch_freq[rf_tx_enable[1]?1:0]);
-    if (reg_stat == LGW_REG_ERROR) {
-        DEBUG_MSG("ERROR: FAIL TO CONNECT BOARD\n");
-        return LGW_HAL_ERROR;
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* preamble actually sent: the recommended size if not explicit, at least the minimum size */
+static void tx_preamble_adjust(struct lgw_pkt_tx_s *pkt) {
+    if (pkt->modulation == MOD_LORA) {
+        if (pkt->preamble == 0) { /* if not explicit, use recommended LoRa preamble size */
+            pkt->preamble = STD_LORA_PREAMBLE;
+        } else if (pkt->preamble < MIN_LORA_PREAMBLE) { /* enforce minimum preamble size */
+            pkt->preamble = MIN_LORA_PREAMBLE;
+            DEBUG_MSG("Note: preamble length adjusted to respect minimum LoRa preamble size\n");
+        }
+    } else if (pkt->modulation == MOD_FSK) {
+        if (pkt->preamble == 0) { /* if not explicit, use LoRa MAC preamble size */
+            pkt->preamble = STD_FSK_PREAMBLE;
+        } else if (pkt->preamble < MIN_FSK_PREAMBLE) { /* enforce minimum preamble size */
+            pkt->preamble = MIN_FSK_PREAMBLE;
+            DEBUG_MSG("Note: preamble length adjusted to respect minimum FSK preamble size\n");
+        }
     }
+}
 
-    /* reset the registers (also shuts the radios down) */
-    lgw_soft_reset();
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    /* gate clocks */
-    lgw_reg_w(LGW_GLOBAL_EN, 0);
-    lgw_reg_w(LGW_CLK32M_EN, 0);
+/* called with the HAL lock held, after a packet was successfully loaded, pkt
+has its preamble adjusted by tx_preamble_adjust */
+static void lgw_tx_end_setup(struct lgw_pkt_tx_s *pkt) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    uint64_t now_us;
+    int32_t lead_us = TX_START_DELAY_DEFAULT;
+
+    now_us = monotonic_us();
+    hal->tx_end_valid = false;
+    if (pkt->tx_mode == TIMESTAMPED) {
+        /* reading the counter here would disturb GPS event capture, extrapolate the last reading instead */
+        if ((hal->cnt_sync_valid == true) && ((now_us - hal->cnt_sync_host_us) <= CNT_SYNC_MAX_AGE_US)) {
+            lead_us = (int32_t)(pkt->count_us - hal->cnt_sync_us - (uint32_t)(now_us - hal->cnt_sync_host_us));
+            if (lead_us < 0) {
+                lead_us = 0;
+            }
+            hal->tx_end_valid = true;
+        }
+    } else if (pkt->tx_mode == IMMEDIATE) {
+        hal->tx_end_valid = true;
+    } /* else ON_GPS, the start depends on the next GPS pulse */
+    if (hal->tx_end_valid == true) {
+        hal->tx_end_us = now_us + (uint64_t)lead_us + ((uint64_t)lgw_time_on_air(pkt) * 1000);
+    }
+    lgw_tx_notify_arm(); /* also disarms the end of a previous packet */
+}
 
-    /* switch on and reset the radios (also starts the 32 MHz XTAL) */
-    lgw_reg_w(LGW_RADIO_A_EN,1);
-    lgw_reg_w(LGW_RADIO_B_EN,1);
-    wait_ms(500); /* TODO: optimize */
-    lgw_reg_w(LGW_RADIO_RST,1);
-    wait_ms(5);
-    lgw_reg_w(LGW_RADIO_RST,0);
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    /* setup the radios */
-    err = lgw_setup_sx125x(0, rf_clkout, rf_enable[0], rf_radio_type[0], rf_rx_freq[0]);
-    if (err != 0) {
-        DEBUG_MSG("ERROR: Failed to setup sx125x radio for RF chain 0\n");
-        return LGW_HAL_ERROR;
+/* called with the HAL lock held, disarms the timer when the end of the TX is unknown */
+static void lgw_tx_notify_arm(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    struct itimerspec its;
+
+    if (hal->tx_notify_fd < 0) {
+        return;
     }
-    err = lgw_setup_sx125x(1, rf_clkout, rf_enable[1], rf_radio_type[1], rf_rx_freq[1]);
-    if (err != 0) {
-        DEBUG_MSG("ERROR: Failed to setup sx125x radio for RF chain 0\n");
-        return LGW_HAL_ERROR;
+    memset(&its, 0, sizeof its);
+    if (hal->tx_end_valid == true) {
+        its.it_value.tv_sec = hal->tx_end_us / 1000000;
+        its.it_value.tv_nsec = (hal->tx_end_us % 1000000) * 1000;
     }
+    timerfd_settime(hal->tx_notify_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
 
-    /* gives AGC control of GPIOs to enable Tx external digital filter */
-    lgw_reg_w(LGW_GPIO_MODE,31); /* Set all GPIOs as output */
-    lgw_reg_w(LGW_GPIO_SELECT_OUTPUT,2);
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    /* Configure LBT */
-    if (lbt_is_enabled() == true) {
-        lgw_reg_w(LGW_CLK32M_EN, 1);
-        i = lbt_setup();
-        if (i != LGW_LBT_SUCCESS) {
-            DEBUG_MSG("ERROR: lbt_setup() did not return SUCCESS\n");
-            return LGW_HAL_ERROR;
-        }
+/* the radios start the 32 MHz XTAL when switched on, instead of a fixed delay
+wait until the RX PLL of the one providing the clock locks: it needs a running
+XTAL. The radio reset that follows puts the radio back to sleep. */
+static void lgw_radio_wait_ready(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
 
-        /* Start SX1301 counter and LBT FSM at the same time to be in sync */
-        lgw_reg_w(LGW_CLK32M_EN, 0);
-        i = lbt_start();
-        if (i != LGW_LBT_SUCCESS) {
-            DEBUG_MSG("ERROR: lbt_start() did not return SUCCESS\n");
-            return LGW_HAL_ERROR;
-        }
+    wait_ms(RADIO_READY_MIN_MS);
+    if (lgw_sx125x_wait_pll_lock(hal->rf_clkout, RADIO_READY_MAX_MS - RADIO_READY_MIN_MS) == LGW_REG_SUCCESS) {
+        DEBUG_PRINTF("Note: radio %u ready\n", hal->rf_clkout);
+    } else {
+        DEBUG_PRINTF("WARNING: radio %u not ready after %u ms\n", hal->rf_clkout, RADIO_READY_MAX_MS);
     }
+}
 
-    /* Enable clocks */
-    lgw_reg_w(LGW_GLOBAL_EN, 1);
-    lgw_reg_w(LGW_CLK32M_EN, 1);
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    /* GPIOs table :
-    DGPIO0 -> N/A
-    DGPIO1 -> N/A
-    DGPIO2 -> N/A
-    DGPIO3 -> TX digital filter ON
-    DGPIO4 -> TX ON
-    */
+static void calcache_key(struct calcache_entry_s *e, uint8_t cal_cmd) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_hal_state_s *hal = ctx->hal;
+    memset(e, 0, sizeof *e);
+    memcpy(e->board, ctx->spi_path, sizeof e->board); /* same size, null terminated */
+    e->fw_version = FW_VERSION_CAL;
+    e->cal_cmd = cal_cmd;
+    e->clksrc = hal->rf_clkout;
+    e->rx_freq[0] = hal->rf_enable[0] ? hal->rf_rx_freq[0] : 0;
+    e->rx_freq[1] = hal->rf_enable[1] ? hal->rf_rx_freq[1] : 0;
+}
 
-    /* select calibration command */
-    cal_cmd = 0;
-    cal_cmd |= rf_enable[0] ? 0x01 : 0x00; /* Bit 0: Calibrate Rx IQ mismatch compensation on radio A */
-    cal_cmd |= rf_enable[1] ? 0x02 : 0x00; /* Bit 1: Calibrate Rx IQ mismatch compensation on radio B */
-    cal_cmd |= (rf_enable[0] && rf_tx_enable[0]) ? 0x04 : 0x00; /* Bit 2: Calibrate Tx DC offset on radio A */
-    cal_cmd |= (rf_enable[1] && rf_tx_enable[1]) ? 0x08 : 0x00; /* Bit 3: Calibrate Tx DC offset on radio B */
-    cal_cmd |= 0x10; /* Bit 4: 0: calibrate with DAC gain=2, 1: with DAC gain=3 (use 3) */
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-    switch (rf_radio_type[0]) { /* we assume that there is only one radio type on the board */
-        case LGW_RADIO_TYPE_SX1255:
-            cal_cmd |= 0x20; /* Bit 5: 0: SX1257, 1: SX1255 */
-            break;
-        case LGW_RADIO_TYPE_SX1257:
-            cal_cmd |= 0x00; /* Bit 5: 0: SX1257, 1: SX1255 */
+/* same concentrator, calibration firmware and radio configuration */
+static bool calcache_match(const struct calcache_entry_s *a, const struct calcache_entry_s *b) {
+    return (strncmp(a->board, b->board, sizeof a->board) == 0) && (a->fw_version == b->fw_version) && (a->cal_cmd == b->cal_cmd) && (a->clksrc == b->clksrc) && (a->rx_freq[0] == b->rx_freq[0]) && (a->rx_freq[1] == b->rx_freq[1]);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* read the entries of the calibration cache file, none if it is missing or was written with another layout */
+static int calcache_read(const char *path, struct calcache_entry_s *table) {
+    FILE *f;
+    struct calcache_head_s head;
+    int nb = 0;
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    if ((fread(&head, sizeof head, 1, f) == 1) && (head.magic == CALCACHE_MAGIC) && (head.version == CALCACHE_VERSION) && (head.entry_size == sizeof table[0]) && (head.nb <= CALCACHE_NB)) {
+        while ((nb < (int)head.nb) && (fread(&table[nb], sizeof table[nb], 1, f) == 1)) {
+            table[nb].board[sizeof table[nb].board - 1] = '\0';
+            ++nb;
+        }
+        if (nb != (int)head.nb) {
+            nb = 0; /* truncated file */
+        }
+    } else {
+        DEBUG_PRINTF("WARNING: calibration cache file %s ignored, not written by this library version\n", path);
+    }
+    fclose(f);
+    return nb;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* restore the calibration results matching the current configuration, false if there is none */
+static bool calcache_load(uint8_t cal_cmd) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    struct calcache_entry_s table[CALCACHE_NB];
+    struct calcache_entry_s key, e;
+    bool found = false;
+    int i, nb;
+
+    if (hal->calcache_conf.enable == false) {
+        return false;
+    }
+    calcache_key(&key, cal_cmd);
+    nb = calcache_read(hal->calcache_conf.path, table);
+    for (i = 0; i < nb; ++i) {
+        if (calcache_match(&table[i], &key)) {
+            e = table[i];
+            found = (hal->calcache_conf.max_age_s == 0) || (((int64_t)time(NULL) - e.time) <= (int64_t)hal->calcache_conf.max_age_s);
             break;
-        default:
-            DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", rf_radio_type[0]);
+        }
+    }
+    if (found == false) {
+        return false;
+    }
+
+    memcpy(hal->cal_offset_a_i, e.offset_a_i, sizeof hal->cal_offset_a_i);
+    memcpy(hal->cal_offset_a_q, e.offset_a_q, sizeof hal->cal_offset_a_q);
+    memcpy(hal->cal_offset_b_i, e.offset_b_i, sizeof hal->cal_offset_b_i);
+    memcpy(hal->cal_offset_b_q, e.offset_b_q, sizeof hal->cal_offset_b_q);
+    for (i = 0; i < CALCACHE_IQ_NB; ++i) {
+        lgw_reg_w(calcache_iq_reg[i], e.iq_mismatch[i]);
+    }
+    DEBUG_PRINTF("Note: calibration of %lld s ago restored (status = %u)\n", (long long)((int64_t)time(NULL) - e.time), e.status);
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* store the results of the calibration that just ran, replacing the same configuration or the oldest one */
+static void calcache_save(uint8_t cal_cmd, uint8_t cal_status) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    FILE *f;
+    struct calcache_head_s head;
+    struct calcache_entry_s table[CALCACHE_NB];
+    struct calcache_entry_s e;
+    char tmp_path[sizeof hal->calcache_conf.path + 4];
+    uint8_t expected;
+    int i, nb, slot;
+
+    if (hal->calcache_conf.enable == false) {
+        return;
+    }
+
+    /* only a fully successful calibration is worth reusing */
+    expected = 0x81; /* see the calibration status bits in lgw_calibrate */
+    expected |= (cal_cmd & 0x01) ? 0x0A : 0x00; /* radio A access and image rejection */
+    expected |= (cal_cmd & 0x02) ? 0x14 : 0x00; /* radio B access and image rejection */
+    expected |= (cal_cmd & 0x04) ? 0x20 : 0x00; /* radio A TX DC offset */
+    expected |= (cal_cmd & 0x08) ? 0x40 : 0x00; /* radio B TX DC offset */
+    if ((cal_status & expected) != expected) {
+        DEBUG_PRINTF("Note: calibration status %u not cached\n", cal_status);
+        return;
+    }
+
+    calcache_key(&e, cal_cmd);
+    e.status = cal_status;
+    e.time = (int64_t)time(NULL);
+    memcpy(e.offset_a_i, hal->cal_offset_a_i, sizeof e.offset_a_i);
+    memcpy(e.offset_a_q, hal->cal_offset_a_q, sizeof e.offset_a_q);
+    memcpy(e.offset_b_i, hal->cal_offset_b_i, sizeof e.offset_b_i);
+    memcpy(e.offset_b_q, hal->cal_offset_b_q, sizeof e.offset_b_q);
+    for (i = 0; i < CALCACHE_IQ_NB; ++i) {
+        lgw_reg_r(calcache_iq_reg[i], &e.iq_mismatch[i]);
+    }
+
+    /* read the entries already cached */
+    nb = calcache_read(hal->calcache_conf.path, table);
+
+    /* same configuration, free slot or oldest entry */
+    slot = nb;
+    for (i = 0; i < nb; ++i) {
+        if (calcache_match(&table[i], &e)) {
+            slot = i;
             break;
+        }
+    }
+    if (slot == CALCACHE_NB) {
+        slot = 0;
+        for (i = 1; i < nb; ++i) {
+            if (table[i].time < table[slot].time) {
+                slot = i;
+            }
+        }
+    }
+    table[slot] = e;
+    if (slot == nb) {
+        ++nb;
     }
 
-    cal_cmd |= 0x00; /* Bit 6-7: Board type 0: ref, 1: FPGA, 3: board X */
-    cal_time = 2300; /* measured between 2.1 and 2.2 sec, because 1 TX only */
+    /* write a new file then rename it, a reader never sees a partial file */
+    snprintf(tmp_path, sizeof tmp_path, "%s.tmp", hal->calcache_conf.path);
+    f = fopen(tmp_path, "wb");
+    if (f == NULL) {
+        DEBUG_PRINTF("WARNING: failed to create calibration cache file %s\n", tmp_path);
+        return;
+    }
+    memset(&head, 0, sizeof head);
+    head.magic = CALCACHE_MAGIC;
+    head.version = CALCACHE_VERSION;
+    head.entry_size = sizeof table[0];
+    head.nb = nb;
+    i = ((fwrite(&head, sizeof head, 1, f) == 1) && (fwrite(table, sizeof table[0], nb, f) == (size_t)nb)) ? 0 : -1;
+    if ((fclose(f) != 0) || (i != 0) || (rename(tmp_path, hal->calcache_conf.path) != 0)) {
+        DEBUG_PRINTF("WARNING: failed to write calibration cache file %s\n", hal->calcache_conf.path);
+        remove(tmp_path);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* run the calibration firmware on the AGC MCU and get its results, the clocks must be running */
+static int lgw_calibrate(uint8_t cal_cmd, uint8_t *status) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    int i;
+    int32_t read_val;
+    uint8_t fw_version;
+    uint64_t start_us;
+    uint8_t cal_status;
 
     /* Load the calibration firmware  */
     load_firmware(MCU_AGC, cal_firmware, MCU_AGC_FW_BYTE);
@@ -813,20 +1471,24 @@ int lgw_start(void) {
     fw_version = (uint8_t)read_val;
     if (fw_version != FW_VERSION_CAL) {
         printf("ERROR: Version of calibration firmware not expected, actual:%d expected:%d\n", fw_version, FW_VERSION_CAL);
-        return -1;
+        return LGW_HAL_ERROR;
     }
 
     lgw_reg_w(LGW_PAGE_REG, 3); /* Calibration will start on this condition as soon as MCU can talk to concentrator registers */
     lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 0); /* Give control of concentrator registers to MCU */
 
-    /* Wait for calibration to end */
-    DEBUG_PRINTF("Note: calibration started (time: %u ms)\n", cal_time);
-    wait_ms(cal_time); /* Wait for end of calibration */
+    /* Wait for calibration to end, the status register stays readable while the MCU runs */
+    DEBUG_PRINTF("Note: calibration started (max time: %u ms)\n", CAL_TIME_MAX_MS);
+    start_us = monotonic_us();
+    do {
+        wait_ms(CAL_POLL_MS);
+        lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
+        cal_status = (uint8_t)read_val;
+    } while (((cal_status & 0x80) == 0) && ((monotonic_us() - start_us) < (CAL_TIME_MAX_MS * 1000ULL)));
+    DEBUG_PRINTF("Note: calibration ran for %llu ms\n", (unsigned long long)(monotonic_us() - start_us) / 1000);
     lgw_reg_w(LGW_EMERGENCY_FORCE_HOST_CTRL, 1); /* Take back control */
 
     /* Get calibration status */
-    lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
-    cal_status = (uint8_t)read_val;
     /*
         bit 7: calibration finished
         bit 0: could access SX1301 registers
@@ -843,22 +1505,22 @@ int lgw_start(void) {
     } else {
         DEBUG_PRINTF("Note: calibration finished (status = %u)\n", cal_status);
     }
-    if (rf_enable[0] && ((cal_status & 0x02) == 0)) {
+    if (hal->rf_enable[0] && ((cal_status & 0x02) == 0)) {
         DEBUG_MSG("WARNING: calibration could not access radio A\n");
     }
-    if (rf_enable[1] && ((cal_status & 0x04) == 0)) {
+    if (hal->rf_enable[1] && ((cal_status & 0x04) == 0)) {
         DEBUG_MSG("WARNING: calibration could not access radio B\n");
     }
-    if (rf_enable[0] && ((cal_status & 0x08) == 0)) {
+    if (hal->rf_enable[0] && ((cal_status & 0x08) == 0)) {
         DEBUG_MSG("WARNING: problem in calibration of radio A for image rejection\n");
     }
-    if (rf_enable[1] && ((cal_status & 0x10) == 0)) {
+    if (hal->rf_enable[1] && ((cal_status & 0x10) == 0)) {
         DEBUG_MSG("WARNING: problem in calibration of radio B for image rejection\n");
     }
-    if (rf_enable[0] && rf_tx_enable[0] && ((cal_status & 0x20) == 0)) {
+    if (hal->rf_enable[0] && hal->rf_tx_enable[0] && ((cal_status & 0x20) == 0)) {
         DEBUG_MSG("WARNING: problem in calibration of radio A for TX DC offset\n");
     }
-    if (rf_enable[1] && rf_tx_enable[1] && ((cal_status & 0x40) == 0)) {
+    if (hal->rf_enable[1] && hal->rf_tx_enable[1] && ((cal_status & 0x40) == 0)) {
         DEBUG_MSG("WARNING: problem in calibration of radio B for TX DC offset\n");
     }
 
@@ -866,40 +1528,180 @@ int lgw_start(void) {
     for(i=0; i<=7; ++i) {
         lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA0+i);
         lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-        cal_offset_a_i[i] = (int8_t)read_val;
+        hal->cal_offset_a_i[i] = (int8_t)read_val;
         lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xA8+i);
         lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-        cal_offset_a_q[i] = (int8_t)read_val;
+        hal->cal_offset_a_q[i] = (int8_t)read_val;
         lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB0+i);
         lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-        cal_offset_b_i[i] = (int8_t)read_val;
+        hal->cal_offset_b_i[i] = (int8_t)read_val;
         lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, 0xB8+i);
         lgw_reg_r(LGW_DBG_AGC_MCU_RAM_DATA, &read_val);
-        cal_offset_b_q[i] = (int8_t)read_val;
+        hal->cal_offset_b_q[i] = (int8_t)read_val;
     }
 
-    /* load adjusted parameters */
-    lgw_constant_adjust();
+    *status = cal_status;
+    return LGW_HAL_SUCCESS;
+}
 
-    /* Sanity check for RX frequency */
-    if (rf_rx_freq[0] == 0) {
-        DEBUG_MSG("ERROR: wrong configuration, rf_rx_freq[0] is not set\n");
-        return LGW_HAL_ERROR;
-    }
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* modem frequency-to-time drift compensation, depends on radio A frequency */
+static void lgw_freq_drift_setup(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    unsigned x;
 
     /* Freq-to-time-drift calculation */
-    x = 4096000000 / (rf_rx_freq[0] >> 1); /* dividend: (4*2048*1000000) >> 1, rescaled to avoid 32b overflow */
+    x = 4096000000 / (hal->rf_rx_freq[0] >> 1); /* dividend: (4*2048*1000000) >> 1, rescaled to avoid 32b overflow */
     x = ( x > 63 ) ? 63 : x; /* saturation */
     lgw_reg_w(LGW_FREQ_TO_TIME_DRIFT, x); /* default 9 */
 
-    x = 4096000000 / (rf_rx_freq[0] >> 3); /* dividend: (16*2048*1000000) >> 3, rescaled to avoid 32b overflow */
+    x = 4096000000 / (hal->rf_rx_freq[0] >> 3); /* dividend: (16*2048*1000000) >> 3, rescaled to avoid 32b overflow */
     x = ( x > 63 ) ? 63 : x; /* saturation */
     lgw_reg_w(LGW_MBWSSF_FREQ_TO_TIME_DRIFT, x); /* default 36 */
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int lgw_start_nolock(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    int i, err;
+    int reg_stat;
+    uint8_t radio_select;
+    int32_t read_val;
+    uint8_t load_val;
+    uint8_t fw_version;
+    uint8_t cal_cmd;
+    uint8_t cal_status;
+    bool lbt_ready;
+    uint32_t lbt_ready_ms;
+
+    uint64_t fsk_sync_word_reg;
+
+    if (hal->lgw_is_started == true) {
+        DEBUG_MSG("Note: LoRa concentrator already started, restarting it now\n");
+    }
+
+    reg_stat = lgw_connect(false, hal->rf_tx_notch_freq[hal->rf_tx_enable[1]?1:0]);
+    if (reg_stat == LGW_REG_ERROR) {
+        DEBUG_MSG("ERROR: FAIL TO CONNECT BOARD\n");
+        return LGW_HAL_ERROR;
+    }
+
+    /* reset the registers (also shuts the radios down) */
+    lgw_soft_reset();
+
+    /* gate clocks */
+    lgw_reg_batch_begin();
+    lgw_reg_w(LGW_GLOBAL_EN, 0);
+    lgw_reg_w(LGW_CLK32M_EN, 0);
+
+    /* switch on and reset the radios (also starts the 32 MHz XTAL) */
+    lgw_reg_w(LGW_RADIO_A_EN,1);
+    lgw_reg_w(LGW_RADIO_B_EN,1);
+    lgw_reg_batch_end();
+    lgw_radio_wait_ready();
+    lgw_reg_w(LGW_RADIO_RST,1);
+    wait_ms(5);
+    lgw_reg_w(LGW_RADIO_RST,0);
+
+    /* setup the radios */
+    err = lgw_setup_sx125x(0, hal->rf_clkout, hal->rf_enable[0], hal->rf_radio_type[0], hal->rf_rx_freq[0]);
+    if (err != 0) {
+        DEBUG_MSG("ERROR: Failed to setup sx125x radio for RF chain 0\n");
+        return LGW_HAL_ERROR;
+    }
+    err = lgw_setup_sx125x(1, hal->rf_clkout, hal->rf_enable[1], hal->rf_radio_type[1], hal->rf_rx_freq[1]);
+    if (err != 0) {
+        DEBUG_MSG("ERROR: Failed to setup sx125x radio for RF chain 0\n");
+        return LGW_HAL_ERROR;
+    }
+
+    /* gives AGC control of GPIOs to enable Tx external digital filter */
+    lgw_reg_w(LGW_GPIO_MODE,31); /* Set all GPIOs as output */
+    lgw_reg_w(LGW_GPIO_SELECT_OUTPUT,2);
+
+    /* Configure LBT */
+    if (lbt_is_enabled() == true) {
+        lgw_reg_w(LGW_CLK32M_EN, 1);
+        i = lbt_setup();
+        if (i != LGW_LBT_SUCCESS) {
+            DEBUG_MSG("ERROR: lbt_setup() did not return SUCCESS\n");
+            return LGW_HAL_ERROR;
+        }
+
+        /* Start SX1301 counter and LBT FSM at the same time to be in sync */
+        lgw_reg_w(LGW_CLK32M_EN, 0);
+        i = lbt_start();
+        if (i != LGW_LBT_SUCCESS) {
+            DEBUG_MSG("ERROR: lbt_start() did not return SUCCESS\n");
+            return LGW_HAL_ERROR;
+        }
+    }
+
+    /* Enable clocks */
+    lgw_reg_w(LGW_GLOBAL_EN, 1);
+    lgw_reg_w(LGW_CLK32M_EN, 1);
+
+    /* GPIOs table :
+    DGPIO0 -> N/A
+    DGPIO1 -> N/A
+    DGPIO2 -> N/A
+    DGPIO3 -> TX digital filter ON
+    DGPIO4 -> TX ON
+    */
+
+    /* select calibration command */
+    cal_cmd = 0;
+    cal_cmd |= hal->rf_enable[0] ? 0x01 : 0x00; /* Bit 0: Calibrate Rx IQ mismatch compensation on radio A */
+    cal_cmd |= hal->rf_enable[1] ? 0x02 : 0x00; /* Bit 1: Calibrate Rx IQ mismatch compensation on radio B */
+    cal_cmd |= (hal->rf_enable[0] && hal->rf_tx_enable[0]) ? 0x04 : 0x00; /* Bit 2: Calibrate Tx DC offset on radio A */
+    cal_cmd |= (hal->rf_enable[1] && hal->rf_tx_enable[1]) ? 0x08 : 0x00; /* Bit 3: Calibrate Tx DC offset on radio B */
+    cal_cmd |= 0x10; /* Bit 4: 0: calibrate with DAC gain=2, 1: with DAC gain=3 (use 3) */
+
+    switch (hal->rf_radio_type[0]) { /* we assume that there is only one radio type on the board */
+        case LGW_RADIO_TYPE_SX1255:
+            cal_cmd |= 0x20; /* Bit 5: 0: SX1257, 1: SX1255 */
+            break;
+        case LGW_RADIO_TYPE_SX1257:
+            cal_cmd |= 0x00; /* Bit 5: 0: SX1257, 1: SX1255 */
+            break;
+        default:
+            DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", hal->rf_radio_type[0]);
+            break;
+    }
+
+    cal_cmd |= 0x00; /* Bit 6-7: Board type 0: ref, 1: FPGA, 3: board X */
+    /* reuse the results of a previous calibration with the same radio configuration */
+    if (calcache_load(cal_cmd) == true) {
+        DEBUG_MSG("Note: calibration results restored from the calibration cache\n");
+    } else {
+        err = lgw_calibrate(cal_cmd, &cal_status);
+        if (err != LGW_HAL_SUCCESS) {
+            return err;
+        }
+        calcache_save(cal_cmd, cal_status);
+    }
+
+    /* load adjusted parameters, static modem configuration is sent as a register image */
+    lgw_reg_batch_begin();
+    lgw_reg_image_begin();
+    lgw_constant_adjust();
+
+    /* Sanity check for RX frequency */
+    if (hal->rf_rx_freq[0] == 0) {
+        DEBUG_MSG("ERROR: wrong configuration, rf_rx_freq[0] is not set\n");
+        lgw_reg_image_end();
+        lgw_reg_batch_end();
+        return LGW_HAL_ERROR;
+    }
+
+    lgw_freq_drift_setup();
 
     /* configure LoRa 'multi' demodulators aka. LoRa 'sensor' channels (IF0-3) */
     radio_select = 0; /* IF mapping to radio A/B (per bit, 0=A, 1=B) */
     for(i=0; i<LGW_MULTI_NB; ++i) {
-        radio_select += (if_rf_chain[i] == 1 ? 1 << i : 0); /* transform bool array into binary word */
+        radio_select += (hal->if_rf_chain[i] == 1 ? 1 << i : 0); /* transform bool array into binary word */
     }
     /*
     lgw_reg_w(LGW_RADIO_SELECT, radio_select);
@@ -908,41 +1710,41 @@ int lgw_start(void) {
     will be loaded in LGW_RADIO_SELECT at the end of start procedure.
     */
 
-    lgw_reg_w(LGW_IF_FREQ_0, IF_HZ_TO_REG(if_freq[0])); /* default -384 */
-    lgw_reg_w(LGW_IF_FREQ_1, IF_HZ_TO_REG(if_freq[1])); /* default -128 */
-    lgw_reg_w(LGW_IF_FREQ_2, IF_HZ_TO_REG(if_freq[2])); /* default 128 */
-    lgw_reg_w(LGW_IF_FREQ_3, IF_HZ_TO_REG(if_freq[3])); /* default 384 */
-    lgw_reg_w(LGW_IF_FREQ_4, IF_HZ_TO_REG(if_freq[4])); /* default -384 */
-    lgw_reg_w(LGW_IF_FREQ_5, IF_HZ_TO_REG(if_freq[5])); /* default -128 */
-    lgw_reg_w(LGW_IF_FREQ_6, IF_HZ_TO_REG(if_freq[6])); /* default 128 */
-    lgw_reg_w(LGW_IF_FREQ_7, IF_HZ_TO_REG(if_freq[7])); /* default 384 */
-
-    lgw_reg_w(LGW_CORR0_DETECT_EN, (if_enable[0] == true) ? lora_multi_sfmask[0] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR1_DETECT_EN, (if_enable[1] == true) ? lora_multi_sfmask[1] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR2_DETECT_EN, (if_enable[2] == true) ? lora_multi_sfmask[2] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR3_DETECT_EN, (if_enable[3] == true) ? lora_multi_sfmask[3] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR4_DETECT_EN, (if_enable[4] == true) ? lora_multi_sfmask[4] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR5_DETECT_EN, (if_enable[5] == true) ? lora_multi_sfmask[5] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR6_DETECT_EN, (if_enable[6] == true) ? lora_multi_sfmask[6] : 0); /* default 0 */
-    lgw_reg_w(LGW_CORR7_DETECT_EN, (if_enable[7] == true) ? lora_multi_sfmask[7] : 0); /* default 0 */
+    lgw_reg_w(LGW_IF_FREQ_0, IF_HZ_TO_REG(hal->if_freq[0])); /* default -384 */
+    lgw_reg_w(LGW_IF_FREQ_1, IF_HZ_TO_REG(hal->if_freq[1])); /* default -128 */
+    lgw_reg_w(LGW_IF_FREQ_2, IF_HZ_TO_REG(hal->if_freq[2])); /* default 128 */
+    lgw_reg_w(LGW_IF_FREQ_3, IF_HZ_TO_REG(hal->if_freq[3])); /* default 384 */
+    lgw_reg_w(LGW_IF_FREQ_4, IF_HZ_TO_REG(hal->if_freq[4])); /* default -384 */
+    lgw_reg_w(LGW_IF_FREQ_5, IF_HZ_TO_REG(hal->if_freq[5])); /* default -128 */
+    lgw_reg_w(LGW_IF_FREQ_6, IF_HZ_TO_REG(hal->if_freq[6])); /* default 128 */
+    lgw_reg_w(LGW_IF_FREQ_7, IF_HZ_TO_REG(hal->if_freq[7])); /* default 384 */
+
+    lgw_reg_w(LGW_CORR0_DETECT_EN, (hal->if_enable[0] == true) ? hal->lora_multi_sfmask[0] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR1_DETECT_EN, (hal->if_enable[1] == true) ? hal->lora_multi_sfmask[1] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR2_DETECT_EN, (hal->if_enable[2] == true) ? hal->lora_multi_sfmask[2] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR3_DETECT_EN, (hal->if_enable[3] == true) ? hal->lora_multi_sfmask[3] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR4_DETECT_EN, (hal->if_enable[4] == true) ? hal->lora_multi_sfmask[4] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR5_DETECT_EN, (hal->if_enable[5] == true) ? hal->lora_multi_sfmask[5] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR6_DETECT_EN, (hal->if_enable[6] == true) ? hal->lora_multi_sfmask[6] : 0); /* default 0 */
+    lgw_reg_w(LGW_CORR7_DETECT_EN, (hal->if_enable[7] == true) ? hal->lora_multi_sfmask[7] : 0); /* default 0 */
 
     lgw_reg_w(LGW_PPM_OFFSET, 0x60); /* as the threshold is 16ms, use 0x60 to enable ppm_offset for SF12 and SF11 @125kHz*/
 
-    lgw_reg_w(LGW_CONCENTRATOR_MODEM_ENABLE, 1); /* default 0 */
-
     /* configure LoRa 'stand-alone' modem (IF8) */
-    lgw_reg_w(LGW_IF_FREQ_8, IF_HZ_TO_REG(if_freq[8])); /* MBWSSF modem (default 0) */
-    if (if_enable[8] == true) {
-        lgw_reg_w(LGW_MBWSSF_RADIO_SELECT, if_rf_chain[8]);
-        switch(lora_rx_bw) {
+    lgw_reg_w(LGW_IF_FREQ_8, IF_HZ_TO_REG(hal->if_freq[8])); /* MBWSSF modem (default 0) */
+    if (hal->if_enable[8] == true) {
+        lgw_reg_w(LGW_MBWSSF_RADIO_SELECT, hal->if_rf_chain[8]);
+        switch(hal->lora_rx_bw) {
             case BW_125KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW, 0); break;
             case BW_250KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW, 1); break;
             case BW_500KHZ: lgw_reg_w(LGW_MBWSSF_MODEM_BW, 2); break;
             default:
-                DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", lora_rx_bw);
+                DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", hal->lora_rx_bw);
+                lgw_reg_image_end();
+                lgw_reg_batch_end();
                 return LGW_HAL_ERROR;
         }
-        switch(lora_rx_sf) {
+        switch(hal->lora_rx_sf) {
             case DR_LORA_SF7: lgw_reg_w(LGW_MBWSSF_RATE_SF, 7); break;
             case DR_LORA_SF8: lgw_reg_w(LGW_MBWSSF_RATE_SF, 8); break;
             case DR_LORA_SF9: lgw_reg_w(LGW_MBWSSF_RATE_SF, 9); break;
@@ -950,36 +1752,40 @@ int lgw_start(void) {
             case DR_LORA_SF11: lgw_reg_w(LGW_MBWSSF_RATE_SF, 11); break;
             case DR_LORA_SF12: lgw_reg_w(LGW_MBWSSF_RATE_SF, 12); break;
             default:
-                DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", lora_rx_sf);
+                DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", hal->lora_rx_sf);
+                lgw_reg_image_end();
+                lgw_reg_batch_end();
                 return LGW_HAL_ERROR;
         }
-        lgw_reg_w(LGW_MBWSSF_PPM_OFFSET, lora_rx_ppm_offset); /* default 0 */
-        lgw_reg_w(LGW_MBWSSF_MODEM_ENABLE, 1); /* default 0 */
-    } else {
-        lgw_reg_w(LGW_MBWSSF_MODEM_ENABLE, 0);
+        lgw_reg_w(LGW_MBWSSF_PPM_OFFSET, hal->lora_rx_ppm_offset); /* default 0 */
     }
 
     /* configure FSK modem (IF9) */
-    lgw_reg_w(LGW_IF_FREQ_9, IF_HZ_TO_REG(if_freq[9])); /* FSK modem, default 0 */
-    lgw_reg_w(LGW_FSK_PSIZE, fsk_sync_word_size-1);
-    lgw_reg_w(LGW_FSK_TX_PSIZE, fsk_sync_word_size-1);
-    fsk_sync_word_reg = fsk_sync_word << (8 * (8 - fsk_sync_word_size));
+    lgw_reg_w(LGW_IF_FREQ_9, IF_HZ_TO_REG(hal->if_freq[9])); /* FSK modem, default 0 */
+    lgw_reg_w(LGW_FSK_PSIZE, hal->fsk_sync_word_size-1);
+    lgw_reg_w(LGW_FSK_TX_PSIZE, hal->fsk_sync_word_size-1);
+    fsk_sync_word_reg = hal->fsk_sync_word << (8 * (8 - hal->fsk_sync_word_size));
     lgw_reg_w(LGW_FSK_REF_PATTERN_LSB, (uint32_t)(0xFFFFFFFF & fsk_sync_word_reg));
     lgw_reg_w(LGW_FSK_REF_PATTERN_MSB, (uint32_t)(0xFFFFFFFF & (fsk_sync_word_reg >> 32)));
-    if (if_enable[9] == true) {
-        lgw_reg_w(LGW_FSK_RADIO_SELECT, if_rf_chain[9]);
-        lgw_reg_w(LGW_FSK_BR_RATIO, LGW_XTAL_FREQU/fsk_rx_dr); /* setting the dividing ratio for datarate */
-        lgw_reg_w(LGW_FSK_CH_BW_EXPO, fsk_rx_bw);
-        lgw_reg_w(LGW_FSK_MODEM_ENABLE, 1); /* default 0 */
-    } else {
-        lgw_reg_w(LGW_FSK_MODEM_ENABLE, 0);
+    if (hal->if_enable[9] == true) {
+        lgw_reg_w(LGW_FSK_RADIO_SELECT, hal->if_rf_chain[9]);
+        lgw_reg_w(LGW_FSK_BR_RATIO, LGW_XTAL_FREQU/hal->fsk_rx_dr); /* setting the dividing ratio for datarate */
+        lgw_reg_w(LGW_FSK_CH_BW_EXPO, hal->fsk_rx_bw);
     }
+    lgw_reg_image_end();
+
+    /* enable the modems once their configuration is written */
+    lgw_reg_w(LGW_CONCENTRATOR_MODEM_ENABLE, 1); /* default 0 */
+    lgw_reg_w(LGW_MBWSSF_MODEM_ENABLE, (hal->if_enable[8] == true) ? 1 : 0); /* default 0 */
+    lgw_reg_w(LGW_FSK_MODEM_ENABLE, (hal->if_enable[9] == true) ? 1 : 0); /* default 0 */
+    lgw_reg_batch_end();
 
     /* Load firmware */
     load_firmware(MCU_ARB, arb_firmware, MCU_ARB_FW_BYTE);
     load_firmware(MCU_AGC, agc_firmware, MCU_AGC_FW_BYTE);
 
     /* gives the AGC MCU control over radio, RF front-end and filter gain */
+    lgw_reg_batch_begin();
     lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL, 0);
     lgw_reg_w(LGW_FORCE_HOST_FE_CTRL, 0);
     lgw_reg_w(LGW_FORCE_DEC_FILTER_GAIN, 0);
@@ -988,6 +1794,7 @@ int lgw_start(void) {
     lgw_reg_w(LGW_RADIO_SELECT, 0); /* MUST not be = to 1 or 2 at firmware init */
     lgw_reg_w(LGW_MCU_RST_0, 0);
     lgw_reg_w(LGW_MCU_RST_1, 0);
+    lgw_reg_batch_end();
 
     /* Check firmware version */
     lgw_reg_w(LGW_DBG_AGC_MCU_RAM_ADDR, FW_VERSION_ADDR);
@@ -1015,10 +1822,10 @@ int lgw_start(void) {
     }
 
     /* Update Tx gain LUT and start AGC */
-    for (i = 0; i < txgain_lut.size; ++i) {
+    for (i = 0; i < hal->txgain_lut.size; ++i) {
         lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT); /* start a transaction */
         wait_ms(1);
-        load_val = txgain_lut.lut[i].mix_gain + (16 * txgain_lut.lut[i].dac_gain) + (64 * txgain_lut.lut[i].pa_gain);
+        load_val = hal->txgain_lut.lut[i].mix_gain + (16 * hal->txgain_lut.lut[i].dac_gain) + (64 * hal->txgain_lut.lut[i].pa_gain);
         lgw_reg_w(LGW_RADIO_SELECT, load_val);
         wait_ms(1);
         lgw_reg_r(LGW_MCU_AGC_STATUS, &read_val);
@@ -1028,7 +1835,7 @@ int lgw_start(void) {
         }
     }
     /* As the AGC fw is waiting for 16 entries, we need to abort the transaction if we get less entries */
-    if (txgain_lut.size < TX_GAIN_LUT_SIZE_MAX) {
+    if (hal->txgain_lut.size < TX_GAIN_LUT_SIZE_MAX) {
         lgw_reg_w(LGW_RADIO_SELECT, AGC_CMD_WAIT);
         wait_ms(1);
         load_val = AGC_CMD_ABORT;
@@ -1078,42 +1885,134 @@ int lgw_start(void) {
     /* enable GPS event capture */
     lgw_reg_w(LGW_GPS_EN, 1);
 
-    /* */
+    /* wait for the LBT FSM to have scanned every channel */
     if (lbt_is_enabled() == true) {
         printf("INFO: Configuring LBT, this may take few seconds, please wait...\n");
-        wait_ms(8400);
+        i = lbt_wait_ready(LBT_READY_TIMEOUT_MS, &lbt_ready);
+        if (i != LGW_LBT_SUCCESS) {
+            DEBUG_MSG("ERROR: lbt_wait_ready() did not return SUCCESS\n");
+            return LGW_HAL_ERROR;
+        }
+        if (lbt_ready == true) {
+            lbt_get_ready_time(&lbt_ready_ms);
+            printf("INFO: LBT ready after %u ms\n", lbt_ready_ms);
+        } else {
+            printf("WARNING: not all LBT channels were scanned after %u ms, they are busy or LBT is not working\n", LBT_READY_TIMEOUT_MS);
+        }
     }
 
-    lgw_is_started = true;
+    lgw_rx_tables_setup();
+    lgw_rx_poll_setup();
+
+    hal->cal_rx_freq[0] = hal->rf_rx_freq[0];
+    hal->cal_rx_freq[1] = hal->rf_rx_freq[1];
+    hal->lgw_is_started = true;
     return LGW_HAL_SUCCESS;
 }
 
+int lgw_start(void) {
+    int x;
+
+    hal_lock();
+    x = lgw_start_nolock();
+    hal_unlock();
+    return x;
+}
+
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_stop(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    hal_lock();
     lgw_soft_reset();
     lgw_disconnect();
 
-    lgw_is_started = false;
+    hal->lgw_is_started = false;
+    hal_unlock();
     return LGW_HAL_SUCCESS;
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+int lgw_rxrf_retune(uint8_t rf_chain, uint32_t freq_hz) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    int x;
+    uint8_t tx_status;
+    uint32_t delta;
+
+    hal_lock();
+
+    /* check if the concentrator is running */
+    if (hal->lgw_is_started == false) {
+        DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE RETUNING\n");
+        hal_unlock();
+        return LGW_HAL_ERROR;
+    }
+
+    /* check input parameters */
+    if ((rf_chain >= LGW_RF_CHAIN_NB) || (hal->rf_enable[rf_chain] == false) || (freq_hz == 0)) {
+        DEBUG_MSG("ERROR: NOT A VALID RF_CHAIN OR FREQUENCY TO RETUNE\n");
+        hal_unlock();
+        return LGW_HAL_ERROR;
+    }
+    if (freq_hz == hal->rf_rx_freq[rf_chain]) {
+        hal_unlock();
+        return LGW_HAL_SUCCESS;
+    }
+
+    /* the calibration results and LBT setup only hold close to the calibrated frequency */
+    delta = (freq_hz > hal->cal_rx_freq[rf_chain]) ? (freq_hz - hal->cal_rx_freq[rf_chain]) : (hal->cal_rx_freq[rf_chain] - freq_hz);
+    if ((delta > LGW_RETUNE_RANGE_HZ) || (lbt_is_enabled() == true)) {
+        DEBUG_PRINTF("Note: rf_chain %u retuned %u Hz away from its calibration, restarting the concentrator\n", rf_chain, delta);
+        hal->rf_rx_freq[rf_chain] = freq_hz;
+        x = lgw_start_nolock();
+        hal_unlock();
+        return x;
+    }
+
+    /* the radios are briefly taken back from the AGC MCU, which must not be transmitting */
+    x = lgw_status(TX_STATUS, &tx_status);
+    if ((x != LGW_HAL_SUCCESS) || (tx_status != TX_FREE)) {
+        DEBUG_MSG("ERROR: TX PENDING, CANNOT RETUNE\n");
+        hal_unlock();
+        return LGW_HAL_ERROR;
+    }
+    lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL, 1);
+    x = lgw_sx125x_set_rx_freq(rf_chain, hal->rf_radio_type[rf_chain], freq_hz);
+    lgw_reg_w(LGW_FORCE_HOST_RADIO_CTRL, 0);
+    hal->rf_rx_freq[rf_chain] = freq_hz;
+    if (x != 0) {
+        DEBUG_PRINTF("WARNING: rf_chain %u PLL did not lock, restarting the concentrator\n", rf_chain);
+        x = lgw_start_nolock();
+        hal_unlock();
+        return x;
+    }
+    if (rf_chain == 0) {
+        lgw_freq_drift_setup();
+    }
+
+    DEBUG_PRINTF("Note: rf_chain %u retuned to %u Hz\n", rf_chain, freq_hz);
+    hal_unlock();
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int rx_fetch(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, struct lgw_pkt_rx_ref_s *ref_data) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
     int nb_pkt_fetch; /* loop variable and return value */
-    struct lgw_pkt_rx_s *p; /* pointer to the current structure in the struct array */
-    uint8_t buff[255+RX_METADATA_NB]; /* buffer to store the result of SPI read bursts */
+    struct lgw_pkt_rx_s *p; /* pointer to the current structure in the struct array, copying fetch */
+    struct lgw_pkt_rx_ref_s meta; /* decoded metadata, copying fetch */
+    uint8_t fifo[5]; /* FIFO status */
+    uint8_t buff[255+RX_METADATA_NB]; /* buffer to store the result of SPI read bursts, copying fetch */
+    int pool_idx; /* pool buffer the SPI burst reads into, zero-copy fetch */
     unsigned sz; /* size of the payload, uses to address metadata */
-    int ifmod; /* type of if_chain/modem a packet was received by */
     int stat_fifo; /* the packet status as indicated in the FIFO */
-    uint32_t raw_timestamp; /* timestamp when internal 'RX finished' was triggered */
-    uint32_t delay_x, delay_y, delay_z; /* temporary variable for timestamp offset calculation */
-    uint32_t timestamp_correction; /* correction to account for processing delay */
-    uint32_t sf, cr, bw_pow, crc_en, ppm; /* used to calculate timestamp correction */
+    uint64_t time_start; /* used for RX statistics */
+    uint32_t time_spent, msg_start, msg_end;
 
     /* check if the concentrator is running */
-    if (lgw_is_started == false) {
+    if (hal->lgw_is_started == false) {
         DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE RECEIVING\n");
         return LGW_HAL_ERROR;
     }
@@ -1123,214 +2022,330 @@ int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
         DEBUG_PRINTF("ERROR: %d = INVALID MAX NUMBER OF PACKETS TO FETCH\n", max_pkt);
         return LGW_HAL_ERROR;
     }
-    CHECK_NULL(pkt_data);
+    if ((pkt_data == NULL) && (ref_data == NULL)) {
+        DEBUG_MSG("ERROR: NULL POINTER AS ARGUMENT\n");
+        return LGW_HAL_ERROR;
+    }
+
+    time_start = monotonic_us();
+    lgw_spi_get_msg_cnt(lgw_ctx_current()->spi_target, &msg_start);
 
-    /* Initialize buffer */
-    memset (buff, 0, sizeof buff);
+    /* FIFO advance write of a packet goes in the same SPI message as the FIFO status read of the next one */
+    lgw_reg_batch_begin();
 
     /* iterate max_pkt times at most */
     for (nb_pkt_fetch = 0; nb_pkt_fetch < max_pkt; ++nb_pkt_fetch) {
 
-        /* point to the proper struct in the struct array */
-        p = &pkt_data[nb_pkt_fetch];
-
         /* fetch all the RX FIFO data */
-        lgw_reg_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, buff, 5);
+        lgw_reg_rb(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, fifo, 5);
         /* 0:   number of packets available in RX data buffer */
         /* 1,2: start address of the current packet in RX data buffer */
         /* 3:   CRC status of the current packet */
         /* 4:   size of the current packet payload in byte */
 
+        /* track FIFO occupancy, a full FIFO means the host is too slow to drain it */
+        if (fifo[0] > hal->rx_stats.fifo_max) {
+            hal->rx_stats.fifo_max = fifo[0];
+        }
+        if ((nb_pkt_fetch == 0) && (fifo[0] >= LGW_PKT_FIFO_SIZE)) {
+            hal->rx_stats.nb_fifo_full += 1;
+        }
+
         /* how many packets are in the RX buffer ? Break if zero */
-        if (buff[0] == 0) {
+        if (fifo[0] == 0) {
             break; /* no more packets to fetch, exit out of FOR loop */
         }
 
         /* sanity check */
-        if (buff[0] > LGW_PKT_FIFO_SIZE) {
-            DEBUG_PRINTF("WARNING: %u = INVALID NUMBER OF PACKETS TO FETCH, ABORTING\n", buff[0]);
+        if (fifo[0] > LGW_PKT_FIFO_SIZE) {
+            DEBUG_PRINTF("WARNING: %u = INVALID NUMBER OF PACKETS TO FETCH, ABORTING\n", fifo[0]);
             break;
         }
 
-        DEBUG_PRINTF("FIFO content: %x %x %x %x %x\n", buff[0], buff[1], buff[2], buff[3], buff[4]);
+        DEBUG_PRINTF("FIFO content: %x %x %x %x %x\n", fifo[0], fifo[1], fifo[2], fifo[3], fifo[4]);
 
-        p->size = buff[4];
-        sz = p->size;
-        stat_fifo = buff[3]; /* will be used later, need to save it before overwriting buff */
+        sz = fifo[4];
+        stat_fifo = fifo[3];
+
+        if (ref_data == NULL) {
+            /* get payload + metadata, then copy them to result struct */
+            lgw_reg_rb(LGW_RX_DATA_BUF_DATA, buff, sz+RX_METADATA_NB);
+            if (rx_decode(buff, sz, stat_fifo, &meta) == false) {
+                break;
+            }
+            p = &pkt_data[nb_pkt_fetch];
+            rx_meta_copy(p, &meta);
+            memcpy((void *)p->payload, (void *)buff, sz);
+        } else {
+            /* get payload + metadata straight into a pool buffer, the packet stays in the FIFO if none is free */
+            pool_idx = rx_pool_alloc();
+            if (pool_idx < 0) {
+                DEBUG_MSG("WARNING: RX BUFFER POOL EMPTY, PACKETS LEFT IN FIFO\n");
+                hal->rx_stats.nb_pool_empty += 1;
+                break;
+            }
+            lgw_reg_rb(LGW_RX_DATA_BUF_DATA, hal->rx_pool_data[pool_idx], sz+RX_METADATA_NB);
+            if (rx_decode(hal->rx_pool_data[pool_idx], sz, stat_fifo, &ref_data[nb_pkt_fetch]) == false) {
+                rx_pool_put(hal, pool_idx);
+                break;
+            }
+            ref_data[nb_pkt_fetch].payload = hal->rx_pool_data[pool_idx];
+            ref_data[nb_pkt_fetch].pool_idx = (uint8_t)pool_idx;
+        }
 
-        /* get payload + metadata */
-        lgw_reg_rb(LGW_RX_DATA_BUF_DATA, buff, sz+RX_METADATA_NB);
+        /* advance packet FIFO */
+        lgw_reg_w(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, 0);
+    }
+    lgw_reg_batch_end();
 
-        /* copy payload to result struct */
-        memcpy((void *)p->payload, (void *)buff, sz);
+    /* update RX statistics */
+    lgw_spi_get_msg_cnt(lgw_ctx_current()->spi_target, &msg_end);
+    time_spent = (uint32_t)(monotonic_us() - time_start);
+    hal->rx_stats.nb_call += 1;
+    hal->rx_stats.nb_pkt += nb_pkt_fetch;
+    hal->rx_stats.nb_spi_msg += msg_end - msg_start;
+    hal->rx_stats.time_us += time_spent;
+    if (time_spent > hal->rx_stats.time_max_us) {
+        hal->rx_stats.time_max_us = time_spent;
+    }
 
-        /* process metadata */
-        p->if_chain = buff[sz+0];
-        if (p->if_chain >= LGW_IF_CHAIN_NB) {
-            DEBUG_PRINTF("WARNING: %u NOT A VALID IF_CHAIN NUMBER, ABORTING\n", p->if_chain);
-            break;
-        }
-        ifmod = ifmod_config[p->if_chain];
-        DEBUG_PRINTF("[%d %d]\n", p->if_chain, ifmod);
+    return nb_pkt_fetch;
+}
 
-        p->rf_chain = (uint8_t)if_rf_chain[p->if_chain];
-        p->freq_hz = (uint32_t)((int32_t)rf_rx_freq[p->rf_chain] + if_freq[p->if_chain]);
-        p->rssi = (float)buff[sz+5] + rf_rssi_offset[p->rf_chain];
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-        if ((ifmod == IF_LORA_MULTI) || (ifmod == IF_LORA_STD)) {
-            DEBUG_MSG("Note: LoRa packet\n");
-            switch(stat_fifo & 0x07) {
-                case 5:
-                    p->status = STAT_CRC_OK;
-                    crc_en = 1;
-                    break;
-                case 7:
-                    p->status = STAT_CRC_BAD;
-                    crc_en = 1;
-                    break;
-                case 1:
-                    p->status = STAT_NO_CRC;
-                    crc_en = 0;
-                    break;
-                default:
-                    p->status = STAT_UNDEFINED;
-                    crc_en = 0;
-            }
-            p->modulation = MOD_LORA;
-            p->snr = ((float)((int8_t)buff[sz+2]))/4;
-            p->snr_min = ((float)((int8_t)buff[sz+3]))/4;
-            p->snr_max = ((float)((int8_t)buff[sz+4]))/4;
-            if (ifmod == IF_LORA_MULTI) {
-                p->bandwidth = BW_125KHZ; /* fixed in hardware */
-            } else {
-                p->bandwidth = lora_rx_bw; /* get the parameter from the config variable */
+int lgw_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data) {
+    int x;
+
+    CHECK_NULL(pkt_data);
+
+    hal_lock();
+    x = rx_fetch(max_pkt, pkt_data, NULL);
+    hal_unlock();
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_receive_ref(uint8_t max_pkt, struct lgw_pkt_rx_ref_s *pkt_data) {
+    int x;
+
+    CHECK_NULL(pkt_data);
+
+    hal_lock();
+    x = rx_fetch(max_pkt, NULL, pkt_data);
+    hal_unlock();
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rx_ref_hold(struct lgw_pkt_rx_ref_s *pkt) {
+    CHECK_NULL(pkt);
+    if ((pkt->payload == NULL) || (pkt->pool_idx >= LGW_RX_POOL_SIZE)) {
+        DEBUG_MSG("ERROR: PACKET DESCRIPTOR DOES NOT HOLD A POOL BUFFER\n");
+        return LGW_HAL_ERROR;
+    }
+
+    __atomic_add_fetch(&rx_pool_owner(pkt)->rx_pool_ref[pkt->pool_idx], 1, __ATOMIC_RELAXED);
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rx_ref_release(struct lgw_pkt_rx_ref_s *pkt) {
+    CHECK_NULL(pkt);
+    if ((pkt->payload == NULL) || (pkt->pool_idx >= LGW_RX_POOL_SIZE)) {
+        DEBUG_MSG("ERROR: PACKET DESCRIPTOR DOES NOT HOLD A POOL BUFFER\n");
+        return LGW_HAL_ERROR;
+    }
+
+    rx_pool_put(rx_pool_owner(pkt), pkt->pool_idx);
+    pkt->payload = NULL;
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* poll the FIFO for lgw_receive_wait and lgw_receive_ref_wait, see rx_fetch for pkt_data/ref_data */
+static int rx_wait(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, struct lgw_pkt_rx_ref_s *ref_data, int timeout_ms) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    int nb_pkt;
+    uint64_t start_us;
+    uint32_t elapsed_ms;
+    uint32_t poll_ms;
+    uint32_t sleep_ms;
+
+    start_us = monotonic_us();
+    while (1) {
+        hal_lock();
+        nb_pkt = rx_fetch(max_pkt, pkt_data, ref_data);
+        if (nb_pkt != 0) {
+            /* packets tend to come in bursts, poll fast again */
+            hal->rx_poll_ms = RX_POLL_MIN_MS;
+            hal_unlock();
+            return nb_pkt;
+        }
+        hal->rx_stats.nb_empty_poll += 1;
+        poll_ms = hal->rx_poll_ms;
+        hal_unlock();
+
+        /* sleep until the next poll, without going past the timeout */
+        if (timeout_ms == 0) {
+            return 0;
+        }
+        sleep_ms = poll_ms;
+        if (timeout_ms > 0) {
+            elapsed_ms = (uint32_t)((monotonic_us() - start_us) / 1000);
+            if (elapsed_ms >= (uint32_t)timeout_ms) {
+                return 0;
             }
-            sf = (buff[sz+1] >> 4) & 0x0F;
-            switch (sf) {
-                case 7: p->datarate = DR_LORA_SF7; break;
-                case 8: p->datarate = DR_LORA_SF8; break;
-                case 9: p->datarate = DR_LORA_SF9; break;
-                case 10: p->datarate = DR_LORA_SF10; break;
-                case 11: p->datarate = DR_LORA_SF11; break;
-                case 12: p->datarate = DR_LORA_SF12; break;
-                default: p->datarate = DR_UNDEFINED;
+            if (sleep_ms > ((uint32_t)timeout_ms - elapsed_ms)) {
+                sleep_ms = (uint32_t)timeout_ms - elapsed_ms;
             }
-            cr = (buff[sz+1] >> 1) & 0x07;
-            switch (cr) {
-                case 1: p->coderate = CR_LORA_4_5; break;
-                case 2: p->coderate = CR_LORA_4_6; break;
-                case 3: p->coderate = CR_LORA_4_7; break;
-                case 4: p->coderate = CR_LORA_4_8; break;
-                default: p->coderate = CR_UNDEFINED;
+        }
+        wait_ms(sleep_ms);
+
+        /* channel idle, back off up to the interval the channel plan allows,
+        unless another waiter on the context changed the interval meanwhile */
+        hal_lock();
+        if (hal->rx_poll_ms == poll_ms) {
+            hal->rx_poll_ms = poll_ms * 2;
+            if (hal->rx_poll_ms > hal->rx_poll_max_ms) {
+                hal->rx_poll_ms = hal->rx_poll_max_ms;
             }
+        }
+        hal_unlock();
+    }
+}
 
-            /* determine if 'PPM mode' is on, needed for timestamp correction */
-            if (SET_PPM_ON(p->bandwidth,p->datarate)) {
-                ppm = 1;
-            } else {
-                ppm = 0;
-            }
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-            /* timestamp correction code, base delay */
-            if (ifmod == IF_LORA_STD) { /* if packet was received on the stand-alone LoRa modem */
-                switch (lora_rx_bw) {
-                    case BW_125KHZ:
-                        delay_x = 64;
-                        bw_pow = 1;
-                        break;
-                    case BW_250KHZ:
-                        delay_x = 32;
-                        bw_pow = 2;
-                        break;
-                    case BW_500KHZ:
-                        delay_x = 16;
-                        bw_pow = 4;
-                        break;
-                    default:
-                        DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d IN SWITCH STATEMENT\n", p->bandwidth);
-                        delay_x = 0;
-                        bw_pow = 0;
-                }
-            } else { /* packet was received on one of the sensor channels = 125kHz */
-                delay_x = 114;
-                bw_pow = 1;
-            }
+int lgw_receive_wait(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, int timeout_ms) {
+    CHECK_NULL(pkt_data);
+    return rx_wait(max_pkt, pkt_data, NULL, timeout_ms);
+}
 
-            /* timestamp correction code, variable delay */
-            if ((sf >= 6) && (sf <= 12) && (bw_pow > 0)) {
-                if ((2*(sz + 2*crc_en) - (sf-7)) <= 0) { /* payload fits entirely in first 8 symbols */
-                    delay_y = ( ((1<<(sf-1)) * (sf+1)) + (3 * (1<<(sf-4))) ) / bw_pow;
-                    delay_z = 32 * (2*(sz+2*crc_en) + 5) / bw_pow;
-                } else {
-                    delay_y = ( ((1<<(sf-1)) * (sf+1)) + ((4 - ppm) * (1<<(sf-4))) ) / bw_pow;
-                    delay_z = (16 + 4*cr) * (((2*(sz+2*crc_en)-sf+6) % (sf - 2*ppm)) + 1) / bw_pow;
-                }
-                timestamp_correction = delay_x + delay_y + delay_z;
-            } else {
-                timestamp_correction = 0;
-                DEBUG_MSG("WARNING: invalid packet, no timestamp correction\n");
-            }
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-            /* RSSI correction */
-            if (ifmod == IF_LORA_MULTI) {
-                p->rssi -= RSSI_MULTI_BIAS;
-            }
+int lgw_receive_ref_wait(uint8_t max_pkt, struct lgw_pkt_rx_ref_s *pkt_data, int timeout_ms) {
+    CHECK_NULL(pkt_data);
+    return rx_wait(max_pkt, NULL, pkt_data, timeout_ms);
+}
 
-        } else if (ifmod == IF_FSK_STD) {
-            DEBUG_MSG("Note: FSK packet\n");
-            switch(stat_fifo & 0x07) {
-                case 5:
-                    p->status = STAT_CRC_OK;
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_rx_stats(struct lgw_rx_stats_s *stats, bool reset) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    CHECK_NULL(stats);
+
+    hal_lock();
+    *stats = hal->rx_stats;
+    if (reset == true) {
+        memset(&hal->rx_stats, 0, sizeof hal->rx_stats);
+    }
+    hal_unlock();
+
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rx_tables_setup(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    struct tstamp_lora_s *t;
+    uint32_t delay_x, bw_pow, ppm;
+    uint32_t sf, len;
+    uint8_t bw;
+    int i, j;
+
+    /* LoRa timestamp correction, same arithmetic as the former per-packet computation */
+    for (i = 0; i < 2; ++i) {
+        t = &hal->tstamp_lora[i];
+        memset(t, 0, sizeof *t);
+        if (i == TSTAMP_LORA_STD) { /* packet received on the stand-alone LoRa modem */
+            bw = hal->lora_rx_bw;
+            switch (hal->lora_rx_bw) {
+                case BW_125KHZ:
+                    delay_x = 64;
+                    bw_pow = 1;
                     break;
-                case 7:
-                    p->status = STAT_CRC_BAD;
+                case BW_250KHZ:
+                    delay_x = 32;
+                    bw_pow = 2;
                     break;
-                case 1:
-                    p->status = STAT_NO_CRC;
+                case BW_500KHZ:
+                    delay_x = 16;
+                    bw_pow = 4;
                     break;
                 default:
-                    p->status = STAT_UNDEFINED;
-                    break;
+                    delay_x = 0;
+                    bw_pow = 0;
             }
-            p->modulation = MOD_FSK;
-            p->snr = -128.0;
-            p->snr_min = -128.0;
-            p->snr_max = -128.0;
-            p->bandwidth = fsk_rx_bw;
-            p->datarate = fsk_rx_dr;
-            p->coderate = CR_UNDEFINED;
-            timestamp_correction = ((uint32_t)680000 / fsk_rx_dr) - 20;
-
-            /* RSSI correction */
-            p->rssi = RSSI_FSK_POLY_0 + RSSI_FSK_POLY_1 * p->rssi + RSSI_FSK_POLY_2 * pow(p->rssi, 2);
-        } else {
-            DEBUG_MSG("ERROR: UNEXPECTED PACKET ORIGIN\n");
-            p->status = STAT_UNDEFINED;
-            p->modulation = MOD_UNDEFINED;
-            p->rssi = -128.0;
-            p->snr = -128.0;
-            p->snr_min = -128.0;
-            p->snr_max = -128.0;
-            p->bandwidth = BW_UNDEFINED;
-            p->datarate = DR_UNDEFINED;
-            p->coderate = CR_UNDEFINED;
-            timestamp_correction = 0;
-        }
-
-        raw_timestamp = (uint32_t)buff[sz+6] + ((uint32_t)buff[sz+7] << 8) + ((uint32_t)buff[sz+8] << 16) + ((uint32_t)buff[sz+9] << 24);
-        p->count_us = raw_timestamp - timestamp_correction;
-        p->crc = (uint16_t)buff[sz+10] + ((uint16_t)buff[sz+11] << 8);
+        } else { /* packet received on one of the sensor channels = 125kHz */
+            bw = BW_125KHZ;
+            delay_x = 114;
+            bw_pow = 1;
+        }
+        if (bw_pow == 0) {
+            continue; /* no correction, table left invalid */
+        }
+        t->valid = true;
+        t->bw_shift = (bw_pow == 4) ? 2 : ((bw_pow == 2) ? 1 : 0);
+
+        for (j = 0; j < TSTAMP_SF_NB; ++j) {
+            sf = TSTAMP_SF_MIN + j;
+            ppm = SET_PPM_ON(bw, rx_lora_dr_lut[sf]) ? 1 : 0;
+            t->base_short[j] = (uint16_t)(delay_x + ( ((1<<(sf-1)) * (sf+1)) + (3 * (1<<(sf-4))) ) / bw_pow);
+            t->base[j] = (uint16_t)(delay_x + ( ((1<<(sf-1)) * (sf+1)) + ((4 - ppm) * (1<<(sf-4))) ) / bw_pow);
+            for (len = 0; len < TSTAMP_LEN_NB; ++len) {
+                /* unsigned arithmetic, wrapping for short payloads exactly like the former computation */
+                if ((2*len - (sf-7)) == 0) { /* payload fits entirely in first 8 symbols */
+                    t->sym[j][len] = 0;
+                } else {
+                    t->sym[j][len] = (uint8_t)(((2*len - sf + 6) % (sf - 2*ppm)) + 1);
+                }
+            }
+        }
+    }
 
-        /* advance packet FIFO */
-        lgw_reg_w(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, 0);
+    /* FSK timestamp correction */
+    hal->tstamp_fsk = (hal->fsk_rx_dr != 0) ? (((uint32_t)680000 / hal->fsk_rx_dr) - 20) : 0;
+
+    hal->rx_tables_ready = true;
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+uint32_t lgw_tstamp_correction(uint8_t if_chain, uint32_t datarate, uint8_t coderate, bool crc_en, uint16_t size) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    int32_t sf;
+
+    if ((hal->rx_tables_ready == false) || (if_chain >= LGW_IF_CHAIN_NB) || (size > 255)) {
+        return 0;
     }
 
-    return nb_pkt_fetch;
+    switch (ifmod_config[if_chain]) {
+        case IF_LORA_MULTI:
+        case IF_LORA_STD:
+            /* DR_LORA_SF7 (0x02) to DR_LORA_SF12 (0x40) are single bits, no switch to mispredict on mixed traffic */
+            if ((datarate == 0) || ((datarate & DR_LORA_MULTI) != datarate) || ((datarate & (datarate - 1)) != 0)) {
+                return 0;
+            }
+            sf = __builtin_ctz(datarate) + 6;
+            return tstamp_lora_correction(&hal->tstamp_lora[(ifmod_config[if_chain] == IF_LORA_STD) ? TSTAMP_LORA_STD : TSTAMP_LORA_MULTI], (uint32_t)sf, coderate, size + ((crc_en == true) ? 2 : 0));
+        case IF_FSK_STD:
+            return hal->tstamp_fsk;
+        default:
+            return 0;
+    }
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
-int lgw_send(struct lgw_pkt_tx_s pkt_data) {
+static int lgw_send_nolock(struct lgw_pkt_tx_s pkt_data) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
     int i, x;
     uint8_t buff[256+TX_METADATA_NB]; /* buffer to prepare the packet to send + metadata before SPI write burst */
     uint32_t part_int = 0; /* integer part for PLL register value calculation */
@@ -1346,7 +2361,7 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
     bool tx_notch_enable = false;
 
     /* check if the concentrator is running */
-    if (lgw_is_started == false) {
+    if (hal->lgw_is_started == false) {
         DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE SENDING\n");
         return LGW_HAL_ERROR;
     }
@@ -1358,11 +2373,11 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
     }
 
     /* check input variables */
-    if (rf_tx_enable[pkt_data.rf_chain] == false) {
+    if (hal->rf_tx_enable[pkt_data.rf_chain] == false) {
         DEBUG_MSG("ERROR: SELECTED RF_CHAIN IS DISABLED FOR TX ON SELECTED BOARD\n");
         return LGW_HAL_ERROR;
     }
-    if (rf_enable[pkt_data.rf_chain] == false) {
+    if (hal->rf_enable[pkt_data.rf_chain] == false) {
         DEBUG_MSG("ERROR: SELECTED RF_CHAIN IS DISABLED\n");
         return LGW_HAL_ERROR;
     }
@@ -1414,31 +2429,34 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
     tx_start_delay = lgw_get_tx_start_delay(tx_notch_enable, pkt_data.bandwidth);
 
     /* interpretation of TX power */
-    for (pow_index = txgain_lut.size-1; pow_index > 0; pow_index--) {
-        if (txgain_lut.lut[pow_index].rf_power <= pkt_data.rf_power) {
+    for (pow_index = hal->txgain_lut.size-1; pow_index > 0; pow_index--) {
+        if (hal->txgain_lut.lut[pow_index].rf_power <= pkt_data.rf_power) {
             break;
         }
     }
 
+    /* TX configuration and TX buffer are sent in as few SPI messages as possible */
+    lgw_reg_batch_begin();
+
     /* loading TX imbalance correction */
-    target_mix_gain = txgain_lut.lut[pow_index].mix_gain;
+    target_mix_gain = hal->txgain_lut.lut[pow_index].mix_gain;
     if (pkt_data.rf_chain == 0) { /* use radio A calibration table */
-        lgw_reg_w(LGW_TX_OFFSET_I, cal_offset_a_i[target_mix_gain - 8]);
-        lgw_reg_w(LGW_TX_OFFSET_Q, cal_offset_a_q[target_mix_gain - 8]);
+        lgw_reg_w(LGW_TX_OFFSET_I, hal->cal_offset_a_i[target_mix_gain - 8]);
+        lgw_reg_w(LGW_TX_OFFSET_Q, hal->cal_offset_a_q[target_mix_gain - 8]);
     } else { /* use radio B calibration table */
-        lgw_reg_w(LGW_TX_OFFSET_I, cal_offset_b_i[target_mix_gain - 8]);
-        lgw_reg_w(LGW_TX_OFFSET_Q, cal_offset_b_q[target_mix_gain - 8]);
+        lgw_reg_w(LGW_TX_OFFSET_I, hal->cal_offset_b_i[target_mix_gain - 8]);
+        lgw_reg_w(LGW_TX_OFFSET_Q, hal->cal_offset_b_q[target_mix_gain - 8]);
     }
 
     /* Set digital gain from LUT */
-    lgw_reg_w(LGW_TX_GAIN, txgain_lut.lut[pow_index].dig_gain);
+    lgw_reg_w(LGW_TX_GAIN, hal->txgain_lut.lut[pow_index].dig_gain);
 
     /* fixed metadata, useful payload and misc metadata compositing */
     transfer_size = TX_METADATA_NB + pkt_data.size; /*  */
     payload_offset = TX_METADATA_NB; /* start the payload just after the metadata */
 
     /* metadata 0 to 2, TX PLL frequency */
-    switch (rf_radio_type[0]) { /* we assume that there is only one radio type on the board */
+    switch (hal->rf_radio_type[0]) { /* we assume that there is only one radio type on the board */
         case LGW_RADIO_TYPE_SX1255:
             part_int = pkt_data.freq_hz / (SX125x_32MHz_FRAC << 7); /* integer part, gives the MSB */
             part_frac = ((pkt_data.freq_hz % (SX125x_32MHz_FRAC << 7)) << 9) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
@@ -1448,7 +2466,7 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
             part_frac = ((pkt_data.freq_hz % (SX125x_32MHz_FRAC << 8)) << 8) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
             break;
         default:
-            DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", rf_radio_type[0]);
+            DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", hal->rf_radio_type[0]);
             break;
     }
 
@@ -1518,12 +2536,7 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
         }
 
         /* metadata 12 & 13, LoRa preamble size */
-        if (pkt_data.preamble == 0) { /* if not explicit, use recommended LoRa preamble size */
-            pkt_data.preamble = STD_LORA_PREAMBLE;
-        } else if (pkt_data.preamble < MIN_LORA_PREAMBLE) { /* enforce minimum preamble size */
-            pkt_data.preamble = MIN_LORA_PREAMBLE;
-            DEBUG_MSG("Note: preamble length adjusted to respect minimum LoRa preamble size\n");
-        }
+        tx_preamble_adjust(&pkt_data);
         buff[12] = 0xFF & (pkt_data.preamble >> 8);
         buff[13] = 0xFF & pkt_data.preamble;
 
@@ -1559,12 +2572,7 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
         buff[11] = 0x01 | (pkt_data.no_crc?0:0x02) | (0x02 << 2); /* always in variable length packet mode, whitening, and CCITT CRC if CRC is not disabled  */
 
         /* metadata 12 & 13, FSK preamble size */
-        if (pkt_data.preamble == 0) { /* if not explicit, use LoRa MAC preamble size */
-            pkt_data.preamble = STD_FSK_PREAMBLE;
-        } else if (pkt_data.preamble < MIN_FSK_PREAMBLE) { /* enforce minimum preamble size */
-            pkt_data.preamble = MIN_FSK_PREAMBLE;
-            DEBUG_MSG("Note: preamble length adjusted to respect minimum FSK preamble size\n");
-        }
+        tx_preamble_adjust(&pkt_data);
         buff[12] = 0xFF & (pkt_data.preamble >> 8);
         buff[13] = 0xFF & pkt_data.preamble;
 
@@ -1583,6 +2591,7 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
 
     } else {
         DEBUG_MSG("ERROR: INVALID TX MODULATION..\n");
+        lgw_reg_batch_end();
         return LGW_HAL_ERROR;
     }
 
@@ -1598,6 +2607,7 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
     /* put metadata + payload in the TX data buffer */
     lgw_reg_w(LGW_TX_DATA_BUF_ADDR, 0);
     lgw_reg_wb(LGW_TX_DATA_BUF_DATA, buff, transfer_size);
+    lgw_reg_batch_end();
     DEBUG_ARRAY(i, transfer_size, buff);
 
     x = lbt_is_channel_free(&pkt_data, tx_start_delay, &tx_allowed);
@@ -1633,15 +2643,134 @@ int lgw_send(struct lgw_pkt_tx_s pkt_data) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_send(struct lgw_pkt_tx_s pkt_data) {
+    int x;
+
+    /* the end of the packet is computed from the preamble actually sent */
+    tx_preamble_adjust(&pkt_data);
+
+    hal_lock();
+    x = lgw_send_nolock(pkt_data);
+    if (x == LGW_HAL_SUCCESS) {
+        lgw_tx_end_setup(&pkt_data);
+    }
+    hal_unlock();
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_send_wait(int timeout_ms) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    uint64_t start_us, now_us, end_us;
+    uint64_t limit_us = 0;
+    bool end_valid;
+    uint8_t status;
+    unsigned long poll_ms;
+
+    if (hal->lgw_is_started == false) {
+        DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING\n");
+        return LGW_HAL_ERROR;
+    }
+
+    start_us = monotonic_us();
+    if (timeout_ms >= 0) {
+        limit_us = start_us + ((uint64_t)timeout_ms * 1000);
+    }
+    hal_lock();
+    end_valid = hal->tx_end_valid;
+    end_us = hal->tx_end_us;
+    hal_unlock();
+
+    /* sleep until the expected end of the packet without reading the TX status */
+    if ((end_valid == true) && (end_us > start_us)) {
+        if ((timeout_ms >= 0) && (end_us > limit_us)) {
+            end_us = limit_us;
+        }
+        wait_ms((unsigned long)((end_us - start_us + 999) / 1000));
+    }
+
+    /* confirm, then poll only if the TX is late or its end was unknown */
+    poll_ms = (end_valid == true) ? TX_WAIT_POLL_MS : TX_WAIT_POLL_ANY_MS;
+    for (;;) {
+        if (lgw_status(TX_STATUS, &status) != LGW_HAL_SUCCESS) {
+            return LGW_HAL_ERROR;
+        }
+        if (status == TX_FREE) {
+            return LGW_HAL_SUCCESS;
+        }
+        now_us = monotonic_us();
+        if ((timeout_ms >= 0) && (now_us >= limit_us)) {
+            DEBUG_MSG("WARNING: TIMEOUT WAITING FOR END OF TX\n");
+            return LGW_HAL_ERROR;
+        }
+        wait_ms(poll_ms);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_tx_notify_fd(void) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    int fd;
+
+    hal_lock();
+    if (hal->tx_notify_fd < 0) {
+        hal->tx_notify_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (hal->tx_notify_fd < 0) {
+            DEBUG_MSG("ERROR: FAILED TO CREATE TX NOTIFICATION TIMER\n");
+        }
+        lgw_tx_notify_arm(); /* a packet may already be on its way */
+    }
+    fd = hal->tx_notify_fd;
+    hal_unlock();
+
+    return fd;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_lbt_pick_channel(struct lgw_pkt_tx_s *pkt_data, const uint32_t *freq_hz, uint8_t nb_freq, int *index) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    uint16_t tx_start_delay = 0;
+    int x;
+
+    /* check input variables */
+    CHECK_NULL(pkt_data);
+    CHECK_NULL(freq_hz);
+    CHECK_NULL(index);
+
+    hal_lock();
+    if (hal->lgw_is_started == false) {
+        hal_unlock();
+        DEBUG_MSG("ERROR: CONCENTRATOR IS NOT RUNNING, START IT BEFORE PICKING A CHANNEL\n");
+        return LGW_HAL_ERROR;
+    }
+
+    /* same start delay as lgw_send, only needed for packets sent on PPS */
+    if (pkt_data->tx_mode == ON_GPS) {
+        tx_start_delay = lgw_get_tx_start_delay((pkt_data->modulation == MOD_LORA) && (pkt_data->bandwidth == BW_125KHZ), pkt_data->bandwidth);
+    }
+    x = lbt_pick_channel(pkt_data, tx_start_delay, freq_hz, nb_freq, index);
+    hal_unlock();
+
+    return (x == LGW_LBT_SUCCESS) ? LGW_HAL_SUCCESS : LGW_HAL_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_status(uint8_t select, uint8_t *code) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
     int32_t read_value;
 
     /* check input variables */
     CHECK_NULL(code);
 
     if (select == TX_STATUS) {
+        hal_lock();
         lgw_reg_r(LGW_TX_STATUS, &read_value);
-        if (lgw_is_started == false) {
+        hal_unlock();
+        if (hal->lgw_is_started == false) {
             *code = TX_OFF;
         } else if ((read_value & 0x10) == 0) { /* bit 4 @1: TX programmed */
             *code = TX_FREE;
@@ -1668,7 +2797,9 @@ int lgw_status(uint8_t select, uint8_t *code) {
 int lgw_abort_tx(void) {
     int i;
 
+    hal_lock();
     i = lgw_reg_w(LGW_TX_TRIG_ALL, 0);
+    hal_unlock();
 
     if (i == LGW_REG_SUCCESS) return LGW_HAL_SUCCESS;
     else return LGW_HAL_ERROR;
@@ -1680,7 +2811,9 @@ int lgw_get_trigcnt(uint32_t* trig_cnt_us) {
     int i;
     int32_t val;
 
+    hal_lock();
     i = lgw_reg_r(LGW_TIMESTAMP, &val);
+    hal_unlock();
     if (i == LGW_REG_SUCCESS) {
         *trig_cnt_us = (uint32_t)val;
         return LGW_HAL_SUCCESS;
@@ -1691,6 +2824,57 @@ int lgw_get_trigcnt(uint32_t* trig_cnt_us) {
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_get_instcnt(uint32_t* inst_cnt_us) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(inst_cnt_us);
+
+    hal_lock();
+    i = cnt_sync_read(hal);
+    if (i == LGW_REG_SUCCESS) {
+        *inst_cnt_us = hal->cnt_sync_us;
+    }
+    hal_unlock();
+    return (i == LGW_REG_SUCCESS) ? LGW_HAL_SUCCESS : LGW_HAL_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_get_instcnt_est(uint32_t* inst_cnt_us, uint32_t max_age_us) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
+    uint64_t age_us;
+    uint32_t phase;
+    bool sync;
+    int32_t val;
+    int i = LGW_REG_SUCCESS;
+
+    /* check input variables */
+    CHECK_NULL(inst_cnt_us);
+
+    hal_lock();
+    age_us = monotonic_us() - hal->cnt_sync_host_us;
+    sync = (hal->cnt_sync_valid == false) || (age_us > CNT_SYNC_MAX_AGE_US);
+    if ((sync == false) && (age_us > max_age_us)) {
+        /* due for a new reading, but not next to a pulse: its capture would be lost */
+        if (lgw_reg_r(LGW_TIMESTAMP, &val) == LGW_REG_SUCCESS) {
+            phase = (hal->cnt_sync_us + (uint32_t)age_us - (uint32_t)val) % 1000000;
+            sync = (phase > CNT_SYNC_PPS_GUARD_US) && (phase < (1000000 - CNT_SYNC_PPS_GUARD_US));
+        }
+    }
+    if (sync == true) {
+        i = cnt_sync_read(hal);
+    }
+    if (i == LGW_REG_SUCCESS) {
+        *inst_cnt_us = hal->cnt_sync_us + (uint32_t)(monotonic_us() - hal->cnt_sync_host_us);
+    }
+    hal_unlock();
+    return (i == LGW_REG_SUCCESS) ? LGW_HAL_SUCCESS : LGW_HAL_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 const char* lgw_version_info() {
     return lgw_version_string;
 }
@@ -1698,6 +2882,7 @@ const char* lgw_version_info() {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 uint32_t lgw_time_on_air(struct lgw_pkt_tx_s *packet) {
+    struct lgw_hal_state_s *hal = lgw_ctx_current()->hal;
     int32_t val;
     uint8_t SF, H, DE;
     uint16_t BW;
@@ -1752,7 +2937,7 @@ uint32_t lgw_time_on_air(struct lgw_pkt_tx_s *packet) {
                 PKT_PAYLOAD: x bytes
                 CRC: 0 or 2 bytes
         */
-        Tfsk = (8 * (double)(packet->preamble + fsk_sync_word_size + 1 + packet->size + ((packet->no_crc == true) ? 0 : 2)) / (double)packet->datarate) * 1E3;
+        Tfsk = (8 * (double)(packet->preamble + hal->fsk_sync_word_size + 1 + packet->size + ((packet->no_crc == true) ? 0 : 2)) / (double)packet->datarate) * 1E3;
 
         /* Duration of packet */
         Tpacket = (uint32_t)Tfsk + 1; /* add margin for rounding */
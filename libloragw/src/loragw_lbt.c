@@ -20,12 +20,14 @@ Maintainer: Michael Coracin
 #include <stdbool.h>    /* bool type */
 #include <stdio.h>      /* printf fprintf */
 #include <stdlib.h>     /* abs, labs, llabs */
-#include <string.h>     /* memset */
+#include <string.h>     /* memset memcpy */
 
+#include "loragw_reg.h"
 #include "loragw_radio.h"
 #include "loragw_aux.h"
 #include "loragw_lbt.h"
 #include "loragw_fpga.h"
+#include "loragw_ctx.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -46,35 +48,77 @@ Maintainer: Michael Coracin
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE TYPES -------------------------------------------------------- */
 
+/* LBT configuration of one concentrator context, see loragw_ctx.h */
+struct lgw_lbt_state_s {
+    bool        lbt_enable;
+    uint8_t     lbt_nb_active_channel;
+    int8_t      lbt_rssi_target_dBm;
+    int8_t      lbt_rssi_offset_dB;
+    uint32_t    lbt_start_freq;
+    struct lgw_conf_lbt_chan_s lbt_channel_cfg[LBT_CHANNEL_FREQ_NB];
+    uint32_t    lbt_snapshot_max_age_us;
+    bool        lbt_snapshot_valid;
+    uint64_t    lbt_snapshot_us;                            /* host time the snapshot was read */
+    uint32_t    lbt_last_free[LBT_CHANNEL_FREQ_NB];         /* time each channel was last free, in us */
+    uint64_t    lbt_start_us;                               /* host time the LBT FSM was started */
+    bool        lbt_ready;
+    uint32_t    lbt_ready_ms;                               /* time from lbt_start to all the channels scanned */
+};
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
 /* -------------------------------------------------------------------------- */
 /* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
 
-extern void *lgw_spi_target; /*! generic pointer to the SPI device */
-extern uint8_t lgw_spi_mux_mode; /*! current SPI mux mode used */
 extern uint16_t lgw_i_tx_start_delay_us;
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-static bool lbt_enable;
-static uint8_t lbt_nb_active_channel;
-static int8_t lbt_rssi_target_dBm;
-static int8_t lbt_rssi_offset_dB;
-static uint32_t lbt_start_freq;
-static struct lgw_conf_lbt_chan_s lbt_channel_cfg[LBT_CHANNEL_FREQ_NB];
+static struct lgw_lbt_state_s lbt_state_dflt; /* state of the default context */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
 
 bool is_equal_freq(uint32_t a, uint32_t b);
 
+static int lbt_channels_read(struct lgw_lbt_state_s *lbt, int first, int last);
+
+static int lbt_snapshot_refresh(struct lgw_lbt_state_s *lbt);
+
+static int lbt_tx_start_time(struct lgw_pkt_tx_s *pkt_data, uint16_t tx_start_delay, uint32_t *tx_start_time);
+
+static uint32_t lbt_channel_find(struct lgw_lbt_state_s *lbt, uint32_t freq_hz, uint8_t bandwidth, int *ch1, int *ch2);
+
+static int32_t lbt_tx_margin(struct lgw_lbt_state_s *lbt, struct lgw_pkt_tx_s *pkt_data, uint32_t tx_start_time, int ch1, int ch2, uint32_t tx_max_time);
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
+struct lgw_lbt_state_s *lgw_lbt_state_new(bool dflt) {
+    struct lgw_lbt_state_s *state;
+
+    state = (dflt == true) ? &lbt_state_dflt : malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
+    }
+    memset(state, 0, sizeof *state);
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_lbt_state_free(struct lgw_lbt_state_s *state) {
+    if ((state != NULL) && (state != &lbt_state_dflt)) {
+        free(state);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lbt_setconf(struct lgw_conf_lbt_s * conf) {
+    struct lgw_lbt_state_s *lbt = lgw_ctx_current()->lbt;
     int i;
 
     /* Check input parameters */
@@ -87,17 +131,19 @@ int lbt_setconf(struct lgw_conf_lbt_s * conf) {
     }
 
     /* Initialize LBT channels configuration */
-    memset(lbt_channel_cfg, 0, sizeof lbt_channel_cfg);
+    memset(lbt->lbt_channel_cfg, 0, sizeof lbt->lbt_channel_cfg);
 
     /* Set internal LBT config according to parameters */
-    lbt_enable = conf->enable;
-    lbt_nb_active_channel = conf->nb_channel;
-    lbt_rssi_target_dBm = conf->rssi_target;
-    lbt_rssi_offset_dB = conf->rssi_offset;
-
-    for (i=0; i<lbt_nb_active_channel; i++) {
-        lbt_channel_cfg[i].freq_hz = conf->channels[i].freq_hz;
-        lbt_channel_cfg[i].scan_time_us = conf->channels[i].scan_time_us;
+    lbt->lbt_enable = conf->enable;
+    lbt->lbt_nb_active_channel = conf->nb_channel;
+    lbt->lbt_rssi_target_dBm = conf->rssi_target;
+    lbt->lbt_rssi_offset_dB = conf->rssi_offset;
+    lbt->lbt_snapshot_max_age_us = conf->snapshot_max_age_us;
+    lbt->lbt_snapshot_valid = false;
+
+    for (i=0; i<lbt->lbt_nb_active_channel; i++) {
+        lbt->lbt_channel_cfg[i].freq_hz = conf->channels[i].freq_hz;
+        lbt->lbt_channel_cfg[i].scan_time_us = conf->channels[i].scan_time_us;
     }
 
     return LGW_LBT_SUCCESS;
@@ -106,6 +152,7 @@ int lbt_setconf(struct lgw_conf_lbt_s * conf) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lbt_setup(void) {
+    struct lgw_lbt_state_s *lbt = lgw_ctx_current()->lbt;
     int x, i;
     int32_t val;
     uint32_t freq_offset;
@@ -129,10 +176,10 @@ int lbt_setup(void) {
     }
     switch(val) {
         case 0:
-            lbt_start_freq = 915000000;
+            lbt->lbt_start_freq = 915000000;
             break;
         case 1:
-            lbt_start_freq = 863000000;
+            lbt->lbt_start_freq = 863000000;
             break;
         default:
             DEBUG_PRINTF("ERROR: LBT start frequency %d is not supported\n", val);
@@ -140,43 +187,43 @@ int lbt_setup(void) {
     }
 
     /* Configure SX127x for FSK */
-    x = lgw_setup_sx127x(lbt_start_freq, MOD_FSK, LGW_SX127X_RXBW_100K_HZ, lbt_rssi_offset_dB); /* 200KHz LBT channels */
+    x = lgw_setup_sx127x(lbt->lbt_start_freq, MOD_FSK, LGW_SX127X_RXBW_100K_HZ, lbt->lbt_rssi_offset_dB); /* 200KHz LBT channels */
     if (x != LGW_REG_SUCCESS) {
         DEBUG_MSG("ERROR: Failed to configure SX127x for LBT\n");
         return LGW_LBT_ERROR;
     }
 
     /* Configure FPGA for LBT */
-    val = -2*lbt_rssi_target_dBm; /* Convert RSSI target in dBm to FPGA register format */
+    val = -2*lbt->lbt_rssi_target_dBm; /* Convert RSSI target in dBm to FPGA register format */
     x = lgw_fpga_reg_w(LGW_FPGA_RSSI_TARGET, val);
     if (x != LGW_REG_SUCCESS) {
         DEBUG_MSG("ERROR: Failed to configure FPGA for LBT\n");
         return LGW_LBT_ERROR;
     }
     /* Set default values for non-active LBT channels */
-    for (i=lbt_nb_active_channel; i<LBT_CHANNEL_FREQ_NB; i++) {
-        lbt_channel_cfg[i].freq_hz = lbt_start_freq;
-        lbt_channel_cfg[i].scan_time_us = 128; /* fastest scan for non-active channels */
+    for (i=lbt->lbt_nb_active_channel; i<LBT_CHANNEL_FREQ_NB; i++) {
+        lbt->lbt_channel_cfg[i].freq_hz = lbt->lbt_start_freq;
+        lbt->lbt_channel_cfg[i].scan_time_us = 128; /* fastest scan for non-active channels */
     }
     /* Configure FPGA for both active and non-active LBT channels */
     for (i=0; i<LBT_CHANNEL_FREQ_NB; i++) {
         /* Check input parameters */
-        if (lbt_channel_cfg[i].freq_hz < lbt_start_freq) {
-            DEBUG_PRINTF("ERROR: LBT channel frequency is out of range (%u)\n", lbt_channel_cfg[i].freq_hz);
+        if (lbt->lbt_channel_cfg[i].freq_hz < lbt->lbt_start_freq) {
+            DEBUG_PRINTF("ERROR: LBT channel frequency is out of range (%u)\n", lbt->lbt_channel_cfg[i].freq_hz);
             return LGW_LBT_ERROR;
         }
-        if ((lbt_channel_cfg[i].scan_time_us != 128) && (lbt_channel_cfg[i].scan_time_us != 5000)) {
-            DEBUG_PRINTF("ERROR: LBT channel scan time is not supported (%u)\n", lbt_channel_cfg[i].scan_time_us);
+        if ((lbt->lbt_channel_cfg[i].scan_time_us != 128) && (lbt->lbt_channel_cfg[i].scan_time_us != 5000)) {
+            DEBUG_PRINTF("ERROR: LBT channel scan time is not supported (%u)\n", lbt->lbt_channel_cfg[i].scan_time_us);
             return LGW_LBT_ERROR;
         }
         /* Configure */
-        freq_offset = (lbt_channel_cfg[i].freq_hz - lbt_start_freq) / 100E3; /* 100kHz unit */
+        freq_offset = (lbt->lbt_channel_cfg[i].freq_hz - lbt->lbt_start_freq) / 100E3; /* 100kHz unit */
         x = lgw_fpga_reg_w(LGW_FPGA_LBT_CH0_FREQ_OFFSET+i, (int32_t)freq_offset);
         if (x != LGW_REG_SUCCESS) {
             DEBUG_PRINTF("ERROR: Failed to configure FPGA for LBT channel %d (freq offset)\n", i);
             return LGW_LBT_ERROR;
         }
-        if (lbt_channel_cfg[i].scan_time_us == 5000) { /* configured to 128 by default */
+        if (lbt->lbt_channel_cfg[i].scan_time_us == 5000) { /* configured to 128 by default */
             x = lgw_fpga_reg_w(LGW_FPGA_LBT_SCAN_TIME_CH0+i, 1);
             if (x != LGW_REG_SUCCESS) {
                 DEBUG_PRINTF("ERROR: Failed to configure FPGA for LBT channel %d (freq offset)\n", i);
@@ -186,13 +233,13 @@ int lbt_setup(void) {
     }
 
     DEBUG_MSG("Note: LBT configuration:\n");
-    DEBUG_PRINTF("\tlbt_enable: %d\n", lbt_enable );
-    DEBUG_PRINTF("\tlbt_nb_active_channel: %d\n", lbt_nb_active_channel );
-    DEBUG_PRINTF("\tlbt_start_freq: %d\n", lbt_start_freq);
-    DEBUG_PRINTF("\tlbt_rssi_target: %d\n", lbt_rssi_target_dBm );
+    DEBUG_PRINTF("\tlbt_enable: %d\n", lbt->lbt_enable );
+    DEBUG_PRINTF("\tlbt_nb_active_channel: %d\n", lbt->lbt_nb_active_channel );
+    DEBUG_PRINTF("\tlbt_start_freq: %d\n", lbt->lbt_start_freq);
+    DEBUG_PRINTF("\tlbt_rssi_target: %d\n", lbt->lbt_rssi_target_dBm );
     for (i=0; i<LBT_CHANNEL_FREQ_NB; i++) {
-        DEBUG_PRINTF("\tlbt_channel_cfg[%d].freq_hz: %u\n", i, lbt_channel_cfg[i].freq_hz );
-        DEBUG_PRINTF("\tlbt_channel_cfg[%d].scan_time_us: %u\n", i, lbt_channel_cfg[i].scan_time_us );
+        DEBUG_PRINTF("\tlbt_channel_cfg[%d].freq_hz: %u\n", i, lbt->lbt_channel_cfg[i].freq_hz );
+        DEBUG_PRINTF("\tlbt_channel_cfg[%d].scan_time_us: %u\n", i, lbt->lbt_channel_cfg[i].scan_time_us );
     }
 
     return LGW_LBT_SUCCESS;
@@ -202,13 +249,17 @@ int lbt_setup(void) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lbt_start(void) {
+    struct lgw_lbt_state_s *lbt = lgw_ctx_current()->lbt;
     int x;
 
+    lbt->lbt_snapshot_valid = false;
+    lbt->lbt_ready = false;
     x = lgw_fpga_reg_w(LGW_FPGA_CTRL_FEATURE_START, 1);
     if (x != LGW_REG_SUCCESS) {
         DEBUG_MSG("ERROR: Failed to start LBT FSM\n");
         return LGW_LBT_ERROR;
     }
+    lbt->lbt_start_us = monotonic_us();
 
     return LGW_LBT_SUCCESS;
 }
@@ -216,19 +267,13 @@ int lbt_start(void) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay, bool * tx_allowed) {
-    int i;
-    int32_t val;
+    struct lgw_lbt_state_s *lbt = lgw_ctx_current()->lbt;
     uint32_t tx_start_time = 0;
-    uint32_t tx_end_time = 0;
-    uint32_t delta_time = 0;
-    uint32_t sx1301_time = 0;
-    uint32_t lbt_time = 0;
-    uint32_t lbt_time1 = 0;
-    uint32_t lbt_time2 = 0;
     uint32_t tx_max_time = 0;
     int lbt_channel_decod_1 = -1;
     int lbt_channel_decod_2 = -1;
-    uint32_t packet_duration = 0;
+    int32_t margin;
+    int x;
 
     /* Check input parameters */
     if ((pkt_data == NULL) || (tx_allowed == NULL)) {
@@ -236,7 +281,7 @@ int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay,
     }
 
     /* Check if TX is allowed */
-    if (lbt_enable == true) {
+    if (lbt->lbt_enable == true) {
         /* TX allowed for LoRa only */
         if (pkt_data->modulation != MOD_LORA) {
             *tx_allowed = false;
@@ -244,108 +289,30 @@ int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay,
             return LGW_LBT_SUCCESS;
         }
 
-        /* Get SX1301 time at last PPS */
-        lgw_get_trigcnt(&sx1301_time);
-
         DEBUG_MSG("################################\n");
-        switch(pkt_data->tx_mode) {
-            case TIMESTAMPED:
-                DEBUG_MSG("tx_mode                    = TIMESTAMPED\n");
-                tx_start_time = pkt_data->count_us & LBT_TIMESTAMP_MASK;
-                break;
-            case ON_GPS:
-                DEBUG_MSG("tx_mode                    = ON_GPS\n");
-                tx_start_time = (sx1301_time + (uint32_t)tx_start_delay + 1000000) & LBT_TIMESTAMP_MASK;
-                break;
-            case IMMEDIATE:
-                DEBUG_MSG("ERROR: tx_mode IMMEDIATE is not supported when LBT is enabled\n");
-                /* FALLTHROUGH  */
-            default:
-                return LGW_LBT_ERROR;
+        if (lbt_tx_start_time(pkt_data, tx_start_delay, &tx_start_time) != LGW_LBT_SUCCESS) {
+            return LGW_LBT_ERROR;
         }
 
         /* Select LBT Channel corresponding to required TX frequency */
-        lbt_channel_decod_1 = -1;
-        lbt_channel_decod_2 = -1;
-        if (pkt_data->bandwidth == BW_125KHZ) {
-            for (i=0; i<lbt_nb_active_channel; i++) {
-                if (is_equal_freq(pkt_data->freq_hz, lbt_channel_cfg[i].freq_hz) == true) {
-                    DEBUG_PRINTF("LBT: select channel %d (%u Hz)\n", i, lbt_channel_cfg[i].freq_hz);
-                    lbt_channel_decod_1 = i;
-                    lbt_channel_decod_2 = i;
-                    if (lbt_channel_cfg[i].scan_time_us == 5000) {
-                        tx_max_time = 4000000; /* 4 seconds */
-                    } else { /* scan_time_us = 128 */
-                        tx_max_time = 400000; /* 400 milliseconds */
-                    }
-                    break;
-                }
-            }
-        } else if (pkt_data->bandwidth == BW_250KHZ) {
-            /* In case of 250KHz, the TX freq has to be in between 2 consecutive channels of 200KHz BW.
-                The TX can only be over 2 channels, not more */
-            for (i=0; i<(lbt_nb_active_channel-1); i++) {
-                if ((is_equal_freq(pkt_data->freq_hz, (lbt_channel_cfg[i].freq_hz+lbt_channel_cfg[i+1].freq_hz)/2) == true) && ((lbt_channel_cfg[i+1].freq_hz-lbt_channel_cfg[i].freq_hz)==200E3)) {
-                    DEBUG_PRINTF("LBT: select channels %d,%d (%u Hz)\n", i, i+1, (lbt_channel_cfg[i].freq_hz+lbt_channel_cfg[i+1].freq_hz)/2);
-                    lbt_channel_decod_1 = i;
-                    lbt_channel_decod_2 = i+1;
-                    if (lbt_channel_cfg[i].scan_time_us == 5000) {
-                        tx_max_time = 4000000; /* 4 seconds */
-                    } else { /* scan_time_us = 128 */
-                        tx_max_time = 200000; /* 200 milliseconds */
-                    }
-                    break;
-                }
-            }
-        } else {
-            /* Nothing to do for now */
-        }
+        tx_max_time = lbt_channel_find(lbt, pkt_data->freq_hz, pkt_data->bandwidth, &lbt_channel_decod_1, &lbt_channel_decod_2);
 
-        /* Get last time when selected channel was free */
+        /* Get last time when selected channel was free, from the snapshot if it is recent enough */
         if ((lbt_channel_decod_1 >= 0) && (lbt_channel_decod_2 >= 0)) {
-            lgw_fpga_reg_w(LGW_FPGA_LBT_TIMESTAMP_SELECT_CH, (int32_t)lbt_channel_decod_1);
-            lgw_fpga_reg_r(LGW_FPGA_LBT_TIMESTAMP_CH, &val);
-            lbt_time = lbt_time1 = (uint32_t)(val & 0x0000FFFF) * 256; /* 16bits (1LSB = 256µs) */
-
-            if (lbt_channel_decod_1 != lbt_channel_decod_2 ) {
-                lgw_fpga_reg_w(LGW_FPGA_LBT_TIMESTAMP_SELECT_CH, (int32_t)lbt_channel_decod_2);
-                lgw_fpga_reg_r(LGW_FPGA_LBT_TIMESTAMP_CH, &val);
-                lbt_time2 = (uint32_t)(val & 0x0000FFFF) * 256; /* 16bits (1LSB = 256µs) */
-
-                if (lbt_time2 < lbt_time1) {
-                    lbt_time = lbt_time2;
-                }
+            if (lbt->lbt_snapshot_max_age_us == 0) {
+                x = lbt_channels_read(lbt, lbt_channel_decod_1, lbt_channel_decod_2);
+            } else {
+                x = lbt_snapshot_refresh(lbt);
+            }
+            if (x != LGW_LBT_SUCCESS) {
+                DEBUG_MSG("ERROR: Failed to read LBT channels timestamps\n");
+                return LGW_LBT_ERROR;
             }
-        } else {
-            lbt_time = 0;
-        }
-
-        packet_duration = lgw_time_on_air(pkt_data) * 1000UL;
-        tx_end_time = (tx_start_time + packet_duration) & LBT_TIMESTAMP_MASK;
-        if (lbt_time < tx_end_time) {
-            delta_time = tx_end_time - lbt_time;
-        } else {
-            /* It means LBT counter has wrapped */
-            printf("LBT: lbt counter has wrapped\n");
-            delta_time = (LBT_TIMESTAMP_MASK - lbt_time) + tx_end_time;
         }
 
-        DEBUG_PRINTF("sx1301_time                = %u\n", sx1301_time & LBT_TIMESTAMP_MASK);
-        DEBUG_PRINTF("tx_freq                    = %u\n", pkt_data->freq_hz);
-        DEBUG_MSG("------------------------------------------------\n");
-        DEBUG_PRINTF("packet_duration            = %u\n", packet_duration);
-        DEBUG_PRINTF("tx_start_time              = %u\n", tx_start_time);
-        DEBUG_PRINTF("lbt_time1                  = %u\n", lbt_time1);
-        DEBUG_PRINTF("lbt_time2                  = %u\n", lbt_time2);
-        DEBUG_PRINTF("lbt_time                   = %u\n", lbt_time);
-        DEBUG_PRINTF("delta_time                 = %u\n", delta_time);
-        DEBUG_MSG("------------------------------------------------\n");
-
         /* send data if allowed */
-        /* lbt_time: last time when channel was free */
-        /* tx_max_time: maximum time allowed to send packet since last free time */
-        /* 2048: some margin */
-        if ((delta_time < (tx_max_time - 2048)) && (lbt_time != 0)) {
+        margin = lbt_tx_margin(lbt, pkt_data, tx_start_time, lbt_channel_decod_1, lbt_channel_decod_2, tx_max_time);
+        if (margin > 0) {
             *tx_allowed = true;
         } else {
             DEBUG_MSG("ERROR: TX request rejected (LBT)\n");
@@ -361,13 +328,296 @@ int lbt_is_channel_free(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay,
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lbt_pick_channel(struct lgw_pkt_tx_s * pkt_data, uint16_t tx_start_delay, const uint32_t * freq_hz, uint8_t nb_freq, int * index) {
+    struct lgw_lbt_state_s *lbt = lgw_ctx_current()->lbt;
+    uint32_t tx_start_time = 0;
+    uint32_t tx_max_time;
+    int ch1, ch2;
+    int32_t margin;
+    int32_t margin_best = 0;
+    int i;
+
+    /* Check input parameters */
+    if ((pkt_data == NULL) || (freq_hz == NULL) || (nb_freq == 0) || (index == NULL)) {
+        return LGW_LBT_ERROR;
+    }
+    *index = -1;
+
+    /* Without LBT, any candidate will do */
+    if (lbt->lbt_enable == false) {
+        *index = 0;
+        return LGW_LBT_SUCCESS;
+    }
+    if (pkt_data->modulation != MOD_LORA) {
+        DEBUG_PRINTF("INFO: TX is not allowed for this modulation (%x)\n", pkt_data->modulation);
+        return LGW_LBT_SUCCESS;
+    }
+    if (lbt_tx_start_time(pkt_data, tx_start_delay, &tx_start_time) != LGW_LBT_SUCCESS) {
+        return LGW_LBT_ERROR;
+    }
+
+    /* One batched read of all the channels, or the current snapshot */
+    if (lbt_snapshot_refresh(lbt) != LGW_LBT_SUCCESS) {
+        DEBUG_MSG("ERROR: Failed to read LBT channels timestamps\n");
+        return LGW_LBT_ERROR;
+    }
+
+    for (i=0; i<nb_freq; i++) {
+        tx_max_time = lbt_channel_find(lbt, freq_hz[i], pkt_data->bandwidth, &ch1, &ch2);
+        margin = lbt_tx_margin(lbt, pkt_data, tx_start_time, ch1, ch2, tx_max_time);
+        DEBUG_PRINTF("LBT: candidate %u Hz, margin %d us\n", freq_hz[i], margin);
+        if (margin > margin_best) {
+            margin_best = margin;
+            *index = i;
+        }
+    }
+
+    return LGW_LBT_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 bool lbt_is_enabled(void) {
-    return lbt_enable;
+    struct lgw_lbt_state_s *lbt = lgw_ctx_current()->lbt;
+    return lbt->lbt_enable;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lbt_wait_ready(uint32_t timeout_ms, bool * ready) {
+    struct lgw_lbt_state_s *lbt = lgw_ctx_current()->lbt;
+    uint64_t end_us;
+    int i;
+
+    /* Check input parameters */
+    if (ready == NULL) {
+        return LGW_LBT_ERROR;
+    }
+    *ready = false;
+
+    end_us = monotonic_us() + ((uint64_t)timeout_ms * 1000);
+    while (true) {
+        if (lbt_channels_read(lbt, 0, lbt->lbt_nb_active_channel - 1) != LGW_LBT_SUCCESS) {
+            DEBUG_MSG("ERROR: Failed to read LBT channels timestamps\n");
+            return LGW_LBT_ERROR;
+        }
+        for (i=0; (i<lbt->lbt_nb_active_channel) && (lbt->lbt_last_free[i] != 0); i++);
+        if (i == lbt->lbt_nb_active_channel) {
+            lbt->lbt_ready_ms = (uint32_t)((monotonic_us() - lbt->lbt_start_us) / 1000);
+            lbt->lbt_ready = true;
+            *ready = true;
+            DEBUG_PRINTF("Note: LBT channels ready %u ms after start\n", lbt->lbt_ready_ms);
+            return LGW_LBT_SUCCESS;
+        }
+        if (monotonic_us() >= end_us) {
+            DEBUG_PRINTF("WARNING: LBT channel %d not scanned after %u ms\n", i, timeout_ms);
+            return LGW_LBT_SUCCESS;
+        }
+        wait_ms(LBT_READY_POLL_MS);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lbt_get_ready_time(uint32_t * ready_ms) {
+    struct lgw_lbt_state_s *lbt = lgw_ctx_current()->lbt;
+
+    /* Check input parameters */
+    if ((ready_ms == NULL) || (lbt->lbt_ready == false)) {
+        return LGW_LBT_ERROR;
+    }
+    *ready_ms = lbt->lbt_ready_ms;
+
+    return LGW_LBT_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lbt_snapshot(uint32_t *last_free) {
+    struct lgw_lbt_state_s *lbt = lgw_ctx_current()->lbt;
+    int x;
+
+    lgw_ctx_lock();
+    x = lbt_channels_read(lbt, 0, lbt->lbt_nb_active_channel - 1);
+    if ((x == LGW_LBT_SUCCESS) && (last_free != NULL)) {
+        memcpy(last_free, lbt->lbt_last_free, sizeof lbt->lbt_last_free);
+    }
+    lgw_ctx_unlock();
+
+    return x;
 }
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
+/* Read the timestamps of channels first to last, each channel selection is sent
+with its timestamp read in a single SPI message. Reading all the active
+channels makes a new snapshot. */
+static int lbt_channels_read(struct lgw_lbt_state_s *lbt, int first, int last) {
+    int x;
+    int i;
+    int32_t val;
+
+    if (lgw_reg_batch_begin() != LGW_REG_SUCCESS) {
+        return LGW_LBT_ERROR;
+    }
+    x = LGW_REG_SUCCESS;
+    lbt->lbt_snapshot_valid = false;
+    for (i=first; (i<=last) && (x == LGW_REG_SUCCESS); i++) {
+        x = lgw_fpga_reg_w(LGW_FPGA_LBT_TIMESTAMP_SELECT_CH, (int32_t)i);
+        if (x == LGW_REG_SUCCESS) {
+            x = lgw_fpga_reg_r(LGW_FPGA_LBT_TIMESTAMP_CH, &val);
+            lbt->lbt_last_free[i] = (uint32_t)(val & 0x0000FFFF) * 256; /* 16bits (1LSB = 256µs) */
+        }
+    }
+    if ((lgw_reg_batch_end() != LGW_REG_SUCCESS) || (x != LGW_REG_SUCCESS)) {
+        return LGW_LBT_ERROR;
+    }
+    if ((first == 0) && (last == (lbt->lbt_nb_active_channel - 1))) {
+        lbt->lbt_snapshot_us = monotonic_us();
+        lbt->lbt_snapshot_valid = true;
+    }
+
+    return LGW_LBT_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Read all the active channels unless the snapshot is recent enough */
+static int lbt_snapshot_refresh(struct lgw_lbt_state_s *lbt) {
+    if ((lbt->lbt_snapshot_valid == true) && ((monotonic_us() - lbt->lbt_snapshot_us) <= lbt->lbt_snapshot_max_age_us)) {
+        return LGW_LBT_SUCCESS;
+    }
+    return lbt_channels_read(lbt, 0, lbt->lbt_nb_active_channel - 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Start of the TX, in the 11-bits LBT timestamp unit */
+static int lbt_tx_start_time(struct lgw_pkt_tx_s *pkt_data, uint16_t tx_start_delay, uint32_t *tx_start_time) {
+    uint32_t sx1301_time = 0;
+
+    switch(pkt_data->tx_mode) {
+        case TIMESTAMPED:
+            DEBUG_MSG("tx_mode                    = TIMESTAMPED\n");
+            *tx_start_time = pkt_data->count_us & LBT_TIMESTAMP_MASK;
+            break;
+        case ON_GPS:
+            DEBUG_MSG("tx_mode                    = ON_GPS\n");
+            /* Get SX1301 time at last PPS */
+            lgw_get_trigcnt(&sx1301_time);
+            DEBUG_PRINTF("sx1301_time                = %u\n", sx1301_time & LBT_TIMESTAMP_MASK);
+            *tx_start_time = (sx1301_time + (uint32_t)tx_start_delay + 1000000) & LBT_TIMESTAMP_MASK;
+            break;
+        case IMMEDIATE:
+            DEBUG_MSG("ERROR: tx_mode IMMEDIATE is not supported when LBT is enabled\n");
+            /* FALLTHROUGH  */
+        default:
+            return LGW_LBT_ERROR;
+    }
+
+    return LGW_LBT_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Select the LBT channel(s) covering a TX frequency, returns the maximum time
+allowed to send a packet since the last free time, ch1 and ch2 are -1 if no
+channel matches */
+static uint32_t lbt_channel_find(struct lgw_lbt_state_s *lbt, uint32_t freq_hz, uint8_t bandwidth, int *ch1, int *ch2) {
+    int i;
+
+    *ch1 = -1;
+    *ch2 = -1;
+    if (bandwidth == BW_125KHZ) {
+        for (i=0; i<lbt->lbt_nb_active_channel; i++) {
+            if (is_equal_freq(freq_hz, lbt->lbt_channel_cfg[i].freq_hz) == true) {
+                DEBUG_PRINTF("LBT: select channel %d (%u Hz)\n", i, lbt->lbt_channel_cfg[i].freq_hz);
+                *ch1 = i;
+                *ch2 = i;
+                if (lbt->lbt_channel_cfg[i].scan_time_us == 5000) {
+                    return 4000000; /* 4 seconds */
+                } else { /* scan_time_us = 128 */
+                    return 400000; /* 400 milliseconds */
+                }
+            }
+        }
+    } else if (bandwidth == BW_250KHZ) {
+        /* In case of 250KHz, the TX freq has to be in between 2 consecutive channels of 200KHz BW.
+            The TX can only be over 2 channels, not more */
+        for (i=0; i<(lbt->lbt_nb_active_channel-1); i++) {
+            if ((is_equal_freq(freq_hz, (lbt->lbt_channel_cfg[i].freq_hz+lbt->lbt_channel_cfg[i+1].freq_hz)/2) == true) && ((lbt->lbt_channel_cfg[i+1].freq_hz-lbt->lbt_channel_cfg[i].freq_hz)==200E3)) {
+                DEBUG_PRINTF("LBT: select channels %d,%d (%u Hz)\n", i, i+1, (lbt->lbt_channel_cfg[i].freq_hz+lbt->lbt_channel_cfg[i+1].freq_hz)/2);
+                *ch1 = i;
+                *ch2 = i+1;
+                if (lbt->lbt_channel_cfg[i].scan_time_us == 5000) {
+                    return 4000000; /* 4 seconds */
+                } else { /* scan_time_us = 128 */
+                    return 200000; /* 200 milliseconds */
+                }
+            }
+        }
+    } else {
+        /* Nothing to do for now */
+    }
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Time left in us before the end of the packet would exceed the maximum TX time
+since the last free time of its channel(s), TX is allowed if it is positive */
+static int32_t lbt_tx_margin(struct lgw_lbt_state_s *lbt, struct lgw_pkt_tx_s *pkt_data, uint32_t tx_start_time, int ch1, int ch2, uint32_t tx_max_time) {
+    uint32_t tx_end_time = 0;
+    uint32_t delta_time = 0;
+    uint32_t lbt_time = 0;
+    uint32_t lbt_time1 = 0;
+    uint32_t lbt_time2 = 0;
+    uint32_t packet_duration = 0;
+
+    if ((ch1 < 0) || (ch2 < 0)) {
+        return -1;
+    }
+    lbt_time = lbt_time1 = lbt->lbt_last_free[ch1];
+    if (ch1 != ch2) {
+        lbt_time2 = lbt->lbt_last_free[ch2];
+        if (lbt_time2 < lbt_time1) {
+            lbt_time = lbt_time2;
+        }
+    }
+    if (lbt_time == 0) {
+        return -1;
+    }
+
+    packet_duration = lgw_time_on_air(pkt_data) * 1000UL;
+    tx_end_time = (tx_start_time + packet_duration) & LBT_TIMESTAMP_MASK;
+    if (lbt_time < tx_end_time) {
+        delta_time = tx_end_time - lbt_time;
+    } else {
+        /* It means LBT counter has wrapped */
+        printf("LBT: lbt counter has wrapped\n");
+        delta_time = (LBT_TIMESTAMP_MASK - lbt_time) + tx_end_time;
+    }
+
+    DEBUG_PRINTF("tx_freq                    = %u\n", pkt_data->freq_hz);
+    DEBUG_MSG("------------------------------------------------\n");
+    DEBUG_PRINTF("packet_duration            = %u\n", packet_duration);
+    DEBUG_PRINTF("tx_start_time              = %u\n", tx_start_time);
+    DEBUG_PRINTF("lbt_time1                  = %u\n", lbt_time1);
+    DEBUG_PRINTF("lbt_time2                  = %u\n", lbt_time2);
+    DEBUG_PRINTF("lbt_time                   = %u\n", lbt_time);
+    DEBUG_PRINTF("delta_time                 = %u\n", delta_time);
+    DEBUG_MSG("------------------------------------------------\n");
+
+    /* lbt_time: last time when channel was free */
+    /* tx_max_time: maximum time allowed to send packet since last free time */
+    /* 2048: some margin */
+    return (int32_t)(tx_max_time - 2048) - (int32_t)delta_time;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* As given frequencies have been converted from float to integer, some aliasing
 issues can appear, so we can't simply check for equality, but have to take some
 margin */
@@ -31,6 +31,7 @@ Maintainer: Michael Coracin
 #include "loragw_hal.h"
 #include "loragw_radio.h"
 #include "loragw_fpga.h"
+#include "loragw_ctx.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -99,11 +100,6 @@ const struct lgw_sx127x_FSK_bandwidth_s sx127x_FskBandwidths[] =
     { 250000, 0, 1 }    /* LGW_SX127X_RXBW_250K_HZ */
 };
 
-/* -------------------------------------------------------------------------- */
-/* --- PRIVATE VARIABLES ---------------------------------------------------- */
-
-extern void *lgw_spi_target; /*! generic pointer to the SPI device */
-
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
 
@@ -151,11 +147,13 @@ void sx125x_write(uint8_t channel, uint8_t addr, uint8_t data) {
     }
 
     /* SPI master data write procedure */
+    lgw_reg_batch_begin();
     lgw_reg_w(reg_cs, 0);
     lgw_reg_w(reg_add, 0x80 | addr); /* MSB at 1 for write operation */
     lgw_reg_w(reg_dat, data);
     lgw_reg_w(reg_cs, 1);
     lgw_reg_w(reg_cs, 0);
+    lgw_reg_batch_end();
 
     return;
 }
@@ -198,11 +196,13 @@ uint8_t sx125x_read(uint8_t channel, uint8_t addr) {
     }
 
     /* SPI master data read procedure */
+    lgw_reg_batch_begin();
     lgw_reg_w(reg_cs, 0);
     lgw_reg_w(reg_add, addr); /* MSB at 0 for read operation */
     lgw_reg_w(reg_dat, 0);
     lgw_reg_w(reg_cs, 1);
     lgw_reg_w(reg_cs, 0);
+    lgw_reg_batch_end(); /* keep the read-back in its own message, the radio transfer must be over */
     lgw_reg_r(reg_rb, &read_value);
 
     return (uint8_t)read_value;
@@ -394,10 +394,6 @@ int reset_sx127x(enum lgw_radio_type_e radio_type) {
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
 int lgw_setup_sx125x(uint8_t rf_chain, uint8_t rf_clkout, bool rf_enable, uint8_t rf_radio_type, uint32_t freq_hz) {
-    uint32_t part_int = 0;
-    uint32_t part_frac = 0;
-    int cpt_attempts = 0;
-
     if (rf_chain >= LGW_RF_CHAIN_NB) {
         DEBUG_MSG("ERROR: INVALID RF_CHAIN\n");
         return -1;
@@ -438,37 +434,10 @@ int lgw_setup_sx125x(uint8_t rf_chain, uint8_t rf_clkout, bool rf_enable, uint8_
         sx125x_write(rf_chain, 0x0D, SX125x_RX_BB_BW + SX125x_RX_ADC_TRIM*4 + SX125x_RX_ADC_BW*32);
         sx125x_write(rf_chain, 0x0E, SX125x_ADC_TEMP + SX125x_RX_PLL_BW*2);
 
-        /* set RX PLL frequency */
-        switch (rf_radio_type) {
-            case LGW_RADIO_TYPE_SX1255:
-                part_int = freq_hz / (SX125x_32MHz_FRAC << 7); /* integer part, gives the MSB */
-                part_frac = ((freq_hz % (SX125x_32MHz_FRAC << 7)) << 9) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
-                break;
-            case LGW_RADIO_TYPE_SX1257:
-                part_int = freq_hz / (SX125x_32MHz_FRAC << 8); /* integer part, gives the MSB */
-                part_frac = ((freq_hz % (SX125x_32MHz_FRAC << 8)) << 8) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
-                break;
-            default:
-                DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", rf_radio_type);
-                break;
+        /* set RX PLL frequency, start and PLL lock */
+        if (lgw_sx125x_set_rx_freq(rf_chain, rf_radio_type, freq_hz) != 0) {
+            return -1;
         }
-
-        sx125x_write(rf_chain, 0x01,0xFF & part_int); /* Most Significant Byte */
-        sx125x_write(rf_chain, 0x02,0xFF & (part_frac >> 8)); /* middle byte */
-        sx125x_write(rf_chain, 0x03,0xFF & part_frac); /* Least Significant Byte */
-
-        /* start and PLL lock */
-        do {
-            if (cpt_attempts >= PLL_LOCK_MAX_ATTEMPTS) {
-                DEBUG_MSG("ERROR: FAIL TO LOCK PLL\n");
-                return -1;
-            }
-            sx125x_write(rf_chain, 0x00, 1); /* enable Xtal oscillator */
-            sx125x_write(rf_chain, 0x00, 3); /* Enable RX (PLL+FE) */
-            ++cpt_attempts;
-            DEBUG_PRINTF("Note: SX125x #%d PLL start (attempt %d)\n", rf_chain, cpt_attempts);
-            wait_ms(1);
-        } while((sx125x_read(rf_chain, 0x11) & 0x02) == 0);
     } else {
         DEBUG_PRINTF("Note: SX125x #%d kept in standby mode\n", rf_chain);
     }
@@ -478,14 +447,83 @@ int lgw_setup_sx125x(uint8_t rf_chain, uint8_t rf_clkout, bool rf_enable, uint8_
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
+int lgw_sx125x_set_rx_freq(uint8_t rf_chain, uint8_t rf_radio_type, uint32_t freq_hz) {
+    uint32_t part_int = 0;
+    uint32_t part_frac = 0;
+    int cpt_attempts = 0;
+
+    if (rf_chain >= LGW_RF_CHAIN_NB) {
+        DEBUG_MSG("ERROR: INVALID RF_CHAIN\n");
+        return -1;
+    }
+
+    /* set RX PLL frequency */
+    switch (rf_radio_type) {
+        case LGW_RADIO_TYPE_SX1255:
+            part_int = freq_hz / (SX125x_32MHz_FRAC << 7); /* integer part, gives the MSB */
+            part_frac = ((freq_hz % (SX125x_32MHz_FRAC << 7)) << 9) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
+            break;
+        case LGW_RADIO_TYPE_SX1257:
+            part_int = freq_hz / (SX125x_32MHz_FRAC << 8); /* integer part, gives the MSB */
+            part_frac = ((freq_hz % (SX125x_32MHz_FRAC << 8)) << 8) / SX125x_32MHz_FRAC; /* fractional part, gives middle part and LSB */
+            break;
+        default:
+            DEBUG_PRINTF("ERROR: UNEXPECTED VALUE %d FOR RADIO TYPE\n", rf_radio_type);
+            break;
+    }
+
+    sx125x_write(rf_chain, 0x01,0xFF & part_int); /* Most Significant Byte */
+    sx125x_write(rf_chain, 0x02,0xFF & (part_frac >> 8)); /* middle byte */
+    sx125x_write(rf_chain, 0x03,0xFF & part_frac); /* Least Significant Byte */
+
+    /* start and PLL lock */
+    do {
+        if (cpt_attempts >= PLL_LOCK_MAX_ATTEMPTS) {
+            DEBUG_MSG("ERROR: FAIL TO LOCK PLL\n");
+            return -1;
+        }
+        sx125x_write(rf_chain, 0x00, 1); /* enable Xtal oscillator */
+        sx125x_write(rf_chain, 0x00, 3); /* Enable RX (PLL+FE) */
+        ++cpt_attempts;
+        DEBUG_PRINTF("Note: SX125x #%d PLL start (attempt %d)\n", rf_chain, cpt_attempts);
+        wait_ms(1);
+    } while((sx125x_read(rf_chain, 0x11) & 0x02) == 0);
+
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sx125x_wait_pll_lock(uint8_t rf_chain, uint32_t timeout_ms) {
+    uint32_t i;
+
+    if (rf_chain >= LGW_RF_CHAIN_NB) {
+        DEBUG_MSG("ERROR: INVALID RF_CHAIN\n");
+        return LGW_REG_ERROR;
+    }
+
+    sx125x_write(rf_chain, 0x00, 1); /* enable Xtal oscillator */
+    sx125x_write(rf_chain, 0x00, 3); /* Enable RX (PLL+FE), the PLL only locks on a running Xtal */
+    for (i = 0; i <= timeout_ms; i++) {
+        if ((sx125x_read(rf_chain, 0x11) & 0x02) != 0) { /* RX PLL locked */
+            return LGW_REG_SUCCESS;
+        }
+        wait_ms(1);
+    }
+    DEBUG_PRINTF("ERROR: SX125x #%d PLL did not lock\n", rf_chain);
+    return LGW_REG_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int lgw_sx127x_reg_w(uint8_t address, uint8_t reg_value) {
-    return lgw_spi_w(lgw_spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_SX127X, address, reg_value);
+    return lgw_spi_w(lgw_ctx_current()->spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_SX127X, address, reg_value);
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int lgw_sx127x_reg_r(uint8_t address, uint8_t *reg_value) {
-    return lgw_spi_r(lgw_spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_SX127X, address, reg_value);
+    return lgw_spi_r(lgw_ctx_current()->spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_SX127X, address, reg_value);
 }
 
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
@@ -559,4 +597,43 @@ int lgw_setup_sx127x(uint32_t frequency, uint8_t modulation, enum lgw_sx127x_rxb
     return LGW_REG_SUCCESS;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sx127x_set_rx_freq(uint32_t frequency) {
+    uint64_t freq_reg;
+    int x;
+
+    /* lgw_setup_sx127x sets FastHopOn: the frequency is taken when the LSB is
+       written, without leaving RX mode. Same registers on SX1272 and SX1276. */
+    freq_reg = ((uint64_t)frequency << 19) / (uint64_t)32000000;
+    x  = lgw_sx127x_reg_w(SX1276_REG_FRFMSB, (freq_reg >> 16) & 0xFF);
+    x |= lgw_sx127x_reg_w(SX1276_REG_FRFMID, (freq_reg >> 8) & 0xFF);
+    x |= lgw_sx127x_reg_w(SX1276_REG_FRFLSB, (freq_reg >> 0) & 0xFF);
+    if (x != LGW_REG_SUCCESS) {
+        DEBUG_MSG("ERROR: Failed to set SX127x frequency\n");
+        return LGW_REG_ERROR;
+    }
+
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sx127x_wait_pll_lock(uint32_t timeout_ms) {
+    uint8_t reg_val;
+    uint32_t i;
+
+    for (i = 0; i <= timeout_ms; i++) {
+        if (lgw_sx127x_reg_r(SX1276_REG_IRQFLAGS1, &reg_val) != LGW_REG_SUCCESS) {
+            return LGW_REG_ERROR;
+        }
+        if (TAKE_N_BITS_FROM(reg_val, 4, 1) == 1) { /* PllLock */
+            return LGW_REG_SUCCESS;
+        }
+        wait_ms(1);
+    }
+    DEBUG_MSG("ERROR: SX127x PLL did not lock\n");
+    return LGW_REG_ERROR;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
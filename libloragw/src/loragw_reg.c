@@ -11,6 +11,9 @@ Description:
     Registers are addressed by name.
     Multi-bytes registers are handled automatically.
     Read-modify-write is handled automatically.
+    A shadow copy of the non-volatile registers saves the read of the
+    read-modify-write cycles.
+    Accesses, bytes and SPI time are counted per register.
 
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Sylvain Miermont
@@ -23,10 +26,15 @@ Maintainer: Sylvain Miermont
 #include <stdint.h>     /* C99 types */
 #include <stdbool.h>    /* bool type */
 #include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc free */
+#include <string.h>     /* memset */
+#include <pthread.h>    /* pthread_once */
 
 #include "loragw_spi.h"
 #include "loragw_reg.h"
 #include "loragw_fpga.h"
+#include "loragw_aux.h"
+#include "loragw_ctx.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -48,6 +56,12 @@ Maintainer: Sylvain Miermont
 #define PAGE_ADDR        0x00
 #define PAGE_MASK        0x03
 
+#define CACHE_SLOT_NB       6    /* 4 SX1301 pages, SX1301 common registers, FPGA */
+#define CACHE_SLOT_COMMON   4
+#define CACHE_SLOT_FPGA     5
+
+#define IMAGE_SLOT_NB       5    /* SX1301 slots of the register cache, FPGA excluded */
+
 const uint8_t FPGA_VERSION[] = { 31, 33 }; /* several versions could be supported */
 
 /*
@@ -55,353 +69,449 @@ auto generated register mapping for C code : 11-Jul-2013 13:20:40
 this file contains autogenerated C struct used to access the LoRa register from the Primer firmware
 this file is autogenerated from registers description
 293 registers are defined
+vola marks the registers written by the chip itself, by the AGC and ARB
+firmware (radio SPI master, front-end enables, PA gain, channel gain, TX
+triggers) or by the calibration firmware (IQ mismatch), they are never cached
 */
 const struct lgw_reg_s loregs[LGW_TOTALREGS] = {
-    {-1,0,0,0,2,0,0},         /* PAGE_REG */
-    {-1,0,7,0,1,0,0},         /* SOFT_RESET */
-    {-1,1,0,0,8,1,103},       /* VERSION */
-    {-1,2,0,0,16,0,0},        /* RX_DATA_BUF_ADDR */
-    {-1,4,0,0,8,0,0},         /* RX_DATA_BUF_DATA */
-    {-1,5,0,0,8,0,0},         /* TX_DATA_BUF_ADDR */
-    {-1,6,0,0,8,0,0},         /* TX_DATA_BUF_DATA */
-    {-1,7,0,0,8,0,0},         /* CAPTURE_RAM_ADDR */
-    {-1,8,0,0,8,1,0},         /* CAPTURE_RAM_DATA */
-    {-1,9,0,0,8,0,0},         /* MCU_PROM_ADDR */
-    {-1,10,0,0,8,0,0},        /* MCU_PROM_DATA */
-    {-1,11,0,0,8,0,0},        /* RX_PACKET_DATA_FIFO_NUM_STORED */
-    {-1,12,0,0,16,1,0},       /* RX_PACKET_DATA_FIFO_ADDR_POINTER */
-    {-1,14,0,0,8,1,0},        /* RX_PACKET_DATA_FIFO_STATUS */
-    {-1,15,0,0,8,1,0},        /* RX_PACKET_DATA_FIFO_PAYLOAD_SIZE */
-    {-1,16,0,0,1,0,0},        /* MBWSSF_MODEM_ENABLE */
-    {-1,16,1,0,1,0,0},        /* CONCENTRATOR_MODEM_ENABLE */
-    {-1,16,2,0,1,0,0},        /* FSK_MODEM_ENABLE */
-    {-1,16,3,0,1,0,0},        /* GLOBAL_EN */
-    {-1,17,0,0,1,0,1},        /* CLK32M_EN */
-    {-1,17,1,0,1,0,1},        /* CLKHS_EN */
-    {-1,18,0,0,1,0,0},        /* START_BIST0 */
-    {-1,18,1,0,1,0,0},        /* START_BIST1 */
-    {-1,18,2,0,1,0,0},        /* CLEAR_BIST0 */
-    {-1,18,3,0,1,0,0},        /* CLEAR_BIST1 */
-    {-1,19,0,0,1,1,0},        /* BIST0_FINISHED */
-    {-1,19,1,0,1,1,0},        /* BIST1_FINISHED */
-    {-1,20,0,0,1,1,0},        /* MCU_AGC_PROG_RAM_BIST_STATUS */
-    {-1,20,1,0,1,1,0},        /* MCU_ARB_PROG_RAM_BIST_STATUS */
-    {-1,20,2,0,1,1,0},        /* CAPTURE_RAM_BIST_STATUS */
-    {-1,20,3,0,1,1,0},        /* CHAN_FIR_RAM0_BIST_STATUS */
-    {-1,20,4,0,1,1,0},        /* CHAN_FIR_RAM1_BIST_STATUS */
-    {-1,21,0,0,1,1,0},        /* CORR0_RAM_BIST_STATUS */
-    {-1,21,1,0,1,1,0},        /* CORR1_RAM_BIST_STATUS */
-    {-1,21,2,0,1,1,0},        /* CORR2_RAM_BIST_STATUS */
-    {-1,21,3,0,1,1,0},        /* CORR3_RAM_BIST_STATUS */
-    {-1,21,4,0,1,1,0},        /* CORR4_RAM_BIST_STATUS */
-    {-1,21,5,0,1,1,0},        /* CORR5_RAM_BIST_STATUS */
-    {-1,21,6,0,1,1,0},        /* CORR6_RAM_BIST_STATUS */
-    {-1,21,7,0,1,1,0},        /* CORR7_RAM_BIST_STATUS */
-    {-1,22,0,0,1,1,0},        /* MODEM0_RAM0_BIST_STATUS */
-    {-1,22,1,0,1,1,0},        /* MODEM1_RAM0_BIST_STATUS */
-    {-1,22,2,0,1,1,0},        /* MODEM2_RAM0_BIST_STATUS */
-    {-1,22,3,0,1,1,0},        /* MODEM3_RAM0_BIST_STATUS */
-    {-1,22,4,0,1,1,0},        /* MODEM4_RAM0_BIST_STATUS */
-    {-1,22,5,0,1,1,0},        /* MODEM5_RAM0_BIST_STATUS */
-    {-1,22,6,0,1,1,0},        /* MODEM6_RAM0_BIST_STATUS */
-    {-1,22,7,0,1,1,0},        /* MODEM7_RAM0_BIST_STATUS */
-    {-1,23,0,0,1,1,0},        /* MODEM0_RAM1_BIST_STATUS */
-    {-1,23,1,0,1,1,0},        /* MODEM1_RAM1_BIST_STATUS */
-    {-1,23,2,0,1,1,0},        /* MODEM2_RAM1_BIST_STATUS */
-    {-1,23,3,0,1,1,0},        /* MODEM3_RAM1_BIST_STATUS */
-    {-1,23,4,0,1,1,0},        /* MODEM4_RAM1_BIST_STATUS */
-    {-1,23,5,0,1,1,0},        /* MODEM5_RAM1_BIST_STATUS */
-    {-1,23,6,0,1,1,0},        /* MODEM6_RAM1_BIST_STATUS */
-    {-1,23,7,0,1,1,0},        /* MODEM7_RAM1_BIST_STATUS */
-    {-1,24,0,0,1,1,0},        /* MODEM0_RAM2_BIST_STATUS */
-    {-1,24,1,0,1,1,0},        /* MODEM1_RAM2_BIST_STATUS */
-    {-1,24,2,0,1,1,0},        /* MODEM2_RAM2_BIST_STATUS */
-    {-1,24,3,0,1,1,0},        /* MODEM3_RAM2_BIST_STATUS */
-    {-1,24,4,0,1,1,0},        /* MODEM4_RAM2_BIST_STATUS */
-    {-1,24,5,0,1,1,0},        /* MODEM5_RAM2_BIST_STATUS */
-    {-1,24,6,0,1,1,0},        /* MODEM6_RAM2_BIST_STATUS */
-    {-1,24,7,0,1,1,0},        /* MODEM7_RAM2_BIST_STATUS */
-    {-1,25,0,0,1,1,0},        /* MODEM_MBWSSF_RAM0_BIST_STATUS */
-    {-1,25,1,0,1,1,0},        /* MODEM_MBWSSF_RAM1_BIST_STATUS */
-    {-1,25,2,0,1,1,0},        /* MODEM_MBWSSF_RAM2_BIST_STATUS */
-    {-1,26,0,0,1,1,0},        /* MCU_AGC_DATA_RAM_BIST0_STATUS */
-    {-1,26,1,0,1,1,0},        /* MCU_AGC_DATA_RAM_BIST1_STATUS */
-    {-1,26,2,0,1,1,0},        /* MCU_ARB_DATA_RAM_BIST0_STATUS */
-    {-1,26,3,0,1,1,0},        /* MCU_ARB_DATA_RAM_BIST1_STATUS */
-    {-1,26,4,0,1,1,0},        /* TX_TOP_RAM_BIST0_STATUS */
-    {-1,26,5,0,1,1,0},        /* TX_TOP_RAM_BIST1_STATUS */
-    {-1,26,6,0,1,1,0},        /* DATA_MNGT_RAM_BIST0_STATUS */
-    {-1,26,7,0,1,1,0},        /* DATA_MNGT_RAM_BIST1_STATUS */
-    {-1,27,0,0,4,0,0},        /* GPIO_SELECT_INPUT */
-    {-1,28,0,0,4,0,0},        /* GPIO_SELECT_OUTPUT */
-    {-1,29,0,0,5,0,0},        /* GPIO_MODE */
-    {-1,30,0,0,5,1,0},        /* GPIO_PIN_REG_IN */
-    {-1,31,0,0,5,0,0},        /* GPIO_PIN_REG_OUT */
-    {-1,32,0,0,8,1,0},        /* MCU_AGC_STATUS */
-    {-1,125,0,0,8,1,0},       /* MCU_ARB_STATUS */
-    {-1,126,0,0,8,1,1},       /* CHIP_ID */
-    {-1,127,0,0,1,0,1},       /* EMERGENCY_FORCE_HOST_CTRL */
-    {0,33,0,0,1,0,0},         /* RX_INVERT_IQ */
-    {0,33,1,0,1,0,1},         /* MODEM_INVERT_IQ */
-    {0,33,2,0,1,0,0},         /* MBWSSF_MODEM_INVERT_IQ */
-    {0,33,3,0,1,0,0},         /* RX_EDGE_SELECT */
-    {0,33,4,0,1,0,0},         /* MISC_RADIO_EN */
-    {0,33,5,0,1,0,0},         /* FSK_MODEM_INVERT_IQ */
-    {0,34,0,0,4,0,7},         /* FILTER_GAIN */
-    {0,35,0,0,8,0,240},       /* RADIO_SELECT */
-    {0,36,0,1,13,0,-384},     /* IF_FREQ_0 */
-    {0,38,0,1,13,0,-128},     /* IF_FREQ_1 */
-    {0,40,0,1,13,0,128},      /* IF_FREQ_2 */
-    {0,42,0,1,13,0,384},      /* IF_FREQ_3 */
-    {0,44,0,1,13,0,-384},     /* IF_FREQ_4 */
-    {0,46,0,1,13,0,-128},     /* IF_FREQ_5 */
-    {0,48,0,1,13,0,128},      /* IF_FREQ_6 */
-    {0,50,0,1,13,0,384},      /* IF_FREQ_7 */
-    {0,52,0,1,13,0,0},        /* IF_FREQ_8 */
-    {0,54,0,1,13,0,0},        /* IF_FREQ_9 */
-    {0,64,0,0,1,0,0},        /* CHANN_OVERRIDE_AGC_GAIN */
-    {0,64,1,0,4,0,7},        /* CHANN_AGC_GAIN */
-    {0,65,0,0,7,0,0},        /* CORR0_DETECT_EN */
-    {0,66,0,0,7,0,0},        /* CORR1_DETECT_EN */
-    {0,67,0,0,7,0,0},        /* CORR2_DETECT_EN */
-    {0,68,0,0,7,0,0},        /* CORR3_DETECT_EN */
-    {0,69,0,0,7,0,0},        /* CORR4_DETECT_EN */
-    {0,70,0,0,7,0,0},        /* CORR5_DETECT_EN */
-    {0,71,0,0,7,0,0},        /* CORR6_DETECT_EN */
-    {0,72,0,0,7,0,0},        /* CORR7_DETECT_EN */
-    {0,73,0,0,1,0,0},        /* CORR_SAME_PEAKS_OPTION_SF6 */
-    {0,73,1,0,1,0,1},        /* CORR_SAME_PEAKS_OPTION_SF7 */
-    {0,73,2,0,1,0,1},        /* CORR_SAME_PEAKS_OPTION_SF8 */
-    {0,73,3,0,1,0,1},        /* CORR_SAME_PEAKS_OPTION_SF9 */
-    {0,73,4,0,1,0,1},        /* CORR_SAME_PEAKS_OPTION_SF10 */
-    {0,73,5,0,1,0,1},        /* CORR_SAME_PEAKS_OPTION_SF11 */
-    {0,73,6,0,1,0,1},        /* CORR_SAME_PEAKS_OPTION_SF12 */
-    {0,74,0,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF6 */
-    {0,74,4,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF7 */
-    {0,75,0,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF8 */
-    {0,75,4,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF9 */
-    {0,76,0,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF10 */
-    {0,76,4,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF11 */
-    {0,77,0,0,4,0,4},        /* CORR_SIG_NOISE_RATIO_SF12 */
-    {0,78,0,0,4,0,4},        /* CORR_NUM_SAME_PEAK */
-    {0,78,4,0,3,0,5},        /* CORR_MAC_GAIN */
-    {0,81,0,0,12,0,0},       /* ADJUST_MODEM_START_OFFSET_RDX4 */
-    {0,83,0,0,12,0,4092},    /* ADJUST_MODEM_START_OFFSET_SF12_RDX4 */
-    {0,85,0,0,8,0,7},        /* DBG_CORR_SELECT_SF */
-    {0,86,0,0,8,0,0},        /* DBG_CORR_SELECT_CHANNEL */
-    {0,87,0,0,8,1,0},        /* DBG_DETECT_CPT */
-    {0,88,0,0,8,1,0},        /* DBG_SYMB_CPT */
-    {0,89,0,0,1,0,1},        /* CHIRP_INVERT_RX */
-    {0,89,1,0,1,0,1},        /* DC_NOTCH_EN */
-    {0,90,0,0,1,0,0},        /* IMPLICIT_CRC_EN */
-    {0,90,1,0,3,0,0},        /* IMPLICIT_CODING_RATE */
-    {0,91,0,0,8,0,0},        /* IMPLICIT_PAYLOAD_LENGHT */
-    {0,92,0,0,8,0,29},       /* FREQ_TO_TIME_INVERT */
-    {0,93,0,0,6,0,9},        /* FREQ_TO_TIME_DRIFT */
-    {0,94,0,0,2,0,2},        /* PAYLOAD_FINE_TIMING_GAIN */
-    {0,94,2,0,2,0,1},        /* PREAMBLE_FINE_TIMING_GAIN */
-    {0,94,4,0,2,0,0},        /* TRACKING_INTEGRAL */
-    {0,95,0,0,4,0,1},        /* FRAME_SYNCH_PEAK1_POS */
-    {0,95,4,0,4,0,2},        /* FRAME_SYNCH_PEAK2_POS */
-    {0,96,0,0,16,0,10},      /* PREAMBLE_SYMB1_NB */
-    {0,98,0,0,1,0,1},        /* FRAME_SYNCH_GAIN */
-    {0,98,1,0,1,0,1},        /* SYNCH_DETECT_TH */
-    {0,99,0,0,4,0,8},        /* LLR_SCALE */
-    {0,99,4,0,2,0,2},        /* SNR_AVG_CST */
-    {0,100,0,0,7,0,0},       /* PPM_OFFSET */
-    {0,101,0,0,8,0,255},     /* MAX_PAYLOAD_LEN */
-    {0,102,0,0,1,0,1},        /* ONLY_CRC_EN */
-    {0,103,0,0,8,0,0},        /* ZERO_PAD */
-    {0,104,0,0,4,0,8},        /* DEC_GAIN_OFFSET */
-    {0,104,4,0,4,0,7},        /* CHAN_GAIN_OFFSET */
-    {0,105,1,0,1,0,1},        /* FORCE_HOST_RADIO_CTRL */
-    {0,105,2,0,1,0,1},        /* FORCE_HOST_FE_CTRL */
-    {0,105,3,0,1,0,1},        /* FORCE_DEC_FILTER_GAIN */
-    {0,106,0,0,1,0,1},        /* MCU_RST_0 */
-    {0,106,1,0,1,0,1},        /* MCU_RST_1 */
-    {0,106,2,0,1,0,0},        /* MCU_SELECT_MUX_0 */
-    {0,106,3,0,1,0,0},        /* MCU_SELECT_MUX_1 */
-    {0,106,4,0,1,1,0},        /* MCU_CORRUPTION_DETECTED_0 */
-    {0,106,5,0,1,1,0},        /* MCU_CORRUPTION_DETECTED_1 */
-    {0,106,6,0,1,0,0},        /* MCU_SELECT_EDGE_0 */
-    {0,106,7,0,1,0,0},        /* MCU_SELECT_EDGE_1 */
-    {0,107,0,0,8,0,1},        /* CHANN_SELECT_RSSI */
-    {0,108,0,0,8,0,32},       /* RSSI_BB_DEFAULT_VALUE */
-    {0,109,0,0,8,0,100},      /* RSSI_DEC_DEFAULT_VALUE */
-    {0,110,0,0,8,0,100},      /* RSSI_CHANN_DEFAULT_VALUE */
-    {0,111,0,0,5,0,7},        /* RSSI_BB_FILTER_ALPHA */
-    {0,112,0,0,5,0,5},        /* RSSI_DEC_FILTER_ALPHA */
-    {0,113,0,0,5,0,8},        /* RSSI_CHANN_FILTER_ALPHA */
-    {0,114,0,0,6,0,0},        /* IQ_MISMATCH_A_AMP_COEFF */
-    {0,115,0,0,6,0,0},        /* IQ_MISMATCH_A_PHI_COEFF */
-    {0,116,0,0,6,0,0},        /* IQ_MISMATCH_B_AMP_COEFF */
-    {0,116,6,0,1,0,0},        /* IQ_MISMATCH_B_SEL_I */
-    {0,117,0,0,6,0,0},        /* IQ_MISMATCH_B_PHI_COEFF */
-    {1,33,0,0,1,0,0},         /* TX_TRIG_IMMEDIATE */
-    {1,33,1,0,1,0,0},         /* TX_TRIG_DELAYED */
-    {1,33,2,0,1,0,0},         /* TX_TRIG_GPS */
-    {1,34,0,0,16,0,0},        /* TX_START_DELAY */
-    {1,36,0,0,4,0,1},        /* TX_FRAME_SYNCH_PEAK1_POS */
-    {1,36,4,0,4,0,2},        /* TX_FRAME_SYNCH_PEAK2_POS */
-    {1,37,0,0,3,0,0},        /* TX_RAMP_DURATION */
-    {1,39,0,1,8,0,0},        /* TX_OFFSET_I */
-    {1,40,0,1,8,0,0},        /* TX_OFFSET_Q */
-    {1,41,0,0,1,0,0},        /* TX_MODE */
-    {1,41,1,0,4,0,0},        /* TX_ZERO_PAD */
-    {1,41,5,0,1,0,0},        /* TX_EDGE_SELECT */
-    {1,41,6,0,1,0,0},        /* TX_EDGE_SELECT_TOP */
-    {1,42,0,0,2,0,0},        /* TX_GAIN */
-    {1,42,2,0,3,0,5},        /* TX_CHIRP_LOW_PASS */
-    {1,42,5,0,2,0,0},        /* TX_FCC_WIDEBAND */
-    {1,42,7,0,1,0,1},        /* TX_SWAP_IQ */
-    {1,43,0,0,1,0,0},        /* MBWSSF_IMPLICIT_HEADER */
-    {1,43,1,0,1,0,0},        /* MBWSSF_IMPLICIT_CRC_EN */
-    {1,43,2,0,3,0,0},        /* MBWSSF_IMPLICIT_CODING_RATE */
-    {1,44,0,0,8,0,0},        /* MBWSSF_IMPLICIT_PAYLOAD_LENGHT */
-    {1,45,0,0,1,0,1},        /* MBWSSF_AGC_FREEZE_ON_DETECT */
-    {1,46,0,0,4,0,1},        /* MBWSSF_FRAME_SYNCH_PEAK1_POS */
-    {1,46,4,0,4,0,2},        /* MBWSSF_FRAME_SYNCH_PEAK2_POS */
-    {1,47,0,0,16,0,10},      /* MBWSSF_PREAMBLE_SYMB1_NB */
-    {1,49,0,0,1,0,1},        /* MBWSSF_FRAME_SYNCH_GAIN */
-    {1,49,1,0,1,0,1},        /* MBWSSF_SYNCH_DETECT_TH */
-    {1,50,0,0,8,0,10},       /* MBWSSF_DETECT_MIN_SINGLE_PEAK */
-    {1,51,0,0,3,0,3},        /* MBWSSF_DETECT_TRIG_SAME_PEAK_NB */
-    {1,52,0,0,8,0,29},       /* MBWSSF_FREQ_TO_TIME_INVERT */
-    {1,53,0,0,6,0,36},       /* MBWSSF_FREQ_TO_TIME_DRIFT */
-    {1,54,0,0,12,0,0},       /* MBWSSF_PPM_CORRECTION */
-    {1,56,0,0,2,0,2},        /* MBWSSF_PAYLOAD_FINE_TIMING_GAIN */
-    {1,56,2,0,2,0,1},        /* MBWSSF_PREAMBLE_FINE_TIMING_GAIN */
-    {1,56,4,0,2,0,0},        /* MBWSSF_TRACKING_INTEGRAL */
-    {1,57,0,0,8,0,0},        /* MBWSSF_ZERO_PAD */
-    {1,58,0,0,2,0,0},        /* MBWSSF_MODEM_BW */
-    {1,58,2,0,1,0,0},        /* MBWSSF_RADIO_SELECT */
-    {1,58,3,0,1,0,1},        /* MBWSSF_RX_CHIRP_INVERT */
-    {1,59,0,0,4,0,8},        /* MBWSSF_LLR_SCALE */
-    {1,59,4,0,2,0,3},        /* MBWSSF_SNR_AVG_CST */
-    {1,59,6,0,1,0,0},        /* MBWSSF_PPM_OFFSET */
-    {1,60,0,0,4,0,7},        /* MBWSSF_RATE_SF */
-    {1,60,4,0,1,0,1},        /* MBWSSF_ONLY_CRC_EN */
-    {1,61,0,0,8,0,255},      /* MBWSSF_MAX_PAYLOAD_LEN */
-    {1,62,0,0,8,1,128},      /* TX_STATUS */
-    {1,63,0,0,3,0,0},        /* FSK_CH_BW_EXPO */
-    {1,63,3,0,3,0,0},        /* FSK_RSSI_LENGTH */
-    {1,63,6,0,1,0,0},        /* FSK_RX_INVERT */
-    {1,63,7,0,1,0,0},        /* FSK_PKT_MODE */
-    {1,64,0,0,3,0,0},        /* FSK_PSIZE */
-    {1,64,3,0,1,0,0},        /* FSK_CRC_EN */
-    {1,64,4,0,2,0,0},        /* FSK_DCFREE_ENC */
-    {1,64,6,0,1,0,0},        /* FSK_CRC_IBM */
-    {1,65,0,0,5,0,0},        /* FSK_ERROR_OSR_TOL */
-    {1,65,7,0,1,0,0},        /* FSK_RADIO_SELECT */
-    {1,66,0,0,16,0,0},       /* FSK_BR_RATIO */
-    {1,68,0,0,32,0,0},       /* FSK_REF_PATTERN_LSB */
-    {1,72,0,0,32,0,0},       /* FSK_REF_PATTERN_MSB */
-    {1,76,0,0,8,0,0},        /* FSK_PKT_LENGTH */
-    {1,77,0,0,1,0,1},        /* FSK_TX_GAUSSIAN_EN */
-    {1,77,1,0,2,0,0},        /* FSK_TX_GAUSSIAN_SELECT_BT */
-    {1,77,3,0,1,0,1},        /* FSK_TX_PATTERN_EN */
-    {1,77,4,0,1,0,0},        /* FSK_TX_PREAMBLE_SEQ */
-    {1,77,5,0,3,0,0},        /* FSK_TX_PSIZE */
-    {1,80,0,0,8,0,0},        /* FSK_NODE_ADRS */
-    {1,81,0,0,8,0,0},        /* FSK_BROADCAST */
-    {1,82,0,0,1,0,1},        /* FSK_AUTO_AFC_ON */
-    {1,83,0,0,10,0,0},       /* FSK_PATTERN_TIMEOUT_CFG */
-    {2,33,0,0,8,0,0},        /* SPI_RADIO_A__DATA */
-    {2,34,0,0,8,1,0},        /* SPI_RADIO_A__DATA_READBACK */
-    {2,35,0,0,8,0,0},        /* SPI_RADIO_A__ADDR */
-    {2,37,0,0,1,0,0},        /* SPI_RADIO_A__CS */
-    {2,38,0,0,8,0,0},        /* SPI_RADIO_B__DATA */
-    {2,39,0,0,8,1,0},        /* SPI_RADIO_B__DATA_READBACK */
-    {2,40,0,0,8,0,0},        /* SPI_RADIO_B__ADDR */
-    {2,42,0,0,1,0,0},        /* SPI_RADIO_B__CS */
-    {2,43,0,0,1,0,0},        /* RADIO_A_EN */
-    {2,43,1,0,1,0,0},        /* RADIO_B_EN */
-    {2,43,2,0,1,0,1},        /* RADIO_RST */
-    {2,43,3,0,1,0,0},        /* LNA_A_EN */
-    {2,43,4,0,1,0,0},        /* PA_A_EN */
-    {2,43,5,0,1,0,0},        /* LNA_B_EN */
-    {2,43,6,0,1,0,0},        /* PA_B_EN */
-    {2,44,0,0,2,0,0},        /* PA_GAIN */
-    {2,45,0,0,4,0,2},        /* LNA_A_CTRL_LUT */
-    {2,45,4,0,4,0,4},        /* PA_A_CTRL_LUT */
-    {2,46,0,0,4,0,2},        /* LNA_B_CTRL_LUT */
-    {2,46,4,0,4,0,4},        /* PA_B_CTRL_LUT */
-    {2,47,0,0,5,0,0},        /* CAPTURE_SOURCE */
-    {2,47,5,0,1,0,0},        /* CAPTURE_START */
-    {2,47,6,0,1,0,0},        /* CAPTURE_FORCE_TRIGGER */
-    {2,47,7,0,1,0,0},        /* CAPTURE_WRAP */
-    {2,48,0,0,16,0,0},       /* CAPTURE_PERIOD */
-    {2,51,0,0,8,1,0},        /* MODEM_STATUS */
-    {2,52,0,0,8,1,0},        /* VALID_HEADER_COUNTER_0 */
-    {2,54,0,0,8,1,0},        /* VALID_PACKET_COUNTER_0 */
-    {2,56,0,0,8,1,0},        /* VALID_HEADER_COUNTER_MBWSSF */
-    {2,57,0,0,8,1,0},        /* VALID_HEADER_COUNTER_FSK */
-    {2,58,0,0,8,1,0},        /* VALID_PACKET_COUNTER_MBWSSF */
-    {2,59,0,0,8,1,0},        /* VALID_PACKET_COUNTER_FSK */
-    {2,60,0,0,8,1,0},        /* CHANN_RSSI */
-    {2,61,0,0,8,1,0},        /* BB_RSSI */
-    {2,62,0,0,8,1,0},        /* DEC_RSSI */
-    {2,63,0,0,8,1,0},        /* DBG_MCU_DATA */
-    {2,64,0,0,8,1,0},        /* DBG_ARB_MCU_RAM_DATA */
-    {2,65,0,0,8,1,0},        /* DBG_AGC_MCU_RAM_DATA */
-    {2,66,0,0,16,1,0},       /* NEXT_PACKET_CNT */
-    {2,68,0,0,16,1,0},       /* ADDR_CAPTURE_COUNT */
-    {2,70,0,0,32,1,0},       /* TIMESTAMP */
-    {2,74,0,0,4,1,0},        /* DBG_CHANN0_GAIN */
-    {2,74,4,0,4,1,0},        /* DBG_CHANN1_GAIN */
-    {2,75,0,0,4,1,0},        /* DBG_CHANN2_GAIN */
-    {2,75,4,0,4,1,0},        /* DBG_CHANN3_GAIN */
-    {2,76,0,0,4,1,0},        /* DBG_CHANN4_GAIN */
-    {2,76,4,0,4,1,0},        /* DBG_CHANN5_GAIN */
-    {2,77,0,0,4,1,0},        /* DBG_CHANN6_GAIN */
-    {2,77,4,0,4,1,0},        /* DBG_CHANN7_GAIN */
-    {2,78,0,0,4,1,0},        /* DBG_DEC_FILT_GAIN */
-    {2,79,0,0,3,1,0},        /* SPI_DATA_FIFO_PTR */
-    {2,79,3,0,3,1,0},        /* PACKET_DATA_FIFO_PTR */
-    {2,80,0,0,8,0,0},        /* DBG_ARB_MCU_RAM_ADDR */
-    {2,81,0,0,8,0,0},        /* DBG_AGC_MCU_RAM_ADDR */
-    {2,82,0,0,1,0,0},        /* SPI_MASTER_CHIP_SELECT_POLARITY */
-    {2,82,1,0,1,0,0},        /* SPI_MASTER_CPOL */
-    {2,82,2,0,1,0,0},        /* SPI_MASTER_CPHA */
-    {2,83,0,0,1,0,0},        /* SIG_GEN_ANALYSER_MUX_SEL */
-    {2,84,0,0,1,0,0},        /* SIG_GEN_EN */
-    {2,84,1,0,1,0,0},        /* SIG_ANALYSER_EN */
-    {2,84,2,0,2,0,0},        /* SIG_ANALYSER_AVG_LEN */
-    {2,84,4,0,3,0,0},        /* SIG_ANALYSER_PRECISION */
-    {2,84,7,0,1,1,0},        /* SIG_ANALYSER_VALID_OUT */
-    {2,85,0,0,8,0,0},        /* SIG_GEN_FREQ */
-    {2,86,0,0,8,0,0},        /* SIG_ANALYSER_FREQ */
-    {2,87,0,0,8,1,0},        /* SIG_ANALYSER_I_OUT */
-    {2,88,0,0,8,1,0},        /* SIG_ANALYSER_Q_OUT */
-    {2,89,0,0,1,0,0},        /* GPS_EN */
-    {2,89,1,0,1,0,1},        /* GPS_POL */
-    {2,90,0,1,8,0,0},        /* SW_TEST_REG1 */
-    {2,91,2,1,6,0,0},        /* SW_TEST_REG2 */
-    {2,92,0,1,16,0,0},       /* SW_TEST_REG3 */
-    {2,94,0,0,4,1,0},        /* DATA_MNGT_STATUS */
-    {2,95,0,0,5,1,0},        /* DATA_MNGT_CPT_FRAME_ALLOCATED */
-    {2,96,0,0,5,1,0},        /* DATA_MNGT_CPT_FRAME_FINISHED */
-    {2,97,0,0,5,1,0},        /* DATA_MNGT_CPT_FRAME_READEN */
-    {1,33,0,0,8,0,0}         /* TX_TRIG_ALL (alias) */
+    {-1,0,0,0,2,0,0,1},       /* PAGE_REG */
+    {-1,0,7,0,1,0,0,1},       /* SOFT_RESET */
+    {-1,1,0,0,8,1,103,0},     /* VERSION */
+    {-1,2,0,0,16,0,0,1},      /* RX_DATA_BUF_ADDR */
+    {-1,4,0,0,8,0,0,1},       /* RX_DATA_BUF_DATA */
+    {-1,5,0,0,8,0,0,1},       /* TX_DATA_BUF_ADDR */
+    {-1,6,0,0,8,0,0,1},       /* TX_DATA_BUF_DATA */
+    {-1,7,0,0,8,0,0,1},       /* CAPTURE_RAM_ADDR */
+    {-1,8,0,0,8,1,0,0},       /* CAPTURE_RAM_DATA */
+    {-1,9,0,0,8,0,0,1},       /* MCU_PROM_ADDR */
+    {-1,10,0,0,8,0,0,1},      /* MCU_PROM_DATA */
+    {-1,11,0,0,8,0,0,1},      /* RX_PACKET_DATA_FIFO_NUM_STORED */
+    {-1,12,0,0,16,1,0,0},     /* RX_PACKET_DATA_FIFO_ADDR_POINTER */
+    {-1,14,0,0,8,1,0,0},      /* RX_PACKET_DATA_FIFO_STATUS */
+    {-1,15,0,0,8,1,0,0},      /* RX_PACKET_DATA_FIFO_PAYLOAD_SIZE */
+    {-1,16,0,0,1,0,0,0},      /* MBWSSF_MODEM_ENABLE */
+    {-1,16,1,0,1,0,0,0},      /* CONCENTRATOR_MODEM_ENABLE */
+    {-1,16,2,0,1,0,0,0},      /* FSK_MODEM_ENABLE */
+    {-1,16,3,0,1,0,0,0},      /* GLOBAL_EN */
+    {-1,17,0,0,1,0,1,0},      /* CLK32M_EN */
+    {-1,17,1,0,1,0,1,0},      /* CLKHS_EN */
+    {-1,18,0,0,1,0,0,1},      /* START_BIST0 */
+    {-1,18,1,0,1,0,0,1},      /* START_BIST1 */
+    {-1,18,2,0,1,0,0,1},      /* CLEAR_BIST0 */
+    {-1,18,3,0,1,0,0,1},      /* CLEAR_BIST1 */
+    {-1,19,0,0,1,1,0,0},      /* BIST0_FINISHED */
+    {-1,19,1,0,1,1,0,0},      /* BIST1_FINISHED */
+    {-1,20,0,0,1,1,0,0},      /* MCU_AGC_PROG_RAM_BIST_STATUS */
+    {-1,20,1,0,1,1,0,0},      /* MCU_ARB_PROG_RAM_BIST_STATUS */
+    {-1,20,2,0,1,1,0,0},      /* CAPTURE_RAM_BIST_STATUS */
+    {-1,20,3,0,1,1,0,0},      /* CHAN_FIR_RAM0_BIST_STATUS */
+    {-1,20,4,0,1,1,0,0},      /* CHAN_FIR_RAM1_BIST_STATUS */
+    {-1,21,0,0,1,1,0,0},      /* CORR0_RAM_BIST_STATUS */
+    {-1,21,1,0,1,1,0,0},      /* CORR1_RAM_BIST_STATUS */
+    {-1,21,2,0,1,1,0,0},      /* CORR2_RAM_BIST_STATUS */
+    {-1,21,3,0,1,1,0,0},      /* CORR3_RAM_BIST_STATUS */
+    {-1,21,4,0,1,1,0,0},      /* CORR4_RAM_BIST_STATUS */
+    {-1,21,5,0,1,1,0,0},      /* CORR5_RAM_BIST_STATUS */
+    {-1,21,6,0,1,1,0,0},      /* CORR6_RAM_BIST_STATUS */
+    {-1,21,7,0,1,1,0,0},      /* CORR7_RAM_BIST_STATUS */
+    {-1,22,0,0,1,1,0,0},      /* MODEM0_RAM0_BIST_STATUS */
+    {-1,22,1,0,1,1,0,0},      /* MODEM1_RAM0_BIST_STATUS */
+    {-1,22,2,0,1,1,0,0},      /* MODEM2_RAM0_BIST_STATUS */
+    {-1,22,3,0,1,1,0,0},      /* MODEM3_RAM0_BIST_STATUS */
+    {-1,22,4,0,1,1,0,0},      /* MODEM4_RAM0_BIST_STATUS */
+    {-1,22,5,0,1,1,0,0},      /* MODEM5_RAM0_BIST_STATUS */
+    {-1,22,6,0,1,1,0,0},      /* MODEM6_RAM0_BIST_STATUS */
+    {-1,22,7,0,1,1,0,0},      /* MODEM7_RAM0_BIST_STATUS */
+    {-1,23,0,0,1,1,0,0},      /* MODEM0_RAM1_BIST_STATUS */
+    {-1,23,1,0,1,1,0,0},      /* MODEM1_RAM1_BIST_STATUS */
+    {-1,23,2,0,1,1,0,0},      /* MODEM2_RAM1_BIST_STATUS */
+    {-1,23,3,0,1,1,0,0},      /* MODEM3_RAM1_BIST_STATUS */
+    {-1,23,4,0,1,1,0,0},      /* MODEM4_RAM1_BIST_STATUS */
+    {-1,23,5,0,1,1,0,0},      /* MODEM5_RAM1_BIST_STATUS */
+    {-1,23,6,0,1,1,0,0},      /* MODEM6_RAM1_BIST_STATUS */
+    {-1,23,7,0,1,1,0,0},      /* MODEM7_RAM1_BIST_STATUS */
+    {-1,24,0,0,1,1,0,0},      /* MODEM0_RAM2_BIST_STATUS */
+    {-1,24,1,0,1,1,0,0},      /* MODEM1_RAM2_BIST_STATUS */
+    {-1,24,2,0,1,1,0,0},      /* MODEM2_RAM2_BIST_STATUS */
+    {-1,24,3,0,1,1,0,0},      /* MODEM3_RAM2_BIST_STATUS */
+    {-1,24,4,0,1,1,0,0},      /* MODEM4_RAM2_BIST_STATUS */
+    {-1,24,5,0,1,1,0,0},      /* MODEM5_RAM2_BIST_STATUS */
+    {-1,24,6,0,1,1,0,0},      /* MODEM6_RAM2_BIST_STATUS */
+    {-1,24,7,0,1,1,0,0},      /* MODEM7_RAM2_BIST_STATUS */
+    {-1,25,0,0,1,1,0,0},      /* MODEM_MBWSSF_RAM0_BIST_STATUS */
+    {-1,25,1,0,1,1,0,0},      /* MODEM_MBWSSF_RAM1_BIST_STATUS */
+    {-1,25,2,0,1,1,0,0},      /* MODEM_MBWSSF_RAM2_BIST_STATUS */
+    {-1,26,0,0,1,1,0,0},      /* MCU_AGC_DATA_RAM_BIST0_STATUS */
+    {-1,26,1,0,1,1,0,0},      /* MCU_AGC_DATA_RAM_BIST1_STATUS */
+    {-1,26,2,0,1,1,0,0},      /* MCU_ARB_DATA_RAM_BIST0_STATUS */
+    {-1,26,3,0,1,1,0,0},      /* MCU_ARB_DATA_RAM_BIST1_STATUS */
+    {-1,26,4,0,1,1,0,0},      /* TX_TOP_RAM_BIST0_STATUS */
+    {-1,26,5,0,1,1,0,0},      /* TX_TOP_RAM_BIST1_STATUS */
+    {-1,26,6,0,1,1,0,0},      /* DATA_MNGT_RAM_BIST0_STATUS */
+    {-1,26,7,0,1,1,0,0},      /* DATA_MNGT_RAM_BIST1_STATUS */
+    {-1,27,0,0,4,0,0,0},      /* GPIO_SELECT_INPUT */
+    {-1,28,0,0,4,0,0,0},      /* GPIO_SELECT_OUTPUT */
+    {-1,29,0,0,5,0,0,0},      /* GPIO_MODE */
+    {-1,30,0,0,5,1,0,0},      /* GPIO_PIN_REG_IN */
+    {-1,31,0,0,5,0,0,0},      /* GPIO_PIN_REG_OUT */
+    {-1,32,0,0,8,1,0,0},      /* MCU_AGC_STATUS */
+    {-1,125,0,0,8,1,0,0},     /* MCU_ARB_STATUS */
+    {-1,126,0,0,8,1,1,0},     /* CHIP_ID */
+    {-1,127,0,0,1,0,1,0},     /* EMERGENCY_FORCE_HOST_CTRL */
+    {0,33,0,0,1,0,0,0},       /* RX_INVERT_IQ */
+    {0,33,1,0,1,0,1,0},       /* MODEM_INVERT_IQ */
+    {0,33,2,0,1,0,0,0},       /* MBWSSF_MODEM_INVERT_IQ */
+    {0,33,3,0,1,0,0,0},       /* RX_EDGE_SELECT */
+    {0,33,4,0,1,0,0,0},       /* MISC_RADIO_EN */
+    {0,33,5,0,1,0,0,0},       /* FSK_MODEM_INVERT_IQ */
+    {0,34,0,0,4,0,7,0},       /* FILTER_GAIN */
+    {0,35,0,0,8,0,240,1},     /* RADIO_SELECT */
+    {0,36,0,1,13,0,-384,0},   /* IF_FREQ_0 */
+    {0,38,0,1,13,0,-128,0},   /* IF_FREQ_1 */
+    {0,40,0,1,13,0,128,0},    /* IF_FREQ_2 */
+    {0,42,0,1,13,0,384,0},    /* IF_FREQ_3 */
+    {0,44,0,1,13,0,-384,0},   /* IF_FREQ_4 */
+    {0,46,0,1,13,0,-128,0},   /* IF_FREQ_5 */
+    {0,48,0,1,13,0,128,0},    /* IF_FREQ_6 */
+    {0,50,0,1,13,0,384,0},    /* IF_FREQ_7 */
+    {0,52,0,1,13,0,0,0},      /* IF_FREQ_8 */
+    {0,54,0,1,13,0,0,0},      /* IF_FREQ_9 */
+    {0,64,0,0,1,0,0,0},      /* CHANN_OVERRIDE_AGC_GAIN */
+    {0,64,1,0,4,0,7,1},      /* CHANN_AGC_GAIN */
+    {0,65,0,0,7,0,0,0},      /* CORR0_DETECT_EN */
+    {0,66,0,0,7,0,0,0},      /* CORR1_DETECT_EN */
+    {0,67,0,0,7,0,0,0},      /* CORR2_DETECT_EN */
+    {0,68,0,0,7,0,0,0},      /* CORR3_DETECT_EN */
+    {0,69,0,0,7,0,0,0},      /* CORR4_DETECT_EN */
+    {0,70,0,0,7,0,0,0},      /* CORR5_DETECT_EN */
+    {0,71,0,0,7,0,0,0},      /* CORR6_DETECT_EN */
+    {0,72,0,0,7,0,0,0},      /* CORR7_DETECT_EN */
+    {0,73,0,0,1,0,0,0},      /* CORR_SAME_PEAKS_OPTION_SF6 */
+    {0,73,1,0,1,0,1,0},      /* CORR_SAME_PEAKS_OPTION_SF7 */
+    {0,73,2,0,1,0,1,0},      /* CORR_SAME_PEAKS_OPTION_SF8 */
+    {0,73,3,0,1,0,1,0},      /* CORR_SAME_PEAKS_OPTION_SF9 */
+    {0,73,4,0,1,0,1,0},      /* CORR_SAME_PEAKS_OPTION_SF10 */
+    {0,73,5,0,1,0,1,0},      /* CORR_SAME_PEAKS_OPTION_SF11 */
+    {0,73,6,0,1,0,1,0},      /* CORR_SAME_PEAKS_OPTION_SF12 */
+    {0,74,0,0,4,0,4,0},      /* CORR_SIG_NOISE_RATIO_SF6 */
+    {0,74,4,0,4,0,4,0},      /* CORR_SIG_NOISE_RATIO_SF7 */
+    {0,75,0,0,4,0,4,0},      /* CORR_SIG_NOISE_RATIO_SF8 */
+    {0,75,4,0,4,0,4,0},      /* CORR_SIG_NOISE_RATIO_SF9 */
+    {0,76,0,0,4,0,4,0},      /* CORR_SIG_NOISE_RATIO_SF10 */
+    {0,76,4,0,4,0,4,0},      /* CORR_SIG_NOISE_RATIO_SF11 */
+    {0,77,0,0,4,0,4,0},      /* CORR_SIG_NOISE_RATIO_SF12 */
+    {0,78,0,0,4,0,4,0},      /* CORR_NUM_SAME_PEAK */
+    {0,78,4,0,3,0,5,0},      /* CORR_MAC_GAIN */
+    {0,81,0,0,12,0,0,0},     /* ADJUST_MODEM_START_OFFSET_RDX4 */
+    {0,83,0,0,12,0,4092,0},  /* ADJUST_MODEM_START_OFFSET_SF12_RDX4 */
+    {0,85,0,0,8,0,7,0},      /* DBG_CORR_SELECT_SF */
+    {0,86,0,0,8,0,0,0},      /* DBG_CORR_SELECT_CHANNEL */
+    {0,87,0,0,8,1,0,0},      /* DBG_DETECT_CPT */
+    {0,88,0,0,8,1,0,0},      /* DBG_SYMB_CPT */
+    {0,89,0,0,1,0,1,0},      /* CHIRP_INVERT_RX */
+    {0,89,1,0,1,0,1,0},      /* DC_NOTCH_EN */
+    {0,90,0,0,1,0,0,0},      /* IMPLICIT_CRC_EN */
+    {0,90,1,0,3,0,0,0},      /* IMPLICIT_CODING_RATE */
+    {0,91,0,0,8,0,0,0},      /* IMPLICIT_PAYLOAD_LENGHT */
+    {0,92,0,0,8,0,29,0},     /* FREQ_TO_TIME_INVERT */
+    {0,93,0,0,6,0,9,0},      /* FREQ_TO_TIME_DRIFT */
+    {0,94,0,0,2,0,2,0},      /* PAYLOAD_FINE_TIMING_GAIN */
+    {0,94,2,0,2,0,1,0},      /* PREAMBLE_FINE_TIMING_GAIN */
+    {0,94,4,0,2,0,0,0},      /* TRACKING_INTEGRAL */
+    {0,95,0,0,4,0,1,0},      /* FRAME_SYNCH_PEAK1_POS */
+    {0,95,4,0,4,0,2,0},      /* FRAME_SYNCH_PEAK2_POS */
+    {0,96,0,0,16,0,10,0},    /* PREAMBLE_SYMB1_NB */
+    {0,98,0,0,1,0,1,0},      /* FRAME_SYNCH_GAIN */
+    {0,98,1,0,1,0,1,0},      /* SYNCH_DETECT_TH */
+    {0,99,0,0,4,0,8,0},      /* LLR_SCALE */
+    {0,99,4,0,2,0,2,0},      /* SNR_AVG_CST */
+    {0,100,0,0,7,0,0,0},     /* PPM_OFFSET */
+    {0,101,0,0,8,0,255,0},   /* MAX_PAYLOAD_LEN */
+    {0,102,0,0,1,0,1,0},      /* ONLY_CRC_EN */
+    {0,103,0,0,8,0,0,0},      /* ZERO_PAD */
+    {0,104,0,0,4,0,8,0},      /* DEC_GAIN_OFFSET */
+    {0,104,4,0,4,0,7,0},      /* CHAN_GAIN_OFFSET */
+    {0,105,1,0,1,0,1,0},      /* FORCE_HOST_RADIO_CTRL */
+    {0,105,2,0,1,0,1,0},      /* FORCE_HOST_FE_CTRL */
+    {0,105,3,0,1,0,1,0},      /* FORCE_DEC_FILTER_GAIN */
+    {0,106,0,0,1,0,1,0},      /* MCU_RST_0 */
+    {0,106,1,0,1,0,1,0},      /* MCU_RST_1 */
+    {0,106,2,0,1,0,0,0},      /* MCU_SELECT_MUX_0 */
+    {0,106,3,0,1,0,0,0},      /* MCU_SELECT_MUX_1 */
+    {0,106,4,0,1,1,0,0},      /* MCU_CORRUPTION_DETECTED_0 */
+    {0,106,5,0,1,1,0,0},      /* MCU_CORRUPTION_DETECTED_1 */
+    {0,106,6,0,1,0,0,0},      /* MCU_SELECT_EDGE_0 */
+    {0,106,7,0,1,0,0,0},      /* MCU_SELECT_EDGE_1 */
+    {0,107,0,0,8,0,1,0},      /* CHANN_SELECT_RSSI */
+    {0,108,0,0,8,0,32,0},     /* RSSI_BB_DEFAULT_VALUE */
+    {0,109,0,0,8,0,100,0},    /* RSSI_DEC_DEFAULT_VALUE */
+    {0,110,0,0,8,0,100,0},    /* RSSI_CHANN_DEFAULT_VALUE */
+    {0,111,0,0,5,0,7,0},      /* RSSI_BB_FILTER_ALPHA */
+    {0,112,0,0,5,0,5,0},      /* RSSI_DEC_FILTER_ALPHA */
+    {0,113,0,0,5,0,8,0},      /* RSSI_CHANN_FILTER_ALPHA */
+    {0,114,0,0,6,0,0,1},      /* IQ_MISMATCH_A_AMP_COEFF */
+    {0,115,0,0,6,0,0,1},      /* IQ_MISMATCH_A_PHI_COEFF */
+    {0,116,0,0,6,0,0,1},      /* IQ_MISMATCH_B_AMP_COEFF */
+    {0,116,6,0,1,0,0,1},      /* IQ_MISMATCH_B_SEL_I */
+    {0,117,0,0,6,0,0,1},      /* IQ_MISMATCH_B_PHI_COEFF */
+    {1,33,0,0,1,0,0,1},       /* TX_TRIG_IMMEDIATE */
+    {1,33,1,0,1,0,0,1},       /* TX_TRIG_DELAYED */
+    {1,33,2,0,1,0,0,1},       /* TX_TRIG_GPS */
+    {1,34,0,0,16,0,0,0},      /* TX_START_DELAY */
+    {1,36,0,0,4,0,1,0},      /* TX_FRAME_SYNCH_PEAK1_POS */
+    {1,36,4,0,4,0,2,0},      /* TX_FRAME_SYNCH_PEAK2_POS */
+    {1,37,0,0,3,0,0,0},      /* TX_RAMP_DURATION */
+    {1,39,0,1,8,0,0,0},      /* TX_OFFSET_I */
+    {1,40,0,1,8,0,0,0},      /* TX_OFFSET_Q */
+    {1,41,0,0,1,0,0,0},      /* TX_MODE */
+    {1,41,1,0,4,0,0,0},      /* TX_ZERO_PAD */
+    {1,41,5,0,1,0,0,0},      /* TX_EDGE_SELECT */
+    {1,41,6,0,1,0,0,0},      /* TX_EDGE_SELECT_TOP */
+    {1,42,0,0,2,0,0,0},      /* TX_GAIN */
+    {1,42,2,0,3,0,5,0},      /* TX_CHIRP_LOW_PASS */
+    {1,42,5,0,2,0,0,0},      /* TX_FCC_WIDEBAND */
+    {1,42,7,0,1,0,1,0},      /* TX_SWAP_IQ */
+    {1,43,0,0,1,0,0,0},      /* MBWSSF_IMPLICIT_HEADER */
+    {1,43,1,0,1,0,0,0},      /* MBWSSF_IMPLICIT_CRC_EN */
+    {1,43,2,0,3,0,0,0},      /* MBWSSF_IMPLICIT_CODING_RATE */
+    {1,44,0,0,8,0,0,0},      /* MBWSSF_IMPLICIT_PAYLOAD_LENGHT */
+    {1,45,0,0,1,0,1,0},      /* MBWSSF_AGC_FREEZE_ON_DETECT */
+    {1,46,0,0,4,0,1,0},      /* MBWSSF_FRAME_SYNCH_PEAK1_POS */
+    {1,46,4,0,4,0,2,0},      /* MBWSSF_FRAME_SYNCH_PEAK2_POS */
+    {1,47,0,0,16,0,10,0},    /* MBWSSF_PREAMBLE_SYMB1_NB */
+    {1,49,0,0,1,0,1,0},      /* MBWSSF_FRAME_SYNCH_GAIN */
+    {1,49,1,0,1,0,1,0},      /* MBWSSF_SYNCH_DETECT_TH */
+    {1,50,0,0,8,0,10,0},     /* MBWSSF_DETECT_MIN_SINGLE_PEAK */
+    {1,51,0,0,3,0,3,0},      /* MBWSSF_DETECT_TRIG_SAME_PEAK_NB */
+    {1,52,0,0,8,0,29,0},     /* MBWSSF_FREQ_TO_TIME_INVERT */
+    {1,53,0,0,6,0,36,0},     /* MBWSSF_FREQ_TO_TIME_DRIFT */
+    {1,54,0,0,12,0,0,0},     /* MBWSSF_PPM_CORRECTION */
+    {1,56,0,0,2,0,2,0},      /* MBWSSF_PAYLOAD_FINE_TIMING_GAIN */
+    {1,56,2,0,2,0,1,0},      /* MBWSSF_PREAMBLE_FINE_TIMING_GAIN */
+    {1,56,4,0,2,0,0,0},      /* MBWSSF_TRACKING_INTEGRAL */
+    {1,57,0,0,8,0,0,0},      /* MBWSSF_ZERO_PAD */
+    {1,58,0,0,2,0,0,0},      /* MBWSSF_MODEM_BW */
+    {1,58,2,0,1,0,0,0},      /* MBWSSF_RADIO_SELECT */
+    {1,58,3,0,1,0,1,0},      /* MBWSSF_RX_CHIRP_INVERT */
+    {1,59,0,0,4,0,8,0},      /* MBWSSF_LLR_SCALE */
+    {1,59,4,0,2,0,3,0},      /* MBWSSF_SNR_AVG_CST */
+    {1,59,6,0,1,0,0,0},      /* MBWSSF_PPM_OFFSET */
+    {1,60,0,0,4,0,7,0},      /* MBWSSF_RATE_SF */
+    {1,60,4,0,1,0,1,0},      /* MBWSSF_ONLY_CRC_EN */
+    {1,61,0,0,8,0,255,0},    /* MBWSSF_MAX_PAYLOAD_LEN */
+    {1,62,0,0,8,1,128,0},    /* TX_STATUS */
+    {1,63,0,0,3,0,0,0},      /* FSK_CH_BW_EXPO */
+    {1,63,3,0,3,0,0,0},      /* FSK_RSSI_LENGTH */
+    {1,63,6,0,1,0,0,0},      /* FSK_RX_INVERT */
+    {1,63,7,0,1,0,0,0},      /* FSK_PKT_MODE */
+    {1,64,0,0,3,0,0,0},      /* FSK_PSIZE */
+    {1,64,3,0,1,0,0,0},      /* FSK_CRC_EN */
+    {1,64,4,0,2,0,0,0},      /* FSK_DCFREE_ENC */
+    {1,64,6,0,1,0,0,0},      /* FSK_CRC_IBM */
+    {1,65,0,0,5,0,0,0},      /* FSK_ERROR_OSR_TOL */
+    {1,65,7,0,1,0,0,0},      /* FSK_RADIO_SELECT */
+    {1,66,0,0,16,0,0,0},     /* FSK_BR_RATIO */
+    {1,68,0,0,32,0,0,0},     /* FSK_REF_PATTERN_LSB */
+    {1,72,0,0,32,0,0,0},     /* FSK_REF_PATTERN_MSB */
+    {1,76,0,0,8,0,0,0},      /* FSK_PKT_LENGTH */
+    {1,77,0,0,1,0,1,0},      /* FSK_TX_GAUSSIAN_EN */
+    {1,77,1,0,2,0,0,0},      /* FSK_TX_GAUSSIAN_SELECT_BT */
+    {1,77,3,0,1,0,1,0},      /* FSK_TX_PATTERN_EN */
+    {1,77,4,0,1,0,0,0},      /* FSK_TX_PREAMBLE_SEQ */
+    {1,77,5,0,3,0,0,0},      /* FSK_TX_PSIZE */
+    {1,80,0,0,8,0,0,0},      /* FSK_NODE_ADRS */
+    {1,81,0,0,8,0,0,0},      /* FSK_BROADCAST */
+    {1,82,0,0,1,0,1,0},      /* FSK_AUTO_AFC_ON */
+    {1,83,0,0,10,0,0,0},     /* FSK_PATTERN_TIMEOUT_CFG */
+    {2,33,0,0,8,0,0,1},      /* SPI_RADIO_A__DATA */
+    {2,34,0,0,8,1,0,0},      /* SPI_RADIO_A__DATA_READBACK */
+    {2,35,0,0,8,0,0,1},      /* SPI_RADIO_A__ADDR */
+    {2,37,0,0,1,0,0,1},      /* SPI_RADIO_A__CS */
+    {2,38,0,0,8,0,0,1},      /* SPI_RADIO_B__DATA */
+    {2,39,0,0,8,1,0,0},      /* SPI_RADIO_B__DATA_READBACK */
+    {2,40,0,0,8,0,0,1},      /* SPI_RADIO_B__ADDR */
+    {2,42,0,0,1,0,0,1},      /* SPI_RADIO_B__CS */
+    {2,43,0,0,1,0,0,1},      /* RADIO_A_EN */
+    {2,43,1,0,1,0,0,1},      /* RADIO_B_EN */
+    {2,43,2,0,1,0,1,1},      /* RADIO_RST */
+    {2,43,3,0,1,0,0,1},      /* LNA_A_EN */
+    {2,43,4,0,1,0,0,1},      /* PA_A_EN */
+    {2,43,5,0,1,0,0,1},      /* LNA_B_EN */
+    {2,43,6,0,1,0,0,1},      /* PA_B_EN */
+    {2,44,0,0,2,0,0,1},      /* PA_GAIN */
+    {2,45,0,0,4,0,2,0},      /* LNA_A_CTRL_LUT */
+    {2,45,4,0,4,0,4,0},      /* PA_A_CTRL_LUT */
+    {2,46,0,0,4,0,2,0},      /* LNA_B_CTRL_LUT */
+    {2,46,4,0,4,0,4,0},      /* PA_B_CTRL_LUT */
+    {2,47,0,0,5,0,0,0},      /* CAPTURE_SOURCE */
+    {2,47,5,0,1,0,0,1},      /* CAPTURE_START */
+    {2,47,6,0,1,0,0,1},      /* CAPTURE_FORCE_TRIGGER */
+    {2,47,7,0,1,0,0,0},      /* CAPTURE_WRAP */
+    {2,48,0,0,16,0,0,0},     /* CAPTURE_PERIOD */
+    {2,51,0,0,8,1,0,0},      /* MODEM_STATUS */
+    {2,52,0,0,8,1,0,0},      /* VALID_HEADER_COUNTER_0 */
+    {2,54,0,0,8,1,0,0},      /* VALID_PACKET_COUNTER_0 */
+    {2,56,0,0,8,1,0,0},      /* VALID_HEADER_COUNTER_MBWSSF */
+    {2,57,0,0,8,1,0,0},      /* VALID_HEADER_COUNTER_FSK */
+    {2,58,0,0,8,1,0,0},      /* VALID_PACKET_COUNTER_MBWSSF */
+    {2,59,0,0,8,1,0,0},      /* VALID_PACKET_COUNTER_FSK */
+    {2,60,0,0,8,1,0,0},      /* CHANN_RSSI */
+    {2,61,0,0,8,1,0,0},      /* BB_RSSI */
+    {2,62,0,0,8,1,0,0},      /* DEC_RSSI */
+    {2,63,0,0,8,1,0,0},      /* DBG_MCU_DATA */
+    {2,64,0,0,8,1,0,0},      /* DBG_ARB_MCU_RAM_DATA */
+    {2,65,0,0,8,1,0,0},      /* DBG_AGC_MCU_RAM_DATA */
+    {2,66,0,0,16,1,0,0},     /* NEXT_PACKET_CNT */
+    {2,68,0,0,16,1,0,0},     /* ADDR_CAPTURE_COUNT */
+    {2,70,0,0,32,1,0,0},     /* TIMESTAMP */
+    {2,74,0,0,4,1,0,0},      /* DBG_CHANN0_GAIN */
+    {2,74,4,0,4,1,0,0},      /* DBG_CHANN1_GAIN */
+    {2,75,0,0,4,1,0,0},      /* DBG_CHANN2_GAIN */
+    {2,75,4,0,4,1,0,0},      /* DBG_CHANN3_GAIN */
+    {2,76,0,0,4,1,0,0},      /* DBG_CHANN4_GAIN */
+    {2,76,4,0,4,1,0,0},      /* DBG_CHANN5_GAIN */
+    {2,77,0,0,4,1,0,0},      /* DBG_CHANN6_GAIN */
+    {2,77,4,0,4,1,0,0},      /* DBG_CHANN7_GAIN */
+    {2,78,0,0,4,1,0,0},      /* DBG_DEC_FILT_GAIN */
+    {2,79,0,0,3,1,0,0},      /* SPI_DATA_FIFO_PTR */
+    {2,79,3,0,3,1,0,0},      /* PACKET_DATA_FIFO_PTR */
+    {2,80,0,0,8,0,0,1},      /* DBG_ARB_MCU_RAM_ADDR */
+    {2,81,0,0,8,0,0,1},      /* DBG_AGC_MCU_RAM_ADDR */
+    {2,82,0,0,1,0,0,0},      /* SPI_MASTER_CHIP_SELECT_POLARITY */
+    {2,82,1,0,1,0,0,0},      /* SPI_MASTER_CPOL */
+    {2,82,2,0,1,0,0,0},      /* SPI_MASTER_CPHA */
+    {2,83,0,0,1,0,0,0},      /* SIG_GEN_ANALYSER_MUX_SEL */
+    {2,84,0,0,1,0,0,0},      /* SIG_GEN_EN */
+    {2,84,1,0,1,0,0,0},      /* SIG_ANALYSER_EN */
+    {2,84,2,0,2,0,0,0},      /* SIG_ANALYSER_AVG_LEN */
+    {2,84,4,0,3,0,0,0},      /* SIG_ANALYSER_PRECISION */
+    {2,84,7,0,1,1,0,0},      /* SIG_ANALYSER_VALID_OUT */
+    {2,85,0,0,8,0,0,0},      /* SIG_GEN_FREQ */
+    {2,86,0,0,8,0,0,0},      /* SIG_ANALYSER_FREQ */
+    {2,87,0,0,8,1,0,0},      /* SIG_ANALYSER_I_OUT */
+    {2,88,0,0,8,1,0,0},      /* SIG_ANALYSER_Q_OUT */
+    {2,89,0,0,1,0,0,0},      /* GPS_EN */
+    {2,89,1,0,1,0,1,0},      /* GPS_POL */
+    {2,90,0,1,8,0,0,0},      /* SW_TEST_REG1 */
+    {2,91,2,1,6,0,0,0},      /* SW_TEST_REG2 */
+    {2,92,0,1,16,0,0,0},     /* SW_TEST_REG3 */
+    {2,94,0,0,4,1,0,0},      /* DATA_MNGT_STATUS */
+    {2,95,0,0,5,1,0,0},      /* DATA_MNGT_CPT_FRAME_ALLOCATED */
+    {2,96,0,0,5,1,0,0},      /* DATA_MNGT_CPT_FRAME_FINISHED */
+    {2,97,0,0,5,1,0,0},      /* DATA_MNGT_CPT_FRAME_READEN */
+    {1,33,0,0,8,0,0,1}       /* TX_TRIG_ALL (alias) */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* register access state of one concentrator context, see loragw_ctx.h */
+struct lgw_reg_state_s {
+    int         lgw_regpage;                            /*! keep the value of the register page selected */
+
+    /* shadow copy of the register bytes, used to skip the read of read-modify-write */
+    bool        cache_enable;
+    bool        cache_valid[CACHE_SLOT_NB][128];
+    uint8_t     cache_data[CACHE_SLOT_NB][128];
+    uint32_t    cache_nb_skipped;                       /* read-modify-write reads served by the cache */
+    uint32_t    cache_nb_read;                          /* read-modify-write reads sent on the SPI link */
+
+    /* per-register access statistics */
+    struct lgw_reg_stats_s reg_stats[LGW_TOTALREGS];
+    uint32_t    reg_nb_page_switch;
+
+    /* register image, field writes merged at byte level until lgw_reg_image_end */
+    int         image_depth;
+    bool        image_dirty;
+    uint8_t     image_data[IMAGE_SLOT_NB][128];
+    uint8_t     image_mask[IMAGE_SLOT_NB][128];       /* bits written in the image */
 };
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES ---------------------------------------------------- */
 
-static int lgw_regpage = -1; /*! keep the value of the register page selected */
+static struct lgw_reg_state_s reg_state_dflt; /* state of the default context */
+
+/* bytes never cached, same register map for all the concentrators */
+static pthread_once_t cache_init_once = PTHREAD_ONCE_INIT;
+static bool cache_vola[CACHE_SLOT_NB][128]; /* byte holds a read-only or volatile field, never cached */
 
 /* -------------------------------------------------------------------------- */
-/* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
+/* --- EXTERNAL VARIABLES --------------------------------------------------- */
 
-void *lgw_spi_target = NULL; /*! generic pointer to the SPI device */
-uint8_t lgw_spi_mux_mode = 0; /*! current SPI mux mode used */
+extern const struct lgw_reg_s fpga_regs[LGW_FPGA_TOTALREGS];
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
 
+static void cache_mark_vola(int slot, const struct lgw_reg_s *r) {
+    int i, size_byte;
+
+    if ((r->rdon == false) && (r->vola == false)) {
+        return;
+    }
+    size_byte = (r->offs + r->leng + 7) / 8;
+    for (i = 0; (i < size_byte) && ((r->addr + i) < 128); ++i) {
+        cache_vola[slot][r->addr + i] = true;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void cache_init(void) {
+    int i;
+
+    for (i = 0; i < LGW_TOTALREGS; ++i) {
+        cache_mark_vola((loregs[i].page == -1) ? CACHE_SLOT_COMMON : loregs[i].page, &loregs[i]);
+    }
+    for (i = 0; i < LGW_FPGA_TOTALREGS; ++i) {
+        cache_mark_vola(CACHE_SLOT_FPGA, &fpga_regs[i]);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* return the cache slot of a register, -1 if it cannot be cached */
+static int cache_slot(uint8_t spi_mux_target, struct lgw_reg_s r) {
+    struct lgw_reg_state_s *reg = lgw_ctx_current()->reg;
+    if (reg->cache_enable == false) {
+        return -1;
+    }
+    pthread_once(&cache_init_once, cache_init);
+    switch (spi_mux_target) {
+        case LGW_SPI_MUX_TARGET_SX1301:
+            return (r.page == -1) ? CACHE_SLOT_COMMON : (PAGE_MASK & r.page);
+        case LGW_SPI_MUX_TARGET_FPGA:
+            return CACHE_SLOT_FPGA;
+        default:
+            return -1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void cache_update(uint8_t spi_mux_target, struct lgw_reg_s r, const uint8_t *data, int size, bool valid) {
+    struct lgw_reg_state_s *reg = lgw_ctx_current()->reg;
+    int slot = cache_slot(spi_mux_target, r);
+    int i;
+
+    if (slot < 0) {
+        return;
+    }
+    for (i = 0; (i < size) && ((r.addr + i) < 128); ++i) {
+        reg->cache_data[slot][r.addr + i] = data[i];
+        reg->cache_valid[slot][r.addr + i] = valid && !cache_vola[slot][r.addr + i];
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 int page_switch(uint8_t target) {
-    lgw_regpage = PAGE_MASK & target;
-    lgw_spi_w(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, PAGE_ADDR, (uint8_t)lgw_regpage);
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
+    ++reg->reg_nb_page_switch;
+    reg->lgw_regpage = PAGE_MASK & target;
+    lgw_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, PAGE_ADDR, (uint8_t)reg->lgw_regpage);
     return LGW_REG_SUCCESS;
 }
 
@@ -422,20 +532,33 @@ bool check_fpga_version(uint8_t version) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 int reg_w_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, struct lgw_reg_s r, int32_t reg_value) {
+    struct lgw_reg_state_s *reg = lgw_ctx_current()->reg;
     int spi_stat = LGW_REG_SUCCESS;
     int i, size_byte;
     uint8_t buf[4] = "\x00\x00\x00\x00";
 
+    int slot;
+
     if ((r.leng == 8) && (r.offs == 0)) {
         /* direct write */
-        spi_stat += lgw_spi_w(spi_target, spi_mux_mode, spi_mux_target, r.addr, (uint8_t)reg_value);
+        buf[0] = (uint8_t)reg_value;
+        spi_stat += lgw_spi_w(spi_target, spi_mux_mode, spi_mux_target, r.addr, buf[0]);
+        cache_update(spi_mux_target, r, buf, 1, (spi_stat == LGW_SPI_SUCCESS));
     } else if ((r.offs + r.leng) <= 8) {
         /* single-byte read-modify-write, offs:[0-7], leng:[1-7] */
-        spi_stat += lgw_spi_r(spi_target, spi_mux_mode, spi_mux_target, r.addr, &buf[0]);
+        slot = cache_slot(spi_mux_target, r);
+        if ((slot >= 0) && reg->cache_valid[slot][r.addr]) {
+            buf[0] = reg->cache_data[slot][r.addr]; /* skip the read, shadow copy is up to date */
+            ++reg->cache_nb_skipped;
+        } else {
+            spi_stat += lgw_spi_r(spi_target, spi_mux_mode, spi_mux_target, r.addr, &buf[0]);
+            ++reg->cache_nb_read;
+        }
         buf[1] = ((1 << r.leng) - 1) << r.offs; /* bit mask */
         buf[2] = ((uint8_t)reg_value) << r.offs; /* new data offsetted */
         buf[3] = (~buf[1] & buf[0]) | (buf[1] & buf[2]); /* mixing old & new data */
         spi_stat += lgw_spi_w(spi_target, spi_mux_mode, spi_mux_target, r.addr, buf[3]);
+        cache_update(spi_mux_target, r, &buf[3], 1, (spi_stat == LGW_SPI_SUCCESS));
     } else if ((r.offs == 0) && (r.leng > 0) && (r.leng <= 32)) {
         /* multi-byte direct write routine */
         size_byte = (r.leng + 7) / 8; /* add a byte if it's not an exact multiple of 8 */
@@ -446,6 +569,7 @@ int reg_w_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target
             reg_value = (reg_value >> 8);
         }
         spi_stat += lgw_spi_wb(spi_target, spi_mux_mode, spi_mux_target, r.addr, buf, size_byte); /* write the register in one burst */
+        cache_update(spi_mux_target, r, buf, size_byte, (spi_stat == LGW_SPI_SUCCESS));
     } else {
         /* register spanning multiple memory bytes but with an offset */
         DEBUG_MSG("ERROR: REGISTER SIZE AND OFFSET ARE NOT SUPPORTED\n");
@@ -467,6 +591,7 @@ int reg_r_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target
     if ((r.offs + r.leng) <= 8) {
         /* read one byte, then shift and mask bits to get reg value with sign extension if needed */
         spi_stat += lgw_spi_r(spi_target, spi_mux_mode, spi_mux_target, r.addr, &bufu[0]);
+        cache_update(spi_mux_target, r, bufu, 1, (spi_stat == LGW_SPI_SUCCESS));
         bufu[1] = bufu[0] << (8 - r.leng - r.offs); /* left-align the data */
         if (r.sign == true) {
             bufs[2] = bufs[1] >> (8 - r.leng); /* right align the data with sign extension (ARITHMETIC right shift) */
@@ -478,6 +603,7 @@ int reg_r_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target
     } else if ((r.offs == 0) && (r.leng > 0) && (r.leng <= 32)) {
         size_byte = (r.leng + 7) / 8; /* add a byte if it's not an exact multiple of 8 */
         spi_stat += lgw_spi_rb(spi_target, spi_mux_mode, spi_mux_target, r.addr, bufu, size_byte);
+        cache_update(spi_mux_target, r, bufu, size_byte, (spi_stat == LGW_SPI_SUCCESS));
         u = 0;
         for (i=(size_byte-1); i>=0; --i) {
             u = (uint32_t)bufu[i] + (u << 8); /* transform a 4-byte array into a 32 bit word */
@@ -497,32 +623,228 @@ int reg_r_align32(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target
     return spi_stat;
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* account one access to a register, t0 is the time the access started */
+static void reg_stats_add(uint16_t register_id, uint32_t *nb, uint16_t nb_byte, uint64_t t0) {
+    struct lgw_reg_state_s *reg = lgw_ctx_current()->reg;
+    *nb += 1;
+    reg->reg_stats[register_id].nb_byte += nb_byte;
+    reg->reg_stats[register_id].time_us += monotonic_us() - t0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void reg_cache_invalidate(uint8_t spi_mux_target) {
+    struct lgw_reg_state_s *reg = lgw_ctx_current()->reg;
+    int i;
+
+    if (spi_mux_target == LGW_SPI_MUX_TARGET_FPGA) {
+        memset(reg->cache_valid[CACHE_SLOT_FPGA], 0, sizeof reg->cache_valid[CACHE_SLOT_FPGA]);
+    } else {
+        for (i = 0; i < CACHE_SLOT_NB; ++i) {
+            if (i != CACHE_SLOT_FPGA) {
+                memset(reg->cache_valid[i], 0, sizeof reg->cache_valid[i]);
+            }
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void reg_cache_invalidate_burst(uint8_t spi_mux_target, struct lgw_reg_s r, uint16_t size) {
+    struct lgw_reg_state_s *reg = lgw_ctx_current()->reg;
+    int slot = cache_slot(spi_mux_target, r);
+    int i;
+
+    /* data ports are volatile and do not auto-increment the address */
+    if ((slot < 0) || cache_vola[slot][r.addr]) {
+        return;
+    }
+    for (i = 0; (i < size) && ((r.addr + i) < 128); ++i) {
+        reg->cache_valid[slot][r.addr + i] = false;
+    }
+}
+
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* merge a field write into the register image, false if it must go on the SPI link */
+static bool image_put(struct lgw_reg_s r, int32_t reg_value) {
+    struct lgw_reg_state_s *reg = lgw_ctx_current()->reg;
+    int slot = (r.page == -1) ? CACHE_SLOT_COMMON : (PAGE_MASK & r.page);
+    int i, size_byte;
+    uint8_t m;
+
+    pthread_once(&cache_init_once, cache_init);
+    if ((r.offs + r.leng) <= 8) {
+        size_byte = 1;
+    } else if ((r.offs == 0) && (r.leng > 0) && (r.leng <= 32)) {
+        size_byte = (r.leng + 7) / 8;
+    } else {
+        return false;
+    }
+    /* volatile fields, and registers sharing a byte with one, keep their write order */
+    for (i = 0; i < size_byte; ++i) {
+        if (((r.addr + i) >= 128) || cache_vola[slot][r.addr + i]) {
+            return false;
+        }
+    }
+
+    if (size_byte == 1) {
+        m = (uint8_t)(((1 << r.leng) - 1) << r.offs);
+        reg->image_data[slot][r.addr] = (~m & reg->image_data[slot][r.addr]) | (m & (uint8_t)(reg_value << r.offs));
+        reg->image_mask[slot][r.addr] |= m;
+    } else {
+        /* same as reg_w_align32, whole bytes are written, LSB first */
+        for (i = 0; i < size_byte; ++i) {
+            reg->image_data[slot][r.addr + i] = (uint8_t)(0x000000FF & reg_value);
+            reg->image_mask[slot][r.addr + i] = 0xFF;
+            reg_value = (reg_value >> 8);
+        }
+    }
+    reg->image_dirty = true;
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* write one slot of the register image, one burst per contiguous range of written bytes */
+static int image_flush_slot(int slot) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
+    struct lgw_reg_s r = {(slot == CACHE_SLOT_COMMON) ? -1 : slot, 0, 0, 0, 8, 0, 0, 0};
+    int spi_stat = LGW_SPI_SUCCESS;
+    uint8_t *mask = reg->image_mask[slot];
+    uint8_t buf[128];
+    bool read;
+    int i, j, k;
+
+    if ((slot != CACHE_SLOT_COMMON) && (slot != reg->lgw_regpage)) {
+        spi_stat += page_switch(slot);
+    }
+    for (i = 0; i < 128; i = j) {
+        if (mask[i] == 0) {
+            j = i + 1;
+            continue;
+        }
+        /* [i, j[ only holds non-volatile bytes: read it back once if a partly written byte is not known */
+        read = false;
+        for (j = i; (j < 128) && (mask[j] != 0); ++j) {
+            if ((mask[j] != 0xFF) && !((reg->cache_enable == true) && reg->cache_valid[slot][j])) {
+                read = true;
+            }
+        }
+        if (read == true) {
+            spi_stat += lgw_spi_rb(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, i, &buf[i], j - i);
+            ++reg->cache_nb_read;
+        } else {
+            memcpy(&buf[i], &reg->cache_data[slot][i], j - i);
+        }
+        for (k = i; k < j; ++k) {
+            buf[k] = (~mask[k] & buf[k]) | (mask[k] & reg->image_data[slot][k]);
+        }
+        r.addr = i;
+        spi_stat += lgw_spi_wb(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, i, &buf[i], j - i);
+        cache_update(LGW_SPI_MUX_TARGET_SX1301, r, &buf[i], j - i, (spi_stat == LGW_SPI_SUCCESS));
+    }
+    memset(mask, 0, 128);
+
+    return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* send the pending register image, before any access that is not merged in it */
+static int image_flush(void) {
+    struct lgw_reg_state_s *reg = lgw_ctx_current()->reg;
+    int spi_stat = LGW_SPI_SUCCESS;
+    int page_first = reg->lgw_regpage;
+    int i, j, slot;
+
+    if (reg->image_dirty == false) {
+        return LGW_SPI_SUCCESS;
+    }
+    reg->image_dirty = false;
+
+    /* common registers first, then the current page, to save page switches */
+    for (i = -2; i < 4; ++i) {
+        slot = (i == -2) ? CACHE_SLOT_COMMON : ((i == -1) ? page_first : i);
+        if ((i >= 0) && (slot == page_first)) {
+            continue;
+        }
+        for (j = 0; (j < 128) && (reg->image_mask[slot][j] == 0); ++j);
+        if (j < 128) {
+            spi_stat += image_flush_slot(slot);
+        }
+    }
+    return spi_stat;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
 
+struct lgw_reg_state_s *lgw_reg_state_new(bool dflt) {
+    struct lgw_reg_state_s *state;
+
+    state = (dflt == true) ? &reg_state_dflt : malloc(sizeof *state);
+    if (state == NULL) {
+        return NULL;
+    }
+    memset(state, 0, sizeof *state);
+    state->lgw_regpage = -1;
+    state->cache_enable = true;
+    return state;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+void lgw_reg_state_free(struct lgw_reg_state_s *state) {
+    if ((state != NULL) && (state != &reg_state_dflt)) {
+        free(state);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
 /* Concentrator connect */
 int lgw_connect(bool spi_only, uint32_t tx_notch_freq) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
     int spi_stat = LGW_SPI_SUCCESS;
     uint8_t u = 0;
     int x;
 
+    /* the thread must know which concentrator it drives */
+    if (lgw_ctx_check() != LGW_CTX_SUCCESS) {
+        DEBUG_MSG("ERROR: NO CONTEXT SELECTED, CALL lgw_ctx_use\n");
+        return LGW_REG_ERROR;
+    }
+
     /* check SPI link status */
-    if (lgw_spi_target != NULL) {
+    if (ctx->spi_target != NULL) {
         DEBUG_MSG("WARNING: concentrator was already connected\n");
-        lgw_spi_close(lgw_spi_target);
+        lgw_spi_close(ctx->spi_target);
     }
 
     /* open the SPI link */
-    spi_stat = lgw_spi_open(&lgw_spi_target);
+    spi_stat = lgw_spi_open((ctx->spi_path[0] != '\0') ? ctx->spi_path : NULL, &ctx->spi_target);
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR CONNECTING CONCENTRATOR\n");
         return LGW_REG_ERROR;
     }
 
+    /* registers are about to be reset, or were changed behind our back */
+    reg_cache_invalidate(LGW_SPI_MUX_TARGET_SX1301);
+    reg_cache_invalidate(LGW_SPI_MUX_TARGET_FPGA);
+    reg->image_depth = 0;
+    reg->image_dirty = false;
+    memset(reg->image_mask, 0, sizeof reg->image_mask);
+
     if (spi_only == false ) {
         /* Detect if the gateway has an FPGA with SPI mux header support */
         /* First, we assume there is an FPGA, and try to read its version */
-        spi_stat = lgw_spi_r(lgw_spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA, loregs[LGW_VERSION].addr, &u);
+        spi_stat = lgw_spi_r(ctx->spi_target, LGW_SPI_MUX_MODE1, LGW_SPI_MUX_TARGET_FPGA, loregs[LGW_VERSION].addr, &u);
         if (spi_stat != LGW_SPI_SUCCESS) {
             DEBUG_MSG("ERROR READING VERSION REGISTER\n");
             return LGW_REG_ERROR;
@@ -530,13 +852,13 @@ int lgw_connect(bool spi_only, uint32_t tx_notch_freq) {
         if (check_fpga_version(u) != true) {
             /* We failed to read expected FPGA version, so let's assume there is no FPGA */
             DEBUG_PRINTF("INFO: no FPGA detected or version not supported (v%u)\n", u);
-            lgw_spi_mux_mode = LGW_SPI_MUX_MODE0;
+            ctx->spi_mux_mode = LGW_SPI_MUX_MODE0;
         } else {
             DEBUG_PRINTF("INFO: detected FPGA with SPI mux header (v%u)\n", u);
-            lgw_spi_mux_mode = LGW_SPI_MUX_MODE1;
+            ctx->spi_mux_mode = LGW_SPI_MUX_MODE1;
             /* FPGA Soft Reset */
-            lgw_spi_w(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_FPGA, 0, 1);
-            lgw_spi_w(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_FPGA, 0, 0);
+            lgw_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_FPGA, 0, 1);
+            lgw_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_FPGA, 0, 0);
             /* FPGA configure */
             x = lgw_fpga_configure(tx_notch_freq);
             if (x != LGW_REG_SUCCESS) {
@@ -546,7 +868,7 @@ int lgw_connect(bool spi_only, uint32_t tx_notch_freq) {
         }
 
         /* check SX1301 version */
-        spi_stat = lgw_spi_r(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, loregs[LGW_VERSION].addr, &u);
+        spi_stat = lgw_spi_r(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, loregs[LGW_VERSION].addr, &u);
         if (spi_stat != LGW_SPI_SUCCESS) {
             DEBUG_MSG("ERROR READING CHIP VERSION REGISTER\n");
             return LGW_REG_ERROR;
@@ -557,12 +879,12 @@ int lgw_connect(bool spi_only, uint32_t tx_notch_freq) {
         }
 
         /* write 0 to the page/reset register */
-        spi_stat = lgw_spi_w(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, loregs[LGW_PAGE_REG].addr, 0);
+        spi_stat = lgw_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, loregs[LGW_PAGE_REG].addr, 0);
         if (spi_stat != LGW_SPI_SUCCESS) {
             DEBUG_MSG("ERROR WRITING PAGE REGISTER\n");
             return LGW_REG_ERROR;
         } else {
-            lgw_regpage = 0;
+            reg->lgw_regpage = 0;
         }
     }
 
@@ -574,9 +896,12 @@ int lgw_connect(bool spi_only, uint32_t tx_notch_freq) {
 
 /* Concentrator disconnect */
 int lgw_disconnect(void) {
-    if (lgw_spi_target != NULL) {
-        lgw_spi_close(lgw_spi_target);
-        lgw_spi_target = NULL;
+    struct lgw_context *ctx = lgw_ctx_current();
+    if (ctx->spi_target != NULL) {
+        image_flush();
+        ctx->reg->image_depth = 0;
+        lgw_spi_close(ctx->spi_target);
+        ctx->spi_target = NULL;
         DEBUG_MSG("Note: success disconnecting the concentrator\n");
         return LGW_REG_SUCCESS;
     } else {
@@ -589,13 +914,17 @@ int lgw_disconnect(void) {
 
 /* soft-reset function */
 int lgw_soft_reset(void) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
     /* check if SPI is initialised */
-    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+    if ((ctx->spi_target == NULL) || (reg->lgw_regpage < 0)) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
-    lgw_spi_w(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, 0, 0x80); /* 1 -> SOFT_RESET bit */
-    lgw_regpage = 0; /* reset the paging static variable */
+    image_flush();
+    lgw_spi_w(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, 0, 0x80); /* 1 -> SOFT_RESET bit */
+    reg->lgw_regpage = 0; /* reset the paging static variable */
+    reg_cache_invalidate(LGW_SPI_MUX_TARGET_SX1301);
     return LGW_REG_SUCCESS;
 }
 
@@ -603,6 +932,8 @@ int lgw_soft_reset(void) {
 
 /* register verification */
 int lgw_reg_check(FILE *f) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
     struct lgw_reg_s r;
     int32_t read_value;
     char ok_msg[] = "+++MATCH+++";
@@ -611,7 +942,7 @@ int lgw_reg_check(FILE *f) {
     int i;
 
     /* check if SPI is initialised */
-    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+    if ((ctx->spi_target == NULL) || (reg->lgw_regpage < 0)) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         fprintf(f, "ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
@@ -636,8 +967,11 @@ int lgw_reg_check(FILE *f) {
 
 /* Write to a register addressed by name */
 int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
     int spi_stat = LGW_SPI_SUCCESS;
     struct lgw_reg_s r;
+    uint64_t t0 = monotonic_us();
 
     /* check input parameters */
     if (register_id >= LGW_TOTALREGS) {
@@ -646,13 +980,14 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
     }
 
     /* check if SPI is initialised */
-    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+    if ((ctx->spi_target == NULL) || (reg->lgw_regpage < 0)) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
 
     /* intercept direct access to PAGE_REG & SOFT_RESET */
     if (register_id == LGW_PAGE_REG) {
+        image_flush();
         page_switch(reg_value);
         return LGW_REG_SUCCESS;
     } else if (register_id == LGW_SOFT_RESET) {
@@ -671,12 +1006,25 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
         return LGW_REG_ERROR;
     }
 
+    /* merge in the register image if one is being built, else keep the write order */
+    if ((reg->image_depth > 0) && (register_id != LGW_EMERGENCY_FORCE_HOST_CTRL) && image_put(r, reg_value)) {
+        reg_stats_add(register_id, &reg->reg_stats[register_id].nb_w, (r.offs + r.leng + 7) / 8, t0);
+        return LGW_REG_SUCCESS;
+    }
+    spi_stat += image_flush();
+
     /* select proper register page if needed */
-    if ((r.page != -1) && (r.page != lgw_regpage)) {
+    if ((r.page != -1) && (r.page != reg->lgw_regpage)) {
         spi_stat += page_switch(r.page);
     }
 
-    spi_stat += reg_w_align32(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r, reg_value);
+    spi_stat += reg_w_align32(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r, reg_value);
+    reg_stats_add(register_id, &reg->reg_stats[register_id].nb_w, (r.offs + r.leng + 7) / 8, t0);
+
+    /* MCU gets or gives back access to the registers, shadow copy cannot be trusted */
+    if (register_id == LGW_EMERGENCY_FORCE_HOST_CTRL) {
+        reg_cache_invalidate(LGW_SPI_MUX_TARGET_SX1301);
+    }
 
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
@@ -690,8 +1038,11 @@ int lgw_reg_w(uint16_t register_id, int32_t reg_value) {
 
 /* Read to a register addressed by name */
 int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
     int spi_stat = LGW_SPI_SUCCESS;
     struct lgw_reg_s r;
+    uint64_t t0 = monotonic_us();
 
     /* check input parameters */
     CHECK_NULL(reg_value);
@@ -701,20 +1052,22 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
     }
 
     /* check if SPI is initialised */
-    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+    if ((ctx->spi_target == NULL) || (reg->lgw_regpage < 0)) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
 
     /* get register struct from the struct array */
     r = loregs[register_id];
+    spi_stat += image_flush();
 
     /* select proper register page if needed */
-    if ((r.page != -1) && (r.page != lgw_regpage)) {
+    if ((r.page != -1) && (r.page != reg->lgw_regpage)) {
         spi_stat += page_switch(r.page);
     }
 
-    spi_stat += reg_r_align32(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r, reg_value);
+    spi_stat += reg_r_align32(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r, reg_value);
+    reg_stats_add(register_id, &reg->reg_stats[register_id].nb_r, (r.offs + r.leng + 7) / 8, t0);
 
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER WRITE\n");
@@ -728,8 +1081,11 @@ int lgw_reg_r(uint16_t register_id, int32_t *reg_value) {
 
 /* Point to a register by name and do a burst write */
 int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
     int spi_stat = LGW_SPI_SUCCESS;
     struct lgw_reg_s r;
+    uint64_t t0 = monotonic_us();
 
     /* check input parameters */
     CHECK_NULL(data);
@@ -743,7 +1099,7 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
     }
 
     /* check if SPI is initialised */
-    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+    if ((ctx->spi_target == NULL) || (reg->lgw_regpage < 0)) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
@@ -756,14 +1112,17 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
         DEBUG_MSG("ERROR: TRYING TO BURST WRITE A READ-ONLY REGISTER\n");
         return LGW_REG_ERROR;
     }
+    spi_stat += image_flush();
 
     /* select proper register page if needed */
-    if ((r.page != -1) && (r.page != lgw_regpage)) {
+    if ((r.page != -1) && (r.page != reg->lgw_regpage)) {
         spi_stat += page_switch(r.page);
     }
 
     /* do the burst write */
-    spi_stat += lgw_spi_wb(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r.addr, data, size);
+    spi_stat += lgw_spi_wb(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r.addr, data, size);
+    reg_cache_invalidate_burst(LGW_SPI_MUX_TARGET_SX1301, r, size);
+    reg_stats_add(register_id, &reg->reg_stats[register_id].nb_wb, size, t0);
 
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BURST WRITE\n");
@@ -777,8 +1136,11 @@ int lgw_reg_wb(uint16_t register_id, uint8_t *data, uint16_t size) {
 
 /* Point to a register by name and do a burst read */
 int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
     int spi_stat = LGW_SPI_SUCCESS;
     struct lgw_reg_s r;
+    uint64_t t0 = monotonic_us();
 
     /* check input parameters */
     CHECK_NULL(data);
@@ -792,21 +1154,23 @@ int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
     }
 
     /* check if SPI is initialised */
-    if ((lgw_spi_target == NULL) || (lgw_regpage < 0)) {
+    if ((ctx->spi_target == NULL) || (reg->lgw_regpage < 0)) {
         DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
         return LGW_REG_ERROR;
     }
 
     /* get register struct from the struct array */
     r = loregs[register_id];
+    spi_stat += image_flush();
 
     /* select proper register page if needed */
-    if ((r.page != -1) && (r.page != lgw_regpage)) {
+    if ((r.page != -1) && (r.page != reg->lgw_regpage)) {
         spi_stat += page_switch(r.page);
     }
 
     /* do the burst read */
-    spi_stat += lgw_spi_rb(lgw_spi_target, lgw_spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r.addr, data, size);
+    spi_stat += lgw_spi_rb(ctx->spi_target, ctx->spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, r.addr, data, size);
+    reg_stats_add(register_id, &reg->reg_stats[register_id].nb_rb, size, t0);
 
     if (spi_stat != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BURST READ\n");
@@ -816,4 +1180,118 @@ int lgw_reg_rb(uint16_t register_id, uint8_t *data, uint16_t size) {
     }
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Queue register writes until lgw_reg_batch_end */
+int lgw_reg_batch_begin(void) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
+    /* check if SPI is initialised */
+    if ((ctx->spi_target == NULL) || (reg->lgw_regpage < 0)) {
+        DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+        return LGW_REG_ERROR;
+    }
+
+    lgw_spi_batch_begin(ctx->spi_target);
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Send queued register writes */
+int lgw_reg_batch_end(void) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
+    /* check if SPI is initialised */
+    if ((ctx->spi_target == NULL) || (reg->lgw_regpage < 0)) {
+        DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+        return LGW_REG_ERROR;
+    }
+
+    if (lgw_spi_batch_end(ctx->spi_target) != LGW_SPI_SUCCESS) {
+        DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER BATCH WRITE\n");
+        return LGW_REG_ERROR;
+    }
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Merge register writes in an image until lgw_reg_image_end */
+int lgw_reg_image_begin(void) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
+    /* check if SPI is initialised */
+    if ((ctx->spi_target == NULL) || (reg->lgw_regpage < 0)) {
+        DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+        return LGW_REG_ERROR;
+    }
+
+    ++reg->image_depth;
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Write the register image */
+int lgw_reg_image_end(void) {
+    struct lgw_context *ctx = lgw_ctx_current();
+    struct lgw_reg_state_s *reg = ctx->reg;
+    /* check if SPI is initialised */
+    if ((ctx->spi_target == NULL) || (reg->lgw_regpage < 0)) {
+        DEBUG_MSG("ERROR: CONCENTRATOR UNCONNECTED\n");
+        return LGW_REG_ERROR;
+    }
+
+    if (reg->image_depth > 0) {
+        --reg->image_depth;
+    }
+    if ((reg->image_depth == 0) && (image_flush() != LGW_SPI_SUCCESS)) {
+        DEBUG_MSG("ERROR: SPI ERROR DURING REGISTER IMAGE WRITE\n");
+        return LGW_REG_ERROR;
+    }
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Enable or disable the register shadow copy */
+int lgw_reg_cache_enable(bool enable) {
+    struct lgw_reg_state_s *reg = lgw_ctx_current()->reg;
+    reg->cache_enable = enable;
+    reg_cache_invalidate(LGW_SPI_MUX_TARGET_SX1301);
+    reg_cache_invalidate(LGW_SPI_MUX_TARGET_FPGA);
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Read-modify-write statistics */
+int lgw_reg_cache_stats(uint32_t *nb_skipped, uint32_t *nb_read) {
+    struct lgw_reg_state_s *reg = lgw_ctx_current()->reg;
+    CHECK_NULL(nb_skipped);
+    CHECK_NULL(nb_read);
+
+    *nb_skipped = reg->cache_nb_skipped;
+    *nb_read = reg->cache_nb_read;
+    return LGW_REG_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Per-register access statistics */
+int lgw_reg_get_stats(struct lgw_reg_stats_s *stats, uint32_t *nb_page_switch, bool reset) {
+    struct lgw_reg_state_s *reg = lgw_ctx_current()->reg;
+    CHECK_NULL(stats);
+    CHECK_NULL(nb_page_switch);
+
+    memcpy(stats, reg->reg_stats, sizeof reg->reg_stats);
+    *nb_page_switch = reg->reg_nb_page_switch;
+    if (reset == true) {
+        memset(reg->reg_stats, 0, sizeof reg->reg_stats);
+        reg->reg_nb_page_switch = 0;
+    }
+    return LGW_REG_SUCCESS;
+}
+
 /* --- EOF ------------------------------------------------------------------ */
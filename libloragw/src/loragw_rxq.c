@@ -0,0 +1,264 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Background RX thread draining the concentrator FIFO into a packet ring
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <errno.h>      /* EINTR ETIMEDOUT */
+#include <time.h>       /* clock_gettime */
+#include <pthread.h>    /* pthread_create pthread_join */
+#include <semaphore.h>  /* sem_wait sem_timedwait sem_post */
+
+#include "loragw_rxq.h"
+#include "loragw_ctx.h"
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_HAL == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                 if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_RXQ_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                 if(a==NULL){return LGW_RXQ_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define RXQ_MASK            (LGW_RXQ_SIZE - 1)
+#define RXQ_FETCH_NB        LGW_PKT_FIFO_SIZE /* packets fetched per lgw_receive_wait call */
+#define RXQ_WAIT_MS         50 /* longest lgw_receive_wait call, bounds the time lgw_rxq_stop takes */
+
+#if (LGW_RXQ_SIZE & RXQ_MASK) != 0
+    #error "LGW_RXQ_SIZE must be a power of 2"
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_pkt_rx_s rxq_ring[LGW_RXQ_SIZE];
+static uint32_t rxq_head; /* free-running index of the next slot to write, only modified by the RX thread */
+static uint32_t rxq_tail; /* free-running index of the next slot to read, only modified by the consumer */
+static sem_t rxq_sem; /* one token per packet in the ring, plus one token posted by lgw_rxq_stop */
+static bool rxq_sem_init = false;
+
+static pthread_t rxq_thread;
+static bool rxq_running = false;
+
+static struct lgw_rxq_stats_s rxq_stats;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void *rxq_thread_main(void *arg);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void *rxq_thread_main(void *arg) {
+    struct lgw_pkt_rx_s fetch[RXQ_FETCH_NB];
+    int nb_pkt;
+    int i;
+    uint32_t tail;
+    uint32_t depth;
+
+    lgw_ctx_use(arg); /* drive the concentrator of the thread that started the queue */
+
+    while (__atomic_load_n(&rxq_running, __ATOMIC_ACQUIRE)) {
+        nb_pkt = lgw_receive_wait(ARRAY_SIZE(fetch), fetch, RXQ_WAIT_MS);
+        if (nb_pkt == LGW_HAL_ERROR) {
+            DEBUG_MSG("ERROR: RX THREAD FAILED TO FETCH PACKETS\n");
+            __atomic_fetch_add(&rxq_stats.nb_error, 1, __ATOMIC_RELAXED);
+            wait_ms(RXQ_WAIT_MS);
+            continue;
+        } else if (nb_pkt == 0) {
+            continue;
+        }
+
+        tail = __atomic_load_n(&rxq_tail, __ATOMIC_ACQUIRE);
+        for (i = 0; i < nb_pkt; ++i) {
+            if ((rxq_head - tail) >= LGW_RXQ_SIZE) {
+                /* ring seen full, refresh the consumer index before dropping */
+                tail = __atomic_load_n(&rxq_tail, __ATOMIC_ACQUIRE);
+                if ((rxq_head - tail) >= LGW_RXQ_SIZE) {
+                    __atomic_fetch_add(&rxq_stats.nb_overrun, 1, __ATOMIC_RELAXED);
+                    continue;
+                }
+            }
+            rxq_ring[rxq_head & RXQ_MASK] = fetch[i];
+            __atomic_store_n(&rxq_head, rxq_head + 1, __ATOMIC_RELEASE);
+            sem_post(&rxq_sem);
+            __atomic_fetch_add(&rxq_stats.nb_pkt_in, 1, __ATOMIC_RELAXED);
+        }
+
+        depth = rxq_head - tail;
+        if (depth > __atomic_load_n(&rxq_stats.depth_max, __ATOMIC_RELAXED)) {
+            __atomic_store_n(&rxq_stats.depth_max, (uint16_t)depth, __ATOMIC_RELAXED);
+        }
+    }
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_rxq_start(void) {
+    if (rxq_running == true) {
+        DEBUG_MSG("ERROR: RX THREAD ALREADY RUNNING\n");
+        return LGW_RXQ_ERROR;
+    }
+
+    /* discard anything left from a previous run */
+    if (rxq_sem_init == true) {
+        sem_destroy(&rxq_sem);
+        rxq_sem_init = false;
+    }
+    if (sem_init(&rxq_sem, 0, 0) != 0) {
+        DEBUG_MSG("ERROR: FAILED TO INITIALIZE RX RING SEMAPHORE\n");
+        return LGW_RXQ_ERROR;
+    }
+    rxq_sem_init = true;
+    rxq_head = 0;
+    rxq_tail = 0;
+
+    __atomic_store_n(&rxq_running, true, __ATOMIC_RELEASE);
+    if (pthread_create(&rxq_thread, NULL, rxq_thread_main, lgw_ctx_current()) != 0) {
+        DEBUG_MSG("ERROR: FAILED TO CREATE RX THREAD\n");
+        rxq_running = false;
+        return LGW_RXQ_ERROR;
+    }
+
+    DEBUG_MSG("Note: RX thread started\n");
+    return LGW_RXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxq_stop(void) {
+    if (rxq_running == false) {
+        DEBUG_MSG("Note: RX thread not running\n");
+        return LGW_RXQ_SUCCESS;
+    }
+
+    __atomic_store_n(&rxq_running, false, __ATOMIC_RELEASE);
+    if (pthread_join(rxq_thread, NULL) != 0) {
+        DEBUG_MSG("ERROR: FAILED TO JOIN RX THREAD\n");
+        return LGW_RXQ_ERROR;
+    }
+
+    /* wake up a consumer waiting forever, it will find the ring empty */
+    sem_post(&rxq_sem);
+
+    return LGW_RXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxq_receive(uint8_t max_pkt, struct lgw_pkt_rx_s *pkt_data, int timeout_ms) {
+    struct timespec deadline;
+    uint32_t head;
+    int nb_pkt = 0;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(pkt_data);
+    if (rxq_sem_init == false) {
+        DEBUG_MSG("ERROR: RX THREAD WAS NEVER STARTED\n");
+        return LGW_RXQ_ERROR;
+    }
+    if (max_pkt == 0) {
+        return 0;
+    }
+
+    /* wait for the first packet */
+    if (timeout_ms == 0) {
+        i = sem_trywait(&rxq_sem);
+    } else if (timeout_ms < 0) {
+        while (((i = sem_wait(&rxq_sem)) != 0) && (errno == EINTR));
+    } else {
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += timeout_ms / 1000;
+        deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (((i = sem_timedwait(&rxq_sem, &deadline)) != 0) && (errno == EINTR));
+    }
+    if (i != 0) {
+        if ((errno == EAGAIN) || (errno == ETIMEDOUT)) {
+            return 0;
+        }
+        DEBUG_PRINTF("ERROR: FAILED TO WAIT ON RX RING (errno %d)\n", errno);
+        return LGW_RXQ_ERROR;
+    }
+
+    /* one token is held, then take whatever else is already available */
+    do {
+        head = __atomic_load_n(&rxq_head, __ATOMIC_ACQUIRE);
+        if (rxq_tail == head) {
+            break; /* wake-up token from lgw_rxq_stop */
+        }
+        pkt_data[nb_pkt] = rxq_ring[rxq_tail & RXQ_MASK];
+        __atomic_store_n(&rxq_tail, rxq_tail + 1, __ATOMIC_RELEASE);
+        ++nb_pkt;
+    } while ((nb_pkt < max_pkt) && (sem_trywait(&rxq_sem) == 0));
+
+    __atomic_fetch_add(&rxq_stats.nb_pkt_out, nb_pkt, __ATOMIC_RELAXED);
+    return nb_pkt;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_rxq_get_stats(struct lgw_rxq_stats_s *stats, bool reset) {
+    /* check input variables */
+    CHECK_NULL(stats);
+
+    stats->nb_pkt_in = __atomic_load_n(&rxq_stats.nb_pkt_in, __ATOMIC_RELAXED);
+    stats->nb_pkt_out = __atomic_load_n(&rxq_stats.nb_pkt_out, __ATOMIC_RELAXED);
+    stats->nb_overrun = __atomic_load_n(&rxq_stats.nb_overrun, __ATOMIC_RELAXED);
+    stats->nb_error = __atomic_load_n(&rxq_stats.nb_error, __ATOMIC_RELAXED);
+    stats->depth_max = __atomic_load_n(&rxq_stats.depth_max, __ATOMIC_RELAXED);
+
+    if (reset == true) {
+        /* subtract what was read, so that increments done meanwhile by the other thread are kept */
+        __atomic_fetch_sub(&rxq_stats.nb_pkt_in, stats->nb_pkt_in, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&rxq_stats.nb_pkt_out, stats->nb_pkt_out, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&rxq_stats.nb_overrun, stats->nb_overrun, __ATOMIC_RELAXED);
+        __atomic_fetch_sub(&rxq_stats.nb_error, stats->nb_error, __ATOMIC_RELAXED);
+        __atomic_store_n(&rxq_stats.depth_max, 0, __ATOMIC_RELAXED);
+    }
+
+    return LGW_RXQ_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
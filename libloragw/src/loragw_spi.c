@@ -0,0 +1,583 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Forward the lgw_spi_* functions to the selected SPI backend: the Linux
+    spidev device (loragw_spi.native.c), the in-memory concentrator
+    simulator (loragw_spi.sim.c) or the trace player (loragw_spi.replay.c).
+    Optionally record every transfer to a trace file on the way.
+    Count the transfers and keep latency histograms of each kind of transfer,
+    per concentrator context.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>        /* C99 types */
+#include <stdio.h>        /* printf fprintf fopen fwrite fgets sscanf */
+#include <stdlib.h>        /* getenv strtoul */
+#include <string.h>        /* strcmp strncmp strncpy strpbrk memset */
+#include <stdbool.h>       /* bool type */
+#include <pthread.h>       /* mutex protecting the links count and the trace */
+
+#include "loragw_spi.h"
+#include "loragw_aux.h"
+#include "loragw_ctx.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_SPI == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_SPI_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                if(a==NULL){return LGW_SPI_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define TRACE_BUFF_SIZE     65536 /* trace file stdio buffer, keeps recording cheap */
+
+#define LINK_DEV_NB_MAX     16 /* SPI devices in one link settings file */
+#define LINK_DEV_SIZE       64 /* longest SPI device path, including the terminating null */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* link settings of one SPI device, an empty device for the backend default */
+struct spi_link_dev_s {
+    char                    device[LINK_DEV_SIZE];
+    struct lgw_spi_link_s   link;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const struct lgw_spi_backend_s *spi_backend = NULL; /* chosen by the first lgw_spi_open if not selected */
+static int spi_open_nb = 0; /* number of links currently open */
+
+static FILE *trace_file = NULL; /* trace being recorded, NULL if none */
+static bool trace_from_env = false; /* trace started by lgw_spi_open, stopped by the last lgw_spi_close */
+static uint64_t trace_last_us; /* time of the last record */
+static char trace_buff[TRACE_BUFF_SIZE];
+
+static struct lgw_spi_link_s spi_link = { LGW_SPI_SPEED_DEFAULT, LGW_BURST_CHUNK }; /* settings of the last link opened */
+static bool spi_link_set = false; /* settings given by lgw_spi_set_link, the settings file is not read */
+
+/* links of several concentrator contexts may be opened, closed and traced concurrently */
+static pthread_mutex_t spi_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static const struct lgw_spi_backend_s *spi_backend_get(void);
+static bool spi_link_valid(const struct lgw_spi_link_s *link);
+static int spi_link_find(struct spi_link_dev_s *tab, int *nb, const char *device);
+static int spi_link_read(const char *path, struct spi_link_dev_s *tab);
+static int spi_trace_open(const char *path);
+static int spi_trace_close(void);
+static void spi_trace(uint8_t op, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, const uint8_t *data, uint16_t size);
+static void spi_stats_add(int op, uint16_t size, uint64_t t0);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static const struct lgw_spi_backend_s *spi_backend_get(void) {
+    const struct lgw_spi_backend_s *list[] = { &lgw_spi_native, &lgw_spi_sim, &lgw_spi_replay };
+    const char *env;
+    unsigned i;
+
+    if (spi_backend == NULL) {
+        spi_backend = &lgw_spi_native;
+        env = getenv(LGW_SPI_BACKEND_ENV);
+        for (i = 0; (env != NULL) && (i < sizeof list / sizeof list[0]); ++i) {
+            if (strcmp(env, list[i]->name) == 0) {
+                spi_backend = list[i];
+            }
+        }
+        DEBUG_PRINTF("Note: SPI backend %s\n", spi_backend->name);
+    }
+    return spi_backend;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool spi_link_valid(const struct lgw_spi_link_s *link) {
+    return (link->speed_hz >= LGW_SPI_SPEED_MIN) && (link->speed_hz <= LGW_SPI_SPEED_MAX) && (link->burst_chunk >= LGW_BURST_CHUNK_MIN) && (link->burst_chunk <= LGW_BURST_CHUNK_MAX);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* index of the entry of device in tab, added with the default settings if
+missing, -1 if the table is full */
+static int spi_link_find(struct spi_link_dev_s *tab, int *nb, const char *device) {
+    int i;
+
+    for (i = 0; i < *nb; ++i) {
+        if (strncmp(tab[i].device, device, LINK_DEV_SIZE) == 0) {
+            return i;
+        }
+    }
+    if (*nb >= LINK_DEV_NB_MAX) {
+        return -1;
+    }
+    memset(&tab[i], 0, sizeof tab[i]);
+    strncpy(tab[i].device, device, LINK_DEV_SIZE - 1);
+    tab[i].link.speed_hz = LGW_SPI_SPEED_DEFAULT;
+    tab[i].link.burst_chunk = LGW_BURST_CHUNK;
+    *nb += 1;
+    return i;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* read all the entries of a settings file, return their number, -1 if the file cannot be read */
+static int spi_link_read(const char *path, struct spi_link_dev_s *tab) {
+    char line[128];
+    char name[32];
+    char value[LINK_DEV_SIZE];
+    unsigned long v;
+    int nb = 0;
+    int cur = -2; /* entry the lines apply to, -2 before any device line, -1 for a device that did not fit */
+    FILE *f;
+
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return -1;
+    }
+    while (fgets(line, sizeof line, f) != NULL) {
+        if ((line[0] == '#') || (sscanf(line, "%31s %63s", name, value) != 2)) {
+            continue;
+        }
+        if (strcmp(name, "device") == 0) {
+            cur = spi_link_find(tab, &nb, value);
+            continue;
+        }
+        if (cur == -2) {
+            cur = spi_link_find(tab, &nb, ""); /* lines before the first device line, from older files */
+        }
+        if (cur < 0) {
+            continue;
+        }
+        v = strtoul(value, NULL, 10);
+        if (strcmp(name, "speed_hz") == 0) {
+            tab[cur].link.speed_hz = (v > 0xFFFFFFFF) ? 0 : (uint32_t)v;
+        } else if (strcmp(name, "burst_chunk") == 0) {
+            tab[cur].link.burst_chunk = (v > 0xFFFF) ? 0 : (uint16_t)v;
+        }
+    }
+    fclose(f);
+    return nb;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* spi_mutex held */
+static int spi_trace_open(const char *path) {
+    const uint8_t hdr[LGW_SPI_TRACE_HDR_SIZE] = { 'L', 'G', 'W', 'T', LGW_SPI_TRACE_VERSION, 0, 0, 0 };
+
+    spi_trace_close();
+    trace_file = fopen(path, "wb");
+    if (trace_file == NULL) {
+        DEBUG_PRINTF("ERROR: FAILED TO CREATE SPI TRACE %s\n", path);
+        return LGW_SPI_ERROR;
+    }
+    setvbuf(trace_file, trace_buff, _IOFBF, sizeof trace_buff);
+    fwrite(hdr, 1, sizeof hdr, trace_file);
+    trace_last_us = monotonic_us();
+    trace_from_env = false;
+
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* spi_mutex held */
+static int spi_trace_close(void) {
+    int x = LGW_SPI_SUCCESS;
+
+    if (trace_file != NULL) {
+        x = (fclose(trace_file) == 0) ? LGW_SPI_SUCCESS : LGW_SPI_ERROR;
+        trace_file = NULL;
+    }
+    trace_from_env = false;
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void spi_trace(uint8_t op, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, const uint8_t *data, uint16_t size) {
+    uint8_t rec[LGW_SPI_TRACE_REC_SIZE];
+    uint64_t now;
+    uint32_t dt;
+
+    pthread_mutex_lock(&spi_mutex);
+    if (trace_file == NULL) {
+        pthread_mutex_unlock(&spi_mutex);
+        return;
+    }
+    now = monotonic_us();
+    dt = ((now - trace_last_us) > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)(now - trace_last_us);
+    trace_last_us = now;
+
+    rec[0] = op | ((spi_mux_mode == LGW_SPI_MUX_MODE1) ? LGW_SPI_TRACE_OP_MUX1 : 0);
+    rec[1] = spi_mux_target;
+    rec[2] = address;
+    rec[3] = (uint8_t)size;
+    rec[4] = (uint8_t)(size >> 8);
+    rec[5] = (uint8_t)dt;
+    rec[6] = (uint8_t)(dt >> 8);
+    rec[7] = (uint8_t)(dt >> 16);
+    rec[8] = (uint8_t)(dt >> 24);
+    fwrite(rec, 1, sizeof rec, trace_file);
+    fwrite(data, 1, size, trace_file);
+    pthread_mutex_unlock(&spi_mutex);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* account one transfer, t0 is the time the backend was called */
+static void spi_stats_add(int op, uint16_t size, uint64_t t0) {
+    struct lgw_spi_stats_s *spi_stats = &lgw_ctx_current()->spi_stats;
+    uint64_t dt = monotonic_us() - t0;
+    uint64_t v;
+    int i;
+
+    for (i = 0, v = dt; (v != 0) && (i < (LGW_SPI_HIST_NB - 1)); ++i) {
+        v >>= 1;
+    }
+    spi_stats->nb[op] += 1;
+    spi_stats->nb_byte[op] += size;
+    spi_stats->time_us[op] += dt;
+    spi_stats->hist[op][i] += 1;
+    if (dt > spi_stats->max_us[op]) {
+        spi_stats->max_us[op] = (dt > 0xFFFFFFFF) ? 0xFFFFFFFF : (uint32_t)dt;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_spi_set_backend(const struct lgw_spi_backend_s *backend) {
+    /* check input variables */
+    CHECK_NULL(backend);
+
+    pthread_mutex_lock(&spi_mutex);
+    if (spi_open_nb > 0) {
+        pthread_mutex_unlock(&spi_mutex);
+        DEBUG_MSG("ERROR: SPI LINK OPEN, CLOSE IT BEFORE CHANGING BACKEND\n");
+        return LGW_SPI_ERROR;
+    }
+    spi_backend = backend;
+    pthread_mutex_unlock(&spi_mutex);
+
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_set_link(const struct lgw_spi_link_s *link) {
+    if ((link != NULL) && (spi_link_valid(link) == false)) {
+        DEBUG_PRINTF("ERROR: NOT A VALID SPI LINK SETTING (%u Hz, %u bytes chunks)\n", link->speed_hz, link->burst_chunk);
+        return LGW_SPI_ERROR;
+    }
+
+    pthread_mutex_lock(&spi_mutex);
+    if (link != NULL) {
+        spi_link = *link;
+    }
+    spi_link_set = (link != NULL);
+    pthread_mutex_unlock(&spi_mutex);
+
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_get_link(struct lgw_spi_link_s *link) {
+    /* check input variables */
+    CHECK_NULL(link);
+
+    /* no lock: also called by the native backend open, under spi_mutex */
+    *link = spi_link;
+
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_link_load(const char *path, const char *spi_path, struct lgw_spi_link_s *link) {
+    struct spi_link_dev_s tab[LINK_DEV_NB_MAX];
+    const char *device = (spi_path != NULL) ? spi_path : "";
+    int nb, i;
+
+    /* check input variables */
+    CHECK_NULL(path);
+    CHECK_NULL(link);
+
+    nb = spi_link_read(path, tab);
+    for (i = 0; i < nb; ++i) {
+        if (strncmp(tab[i].device, device, LINK_DEV_SIZE) == 0) {
+            break;
+        }
+    }
+    if (i >= nb) {
+        return LGW_SPI_ERROR; /* no file, or not tuned for that device */
+    }
+
+    if (spi_link_valid(&tab[i].link) == false) {
+        DEBUG_PRINTF("ERROR: INVALID SPI LINK SETTINGS FOR %s IN %s\n", device, path);
+        return LGW_SPI_ERROR;
+    }
+    *link = tab[i].link;
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_link_save(const char *path, const char *spi_path, const struct lgw_spi_link_s *link) {
+    struct spi_link_dev_s tab[LINK_DEV_NB_MAX];
+    const char *device = (spi_path != NULL) ? spi_path : "";
+    FILE *f;
+    int nb, i, x;
+
+    /* check input variables */
+    CHECK_NULL(path);
+    CHECK_NULL(link);
+    if ((spi_link_valid(link) == false) || (strlen(device) >= LINK_DEV_SIZE) || (strpbrk(device, " \t\n") != NULL)) {
+        DEBUG_MSG("ERROR: NOT A VALID SPI LINK SETTING\n");
+        return LGW_SPI_ERROR;
+    }
+
+    /* keep the settings of the other devices */
+    nb = spi_link_read(path, tab);
+    if (nb < 0) {
+        nb = 0;
+    }
+    i = spi_link_find(tab, &nb, device);
+    if (i < 0) {
+        DEBUG_PRINTF("ERROR: NO ROOM LEFT FOR %s IN %s\n", device, path);
+        return LGW_SPI_ERROR;
+    }
+    tab[i].link = *link;
+
+    f = fopen(path, "w");
+    if (f == NULL) {
+        DEBUG_PRINTF("ERROR: FAILED TO CREATE %s\n", path);
+        return LGW_SPI_ERROR;
+    }
+    fprintf(f, "# SPI link settings, read by lgw_spi_open\n");
+    /* the backend default device has no device line, so it must come first */
+    for (i = 0; i < nb; ++i) {
+        if (tab[i].device[0] == '\0') {
+            fprintf(f, "speed_hz %u\n", tab[i].link.speed_hz);
+            fprintf(f, "burst_chunk %u\n", tab[i].link.burst_chunk);
+        }
+    }
+    for (i = 0; i < nb; ++i) {
+        if (tab[i].device[0] != '\0') {
+            fprintf(f, "device %s\n", tab[i].device);
+            fprintf(f, "speed_hz %u\n", tab[i].link.speed_hz);
+            fprintf(f, "burst_chunk %u\n", tab[i].link.burst_chunk);
+        }
+    }
+    x = (fclose(f) == 0) ? LGW_SPI_SUCCESS : LGW_SPI_ERROR;
+
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_trace_start(const char *path) {
+    int x;
+
+    /* check input variables */
+    CHECK_NULL(path);
+
+    pthread_mutex_lock(&spi_mutex);
+    x = spi_trace_open(path);
+    pthread_mutex_unlock(&spi_mutex);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_trace_stop(void) {
+    int x;
+
+    pthread_mutex_lock(&spi_mutex);
+    x = spi_trace_close();
+    pthread_mutex_unlock(&spi_mutex);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_open(const char *path, void **spi_target_ptr) {
+    struct lgw_spi_link_s link;
+    const char *env;
+    int x;
+
+    pthread_mutex_lock(&spi_mutex);
+    if (spi_link_set == false) {
+        /* read again at each open, a tuning run may have just updated the file */
+        env = getenv(LGW_SPI_LINK_ENV);
+        if (lgw_spi_link_load(((env != NULL) && (env[0] != '\0')) ? env : LGW_SPI_LINK_PATH, path, &link) == LGW_SPI_SUCCESS) {
+            spi_link = link;
+        } else {
+            spi_link.speed_hz = LGW_SPI_SPEED_DEFAULT;
+            spi_link.burst_chunk = LGW_BURST_CHUNK;
+        }
+    }
+    x = spi_backend_get()->open(path, spi_target_ptr);
+    if (x == LGW_SPI_SUCCESS) {
+        spi_open_nb += 1;
+        env = getenv(LGW_SPI_TRACE_ENV);
+        if ((trace_file == NULL) && (env != NULL) && (env[0] != '\0')) {
+            if (spi_trace_open(env) == LGW_SPI_SUCCESS) {
+                trace_from_env = true;
+            }
+        }
+    }
+    pthread_mutex_unlock(&spi_mutex);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_close(void *spi_target) {
+    int x;
+
+    pthread_mutex_lock(&spi_mutex);
+    x = spi_backend_get()->close(spi_target);
+    if ((x == LGW_SPI_SUCCESS) && (spi_open_nb > 0)) {
+        spi_open_nb -= 1;
+    }
+    if ((spi_open_nb == 0) && (trace_from_env == true)) {
+        spi_trace_close();
+    } else if (trace_file != NULL) {
+        fflush(trace_file);
+    }
+    pthread_mutex_unlock(&spi_mutex);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
+    uint64_t t0 = monotonic_us();
+    int x;
+
+    x = spi_backend_get()->w(spi_target, spi_mux_mode, spi_mux_target, address, data);
+    spi_stats_add(LGW_SPI_OP_W, 1, t0);
+    if ((trace_file != NULL) && (x == LGW_SPI_SUCCESS)) {
+        spi_trace(LGW_SPI_TRACE_OP_W, spi_mux_mode, spi_mux_target, address, &data, 1);
+    }
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
+    uint64_t t0 = monotonic_us();
+    int x;
+
+    x = spi_backend_get()->r(spi_target, spi_mux_mode, spi_mux_target, address, data);
+    spi_stats_add(LGW_SPI_OP_R, 1, t0);
+    if ((trace_file != NULL) && (x == LGW_SPI_SUCCESS)) {
+        spi_trace(LGW_SPI_TRACE_OP_R, spi_mux_mode, spi_mux_target, address, data, 1);
+    }
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    uint64_t t0 = monotonic_us();
+    int x;
+
+    x = spi_backend_get()->wb(spi_target, spi_mux_mode, spi_mux_target, address, data, size);
+    spi_stats_add(LGW_SPI_OP_WB, size, t0);
+    if ((trace_file != NULL) && (x == LGW_SPI_SUCCESS)) {
+        spi_trace(LGW_SPI_TRACE_OP_W, spi_mux_mode, spi_mux_target, address, data, size);
+    }
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    uint64_t t0 = monotonic_us();
+    int x;
+
+    x = spi_backend_get()->rb(spi_target, spi_mux_mode, spi_mux_target, address, data, size);
+    spi_stats_add(LGW_SPI_OP_RB, size, t0);
+    if ((trace_file != NULL) && (x == LGW_SPI_SUCCESS)) {
+        spi_trace(LGW_SPI_TRACE_OP_R, spi_mux_mode, spi_mux_target, address, data, size);
+    }
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_begin(void *spi_target) {
+    return spi_backend_get()->batch_begin(spi_target);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_end(void *spi_target) {
+    uint64_t t0 = monotonic_us();
+    int x;
+
+    x = spi_backend_get()->batch_end(spi_target);
+    spi_stats_add(LGW_SPI_OP_BATCH, 0, t0);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_batch_flush(void *spi_target) {
+    uint64_t t0 = monotonic_us();
+    int x;
+
+    x = spi_backend_get()->batch_flush(spi_target);
+    spi_stats_add(LGW_SPI_OP_BATCH, 0, t0);
+    return x;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_get_msg_cnt(void *spi_target, uint32_t *msg_cnt) {
+    return spi_backend_get()->get_msg_cnt(spi_target, msg_cnt);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_get_stats(struct lgw_spi_stats_s *stats, bool reset) {
+    struct lgw_spi_stats_s *spi_stats = &lgw_ctx_current()->spi_stats;
+
+    /* check input variables */
+    CHECK_NULL(stats);
+
+    *stats = *spi_stats;
+    if (reset == true) {
+        memset(spi_stats, 0, sizeof *spi_stats);
+    }
+    return LGW_SPI_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
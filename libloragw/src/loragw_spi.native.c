@@ -12,6 +12,11 @@ Description:
     Single-byte read/write and burst read/write.
     Does not handle pagination.
     Could be used with multiple SPI ports in parallel (explicit file descriptor)
+    Single-byte writes and small burst writes can be queued in a batch and sent
+    to the spidev driver as a single multi-transfer message.
+    Linux spidev backend of the lgw_spi_* functions (see loragw_spi.c).
+    Clock and burst chunk size come from the link settings (lgw_spi_set_link
+    or the settings file) when the device is opened.
 
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Sylvain Miermont
@@ -26,7 +31,8 @@ Maintainer: Sylvain Miermont
 #include <stdlib.h>        /* malloc free */
 #include <unistd.h>        /* lseek, close */
 #include <fcntl.h>        /* open */
-#include <string.h>        /* memset */
+#include <string.h>        /* memset memcpy */
+#include <stdbool.h>       /* bool type */
 //#include <wiringPi.h>
 
 
@@ -55,18 +61,120 @@ Maintainer: Sylvain Miermont
 
 #define READ_ACCESS     0x00
 #define WRITE_ACCESS    0x80
-#define SPI_SPEED       8000000
 #define SPI_DEV_PATH    "/dev/spidev0.0"
 //#define SPI_DEV_PATH    "/dev/spidev32766.0"
 
 #define GPIO_RESET_PIN	0
 
+#define SPI_BATCH_NB    64  /* max number of frames queued before an automatic flush */
+#define SPI_BATCH_FRAME 8   /* max size of a queued frame (mux header + command + 6 data bytes) */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct lgw_spi_dev_s {
+    int fd;                     /*!< file descriptor of the spidev device */
+    int batch_depth;            /*!< >0 when write batching is active (nested begin/end) */
+    int nb_frame;               /*!< number of frames stored in frame[] */
+    int nb_xfer;                /*!< number of transfers queued in xfer[] */
+    uint32_t msg_cnt;           /*!< number of SPI_IOC_MESSAGE ioctl issued */
+    uint32_t speed_hz;          /*!< SPI clock, from the link settings at open */
+    uint16_t burst_chunk;       /*!< largest burst sent in one message, from the link settings at open */
+    uint8_t frame[SPI_BATCH_NB][SPI_BATCH_FRAME];
+    struct spi_ioc_transfer xfer[SPI_BATCH_NB + 2]; /* queued frames + one read or burst chunk */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void spi_queue_xfer(struct lgw_spi_dev_s *dev, const uint8_t *tx, uint8_t *rx, uint32_t len, bool frame_end);
+static int spi_queue_frame(struct lgw_spi_dev_s *dev, const uint8_t *cmd, uint8_t cmd_size, const uint8_t *data, uint16_t size);
+static int spi_flush(struct lgw_spi_dev_s *dev);
+
+static int spi_native_open(const char *path, void **spi_target_ptr);
+static int spi_native_close(void *spi_target);
+static int spi_native_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data);
+static int spi_native_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data);
+static int spi_native_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
+static int spi_native_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
+static int spi_native_batch_begin(void *spi_target);
+static int spi_native_batch_end(void *spi_target);
+static int spi_native_batch_flush(void *spi_target);
+static int spi_native_get_msg_cnt(void *spi_target, uint32_t *msg_cnt);
+
 /* -------------------------------------------------------------------------- */
-/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* Append a transfer to the pending message, chip select is released after it if frame_end is set */
+static void spi_queue_xfer(struct lgw_spi_dev_s *dev, const uint8_t *tx, uint8_t *rx, uint32_t len, bool frame_end) {
+    struct spi_ioc_transfer *k = &dev->xfer[dev->nb_xfer];
+
+    memset(k, 0, sizeof(*k)); /* clear k */
+    k->tx_buf = (unsigned long) tx;
+    k->rx_buf = (unsigned long) rx;
+    k->len = len;
+    k->speed_hz = dev->speed_hz;
+    k->bits_per_word = 8;
+    k->cs_change = (frame_end == true) ? 1 : 0;
+    dev->nb_xfer += 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Copy a complete write frame in the batch memory, flush first if the batch is full */
+static int spi_queue_frame(struct lgw_spi_dev_s *dev, const uint8_t *cmd, uint8_t cmd_size, const uint8_t *data, uint16_t size) {
+    int spi_stat = LGW_SPI_SUCCESS;
+    uint8_t *f;
+
+    if (dev->nb_frame >= SPI_BATCH_NB) {
+        spi_stat = spi_flush(dev);
+    }
+    f = dev->frame[dev->nb_frame];
+    memcpy(f, cmd, cmd_size);
+    memcpy(f + cmd_size, data, size);
+    dev->nb_frame += 1;
+    spi_queue_xfer(dev, f, NULL, cmd_size + size, true);
+
+    return spi_stat;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Send all the pending transfers in a single SPI_IOC_MESSAGE ioctl */
+static int spi_flush(struct lgw_spi_dev_s *dev) {
+    int nb_xfer = dev->nb_xfer;
+    int len = 0;
+    int a;
+    int i;
+
+    if (nb_xfer == 0) {
+        return LGW_SPI_SUCCESS;
+    }
+    for (i = 0; i < nb_xfer; ++i) {
+        len += dev->xfer[i].len;
+    }
+    /* cs_change on the last transfer would keep the chip selected after the message */
+    dev->xfer[nb_xfer - 1].cs_change = 0;
+
+    a = ioctl(dev->fd, SPI_IOC_MESSAGE(nb_xfer), dev->xfer);
+    dev->msg_cnt += 1;
+    dev->nb_xfer = 0;
+    dev->nb_frame = 0;
+
+    if (a != len) {
+        DEBUG_PRINTF("ERROR: SPI MESSAGE FAILURE (%d transfers, %d/%d bytes)\n", nb_xfer, a, len);
+        return LGW_SPI_ERROR;
+    }
+    return LGW_SPI_SUCCESS;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BACKEND FUNCTIONS DEFINITION ----------------------------------------- */
 
 /* SPI initialization and configuration */
-int lgw_spi_open(void **spi_target_ptr) {
-    int *spi_device = NULL;
+static int spi_native_open(const char *path, void **spi_target_ptr) {
+    struct lgw_spi_dev_s *spi_device = NULL;
+    struct lgw_spi_link_s link;
     int dev;
     int a=0, b=0;
     int i;
@@ -75,7 +183,7 @@ int lgw_spi_open(void **spi_target_ptr) {
     CHECK_NULL(spi_target_ptr); /* cannot be null, must point on a void pointer (*spi_target_ptr can be null) */
 
     /* allocate memory for the device descriptor */
-    spi_device = malloc(sizeof(int));
+    spi_device = malloc(sizeof(struct lgw_spi_dev_s));
     if (spi_device == NULL) {
         DEBUG_MSG("ERROR: MALLOC FAIL\n");
         return LGW_SPI_ERROR;
@@ -88,9 +196,13 @@ int lgw_spi_open(void **spi_target_ptr) {
 	//digitalWrite(GPIO_RESET_PIN, LOW);	//added by Kabanov
 
     /* open SPI device */
-    dev = open(SPI_DEV_PATH, O_RDWR);
+    if (path == NULL) {
+        path = SPI_DEV_PATH;
+    }
+    dev = open(path, O_RDWR);
     if (dev < 0) {
-        DEBUG_PRINTF("ERROR: failed to open SPI device %s\n", SPI_DEV_PATH);
+        DEBUG_PRINTF("ERROR: failed to open SPI device %s\n", path);
+        free(spi_device);
         return LGW_SPI_ERROR;
     }
 
@@ -106,7 +218,8 @@ int lgw_spi_open(void **spi_target_ptr) {
     }
 
     /* setting SPI max clk (in Hz) */
-    i = SPI_SPEED;
+    lgw_spi_get_link(&link);
+    i = link.speed_hz;
     a = ioctl(dev, SPI_IOC_WR_MAX_SPEED_HZ, &i);
     b = ioctl(dev, SPI_IOC_RD_MAX_SPEED_HZ, &i);
     if ((a < 0) || (b < 0)) {
@@ -134,10 +247,14 @@ int lgw_spi_open(void **spi_target_ptr) {
     if ((a < 0) || (b < 0)) {
         DEBUG_MSG("ERROR: SPI PORT FAIL TO SET 8 BITS-PER-WORD\n");
         close(dev);
+        free(spi_device);
         return LGW_SPI_ERROR;
     }
 
-    *spi_device = dev;
+    memset(spi_device, 0, sizeof(struct lgw_spi_dev_s));
+    spi_device->fd = dev;
+    spi_device->speed_hz = link.speed_hz;
+    spi_device->burst_chunk = link.burst_chunk;
     *spi_target_ptr = (void *)spi_device;
     DEBUG_MSG("Note: SPI port opened and configured ok\n");
     return LGW_SPI_SUCCESS;
@@ -146,16 +263,17 @@ int lgw_spi_open(void **spi_target_ptr) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /* SPI release */
-int lgw_spi_close(void *spi_target) {
-    int spi_device;
+static int spi_native_close(void *spi_target) {
+    struct lgw_spi_dev_s *spi_device;
     int a;
 
     /* check input variables */
     CHECK_NULL(spi_target);
 
-    /* close file & deallocate file descriptor */
-    spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
-    a = close(spi_device);
+    /* send pending writes, close file & deallocate device descriptor */
+    spi_device = (struct lgw_spi_dev_s *)spi_target; /* must check that spi_target is not null beforehand */
+    spi_flush(spi_device);
+    a = close(spi_device->fd);
     free(spi_target);
 
     /* determine return code */
@@ -171,11 +289,10 @@ int lgw_spi_close(void *spi_target) {
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /* Simple write */
-int lgw_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
-    int spi_device;
+static int spi_native_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
+    struct lgw_spi_dev_s *spi_device;
     uint8_t out_buf[3];
     uint8_t command_size;
-    struct spi_ioc_transfer k;
     int a;
 
     /* check input variables */
@@ -184,7 +301,7 @@ int lgw_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, ui
         DEBUG_MSG("WARNING: SPI address > 127\n");
     }
 
-    spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
+    spi_device = (struct lgw_spi_dev_s *)spi_target; /* must check that spi_target is not null beforehand */
 
     /* prepare frame to be sent */
     if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
@@ -198,17 +315,14 @@ int lgw_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, ui
         command_size = 2;
     }
 
-    /* I/O transaction */
-    memset(&k, 0, sizeof(k)); /* clear k */
-    k.tx_buf = (unsigned long) out_buf;
-    k.len = command_size;
-    k.speed_hz = SPI_SPEED;
-    k.cs_change = 0;
-    k.bits_per_word = 8;
-    a = ioctl(spi_device, SPI_IOC_MESSAGE(1), &k);
+    /* I/O transaction, deferred if a batch is open */
+    a = spi_queue_frame(spi_device, out_buf, command_size, NULL, 0);
+    if ((a == LGW_SPI_SUCCESS) && (spi_device->batch_depth == 0)) {
+        a = spi_flush(spi_device);
+    }
 
     /* determine return code */
-    if (a != (int)k.len) {
+    if (a != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI WRITE FAILURE\n");
         return LGW_SPI_ERROR;
     } else {
@@ -220,12 +334,11 @@ int lgw_spi_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, ui
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /* Simple read */
-int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
-    int spi_device;
+static int spi_native_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
+    struct lgw_spi_dev_s *spi_device;
     uint8_t out_buf[3];
     uint8_t command_size;
     uint8_t in_buf[ARRAY_SIZE(out_buf)];
-    struct spi_ioc_transfer k;
     int a;
 
     /* check input variables */
@@ -235,7 +348,7 @@ int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, ui
     }
     CHECK_NULL(data);
 
-    spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
+    spi_device = (struct lgw_spi_dev_s *)spi_target; /* must check that spi_target is not null beforehand */
 
     /* prepare frame to be sent */
     if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
@@ -249,16 +362,12 @@ int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, ui
         command_size = 2;
     }
 
-    /* I/O transaction */
-    memset(&k, 0, sizeof(k)); /* clear k */
-    k.tx_buf = (unsigned long) out_buf;
-    k.rx_buf = (unsigned long) in_buf;
-    k.len = command_size;
-    k.cs_change = 0;
-    a = ioctl(spi_device, SPI_IOC_MESSAGE(1), &k);
+    /* I/O transaction, pending writes are sent in the same message */
+    spi_queue_xfer(spi_device, out_buf, in_buf, command_size, true);
+    a = spi_flush(spi_device);
 
     /* determine return code */
-    if (a != (int)k.len) {
+    if (a != LGW_SPI_SUCCESS) {
         DEBUG_MSG("ERROR: SPI READ FAILURE\n");
         return LGW_SPI_ERROR;
     } else {
@@ -271,11 +380,10 @@ int lgw_spi_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, ui
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /* Burst (multiple-byte) write */
-int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
-    int spi_device;
+static int spi_native_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    struct lgw_spi_dev_s *spi_device;
     uint8_t command[2];
     uint8_t command_size;
-    struct spi_ioc_transfer k[2];
     int size_to_do, chunk_size, offset;
     int byte_transfered = 0;
     int i;
@@ -291,7 +399,7 @@ int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
         return LGW_SPI_ERROR;
     }
 
-    spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
+    spi_device = (struct lgw_spi_dev_s *)spi_target; /* must check that spi_target is not null beforehand */
 
     /* prepare command byte */
     if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
@@ -302,20 +410,26 @@ int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
         command[0] = WRITE_ACCESS | (address & 0x7F);
         command_size = 1;
     }
+
+    /* small bursts (multi-byte registers) are queued like single writes */
+    if ((spi_device->batch_depth > 0) && ((command_size + size) <= SPI_BATCH_FRAME)) {
+        if (spi_queue_frame(spi_device, command, command_size, data, size) != LGW_SPI_SUCCESS) {
+            DEBUG_MSG("ERROR: SPI BURST WRITE FAILURE\n");
+            return LGW_SPI_ERROR;
+        }
+        return LGW_SPI_SUCCESS;
+    }
     size_to_do = size;
 
-    /* I/O transaction */
-    memset(&k, 0, sizeof(k)); /* clear k */
-    k[0].tx_buf = (unsigned long) &command[0];
-    k[0].len = command_size;
-    k[0].cs_change = 0;
-    k[1].cs_change = 0;
+    /* I/O transaction, pending writes are sent with the first chunk */
     for (i=0; size_to_do > 0; ++i) {
-        chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-        offset = i * LGW_BURST_CHUNK;
-        k[1].tx_buf = (unsigned long)(data + offset);
-        k[1].len = chunk_size;
-        byte_transfered += (ioctl(spi_device, SPI_IOC_MESSAGE(2), &k) - k[0].len );
+        chunk_size = (size_to_do < spi_device->burst_chunk) ? size_to_do : spi_device->burst_chunk;
+        offset = i * spi_device->burst_chunk;
+        spi_queue_xfer(spi_device, command, NULL, command_size, false);
+        spi_queue_xfer(spi_device, data + offset, NULL, chunk_size, true);
+        if (spi_flush(spi_device) == LGW_SPI_SUCCESS) {
+            byte_transfered += chunk_size;
+        }
         DEBUG_PRINTF("BURST WRITE: to trans %d # chunk %d # transferred %d \n", size_to_do, chunk_size, byte_transfered);
         size_to_do -= chunk_size; /* subtract the quantity of data already transferred */
     }
@@ -333,11 +447,10 @@ int lgw_spi_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
 /* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
 
 /* Burst (multiple-byte) read */
-int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
-    int spi_device;
+static int spi_native_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    struct lgw_spi_dev_s *spi_device;
     uint8_t command[2];
     uint8_t command_size;
-    struct spi_ioc_transfer k[2];
     int size_to_do, chunk_size, offset;
     int byte_transfered = 0;
     int i;
@@ -353,7 +466,7 @@ int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
         return LGW_SPI_ERROR;
     }
 
-    spi_device = *(int *)spi_target; /* must check that spi_target is not null beforehand */
+    spi_device = (struct lgw_spi_dev_s *)spi_target; /* must check that spi_target is not null beforehand */
 
     /* prepare command byte */
     if (spi_mux_mode == LGW_SPI_MUX_MODE1) {
@@ -366,18 +479,15 @@ int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
     }
     size_to_do = size;
 
-    /* I/O transaction */
-    memset(&k, 0, sizeof(k)); /* clear k */
-    k[0].tx_buf = (unsigned long) &command[0];
-    k[0].len = command_size;
-    k[0].cs_change = 0;
-    k[1].cs_change = 0;
+    /* I/O transaction, pending writes are sent with the first chunk */
     for (i=0; size_to_do > 0; ++i) {
-        chunk_size = (size_to_do < LGW_BURST_CHUNK) ? size_to_do : LGW_BURST_CHUNK;
-        offset = i * LGW_BURST_CHUNK;
-        k[1].rx_buf = (unsigned long)(data + offset);
-        k[1].len = chunk_size;
-        byte_transfered += (ioctl(spi_device, SPI_IOC_MESSAGE(2), &k) - k[0].len );
+        chunk_size = (size_to_do < spi_device->burst_chunk) ? size_to_do : spi_device->burst_chunk;
+        offset = i * spi_device->burst_chunk;
+        spi_queue_xfer(spi_device, command, NULL, command_size, false);
+        spi_queue_xfer(spi_device, NULL, data + offset, chunk_size, true);
+        if (spi_flush(spi_device) == LGW_SPI_SUCCESS) {
+            byte_transfered += chunk_size;
+        }
         DEBUG_PRINTF("BURST READ: to trans %d # chunk %d # transferred %d \n", size_to_do, chunk_size, byte_transfered);
         size_to_do -= chunk_size;  /* subtract the quantity of data already transferred */
     }
@@ -392,4 +502,79 @@ int lgw_spi_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, u
     }
 }
 
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Start queuing writes */
+static int spi_native_batch_begin(void *spi_target) {
+    struct lgw_spi_dev_s *spi_device;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+
+    spi_device = (struct lgw_spi_dev_s *)spi_target;
+    spi_device->batch_depth += 1;
+
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Stop queuing writes, send the queue when leaving the outermost batch */
+static int spi_native_batch_end(void *spi_target) {
+    struct lgw_spi_dev_s *spi_device;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+
+    spi_device = (struct lgw_spi_dev_s *)spi_target;
+    if (spi_device->batch_depth > 0) {
+        spi_device->batch_depth -= 1;
+    }
+    if (spi_device->batch_depth == 0) {
+        return spi_flush(spi_device);
+    }
+
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Send queued writes now */
+static int spi_native_batch_flush(void *spi_target) {
+    /* check input variables */
+    CHECK_NULL(spi_target);
+
+    return spi_flush((struct lgw_spi_dev_s *)spi_target);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* Number of SPI messages (ioctl) sent since the SPI link was opened */
+static int spi_native_get_msg_cnt(void *spi_target, uint32_t *msg_cnt) {
+    /* check input variables */
+    CHECK_NULL(spi_target);
+    CHECK_NULL(msg_cnt);
+
+    *msg_cnt = ((struct lgw_spi_dev_s *)spi_target)->msg_cnt;
+
+    return LGW_SPI_SUCCESS;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC VARIABLES ----------------------------------------------------- */
+
+const struct lgw_spi_backend_s lgw_spi_native = {
+    "native",
+    spi_native_open,
+    spi_native_close,
+    spi_native_w,
+    spi_native_r,
+    spi_native_wb,
+    spi_native_rb,
+    spi_native_batch_begin,
+    spi_native_batch_end,
+    spi_native_batch_flush,
+    spi_native_get_msg_cnt
+};
+
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,367 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Replay backend of the lgw_spi_* functions: serves the reads of a trace
+    recorded with lgw_spi_trace_start (see loragw_spi.h for the format), so
+    that a capture of real traffic can be run through the HAL offline.
+    The trace is mapped in memory and played in order. When the HAL issues a
+    transfer the trace does not hold next (timing dependent polling), the
+    following records are searched to resynchronize.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>        /* C99 types */
+#include <stdio.h>        /* printf fprintf */
+#include <stdlib.h>        /* getenv */
+#include <string.h>        /* memset memcmp strncpy */
+#include <stdbool.h>       /* bool type */
+#include <unistd.h>        /* close */
+#include <fcntl.h>        /* open */
+#include <time.h>          /* nanosleep */
+#include <sys/mman.h>      /* mmap munmap */
+#include <sys/stat.h>      /* fstat */
+
+#include "loragw_spi.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_SPI == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_SPI_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                if(a==NULL){return LGW_SPI_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define REPLAY_RESYNC_NB    256 /* records searched ahead for a transfer not found next in the trace */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct replay_rec_s {
+    uint8_t         op;
+    uint8_t         mux_target;
+    uint8_t         address;
+    uint16_t        size;
+    uint32_t        dt_us;
+    const uint8_t   *data;
+    size_t          next;       /* offset of the following record */
+};
+
+struct replay_dev_s {
+    bool            is_open;
+    const uint8_t   *map;       /* trace file mapped in memory */
+    size_t          len;
+    size_t          pos;        /* offset of the next record to play */
+    uint64_t        t0_us;      /* host time of the first record, paced mode */
+    uint64_t        trace_us;   /* trace time of the last record played */
+    uint32_t        msg_cnt;
+    struct lgw_spi_replay_stats_s stats;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct replay_dev_s replay;
+static struct lgw_spi_replay_conf_s replay_conf = { "", false };
+static bool replay_conf_set = false; /* else the trace is named by LGW_SPI_REPLAY_ENV */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static bool replay_parse(size_t pos, struct replay_rec_s *rec);
+static const struct replay_rec_s *replay_next(uint8_t op, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint16_t size, struct replay_rec_s *rec);
+static void replay_pace(void);
+
+static int spi_replay_open(const char *spi_path, void **spi_target_ptr);
+static int spi_replay_close(void *spi_target);
+static int spi_replay_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data);
+static int spi_replay_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data);
+static int spi_replay_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
+static int spi_replay_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
+static int spi_replay_batch(void *spi_target);
+static int spi_replay_get_msg_cnt(void *spi_target, uint32_t *msg_cnt);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static bool replay_parse(size_t pos, struct replay_rec_s *rec) {
+    const uint8_t *p = replay.map + pos;
+
+    if ((pos + LGW_SPI_TRACE_REC_SIZE) > replay.len) {
+        return false;
+    }
+    rec->op = p[0];
+    rec->mux_target = p[1];
+    rec->address = p[2];
+    rec->size = (uint16_t)(p[3] | (p[4] << 8));
+    rec->dt_us = (uint32_t)p[5] | ((uint32_t)p[6] << 8) | ((uint32_t)p[7] << 16) | ((uint32_t)p[8] << 24);
+    rec->data = p + LGW_SPI_TRACE_REC_SIZE;
+    rec->next = pos + LGW_SPI_TRACE_REC_SIZE + rec->size;
+    return (rec->next <= replay.len);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* find the record of a transfer, at the current position or a little further */
+static const struct replay_rec_s *replay_next(uint8_t op, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint16_t size, struct replay_rec_s *rec) {
+    uint8_t rec_op = op | ((spi_mux_mode == LGW_SPI_MUX_MODE1) ? LGW_SPI_TRACE_OP_MUX1 : 0);
+    size_t pos = replay.pos;
+    uint64_t trace_us = replay.trace_us;
+    int i;
+
+    replay.msg_cnt += 1;
+    for (i = 0; (i < REPLAY_RESYNC_NB) && (replay_parse(pos, rec) == true); ++i) {
+        trace_us += rec->dt_us;
+        if ((rec->op == rec_op) && (rec->mux_target == spi_mux_target) && (rec->address == address) && (rec->size == size)) {
+            replay.stats.nb_skip += i;
+            replay.stats.nb_rec += 1;
+            replay.pos = rec->next;
+            replay.trace_us = trace_us;
+            replay_pace();
+            return rec;
+        }
+        pos = rec->next;
+    }
+    if (replay_parse(replay.pos, rec) == false) {
+        replay.stats.end = true;
+    }
+    replay.stats.nb_mismatch += 1;
+    DEBUG_PRINTF("WARNING: SPI TRANSFER 0x%02X@0x%02X NOT FOUND IN TRACE\n", rec_op, address);
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* paced mode, wait until the host time matches the trace time */
+static void replay_pace(void) {
+    struct timespec dly;
+    uint64_t now;
+
+    if (replay_conf.paced == false) {
+        return;
+    }
+    now = monotonic_us();
+    if ((now - replay.t0_us) < replay.trace_us) {
+        dly.tv_sec = (replay.trace_us - (now - replay.t0_us)) / 1000000;
+        dly.tv_nsec = ((replay.trace_us - (now - replay.t0_us)) % 1000000) * 1000;
+        nanosleep(&dly, NULL);
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BACKEND FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int spi_replay_open(const char *spi_path, void **spi_target_ptr) {
+    const char *path;
+    struct stat st;
+    void *map;
+    int fd;
+
+    /* check input variables */
+    CHECK_NULL(spi_target_ptr);
+    (void)spi_path; /* the trace stands for the device, a single one */
+
+    if (replay.is_open == true) {
+        DEBUG_MSG("ERROR: SPI REPLAY ALREADY OPEN\n");
+        return LGW_SPI_ERROR;
+    }
+
+    path = (replay_conf_set == true) ? replay_conf.path : getenv(LGW_SPI_REPLAY_ENV);
+    if ((path == NULL) || (path[0] == '\0')) {
+        DEBUG_MSG("ERROR: NO SPI TRACE TO REPLAY\n");
+        return LGW_SPI_ERROR;
+    }
+
+    /* map the whole trace, the kernel pages it in as it is played */
+    fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        DEBUG_PRINTF("ERROR: FAILED TO OPEN SPI TRACE %s\n", path);
+        return LGW_SPI_ERROR;
+    }
+    if ((fstat(fd, &st) != 0) || (st.st_size < LGW_SPI_TRACE_HDR_SIZE)) {
+        DEBUG_MSG("ERROR: SPI TRACE TOO SHORT\n");
+        close(fd);
+        return LGW_SPI_ERROR;
+    }
+    map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        DEBUG_MSG("ERROR: FAILED TO MAP SPI TRACE\n");
+        return LGW_SPI_ERROR;
+    }
+    if ((memcmp(map, LGW_SPI_TRACE_MAGIC, 4) != 0) || (((const uint8_t *)map)[4] != LGW_SPI_TRACE_VERSION)) {
+        DEBUG_MSG("ERROR: NOT A VALID SPI TRACE\n");
+        munmap(map, (size_t)st.st_size);
+        return LGW_SPI_ERROR;
+    }
+
+    memset(&replay, 0, sizeof replay);
+    replay.map = (const uint8_t *)map;
+    replay.len = (size_t)st.st_size;
+    replay.pos = LGW_SPI_TRACE_HDR_SIZE;
+    replay.t0_us = monotonic_us();
+    replay.is_open = true;
+
+    *spi_target_ptr = (void *)&replay;
+    DEBUG_PRINTF("Note: SPI replay of %s open\n", path);
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_replay_close(void *spi_target) {
+    /* check input variables */
+    CHECK_NULL(spi_target);
+
+    if (replay.is_open == true) {
+        munmap((void *)replay.map, replay.len);
+        replay.map = NULL;
+        replay.is_open = false;
+    }
+    DEBUG_MSG("Note: SPI replay closed\n");
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_replay_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
+    return spi_replay_wb(spi_target, spi_mux_mode, spi_mux_target, address, &data, 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_replay_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
+    return spi_replay_rb(spi_target, spi_mux_mode, spi_mux_target, address, data, 1);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_replay_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    struct replay_rec_s rec;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+    CHECK_NULL(data);
+
+    /* a write not found in the trace is not an error, the HAL just went another way */
+    if (replay_next(LGW_SPI_TRACE_OP_W, spi_mux_mode, spi_mux_target, address, size, &rec) != NULL) {
+        if (memcmp(rec.data, data, size) != 0) {
+            replay.stats.nb_mismatch += 1;
+        }
+    }
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_replay_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    struct replay_rec_s rec;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+    CHECK_NULL(data);
+
+    if (replay_next(LGW_SPI_TRACE_OP_R, spi_mux_mode, spi_mux_target, address, size, &rec) != NULL) {
+        memcpy(data, rec.data, size);
+        return LGW_SPI_SUCCESS;
+    }
+    memset(data, 0, size);
+    if (replay.stats.end == true) {
+        return LGW_SPI_ERROR; /* nothing left to play, let the application stop */
+    }
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* transfers are played one by one, batching makes no difference */
+static int spi_replay_batch(void *spi_target) {
+    /* check input variables */
+    CHECK_NULL(spi_target);
+
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_replay_get_msg_cnt(void *spi_target, uint32_t *msg_cnt) {
+    /* check input variables */
+    CHECK_NULL(spi_target);
+    CHECK_NULL(msg_cnt);
+
+    *msg_cnt = replay.msg_cnt;
+    return LGW_SPI_SUCCESS;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC VARIABLES ----------------------------------------------------- */
+
+const struct lgw_spi_backend_s lgw_spi_replay = {
+    "replay",
+    spi_replay_open,
+    spi_replay_close,
+    spi_replay_w,
+    spi_replay_r,
+    spi_replay_wb,
+    spi_replay_rb,
+    spi_replay_batch,
+    spi_replay_batch,
+    spi_replay_batch,
+    spi_replay_get_msg_cnt
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_spi_replay_setconf(const struct lgw_spi_replay_conf_s *conf) {
+    /* check input variables */
+    CHECK_NULL(conf);
+
+    if (replay.is_open == true) {
+        DEBUG_MSG("ERROR: SPI REPLAY OPEN, CLOSE IT BEFORE CHANGING ITS CONFIGURATION\n");
+        return LGW_SPI_ERROR;
+    }
+    replay_conf = *conf;
+    replay_conf.path[sizeof replay_conf.path - 1] = '\0';
+    replay_conf_set = true;
+
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_replay_get_stats(struct lgw_spi_replay_stats_s *stats) {
+    /* check input variables */
+    CHECK_NULL(stats);
+
+    *stats = replay.stats;
+    return LGW_SPI_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,908 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    In-memory SX1301 simulator backend of the lgw_spi_* functions, so that
+    the HAL can be run and benchmarked without a concentrator board.
+    Emulates the paged register file and soft reset, the MCU program RAM
+    read-back, the AGC/arbiter firmware start-up and calibration handshakes,
+    the SX125x radios SPI master, the counter, the TX status and triggers,
+    and the RX packet FIFO fed by a synthetic packet generator.
+    Each open gives a new simulated concentrator, so that several contexts
+    can run side by side; a concentrator is only accessed under the lock of
+    its context. The traffic configuration is shared by all of them.
+    No FPGA and no SX127x: other SPI mux targets read as 0.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+#include <stdint.h>        /* C99 types */
+#include <stdio.h>        /* printf fprintf */
+#include <string.h>        /* memset memcpy */
+#include <stdbool.h>       /* bool type */
+#include <pthread.h>        /* pthread_once */
+
+#include "loragw_spi.h"
+#include "loragw_reg.h"
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#if DEBUG_SPI == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_SPI_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                if(a==NULL){return LGW_SPI_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define SIM_DEV_NB          4 /* concentrators simulated at the same time */
+#define SIM_PAGE_NB         4
+#define SIM_ADDR_NB         128
+#define SIM_SOFT_RESET      0x80 /* PAGE_REG bit triggering a soft reset */
+#define SIM_BATCH_FRAME     6 /* largest burst write queued in a batch, as the native backend */
+
+#define SIM_PROM_SIZE       8192
+#define SIM_DATABUFF_SIZE   1024 /* RX data buffer, only used to make up packet addresses */
+
+#define SIM_FW_VERSION_ADDR 0x20
+#define SIM_FW_VERSION_CAL  2
+#define SIM_FW_VERSION_AGC  4
+#define SIM_FW_VERSION_ARB  1
+#define SIM_AGC_CMD_WAIT    16
+#define SIM_AGC_CMD_ABORT   17
+#define SIM_AGC_LUT_SIZE    16
+
+#define SIM_RADIO_VERSION   0x21 /* SX1257 */
+#define SIM_RADIO_PLL_LOCK  0x03 /* status register 0x11: TX and RX PLL locked */
+
+#define SIM_TX_FREE         0x80 /* TX_STATUS values, see lgw_status */
+#define SIM_TX_SCHEDULED    0x90
+#define SIM_TX_EMITTING     0xB0
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+/* register bytes with a behaviour, other bytes are plain memory */
+enum sim_role_e {
+    SIM_PLAIN = 0,
+    SIM_PAGE,
+    SIM_RX_BUF_ADDR,
+    SIM_RX_BUF_DATA,
+    SIM_TX_BUF_ADDR,
+    SIM_TX_BUF_DATA,
+    SIM_PROM_ADDR,
+    SIM_PROM_DATA,
+    SIM_FIFO_NUM,
+    SIM_FIFO_INFO,
+    SIM_AGC_STATUS,
+    SIM_RADIO_SELECT,
+    SIM_MCU_RST,
+    SIM_TX_TRIG,
+    SIM_TX_STATUS,
+    SIM_RADIO_A_CS,
+    SIM_RADIO_B_CS,
+    SIM_ARB_RAM,
+    SIM_AGC_RAM,
+    SIM_TIMESTAMP
+};
+
+enum sim_agc_e {
+    SIM_AGC_OFF = 0,
+    SIM_AGC_CAL,    /* calibration firmware, results ready at once */
+    SIM_AGC_LUT,    /* AGC firmware waiting for the TX gain LUT */
+    SIM_AGC_FREQ,   /* ... for the TX frequency MSBs */
+    SIM_AGC_CHAN,   /* ... for the chan_select option */
+    SIM_AGC_END,    /* ... for RADIO_SELECT */
+    SIM_AGC_RUN
+};
+
+enum sim_tx_e {
+    SIM_TX_IDLE = 0,
+    SIM_TX_WAIT,    /* TIMESTAMPED or ON_GPS packet waiting for its trigger */
+    SIM_TX_ON
+};
+
+struct sim_rx_pkt_s {
+    uint8_t     data[255+16];   /* payload then metadata */
+    uint8_t     size;
+    uint8_t     status;
+    uint16_t    addr;           /* position in the RX data buffer */
+};
+
+struct sim_dev_s {
+    bool        is_open;
+    int         batch_depth;
+    bool        pending;                /* writes queued in the current batch */
+    uint32_t    msg_cnt;
+    uint64_t    t0_us;                  /* counter origin */
+    uint8_t     page;
+    uint8_t     mem[SIM_PAGE_NB][SIM_ADDR_NB];
+    uint8_t     prom[SIM_PROM_SIZE];
+    uint16_t    prom_ptr;
+    uint8_t     tx_buf[256+16];
+    uint8_t     tx_ptr;
+    enum sim_tx_e tx_state;
+    uint32_t    tx_start;               /* counter value when the TX starts */
+    bool        tx_on_gps;
+    uint32_t    tx_trig_seq;            /* order of the last TX trigger among all concentrators, 0 if none */
+    enum sim_agc_e agc_state;
+    bool        agc_armed;
+    uint8_t     agc_lut_idx;
+    uint8_t     agc_status;
+    uint8_t     agc_version;
+    bool        arb_running;
+    uint8_t     radio[LGW_RF_CHAIN_NB][SIM_ADDR_NB];
+    uint32_t    cnt_latch;              /* TIMESTAMP value while its 4 bytes are read */
+    struct sim_rx_pkt_s fifo[LGW_PKT_FIFO_SIZE];
+    int         fifo_head;
+    int         fifo_nb;
+    uint16_t    fifo_ptr;               /* read position in the packet at the FIFO head */
+    uint16_t    buf_addr;               /* next packet position in the RX data buffer */
+    uint64_t    gen_t0_us;              /* RX generator origin */
+    uint64_t    gen_done;               /* packets generated or lost since gen_t0_us */
+    uint32_t    seq;
+    struct lgw_spi_sim_stats_s stats;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- INTERNAL SHARED VARIABLES -------------------------------------------- */
+
+extern const struct lgw_reg_s loregs[LGW_TOTALREGS]; /*! register map, gives the simulated register layout and reset values */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct sim_dev_s sim_dev[SIM_DEV_NB]; /* one per concentrator context, opens are serialized by loragw_spi.c */
+static bool sim_common[SIM_ADDR_NB]; /* addresses shared by all pages */
+static uint8_t sim_role[SIM_PAGE_NB][SIM_ADDR_NB];
+static pthread_once_t sim_map_once = PTHREAD_ONCE_INIT;
+static struct lgw_spi_sim_conf_s sim_conf = { 0, 0, 7, 16, 0, 0 };
+static uint32_t sim_tx_seq; /* TX triggers on all concentrators, to report the last one */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void sim_role_set(int reg_id, enum sim_role_e role);
+static void sim_map_setup(void);
+static void sim_reset(struct sim_dev_s *sim);
+static uint8_t *sim_byte(struct sim_dev_s *sim, uint8_t addr);
+static uint32_t sim_cnt(struct sim_dev_s *sim);
+static void sim_rx_push(struct sim_dev_s *sim);
+static void sim_rx_update(struct sim_dev_s *sim);
+static void sim_agc_release(struct sim_dev_s *sim);
+static void sim_agc_cmd(struct sim_dev_s *sim, uint8_t cmd);
+static void sim_radio_xfer(struct sim_dev_s *sim, int rf_chain, int reg_addr, int reg_data, int reg_rb);
+static void sim_tx_update(struct sim_dev_s *sim);
+static void sim_write(struct sim_dev_s *sim, uint8_t addr, uint8_t data);
+static uint8_t sim_read(struct sim_dev_s *sim, uint8_t addr, bool single);
+static bool sim_port(struct sim_dev_s *sim, uint8_t addr);
+static void sim_msg(struct sim_dev_s *sim, bool is_write, uint16_t size);
+
+static int spi_sim_open(const char *spi_path, void **spi_target_ptr);
+static int spi_sim_close(void *spi_target);
+static int spi_sim_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data);
+static int spi_sim_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data);
+static int spi_sim_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
+static int spi_sim_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size);
+static int spi_sim_batch_begin(void *spi_target);
+static int spi_sim_batch_end(void *spi_target);
+static int spi_sim_batch_flush(void *spi_target);
+static int spi_sim_get_msg_cnt(void *spi_target, uint32_t *msg_cnt);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void sim_role_set(int reg_id, enum sim_role_e role) {
+    const struct lgw_reg_s *r = &loregs[reg_id];
+    int p, i;
+
+    for (p = 0; p < SIM_PAGE_NB; ++p) {
+        if ((r->page == -1) || (r->page == p)) {
+            for (i = 0; i < (r->offs + r->leng + 7) / 8; ++i) {
+                sim_role[p][r->addr + i] = (uint8_t)role;
+            }
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sim_map_setup(void) {
+    int i;
+
+    memset(sim_common, 0, sizeof sim_common);
+    for (i = 0; i < LGW_TOTALREGS; ++i) {
+        if (loregs[i].page == -1) {
+            sim_common[loregs[i].addr] = true;
+        }
+    }
+
+    memset(sim_role, SIM_PLAIN, sizeof sim_role);
+    sim_role_set(LGW_PAGE_REG, SIM_PAGE);
+    sim_role_set(LGW_RX_DATA_BUF_ADDR, SIM_RX_BUF_ADDR);
+    sim_role_set(LGW_RX_DATA_BUF_DATA, SIM_RX_BUF_DATA);
+    sim_role_set(LGW_TX_DATA_BUF_ADDR, SIM_TX_BUF_ADDR);
+    sim_role_set(LGW_TX_DATA_BUF_DATA, SIM_TX_BUF_DATA);
+    sim_role_set(LGW_MCU_PROM_ADDR, SIM_PROM_ADDR);
+    sim_role_set(LGW_MCU_PROM_DATA, SIM_PROM_DATA);
+    sim_role_set(LGW_RX_PACKET_DATA_FIFO_NUM_STORED, SIM_FIFO_NUM);
+    sim_role_set(LGW_RX_PACKET_DATA_FIFO_ADDR_POINTER, SIM_FIFO_INFO);
+    sim_role_set(LGW_RX_PACKET_DATA_FIFO_STATUS, SIM_FIFO_INFO);
+    sim_role_set(LGW_RX_PACKET_DATA_FIFO_PAYLOAD_SIZE, SIM_FIFO_INFO);
+    sim_role_set(LGW_MCU_AGC_STATUS, SIM_AGC_STATUS);
+    sim_role_set(LGW_RADIO_SELECT, SIM_RADIO_SELECT);
+    sim_role_set(LGW_MCU_RST_0, SIM_MCU_RST);
+    sim_role_set(LGW_TX_TRIG_ALL, SIM_TX_TRIG);
+    sim_role_set(LGW_TX_STATUS, SIM_TX_STATUS);
+    sim_role_set(LGW_SPI_RADIO_A__CS, SIM_RADIO_A_CS);
+    sim_role_set(LGW_SPI_RADIO_B__CS, SIM_RADIO_B_CS);
+    sim_role_set(LGW_DBG_ARB_MCU_RAM_DATA, SIM_ARB_RAM);
+    sim_role_set(LGW_DBG_AGC_MCU_RAM_DATA, SIM_AGC_RAM);
+    sim_role_set(LGW_TIMESTAMP, SIM_TIMESTAMP);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* registers back to their default values, MCUs in reset, FIFO and TX cleared */
+static void sim_reset(struct sim_dev_s *sim) {
+    const struct lgw_reg_s *r;
+    uint8_t mask;
+    int i, p, b;
+
+    memset(sim->mem, 0, sizeof sim->mem);
+    for (i = 0; i < LGW_TOTALREGS; ++i) {
+        r = &loregs[i];
+        for (p = 0; p < SIM_PAGE_NB; ++p) {
+            if ((r->page != -1) && (r->page != p)) {
+                continue;
+            }
+            if ((r->offs + r->leng) <= 8) {
+                mask = (uint8_t)(((1 << r->leng) - 1) << r->offs);
+                sim->mem[p][r->addr] = (sim->mem[p][r->addr] & ~mask) | (((uint8_t)r->dflt << r->offs) & mask);
+            } else {
+                for (b = 0; b < (r->leng + 7) / 8; ++b) {
+                    sim->mem[p][r->addr + b] = (uint8_t)((uint32_t)r->dflt >> (8 * b));
+                }
+            }
+        }
+    }
+    sim->page = 0;
+    sim->prom_ptr = 0;
+    sim->tx_ptr = 0;
+    sim->tx_state = SIM_TX_IDLE;
+    sim->agc_state = SIM_AGC_OFF;
+    sim->agc_armed = false;
+    sim->agc_status = 0;
+    sim->agc_version = 0;
+    sim->arb_running = false;
+    sim->fifo_head = 0;
+    sim->fifo_nb = 0;
+    sim->fifo_ptr = 0;
+    sim->gen_t0_us = monotonic_us();
+    sim->gen_done = 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t *sim_byte(struct sim_dev_s *sim, uint8_t addr) {
+    return &sim->mem[sim_common[addr] ? 0 : sim->page][addr];
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* concentrator 1 MHz counter */
+static uint32_t sim_cnt(struct sim_dev_s *sim) {
+    return (uint32_t)(monotonic_us() - sim->t0_us);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sim_rx_push(struct sim_dev_s *sim) {
+    struct sim_rx_pkt_s *p;
+    uint32_t cnt;
+    int i;
+
+    if (sim->fifo_nb >= LGW_PKT_FIFO_SIZE) {
+        sim->stats.nb_rx_lost += 1;
+        return;
+    }
+    p = &sim->fifo[(sim->fifo_head + sim->fifo_nb) % LGW_PKT_FIFO_SIZE];
+    sim->fifo_nb += 1;
+
+    /* payload: sequence number then a counting pattern */
+    p->size = sim_conf.rx_size;
+    for (i = 0; i < p->size; ++i) {
+        p->data[i] = (i < 4) ? (uint8_t)(sim->seq >> (8 * i)) : (uint8_t)(sim->seq + i);
+    }
+
+    /* metadata, see rx_decode */
+    cnt = sim_cnt(sim);
+    memset(&p->data[p->size], 0, 16);
+    p->data[p->size + 0] = sim_conf.rx_if_chain;
+    p->data[p->size + 1] = (uint8_t)((sim_conf.rx_sf << 4) | (1 << 1)); /* CR 4/5 */
+    p->data[p->size + 2] = 40; /* SNR 10 dB, in 1/4 dB */
+    p->data[p->size + 3] = 20;
+    p->data[p->size + 4] = 60;
+    p->data[p->size + 5] = 100; /* raw RSSI */
+    p->data[p->size + 6] = (uint8_t)cnt;
+    p->data[p->size + 7] = (uint8_t)(cnt >> 8);
+    p->data[p->size + 8] = (uint8_t)(cnt >> 16);
+    p->data[p->size + 9] = (uint8_t)(cnt >> 24);
+    p->data[p->size + 10] = (uint8_t)sim->seq; /* CRC */
+    p->data[p->size + 11] = (uint8_t)(sim->seq >> 8);
+    p->status = ((((sim->seq * 2654435761U) >> 16) % 100) < sim_conf.rx_crc_bad_pct) ? 0x07 : 0x05; /* CRC bad or OK */
+    p->addr = sim->buf_addr;
+    sim->buf_addr = (sim->buf_addr + p->size + 16) % SIM_DATABUFF_SIZE;
+
+    sim->seq += 1;
+    sim->stats.nb_rx_gen += 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* generate the packets received since the last update */
+static void sim_rx_update(struct sim_dev_s *sim) {
+    uint64_t due;
+
+    if ((sim_conf.rx_pkt_rate == 0) || (sim->agc_state != SIM_AGC_RUN)) {
+        sim->gen_t0_us = monotonic_us();
+        sim->gen_done = 0;
+        return;
+    }
+    if (sim_conf.rx_pkt_rate == LGW_SPI_SIM_RX_FLOOD) {
+        while (sim->fifo_nb < LGW_PKT_FIFO_SIZE) {
+            sim_rx_push(sim);
+        }
+        return;
+    }
+    due = (monotonic_us() - sim->gen_t0_us) * sim_conf.rx_pkt_rate / 1000000;
+    while (sim->gen_done < due) {
+        sim_rx_push(sim);
+        sim->gen_done += 1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* AGC MCU leaves reset, RADIO_SELECT tells the calibration firmware from the AGC one */
+static void sim_agc_release(struct sim_dev_s *sim) {
+    uint8_t cal_cmd = sim->mem[0][loregs[LGW_RADIO_SELECT].addr];
+
+    sim->agc_armed = false;
+    if (cal_cmd != 0) {
+        sim->agc_state = SIM_AGC_CAL;
+        sim->agc_version = SIM_FW_VERSION_CAL;
+        sim->agc_status = 0x81; /* finished, SX1301 access */
+        sim->agc_status |= (cal_cmd & 0x01) ? 0x0A : 0x00;
+        sim->agc_status |= (cal_cmd & 0x02) ? 0x14 : 0x00;
+        sim->agc_status |= (cal_cmd & 0x04) ? 0x20 : 0x00;
+        sim->agc_status |= (cal_cmd & 0x08) ? 0x40 : 0x00;
+    } else {
+        sim->agc_state = SIM_AGC_LUT;
+        sim->agc_version = SIM_FW_VERSION_AGC;
+        sim->agc_status = 0x10;
+        sim->agc_lut_idx = 0;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* AGC firmware initialization transactions, see lgw_start */
+static void sim_agc_cmd(struct sim_dev_s *sim, uint8_t cmd) {
+    if ((sim->agc_state < SIM_AGC_LUT) || (sim->agc_state == SIM_AGC_RUN)) {
+        return;
+    }
+    if (cmd == SIM_AGC_CMD_WAIT) {
+        sim->agc_armed = true;
+        return;
+    }
+    if (sim->agc_armed == false) {
+        return;
+    }
+    sim->agc_armed = false;
+    switch (sim->agc_state) {
+        case SIM_AGC_LUT:
+            if (cmd == SIM_AGC_CMD_ABORT) {
+                sim->agc_status = 0x30;
+                sim->agc_state = SIM_AGC_FREQ;
+            } else {
+                sim->agc_status = 0x30 + sim->agc_lut_idx;
+                sim->agc_lut_idx += 1;
+                if (sim->agc_lut_idx >= SIM_AGC_LUT_SIZE) {
+                    sim->agc_state = SIM_AGC_FREQ;
+                }
+            }
+            break;
+        case SIM_AGC_FREQ:
+            sim->agc_status = 0x30 + (cmd & 0x0F);
+            sim->agc_state = SIM_AGC_CHAN;
+            break;
+        case SIM_AGC_CHAN:
+            sim->agc_status = 0x30 + (cmd & 0x0F);
+            sim->agc_state = SIM_AGC_END;
+            break;
+        default:
+            sim->agc_status = 0x40;
+            sim->agc_state = SIM_AGC_RUN;
+            break;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* SX125x SPI master transfer, started by chip select */
+static void sim_radio_xfer(struct sim_dev_s *sim, int rf_chain, int reg_addr, int reg_data, int reg_rb) {
+    uint8_t a = sim->mem[2][loregs[reg_addr].addr];
+    uint8_t d = sim->mem[2][loregs[reg_data].addr];
+
+    if ((a & 0x80) != 0) {
+        sim->radio[rf_chain][a & 0x7F] = d;
+    } else {
+        sim->mem[2][loregs[reg_rb].addr] = sim->radio[rf_chain][a & 0x7F];
+    }
+    sim->radio[rf_chain][0x07] = SIM_RADIO_VERSION;
+    sim->radio[rf_chain][0x11] = SIM_RADIO_PLL_LOCK;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sim_tx_update(struct sim_dev_s *sim) {
+    uint32_t cnt = sim_cnt(sim);
+
+    if ((sim->tx_state == SIM_TX_WAIT) && (sim->tx_on_gps == false) && ((int32_t)(cnt - sim->tx_start) >= 0)) {
+        sim->tx_state = SIM_TX_ON;
+    }
+    if ((sim->tx_state == SIM_TX_ON) && ((uint32_t)(cnt - sim->tx_start) >= sim_conf.tx_time_us)) {
+        sim->tx_state = SIM_TX_IDLE;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sim_write(struct sim_dev_s *sim, uint8_t addr, uint8_t data) {
+    uint8_t *b = sim_byte(sim, addr);
+    uint8_t old = *b;
+
+    switch (sim_role[sim->page][addr]) {
+        case SIM_PAGE:
+            if ((data & SIM_SOFT_RESET) != 0) {
+                sim_reset(sim);
+            } else {
+                sim->page = data & (SIM_PAGE_NB - 1);
+                *b = sim->page;
+            }
+            return;
+        case SIM_RX_BUF_ADDR:
+            *b = data;
+            if (sim->fifo_nb > 0) {
+                sim->fifo_ptr = (uint16_t)(sim->mem[0][loregs[LGW_RX_DATA_BUF_ADDR].addr] | (sim->mem[0][loregs[LGW_RX_DATA_BUF_ADDR].addr + 1] << 8)) - sim->fifo[sim->fifo_head].addr;
+            }
+            return;
+        case SIM_TX_BUF_ADDR:
+            sim->tx_ptr = data;
+            return;
+        case SIM_TX_BUF_DATA:
+            sim->tx_buf[sim->tx_ptr % sizeof sim->tx_buf] = data;
+            sim->tx_ptr += 1;
+            return;
+        case SIM_PROM_ADDR:
+            sim->prom_ptr = 0;
+            return;
+        case SIM_PROM_DATA:
+            sim->prom[sim->prom_ptr % SIM_PROM_SIZE] = data;
+            sim->prom_ptr += 1;
+            return;
+        case SIM_FIFO_NUM:
+            if (sim->fifo_nb > 0) {
+                sim->fifo_head = (sim->fifo_head + 1) % LGW_PKT_FIFO_SIZE;
+                sim->fifo_nb -= 1;
+                sim->stats.nb_rx_read += 1;
+            }
+            sim->fifo_ptr = 0;
+            return;
+        default:
+            break;
+    }
+
+    *b = data;
+    switch (sim_role[sim->page][addr]) {
+        case SIM_RADIO_SELECT:
+            sim_agc_cmd(sim, data);
+            break;
+        case SIM_MCU_RST:
+            if ((data & 0x02) != 0) {
+                sim->agc_state = SIM_AGC_OFF;
+                sim->agc_version = 0;
+                sim->agc_status = 0;
+            } else if ((old & 0x02) != 0) {
+                sim_agc_release(sim);
+            }
+            sim->arb_running = ((data & 0x01) == 0);
+            break;
+        case SIM_TX_TRIG:
+            if ((data & 0x07) == 0) {
+                sim->tx_state = SIM_TX_IDLE; /* abort */
+            } else if ((old & 0x07) == 0) {
+                sim->stats.nb_tx += 1;
+                sim->tx_on_gps = ((data & 0x04) != 0);
+                if ((data & 0x01) != 0) {
+                    sim->tx_state = SIM_TX_ON;
+                    sim->tx_start = sim_cnt(sim);
+                } else {
+                    sim->tx_state = SIM_TX_WAIT;
+                    sim->tx_start = ((uint32_t)sim->tx_buf[3] << 24) | ((uint32_t)sim->tx_buf[4] << 16) | ((uint32_t)sim->tx_buf[5] << 8) | sim->tx_buf[6];
+                }
+                sim->stats.tx_last_start = sim->tx_start;
+                sim->stats.tx_last_id = sim->tx_buf[16]; /* payload follows the 16 bytes of metadata */
+                sim->tx_trig_seq = __atomic_add_fetch(&sim_tx_seq, 1, __ATOMIC_RELAXED);
+            }
+            break;
+        case SIM_RADIO_A_CS:
+            if ((data & 0x01) != 0) {
+                sim_radio_xfer(sim, 0, LGW_SPI_RADIO_A__ADDR, LGW_SPI_RADIO_A__DATA, LGW_SPI_RADIO_A__DATA_READBACK);
+            }
+            break;
+        case SIM_RADIO_B_CS:
+            if ((data & 0x01) != 0) {
+                sim_radio_xfer(sim, 1, LGW_SPI_RADIO_B__ADDR, LGW_SPI_RADIO_B__DATA, LGW_SPI_RADIO_B__DATA_READBACK);
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint8_t sim_read(struct sim_dev_s *sim, uint8_t addr, bool single) {
+    const struct sim_rx_pkt_s *p = &sim->fifo[sim->fifo_head];
+    uint8_t v;
+
+    switch (sim_role[sim->page][addr]) {
+        case SIM_RX_BUF_DATA:
+            if ((sim->fifo_nb == 0) || (sim->fifo_ptr >= (p->size + 16))) {
+                return 0;
+            }
+            return p->data[sim->fifo_ptr++];
+        case SIM_PROM_DATA:
+            if (single == true) {
+                sim->prom_ptr = 0; /* read-back starts over, see load_firmware */
+                return sim->prom[0];
+            }
+            v = sim->prom[sim->prom_ptr % SIM_PROM_SIZE];
+            sim->prom_ptr += 1;
+            return v;
+        case SIM_FIFO_NUM:
+            sim_rx_update(sim);
+            return (uint8_t)sim->fifo_nb;
+        case SIM_FIFO_INFO:
+            if (sim->fifo_nb == 0) {
+                return 0;
+            }
+            switch (addr - loregs[LGW_RX_PACKET_DATA_FIFO_ADDR_POINTER].addr) {
+                case 0: return (uint8_t)p->addr;
+                case 1: return (uint8_t)(p->addr >> 8);
+                case 2: return p->status;
+                default: return p->size;
+            }
+        case SIM_AGC_STATUS:
+            return sim->agc_status;
+        case SIM_TX_STATUS:
+            sim_tx_update(sim);
+            switch (sim->tx_state) {
+                case SIM_TX_WAIT: return SIM_TX_SCHEDULED;
+                case SIM_TX_ON: return SIM_TX_EMITTING;
+                default: return SIM_TX_FREE;
+            }
+        case SIM_ARB_RAM:
+            return ((sim->arb_running == true) && (sim->mem[2][loregs[LGW_DBG_ARB_MCU_RAM_ADDR].addr] == SIM_FW_VERSION_ADDR)) ? SIM_FW_VERSION_ARB : 0;
+        case SIM_AGC_RAM:
+            return (sim->mem[2][loregs[LGW_DBG_AGC_MCU_RAM_ADDR].addr] == SIM_FW_VERSION_ADDR) ? sim->agc_version : 0; /* TX DC offsets read as 0 */
+        case SIM_TIMESTAMP:
+            if (addr == loregs[LGW_TIMESTAMP].addr) {
+                sim->cnt_latch = sim_cnt(sim);
+            }
+            return (uint8_t)(sim->cnt_latch >> (8 * (addr - loregs[LGW_TIMESTAMP].addr)));
+        default:
+            return *sim_byte(sim, addr);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* data registers, bursts do not increment the address */
+static bool sim_port(struct sim_dev_s *sim, uint8_t addr) {
+    switch (sim_role[sim->page][addr]) {
+        case SIM_RX_BUF_DATA:
+        case SIM_TX_BUF_DATA:
+        case SIM_PROM_DATA:
+            return true;
+        default:
+            return false;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* count SPI messages as the native backend sends them */
+static void sim_msg(struct sim_dev_s *sim, bool is_write, uint16_t size) {
+    if ((is_write == true) && (sim->batch_depth > 0) && (size <= SIM_BATCH_FRAME)) {
+        sim->pending = true;
+    } else {
+        sim->msg_cnt += 1;
+        sim->pending = false;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- BACKEND FUNCTIONS DEFINITION ----------------------------------------- */
+
+static int spi_sim_open(const char *spi_path, void **spi_target_ptr) {
+    struct sim_dev_s *sim = NULL;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(spi_target_ptr);
+    (void)spi_path; /* any path opens a new simulated concentrator */
+
+    for (i = 0; i < SIM_DEV_NB; ++i) {
+        if (sim_dev[i].is_open == false) {
+            sim = &sim_dev[i];
+            break;
+        }
+    }
+    if (sim == NULL) {
+        DEBUG_MSG("ERROR: ALL SIMULATED CONCENTRATORS ALREADY OPEN\n");
+        return LGW_SPI_ERROR;
+    }
+
+    pthread_once(&sim_map_once, sim_map_setup);
+    memset(sim, 0, sizeof *sim);
+    sim->t0_us = monotonic_us();
+    sim_reset(sim);
+    sim->is_open = true;
+
+    *spi_target_ptr = (void *)sim;
+    DEBUG_MSG("Note: SPI simulator open\n");
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_sim_close(void *spi_target) {
+    struct sim_dev_s *sim = spi_target;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+
+    sim->is_open = false;
+    DEBUG_MSG("Note: SPI simulator closed\n");
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_sim_w(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t data) {
+    struct sim_dev_s *sim = spi_target;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+
+    sim_msg(sim, true, 1);
+    if ((spi_mux_mode == LGW_SPI_MUX_MODE1) && (spi_mux_target != LGW_SPI_MUX_TARGET_SX1301)) {
+        return LGW_SPI_SUCCESS;
+    }
+    sim_write(sim, address & 0x7F, data);
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_sim_r(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data) {
+    struct sim_dev_s *sim = spi_target;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+    CHECK_NULL(data);
+
+    sim_msg(sim, false, 1);
+    if ((spi_mux_mode == LGW_SPI_MUX_MODE1) && (spi_mux_target != LGW_SPI_MUX_TARGET_SX1301)) {
+        *data = 0;
+        return LGW_SPI_SUCCESS;
+    }
+    *data = sim_read(sim, address & 0x7F, true);
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_sim_wb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    struct sim_dev_s *sim = spi_target;
+    uint8_t a = address & 0x7F;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+    CHECK_NULL(data);
+    if (size == 0) {
+        DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+        return LGW_SPI_ERROR;
+    }
+
+    sim_msg(sim, true, size);
+    if ((spi_mux_mode == LGW_SPI_MUX_MODE1) && (spi_mux_target != LGW_SPI_MUX_TARGET_SX1301)) {
+        return LGW_SPI_SUCCESS;
+    }
+    for (i = 0; i < size; ++i) {
+        sim_write(sim, a, data[i]);
+        if (sim_port(sim, a) == false) {
+            a = (a + 1) & 0x7F;
+        }
+    }
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_sim_rb(void *spi_target, uint8_t spi_mux_mode, uint8_t spi_mux_target, uint8_t address, uint8_t *data, uint16_t size) {
+    struct sim_dev_s *sim = spi_target;
+    uint8_t a = address & 0x7F;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+    CHECK_NULL(data);
+    if (size == 0) {
+        DEBUG_MSG("ERROR: BURST OF NULL LENGTH\n");
+        return LGW_SPI_ERROR;
+    }
+
+    sim_msg(sim, false, size);
+    if ((spi_mux_mode == LGW_SPI_MUX_MODE1) && (spi_mux_target != LGW_SPI_MUX_TARGET_SX1301)) {
+        memset(data, 0, size);
+        return LGW_SPI_SUCCESS;
+    }
+    for (i = 0; i < size; ++i) {
+        data[i] = sim_read(sim, a, false);
+        if (sim_port(sim, a) == false) {
+            a = (a + 1) & 0x7F;
+        }
+    }
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_sim_batch_begin(void *spi_target) {
+    struct sim_dev_s *sim = spi_target;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+
+    sim->batch_depth += 1;
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_sim_batch_end(void *spi_target) {
+    struct sim_dev_s *sim = spi_target;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+
+    if (sim->batch_depth > 0) {
+        sim->batch_depth -= 1;
+    }
+    if (sim->batch_depth == 0) {
+        return spi_sim_batch_flush(spi_target);
+    }
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_sim_batch_flush(void *spi_target) {
+    struct sim_dev_s *sim = spi_target;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+
+    if (sim->pending == true) {
+        sim->msg_cnt += 1;
+        sim->pending = false;
+    }
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int spi_sim_get_msg_cnt(void *spi_target, uint32_t *msg_cnt) {
+    struct sim_dev_s *sim = spi_target;
+
+    /* check input variables */
+    CHECK_NULL(spi_target);
+    CHECK_NULL(msg_cnt);
+
+    *msg_cnt = sim->msg_cnt;
+    return LGW_SPI_SUCCESS;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC VARIABLES ----------------------------------------------------- */
+
+const struct lgw_spi_backend_s lgw_spi_sim = {
+    "sim",
+    spi_sim_open,
+    spi_sim_close,
+    spi_sim_w,
+    spi_sim_r,
+    spi_sim_wb,
+    spi_sim_rb,
+    spi_sim_batch_begin,
+    spi_sim_batch_end,
+    spi_sim_batch_flush,
+    spi_sim_get_msg_cnt
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_spi_sim_setconf(const struct lgw_spi_sim_conf_s *conf) {
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(conf);
+    if ((conf->rx_sf < 7) || (conf->rx_sf > 12) || (conf->rx_if_chain >= LGW_IF_CHAIN_NB) || (conf->rx_crc_bad_pct > 100)) {
+        DEBUG_MSG("ERROR: NOT A VALID SIMULATOR CONFIGURATION\n");
+        return LGW_SPI_ERROR;
+    }
+
+    sim_conf = *conf;
+    for (i = 0; i < SIM_DEV_NB; ++i) {
+        sim_dev[i].gen_t0_us = monotonic_us();
+        sim_dev[i].gen_done = 0;
+    }
+    return LGW_SPI_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_spi_sim_get_stats(struct lgw_spi_sim_stats_s *stats) {
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(stats);
+
+    memset(stats, 0, sizeof *stats);
+    for (i = 0; i < SIM_DEV_NB; ++i) {
+        stats->nb_rx_gen += sim_dev[i].stats.nb_rx_gen;
+        stats->nb_rx_lost += sim_dev[i].stats.nb_rx_lost;
+        stats->nb_rx_read += sim_dev[i].stats.nb_rx_read;
+        stats->nb_tx += sim_dev[i].stats.nb_tx;
+        if ((sim_dev[i].tx_trig_seq != 0) && (sim_dev[i].tx_trig_seq == __atomic_load_n(&sim_tx_seq, __ATOMIC_RELAXED))) {
+            stats->tx_last_start = sim_dev[i].stats.tx_last_start;
+            stats->tx_last_id = sim_dev[i].stats.tx_last_id;
+        }
+    }
+    return LGW_SPI_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,433 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Spectral scan results published in shared memory
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <stdlib.h>     /* malloc free */
+#include <string.h>     /* memcpy */
+#include <fcntl.h>      /* O_CREAT O_EXCL O_RDWR O_RDONLY */
+#include <unistd.h>     /* ftruncate close */
+#include <sched.h>      /* sched_yield */
+#include <sys/mman.h>   /* shm_open shm_unlink mmap munmap */
+#include <sys/stat.h>   /* fstat */
+
+#include "loragw_sscan.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_HAL == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                 if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_SSCAN_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                 if(a==NULL){return LGW_SSCAN_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define SSCAN_MAGIC         0x4E414353  /* "SCAN", set once the header is complete */
+#define SSCAN_MAGIC_CLOSED  0x44534C43  /* "CLSD", set by the writer when it stops updating the object */
+#define SSCAN_READ_RETRY    1000        /* copies attempted by lgw_sscan_read before giving up on a busy slot */
+
+/* layout of the shared memory object: header, then one slot per frequency,
+   each on its own cache lines so that publishing a slot does not slow down
+   readers of the others */
+struct sscan_hdr_s {
+    uint32_t    magic;
+    uint16_t    version;
+    uint16_t    nb_freq;
+    uint32_t    slot_size;  /* sizeof(struct sscan_slot_s) of the writer */
+    uint32_t    sweep;      /* number of complete sweeps */
+} __attribute__ ((aligned (64)));
+
+struct sscan_slot_s {
+    uint32_t                    seq;    /* even: stable, odd: being written, 0: never published */
+    struct lgw_sscan_entry_s    entry;
+} __attribute__ ((aligned (64)));
+
+struct lgw_sscan_s {
+    struct sscan_hdr_s  *hdr;
+    struct sscan_slot_s *slot;
+    size_t              size;   /* size of the mapping */
+    bool                writer;
+};
+
+/* 4 lanes of 32 bits, the width of NEON and SSE2 registers: GCC maps the
+   operations on the SIMD unit of the target or falls back to scalar code */
+#define SSCAN_LANES         4
+typedef uint32_t sscan_vu_t __attribute__ ((vector_size (SSCAN_LANES * 4)));
+typedef int32_t sscan_vi_t __attribute__ ((vector_size (SSCAN_LANES * 4)));
+typedef uint16_t sscan_vh_t __attribute__ ((vector_size (SSCAN_LANES * 4)));  /* 2 x 4 bins as loaded */
+typedef int16_t sscan_vhi_t __attribute__ ((vector_size (SSCAN_LANES * 4)));
+
+/* widen the 16-bit bins to 32-bit lanes by interleaving them with zeros (lane 8 of the zero vector) */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    #define SSCAN_WIDEN_LO  { 8, 0, 8, 1, 8, 2, 8, 3 }
+    #define SSCAN_WIDEN_HI  { 8, 4, 8, 5, 8, 6, 8, 7 }
+#else
+    #define SSCAN_WIDEN_LO  { 0, 8, 1, 8, 2, 8, 3, 8 }
+    #define SSCAN_WIDEN_HI  { 4, 8, 5, 8, 6, 8, 7, 8 }
+#endif
+
+#if (LGW_SSCAN_RSSI_RANGE != 256)
+    #error "the levels computation packs a bin index in 8 bits and loads 8 bins at a time"
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+/* mark the object left by a previous writer as closed, so its readers know it
+   is not updated any more, then remove its name */
+static void sscan_unlink(const char *name) {
+    struct sscan_hdr_s *hdr;
+    int fd;
+
+    fd = shm_open(name, O_RDWR, 0);
+    if (fd < 0) {
+        return;
+    }
+    hdr = mmap(NULL, sizeof *hdr, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (hdr != MAP_FAILED) {
+        __atomic_store_n(&hdr->magic, SSCAN_MAGIC_CLOSED, __ATOMIC_RELEASE);
+        munmap(hdr, sizeof *hdr);
+    }
+    close(fd);
+    shm_unlink(name);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* one 16-byte load for 8 bins, the histograms are not aligned on 16 bytes */
+static inline void sscan_load(const uint16_t *histo, sscan_vu_t *lo, sscan_vu_t *hi) {
+    const sscan_vhi_t widen_lo = SSCAN_WIDEN_LO;
+    const sscan_vhi_t widen_hi = SSCAN_WIDEN_HI;
+    const sscan_vh_t zero = { 0 };
+    sscan_vh_t h;
+
+    memcpy(&h, histo, sizeof h);
+    *lo = (sscan_vu_t)__builtin_shuffle(h, zero, widen_lo);
+    *hi = (sscan_vu_t)__builtin_shuffle(h, zero, widen_hi);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* index of the first cumulated sum reaching target, LGW_SSCAN_RSSI_RANGE if none does */
+static inline uint32_t sscan_search(const uint32_t *cumu, uint32_t target) {
+    uint32_t lo = 0, hi = LGW_SSCAN_RSSI_RANGE, mid;
+
+    while (lo < hi) {
+        mid = (lo + hi) / 2;
+        if (cumu[mid] < target) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* bins are at most 16 bits: the count shifted by 8 bits with the complement of
+   the index below it, the highest key is the first of the most populated bins */
+static inline sscan_vu_t sscan_levels_step(sscan_vu_t v, sscan_vu_t *carry, sscan_vu_t *key_max, sscan_vu_t *key_idx) {
+    const sscan_vi_t shift1 = { 4, 0, 1, 2 }; /* lane i gets lane i-1, or 0 (lane 4 is in the zero vector) */
+    const sscan_vi_t shift2 = { 4, 4, 0, 1 };
+    const sscan_vi_t last = { 3, 3, 3, 3 };
+    const sscan_vu_t zero = { 0 };
+    sscan_vu_t key, gt;
+
+    key = (v << 8) | *key_idx;
+    *key_idx -= SSCAN_LANES;
+    gt = (sscan_vu_t)((sscan_vi_t)key > (sscan_vi_t)*key_max); /* signed is cheaper on SSE2, keys are below 2^24 */
+    *key_max = (key & gt) | (*key_max & ~gt);
+
+    /* cumulated sum in 2 shift and add steps, plus the previous bins */
+    v += __builtin_shuffle(v, zero, shift1);
+    v += __builtin_shuffle(v, zero, shift2);
+    v += *carry;
+    *carry = __builtin_shuffle(v, last);
+    return v;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void sscan_levels_one(const uint16_t *histo, uint32_t nb_pts, struct lgw_sscan_level_s *level) {
+    static const uint32_t pct[LGW_SSCAN_LEVEL_NB] = LGW_SSCAN_LEVEL_PCT;
+    const sscan_vu_t zero = { 0 };
+    uint32_t cumu[LGW_SSCAN_RSSI_RANGE]; /* cumulated sums */
+    sscan_vu_t carry = zero, key_max = zero;
+    sscan_vu_t key_idx = { 255, 254, 253, 252 };
+    sscan_vu_t lo, hi, v;
+    uint64_t target;
+    uint32_t n, key;
+    int i, k;
+
+    for (i = 0; i < LGW_SSCAN_RSSI_RANGE; i += 2 * SSCAN_LANES) {
+        sscan_load(&histo[i], &lo, &hi);
+        v = sscan_levels_step(lo, &carry, &key_max, &key_idx);
+        memcpy(&cumu[i], &v, sizeof v);
+        v = sscan_levels_step(hi, &carry, &key_max, &key_idx);
+        memcpy(&cumu[i + SSCAN_LANES], &v, sizeof v);
+    }
+
+    /* the cumulated sums only grow: each percentile is a search for its target */
+    level->nb_pts = carry[0];
+    if (nb_pts == 0) {
+        nb_pts = carry[0];
+    }
+    for (k = 0; k < LGW_SSCAN_LEVEL_NB; ++k) {
+        target = ((uint64_t)pct[k] * nb_pts + 99) / 100; /* cumu * 100 >= pct * nb_pts */
+        n = (target > carry[0]) ? LGW_SSCAN_RSSI_RANGE : sscan_search(cumu, (uint32_t)target);
+        level->pct_dbm[k] = ((nb_pts == 0) || (n >= LGW_SSCAN_RSSI_RANGE)) ? LGW_SSCAN_NO_LEVEL : -(float)n / 2;
+    }
+
+    key = 0;
+    for (i = 0; i < SSCAN_LANES; ++i) {
+        key = (key_max[i] > key) ? key_max[i] : key;
+    }
+    level->floor_dbm = ((key >> 8) == 0) ? LGW_SSCAN_NO_LEVEL : -(float)(255 - (key & 0xFF)) / 2;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+struct lgw_sscan_s *lgw_sscan_create(const char *name, uint16_t nb_freq) {
+    struct lgw_sscan_s *sscan;
+    void *map;
+    size_t size;
+    int fd;
+
+    if ((name == NULL) || (nb_freq == 0) || (nb_freq > LGW_SSCAN_FREQ_MAX)) {
+        DEBUG_MSG("ERROR: INVALID SHARED MEMORY NAME OR NUMBER OF FREQUENCIES\n");
+        return NULL;
+    }
+    size = sizeof(struct sscan_hdr_s) + nb_freq * sizeof(struct sscan_slot_s);
+
+    sscan_unlink(name);
+    fd = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        DEBUG_PRINTF("ERROR: FAILED TO CREATE SHARED MEMORY %s\n", name);
+        return NULL;
+    }
+    if (ftruncate(fd, size) != 0) { /* zero filled: every slot starts never published */
+        DEBUG_MSG("ERROR: FAILED TO SIZE SHARED MEMORY\n");
+        close(fd);
+        shm_unlink(name);
+        return NULL;
+    }
+    map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        DEBUG_MSG("ERROR: FAILED TO MAP SHARED MEMORY\n");
+        shm_unlink(name);
+        return NULL;
+    }
+
+    sscan = malloc(sizeof *sscan);
+    if (sscan == NULL) {
+        munmap(map, size);
+        shm_unlink(name);
+        return NULL;
+    }
+    sscan->hdr = map;
+    sscan->slot = (struct sscan_slot_s *)(sscan->hdr + 1);
+    sscan->size = size;
+    sscan->writer = true;
+
+    sscan->hdr->version = LGW_SSCAN_VERSION;
+    sscan->hdr->nb_freq = nb_freq;
+    sscan->hdr->slot_size = sizeof(struct sscan_slot_s);
+    __atomic_store_n(&sscan->hdr->magic, SSCAN_MAGIC, __ATOMIC_RELEASE); /* header complete */
+
+    return sscan;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+struct lgw_sscan_s *lgw_sscan_open(const char *name) {
+    struct lgw_sscan_s *sscan;
+    struct sscan_hdr_s *hdr;
+    struct stat st;
+    void *map;
+    int fd;
+
+    if (name == NULL) {
+        return NULL;
+    }
+    fd = shm_open(name, O_RDONLY, 0);
+    if (fd < 0) {
+        DEBUG_PRINTF("ERROR: NO SHARED MEMORY %s\n", name);
+        return NULL;
+    }
+    if ((fstat(fd, &st) != 0) || (st.st_size < (off_t)sizeof(struct sscan_hdr_s))) {
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        return NULL;
+    }
+
+    /* the size was set before the header was written, so only trust the header once the magic is there */
+    hdr = map;
+    if ((__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) != SSCAN_MAGIC) || (hdr->version != LGW_SSCAN_VERSION) || (hdr->slot_size != sizeof(struct sscan_slot_s)) || ((size_t)st.st_size < sizeof(struct sscan_hdr_s) + hdr->nb_freq * sizeof(struct sscan_slot_s))) {
+        DEBUG_PRINTF("ERROR: SHARED MEMORY %s IS CLOSED OR HAS AN UNKNOWN LAYOUT\n", name);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    sscan = malloc(sizeof *sscan);
+    if (sscan == NULL) {
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    sscan->hdr = hdr;
+    sscan->slot = (struct sscan_slot_s *)(hdr + 1);
+    sscan->size = st.st_size;
+    sscan->writer = false;
+    return sscan;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sscan_close(struct lgw_sscan_s *sscan) {
+    CHECK_NULL(sscan);
+
+    if (sscan->writer) {
+        __atomic_store_n(&sscan->hdr->magic, SSCAN_MAGIC_CLOSED, __ATOMIC_RELEASE);
+    }
+    munmap(sscan->hdr, sscan->size);
+    free(sscan);
+    return LGW_SSCAN_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sscan_info(const struct lgw_sscan_s *sscan, uint16_t *nb_freq, uint32_t *sweep) {
+    CHECK_NULL(sscan);
+    CHECK_NULL(nb_freq);
+
+    if (__atomic_load_n(&sscan->hdr->magic, __ATOMIC_ACQUIRE) != SSCAN_MAGIC) {
+        return LGW_SSCAN_ERROR;
+    }
+    *nb_freq = sscan->hdr->nb_freq;
+    if (sweep != NULL) {
+        *sweep = __atomic_load_n(&sscan->hdr->sweep, __ATOMIC_ACQUIRE);
+    }
+    return LGW_SSCAN_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sscan_publish(struct lgw_sscan_s *sscan, uint16_t index, const struct lgw_sscan_entry_s *entry) {
+    struct sscan_slot_s *slot;
+    uint32_t seq;
+
+    CHECK_NULL(sscan);
+    CHECK_NULL(entry);
+    if ((sscan->writer == false) || (index >= sscan->hdr->nb_freq)) {
+        return LGW_SSCAN_ERROR;
+    }
+    slot = &sscan->slot[index];
+
+    /* odd sequence while the entry is being copied, the fence keeps the copy after it */
+    seq = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    memcpy(&slot->entry, entry, sizeof slot->entry);
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+
+    return LGW_SSCAN_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sscan_sweep_done(struct lgw_sscan_s *sscan) {
+    CHECK_NULL(sscan);
+    if (sscan->writer == false) {
+        return LGW_SSCAN_ERROR;
+    }
+    __atomic_fetch_add(&sscan->hdr->sweep, 1, __ATOMIC_RELEASE);
+    return LGW_SSCAN_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sscan_read(const struct lgw_sscan_s *sscan, uint16_t index, struct lgw_sscan_entry_s *entry) {
+    const struct sscan_slot_s *slot;
+    uint32_t seq1, seq2;
+    int i;
+
+    CHECK_NULL(sscan);
+    CHECK_NULL(entry);
+    if ((__atomic_load_n(&sscan->hdr->magic, __ATOMIC_ACQUIRE) != SSCAN_MAGIC) || (index >= sscan->hdr->nb_freq)) {
+        return LGW_SSCAN_ERROR;
+    }
+    slot = &sscan->slot[index];
+
+    /* the copy is kept only if the sequence was even and did not move during it,
+       a writer that died in the middle of a copy leaves the slot odd for good */
+    for (i = 0; i < SSCAN_READ_RETRY; ++i) {
+        seq1 = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+        if (seq1 == 0) {
+            return LGW_SSCAN_EMPTY;
+        }
+        if ((seq1 & 1) == 0) {
+            memcpy(entry, &slot->entry, sizeof *entry);
+            __atomic_thread_fence(__ATOMIC_ACQUIRE);
+            seq2 = __atomic_load_n(&slot->seq, __ATOMIC_RELAXED);
+            if (seq1 == seq2) {
+                return LGW_SSCAN_SUCCESS;
+            }
+        }
+        sched_yield(); /* let a preempted writer finish its copy */
+    }
+    DEBUG_PRINTF("ERROR: SLOT %u KEPT BUSY BY THE WRITER\n", index);
+    return LGW_SSCAN_ERROR;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_sscan_levels(const uint16_t *histo, uint32_t nb_histo, uint32_t nb_pts, struct lgw_sscan_level_s *level) {
+    uint32_t i;
+
+    CHECK_NULL(histo);
+    CHECK_NULL(level);
+
+    for (i = 0; i < nb_histo; ++i) {
+        sscan_levels_one(&histo[i * LGW_SSCAN_RSSI_RANGE], nb_pts, &level[i]);
+    }
+    return LGW_SSCAN_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
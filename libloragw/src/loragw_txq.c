@@ -0,0 +1,409 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Background TX thread loading queued packets just in time in the single
+    concentrator TX buffer
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <string.h>     /* memset */
+#include <time.h>       /* clock_gettime */
+#include <pthread.h>    /* pthread_create pthread_join pthread_cond_timedwait */
+
+#include "loragw_txq.h"
+#include "loragw_ctx.h"
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+#if DEBUG_HAL == 1
+    #define DEBUG_MSG(str)                fprintf(stderr, str)
+    #define DEBUG_PRINTF(fmt, args...)    fprintf(stderr,"%s:%d: "fmt, __FUNCTION__, __LINE__, args)
+    #define CHECK_NULL(a)                 if(a==NULL){fprintf(stderr,"%s:%d: ERROR: NULL POINTER AS ARGUMENT\n", __FUNCTION__, __LINE__);return LGW_TXQ_ERROR;}
+#else
+    #define DEBUG_MSG(str)
+    #define DEBUG_PRINTF(fmt, args...)
+    #define CHECK_NULL(a)                 if(a==NULL){return LGW_TXQ_ERROR;}
+#endif
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS & TYPES -------------------------------------------- */
+
+#define TXQ_LOAD_LEAD_US    30000 /* a TIMESTAMPED packet is loaded at most that long before its start */
+#define TXQ_LATE_US         2000 /* a TIMESTAMPED packet closer than that to its start is dropped, covers TX start delay and SPI load */
+#define TXQ_POLL_MIN_US     200 /* TX status polling interval once the end of the current packet is reached */
+#define TXQ_POLL_MAX_US     10000 /* longest sleep while the TX buffer is busy */
+#define TXQ_SYNC_AGE_US     1000000 /* the counter is extrapolated, and read again at most that often */
+
+struct txq_entry_s {
+    bool                used;
+    uint32_t            seq; /* arrival order, used to send IMMEDIATE packets first in first out */
+    uint32_t            toa_us;
+    struct lgw_pkt_tx_s pkt;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct txq_entry_s txq_list[LGW_TXQ_SIZE]; /* unordered, searched linearly */
+static uint32_t txq_seq;
+static uint16_t txq_depth;
+
+static bool txq_busy = false; /* a packet loaded by the thread may still be scheduled or emitting */
+static uint32_t txq_busy_until; /* concentrator counter value at the end of that packet */
+
+static pthread_mutex_t txq_mutex = PTHREAD_MUTEX_INITIALIZER; /* protects everything above */
+static pthread_cond_t txq_cond;
+static bool txq_cond_init = false;
+
+static pthread_t txq_thread;
+static bool txq_running = false;
+
+static struct lgw_txq_stats_s txq_stats;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static bool txq_overlap(uint32_t a_start, uint32_t a_toa, uint32_t b_start, uint32_t b_toa);
+
+static int txq_next(uint32_t now, int32_t *sleep_us);
+
+static void *txq_thread_main(void *arg);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static bool txq_overlap(uint32_t a_start, uint32_t a_toa, uint32_t b_start, uint32_t b_toa) {
+    int32_t d = (int32_t)(b_start - a_start); /* counter wraps every ~72 minutes */
+
+    if (d >= 0) {
+        return (d < (int32_t)(a_toa + LGW_TXQ_GUARD_US));
+    } else {
+        return (-d < (int32_t)(b_toa + LGW_TXQ_GUARD_US));
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* called with txq_mutex held, returns the entry to load now or -1 and the time to sleep */
+static int txq_next(uint32_t now, int32_t *sleep_us) {
+    int ts = -1; /* earliest TIMESTAMPED packet */
+    int im = -1; /* oldest IMMEDIATE packet */
+    int32_t lead;
+    int i;
+
+    /* drop the TIMESTAMPED packets that can no longer be loaded in time */
+    for (i = 0; i < LGW_TXQ_SIZE; ++i) {
+        if ((txq_list[i].used == false) || (txq_list[i].pkt.tx_mode != TIMESTAMPED)) {
+            continue;
+        }
+        if ((int32_t)(txq_list[i].pkt.count_us - now) < TXQ_LATE_US) {
+            DEBUG_PRINTF("WARNING: TX PACKET FOR %u DROPPED, TOO LATE AT %u\n", txq_list[i].pkt.count_us, now);
+            txq_list[i].used = false;
+            txq_depth -= 1;
+            txq_stats.nb_late += 1;
+            continue;
+        }
+        if ((ts < 0) || ((int32_t)(txq_list[i].pkt.count_us - txq_list[ts].pkt.count_us) < 0)) {
+            ts = i;
+        }
+    }
+    for (i = 0; i < LGW_TXQ_SIZE; ++i) {
+        if ((txq_list[i].used == true) && (txq_list[i].pkt.tx_mode == IMMEDIATE)) {
+            if ((im < 0) || ((int32_t)(txq_list[i].seq - txq_list[im].seq) < 0)) {
+                im = i;
+            }
+        }
+    }
+
+    /* a TIMESTAMPED packet close enough has priority, an IMMEDIATE one goes if it ends before the next slot */
+    *sleep_us = TXQ_POLL_MAX_US;
+    if (ts >= 0) {
+        lead = (int32_t)(txq_list[ts].pkt.count_us - now);
+        if (lead <= TXQ_LOAD_LEAD_US) {
+            return ts;
+        }
+        if ((im >= 0) && (lead >= (int32_t)(txq_list[im].toa_us + 2 * LGW_TXQ_GUARD_US))) {
+            return im;
+        }
+        /* nothing fits before the next slot, sleep until it must be loaded */
+        *sleep_us = lead - TXQ_LOAD_LEAD_US;
+        return -1;
+    }
+    return im;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void *txq_thread_main(void *arg) {
+    struct lgw_pkt_tx_s pkt;
+    struct timespec deadline;
+    uint8_t tx_status;
+    uint32_t now;
+    uint32_t toa_us;
+    int32_t sleep_us;
+    int i;
+
+    lgw_ctx_use(arg); /* drive the concentrator of the thread that started the queue */
+
+    pthread_mutex_lock(&txq_mutex);
+    while (txq_running == true) {
+        if (txq_depth == 0) {
+            pthread_cond_wait(&txq_cond, &txq_mutex);
+            continue;
+        }
+        pthread_mutex_unlock(&txq_mutex);
+
+        /* the concentrator has a single TX buffer, wait for it to be free */
+        i = lgw_status(TX_STATUS, &tx_status);
+        if (i == LGW_HAL_SUCCESS) {
+            i = lgw_get_instcnt_est(&now, TXQ_SYNC_AGE_US);
+        }
+        pthread_mutex_lock(&txq_mutex);
+        if (i != LGW_HAL_SUCCESS) {
+            txq_stats.nb_error += 1;
+            sleep_us = TXQ_POLL_MAX_US;
+        } else if (tx_status != TX_FREE) {
+            /* sleep until the known end of the packet being emitted */
+            sleep_us = TXQ_POLL_MIN_US;
+            if ((txq_busy == true) && ((int32_t)(txq_busy_until - now) > TXQ_POLL_MIN_US)) {
+                sleep_us = (int32_t)(txq_busy_until - now);
+            }
+            if (sleep_us > TXQ_POLL_MAX_US) {
+                sleep_us = TXQ_POLL_MAX_US;
+            }
+        } else {
+            txq_busy = false;
+            i = txq_next(now, &sleep_us);
+            if (i >= 0) {
+                pkt = txq_list[i].pkt;
+                toa_us = txq_list[i].toa_us;
+                txq_list[i].used = false;
+                txq_depth -= 1;
+                pthread_mutex_unlock(&txq_mutex);
+
+                i = lgw_send(pkt);
+
+                pthread_mutex_lock(&txq_mutex);
+                if (i == LGW_HAL_SUCCESS) {
+                    txq_stats.nb_pkt_sent += 1;
+                    txq_busy = true;
+                    txq_busy_until = ((pkt.tx_mode == TIMESTAMPED) ? pkt.count_us : now + LGW_TXQ_GUARD_US) + toa_us;
+                } else {
+                    DEBUG_MSG("ERROR: TX THREAD FAILED TO SEND PACKET\n");
+                    txq_stats.nb_error += 1;
+                }
+                continue;
+            }
+        }
+
+        /* sleep, a new packet wakes the thread up since it may be due earlier */
+        if (sleep_us > 0) {
+            clock_gettime(CLOCK_MONOTONIC, &deadline);
+            deadline.tv_sec += sleep_us / 1000000;
+            deadline.tv_nsec += (sleep_us % 1000000) * 1000L;
+            if (deadline.tv_nsec >= 1000000000L) {
+                deadline.tv_sec += 1;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            pthread_cond_timedwait(&txq_cond, &txq_mutex, &deadline);
+        }
+    }
+    pthread_mutex_unlock(&txq_mutex);
+
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- PUBLIC FUNCTIONS DEFINITION ------------------------------------------ */
+
+int lgw_txq_start(void) {
+    pthread_condattr_t attr;
+
+    pthread_mutex_lock(&txq_mutex);
+    if (txq_running == true) {
+        pthread_mutex_unlock(&txq_mutex);
+        DEBUG_MSG("ERROR: TX THREAD ALREADY RUNNING\n");
+        return LGW_TXQ_ERROR;
+    }
+
+    /* the thread sleeps on a monotonic clock, so that setting the date does not stall it */
+    if (txq_cond_init == false) {
+        pthread_condattr_init(&attr);
+        pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+        if (pthread_cond_init(&txq_cond, &attr) != 0) {
+            pthread_condattr_destroy(&attr);
+            pthread_mutex_unlock(&txq_mutex);
+            DEBUG_MSG("ERROR: FAILED TO INITIALIZE TX QUEUE CONDITION\n");
+            return LGW_TXQ_ERROR;
+        }
+        pthread_condattr_destroy(&attr);
+        txq_cond_init = true;
+    }
+
+    txq_running = true;
+    txq_busy = false;
+    if (pthread_create(&txq_thread, NULL, txq_thread_main, lgw_ctx_current()) != 0) {
+        txq_running = false;
+        pthread_mutex_unlock(&txq_mutex);
+        DEBUG_MSG("ERROR: FAILED TO CREATE TX THREAD\n");
+        return LGW_TXQ_ERROR;
+    }
+    pthread_mutex_unlock(&txq_mutex);
+
+    DEBUG_MSG("Note: TX thread started\n");
+    return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_stop(void) {
+    int i;
+
+    pthread_mutex_lock(&txq_mutex);
+    if (txq_running == false) {
+        pthread_mutex_unlock(&txq_mutex);
+        DEBUG_MSG("Note: TX thread not running\n");
+        return LGW_TXQ_SUCCESS;
+    }
+    txq_running = false;
+    pthread_cond_signal(&txq_cond);
+    pthread_mutex_unlock(&txq_mutex);
+
+    if (pthread_join(txq_thread, NULL) != 0) {
+        DEBUG_MSG("ERROR: FAILED TO JOIN TX THREAD\n");
+        return LGW_TXQ_ERROR;
+    }
+
+    /* discard what was not sent */
+    pthread_mutex_lock(&txq_mutex);
+    for (i = 0; i < LGW_TXQ_SIZE; ++i) {
+        txq_list[i].used = false;
+    }
+    txq_depth = 0;
+    pthread_mutex_unlock(&txq_mutex);
+
+    return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_enqueue(const struct lgw_pkt_tx_s *pkt_data) {
+    struct lgw_pkt_tx_s pkt;
+    uint32_t toa_us;
+    uint32_t now = 0;
+    int slot = -1;
+    int i;
+
+    /* check input variables */
+    CHECK_NULL(pkt_data);
+    if ((pkt_data->tx_mode != IMMEDIATE) && (pkt_data->tx_mode != TIMESTAMPED)) {
+        DEBUG_PRINTF("ERROR: TX MODE %u NOT SUPPORTED BY THE TX QUEUE\n", pkt_data->tx_mode);
+        return LGW_TXQ_ERROR;
+    }
+    pkt = *pkt_data;
+    toa_us = lgw_time_on_air(&pkt) * 1000;
+    if (toa_us == 0) {
+        DEBUG_MSG("ERROR: INVALID TX PACKET PARAMETERS\n");
+        return LGW_TXQ_ERROR;
+    }
+    if (pkt.tx_mode == TIMESTAMPED) {
+        if (lgw_get_instcnt_est(&now, TXQ_SYNC_AGE_US) != LGW_HAL_SUCCESS) {
+            return LGW_TXQ_ERROR;
+        }
+    }
+
+    pthread_mutex_lock(&txq_mutex);
+    if (txq_running == false) {
+        pthread_mutex_unlock(&txq_mutex);
+        DEBUG_MSG("ERROR: TX THREAD NOT RUNNING\n");
+        return LGW_TXQ_ERROR;
+    }
+
+    if (pkt.tx_mode == TIMESTAMPED) {
+        if ((int32_t)(pkt.count_us - now) < LGW_TXQ_GUARD_US) {
+            txq_stats.nb_late += 1;
+            pthread_mutex_unlock(&txq_mutex);
+            return LGW_TXQ_TOO_LATE;
+        }
+        for (i = 0; i < LGW_TXQ_SIZE; ++i) {
+            if ((txq_list[i].used == true) && (txq_list[i].pkt.tx_mode == TIMESTAMPED) && txq_overlap(txq_list[i].pkt.count_us, txq_list[i].toa_us, pkt.count_us, toa_us)) {
+                break;
+            }
+        }
+        if ((i < LGW_TXQ_SIZE) || ((txq_busy == true) && ((int32_t)(pkt.count_us - txq_busy_until) < LGW_TXQ_GUARD_US))) {
+            DEBUG_PRINTF("WARNING: TX PACKET FOR %u COLLIDES WITH A QUEUED ONE\n", pkt.count_us);
+            txq_stats.nb_collision += 1;
+            pthread_mutex_unlock(&txq_mutex);
+            return LGW_TXQ_COLLISION;
+        }
+    }
+
+    for (i = 0; i < LGW_TXQ_SIZE; ++i) {
+        if (txq_list[i].used == false) {
+            slot = i;
+            break;
+        }
+    }
+    if (slot < 0) {
+        pthread_mutex_unlock(&txq_mutex);
+        return LGW_TXQ_FULL;
+    }
+
+    txq_list[slot].pkt = pkt;
+    txq_list[slot].toa_us = toa_us;
+    txq_list[slot].seq = txq_seq++;
+    txq_list[slot].used = true;
+    txq_depth += 1;
+    txq_stats.nb_pkt_in += 1;
+    if (txq_depth > txq_stats.depth_max) {
+        txq_stats.depth_max = txq_depth;
+    }
+    pthread_cond_signal(&txq_cond);
+    pthread_mutex_unlock(&txq_mutex);
+
+    return LGW_TXQ_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+int lgw_txq_get_stats(struct lgw_txq_stats_s *stats, bool reset) {
+    /* check input variables */
+    CHECK_NULL(stats);
+
+    pthread_mutex_lock(&txq_mutex);
+    *stats = txq_stats;
+    stats->depth = txq_depth;
+    if (reset == true) {
+        memset(&txq_stats, 0, sizeof txq_stats);
+    }
+    pthread_mutex_unlock(&txq_mutex);
+
+    return LGW_TXQ_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
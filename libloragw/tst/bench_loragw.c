@@ -0,0 +1,519 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Micro-benchmark of the HAL: register single and burst accesses, lgw_receive
+    for several FIFO depths and payload sizes, lgw_send, lgw_time_on_air, the
+    GPS time conversions and the NMEA/UBX parsers. Reports the time per call
+    (min, percentiles, max, mean) as a text table, CSV or JSON.
+    Runs against a concentrator through the native SPI link, or against the
+    SPI simulator backend (-s, no concentrator needed).
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf fopen */
+#include <stdlib.h>     /* EXIT_* qsort malloc */
+#include <string.h>     /* memset strcmp */
+#include <time.h>       /* clock_gettime */
+#include <unistd.h>     /* getopt dup dup2 */
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_spi.h"
+#include "loragw_gps.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS & CONSTANTS ------------------------------------------- */
+
+#define ARRAY_SIZE(a)       (sizeof(a) / sizeof((a)[0]))
+#define MSG(args...)        fprintf(stderr, args) /* message that is destined to the user */
+
+#define DEFAULT_SAMPLE_NB   1000 /* samples taken for each benchmark */
+#define SAMPLE_NB_MAX       1000000
+#define BATCH_FAST          100 /* calls timed together for the functions that do not access the SPI link */
+#define BATCH_REG           10 /* calls timed together for the single register accesses */
+#define RX_PKT_SIZE         32 /* payload size used for the FIFO depth sweep */
+#define TX_TIME_US          10 /* simulated TX duration */
+#define BURST_SIZE_MAX      1024
+
+enum out_fmt_e {
+    OUT_TEXT,
+    OUT_CSV,
+    OUT_JSON
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct bench_res_s {
+    const char  *name;      /* function measured */
+    const char  *param;     /* name of the parameter swept, "-" if none */
+    unsigned    value;      /* value of the parameter */
+    unsigned    nb;         /* number of samples */
+    unsigned    batch;      /* calls per sample */
+    unsigned    nb_error;   /* calls that returned an error */
+    double      min, p50, p90, p99, max, mean; /* ns per call */
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const uint16_t burst_size[] = { 16, 64, 256, BURST_SIZE_MAX };
+static const uint8_t rx_depth[] = { 1, 2, 4, 8, 16 };
+static const uint8_t rx_size[] = { 1, 16, 32, 64, 128, 255 };
+static const uint8_t toa_sf[] = { 7, 8, 9, 10, 11, 12 };
+static const uint32_t toa_dr[] = { DR_LORA_SF7, DR_LORA_SF8, DR_LORA_SF9, DR_LORA_SF10, DR_LORA_SF11, DR_LORA_SF12 };
+
+static const char *nmea_body[] = {
+    "GPRMC,083559.34,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A",
+    "GPGGA,092725.00,4717.11399,N,00833.91590,E,1,08,1.01,499.6,M,48.0,M,,"
+};
+static const char *nmea_name[] = { "lgw_parse_nmea_rmc", "lgw_parse_nmea_gga" };
+
+static enum out_fmt_e out_fmt = OUT_TEXT;
+static FILE *out = NULL;
+static unsigned nb_out = 0;
+static const char *backend = "native";
+static unsigned sample_nb = DEFAULT_SAMPLE_NB;
+static double *sample = NULL;
+
+/* state of the functions being measured */
+static uint8_t burst_buf[BURST_SIZE_MAX];
+static uint16_t burst_len;
+static uint8_t rx_max;
+static struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+static struct lgw_pkt_tx_s txpkt;
+static struct tref gps_ref;
+static uint32_t gps_cnt;
+static struct timespec gps_utc;
+static char nmea_buf[128];
+static int nmea_len;
+static char ubx_buf[6 + 16 + 2];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void usage(void);
+
+static uint64_t now_ns(void);
+
+static int cmp_double(const void *a, const void *b);
+
+static int bench_run(const char *name, const char *param, unsigned value, unsigned batch, int (*fn)(void), int (*post)(void));
+
+static void bench_out(const struct bench_res_s *r);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void usage(void) {
+    printf("Library version information: %s\n", lgw_version_info());
+    printf("Available options:\n");
+    printf(" -h print this help\n");
+    printf(" -s run against the SPI simulator backend instead of a concentrator\n");
+    printf(" -n <uint> number of samples for each benchmark (default %u)\n", DEFAULT_SAMPLE_NB);
+    printf(" -f <text|csv|json> output format (default text)\n");
+    printf(" -o <path> write the results to a file instead of stdout\n");
+    printf(" -x also measure lgw_send on a concentrator (packets are emitted at 868.1 MHz)\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static uint64_t now_ns(void) {
+    struct timespec t;
+
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return ((uint64_t)t.tv_sec * 1000000000) + t.tv_nsec;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a;
+    double y = *(const double *)b;
+
+    return (x > y) - (x < y);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* time sample_nb samples of batch calls to fn, post (if not NULL) is called
+after each sample and not timed, a negative return counts as an error */
+static int bench_run(const char *name, const char *param, unsigned value, unsigned batch, int (*fn)(void), int (*post)(void)) {
+    struct bench_res_s r;
+    uint64_t t0;
+    double sum = 0.0;
+    unsigned i, k;
+
+    memset(&r, 0, sizeof r);
+    r.name = name;
+    r.param = param;
+    r.value = value;
+    r.nb = sample_nb;
+    r.batch = batch;
+    for (i = 0; i < sample_nb; ++i) {
+        t0 = now_ns();
+        for (k = 0; k < batch; ++k) {
+            if (fn() < 0) {
+                r.nb_error += 1;
+            }
+        }
+        sample[i] = (double)(now_ns() - t0) / batch;
+        sum += sample[i];
+        if ((post != NULL) && (post() < 0)) {
+            r.nb_error += 1;
+        }
+    }
+    qsort(sample, sample_nb, sizeof sample[0], cmp_double);
+    r.min = sample[0];
+    r.p50 = sample[(sample_nb - 1) * 50 / 100];
+    r.p90 = sample[(sample_nb - 1) * 90 / 100];
+    r.p99 = sample[(sample_nb - 1) * 99 / 100];
+    r.max = sample[sample_nb - 1];
+    r.mean = sum / sample_nb;
+    bench_out(&r);
+    return (r.nb_error == 0) ? 0 : -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void bench_out(const struct bench_res_s *r) {
+    switch (out_fmt) {
+        case OUT_CSV:
+            if (nb_out == 0) {
+                fprintf(out, "version,backend,bench,param,value,samples,batch,errors,min_ns,p50_ns,p90_ns,p99_ns,max_ns,mean_ns\n");
+            }
+            fprintf(out, "%s,%s,%s,%s,%u,%u,%u,%u,%.1f,%.1f,%.1f,%.1f,%.1f,%.1f\n", LIBLORAGW_VERSION, backend, r->name, r->param, r->value, r->nb, r->batch, r->nb_error, r->min, r->p50, r->p90, r->p99, r->max, r->mean);
+            break;
+        case OUT_JSON:
+            if (nb_out == 0) {
+                fprintf(out, "{\"version\":\"%s\",\"backend\":\"%s\",\"results\":[\n", LIBLORAGW_VERSION, backend);
+            } else {
+                fprintf(out, ",\n");
+            }
+            fprintf(out, "{\"bench\":\"%s\",\"param\":\"%s\",\"value\":%u,\"samples\":%u,\"batch\":%u,\"errors\":%u,\"min_ns\":%.1f,\"p50_ns\":%.1f,\"p90_ns\":%.1f,\"p99_ns\":%.1f,\"max_ns\":%.1f,\"mean_ns\":%.1f}", r->name, r->param, r->value, r->nb, r->batch, r->nb_error, r->min, r->p50, r->p90, r->p99, r->max, r->mean);
+            break;
+        default:
+            if (nb_out == 0) {
+                fprintf(out, "libloragw %s, %s backend, ns per call\n", LIBLORAGW_VERSION, backend);
+                fprintf(out, "%-24s %-6s %5s %10s %10s %10s %10s %10s %10s %6s\n", "bench", "param", "value", "min", "p50", "p90", "p99", "max", "mean", "errors");
+            }
+            fprintf(out, "%-24s %-6s %5u %10.1f %10.1f %10.1f %10.1f %10.1f %10.1f %6u\n", r->name, r->param, r->value, r->min, r->p50, r->p90, r->p99, r->max, r->mean, r->nb_error);
+            break;
+    }
+    fflush(out);
+    nb_out += 1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int do_reg_r(void) {
+    int32_t v;
+
+    return lgw_reg_r(LGW_VERSION, &v);
+}
+
+static int do_reg_w(void) {
+    return lgw_reg_w(LGW_IMPLICIT_PAYLOAD_LENGHT, 0x5A);
+}
+
+static int do_reg_wb(void) {
+    return lgw_reg_wb(LGW_RX_DATA_BUF_DATA, burst_buf, burst_len);
+}
+
+static int do_reg_rb(void) {
+    return lgw_reg_rb(LGW_RX_DATA_BUF_DATA, burst_buf, burst_len);
+}
+
+static int do_receive(void) {
+    return lgw_receive(rx_max, rxpkt);
+}
+
+static int do_send(void) {
+    return lgw_send(txpkt);
+}
+
+static int do_send_wait(void) {
+    return lgw_send_wait(1000);
+}
+
+static int do_time_on_air(void) {
+    return (lgw_time_on_air(&txpkt) == 0) ? -1 : 0;
+}
+
+static int do_cnt2utc(void) {
+    struct timespec utc;
+
+    gps_cnt += 1000;
+    return lgw_cnt2utc(gps_ref, gps_cnt, &utc);
+}
+
+static int do_utc2cnt(void) {
+    uint32_t cnt;
+
+    gps_utc.tv_nsec = (gps_utc.tv_nsec + 1000000) % 1000000000;
+    return lgw_utc2cnt(gps_ref, gps_utc, &cnt);
+}
+
+static int do_parse_nmea(void) {
+    return (lgw_parse_nmea(nmea_buf, nmea_len) == INVALID) ? -1 : 0;
+}
+
+static int do_parse_ubx(void) {
+    size_t msg_size;
+
+    return (lgw_parse_ubx(ubx_buf, sizeof ubx_buf, &msg_size) != UBX_NAV_TIMEGPS) ? -1 : 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_spi_sim_conf_s simconf;
+    bool sim = false;
+    bool hw_tx = false;
+    const char *out_path = NULL;
+    unsigned nb_fail = 0;
+    unsigned i;
+    uint8_t ck_a, ck_b, x;
+    int j;
+
+    while ((j = getopt(argc, argv, "hsn:f:o:x")) != -1) {
+        switch (j) {
+            case 'h':
+                usage();
+                return EXIT_SUCCESS;
+            case 's':
+                sim = true;
+                break;
+            case 'n':
+                j = atoi(optarg);
+                if ((j < 1) || (j > SAMPLE_NB_MAX)) {
+                    MSG("ERROR: number of samples must be between 1 and %u\n", SAMPLE_NB_MAX);
+                    return EXIT_FAILURE;
+                }
+                sample_nb = (unsigned)j;
+                break;
+            case 'f':
+                if (strcmp(optarg, "text") == 0) {
+                    out_fmt = OUT_TEXT;
+                } else if (strcmp(optarg, "csv") == 0) {
+                    out_fmt = OUT_CSV;
+                } else if (strcmp(optarg, "json") == 0) {
+                    out_fmt = OUT_JSON;
+                } else {
+                    MSG("ERROR: unknown output format %s\n", optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            case 'x':
+                hw_tx = true;
+                break;
+            default:
+                MSG("ERROR: argument parsing use -h option for help\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+
+    /* the results keep the original stdout, messages printed by the library go to stderr */
+    if (out_path != NULL) {
+        out = fopen(out_path, "w");
+    } else {
+        fflush(stdout);
+        out = fdopen(dup(STDOUT_FILENO), "w");
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+    }
+    if (out == NULL) {
+        MSG("ERROR: failed to open %s\n", (out_path != NULL) ? out_path : "stdout");
+        return EXIT_FAILURE;
+    }
+    sample = malloc(sample_nb * sizeof sample[0]);
+    if (sample == NULL) {
+        MSG("ERROR: failed to allocate the samples\n");
+        return EXIT_FAILURE;
+    }
+
+    if (sim == true) {
+        if (lgw_spi_set_backend(&lgw_spi_sim) != LGW_SPI_SUCCESS) {
+            MSG("ERROR: failed to select the simulator backend\n");
+            return EXIT_FAILURE;
+        }
+        backend = "sim";
+    }
+
+    /* --- REGISTER ACCESSES, CONCENTRATOR NOT STARTED --- */
+    if (lgw_connect(false, 0) != LGW_REG_SUCCESS) {
+        MSG("ERROR: failed to connect to the concentrator\n");
+        return EXIT_FAILURE;
+    }
+    nb_fail += bench_run("lgw_reg_r", "-", 0, BATCH_REG, do_reg_r, NULL) ? 1 : 0;
+    nb_fail += bench_run("lgw_reg_w", "-", 0, BATCH_REG, do_reg_w, NULL) ? 1 : 0;
+    for (i = 0; i < ARRAY_SIZE(burst_size); ++i) {
+        burst_len = burst_size[i];
+        lgw_reg_w(LGW_RX_DATA_BUF_ADDR, 0);
+        nb_fail += bench_run("lgw_reg_wb", "bytes", burst_len, 1, do_reg_wb, NULL) ? 1 : 0;
+        lgw_reg_w(LGW_RX_DATA_BUF_ADDR, 0);
+        nb_fail += bench_run("lgw_reg_rb", "bytes", burst_len, 1, do_reg_rb, NULL) ? 1 : 0;
+    }
+    lgw_disconnect();
+
+    /* --- RX AND TX, CONCENTRATOR STARTED --- */
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 1;
+    lgw_board_setconf(boardconf);
+
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.freq_hz = 868000000;
+    rfconf.rssi_offset = -166.0;
+    rfconf.type = LGW_RADIO_TYPE_SX1257;
+    rfconf.tx_enable = true;
+    lgw_rxrf_setconf(0, rfconf);
+    rfconf.tx_enable = false;
+    lgw_rxrf_setconf(1, rfconf);
+
+    memset(&ifconf, 0, sizeof ifconf);
+    ifconf.enable = true;
+    ifconf.rf_chain = 0;
+    ifconf.freq_hz = -187500;
+    ifconf.datarate = DR_LORA_MULTI;
+    lgw_rxif_setconf(0, ifconf);
+
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        MSG("ERROR: failed to start the concentrator\n");
+        return EXIT_FAILURE;
+    }
+
+    /* on a concentrator, the FIFO holds whatever was received on air */
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rx_pkt_rate = LGW_SPI_SIM_RX_FLOOD;
+    simconf.rx_sf = 7;
+    simconf.rx_size = RX_PKT_SIZE;
+    simconf.tx_time_us = TX_TIME_US;
+    if (sim == true) {
+        lgw_spi_sim_setconf(&simconf);
+    }
+    for (i = 0; i < ARRAY_SIZE(rx_depth); ++i) {
+        rx_max = rx_depth[i];
+        nb_fail += bench_run("lgw_receive", "depth", rx_max, 1, do_receive, NULL) ? 1 : 0;
+    }
+    if (sim == true) {
+        rx_max = LGW_PKT_FIFO_SIZE;
+        for (i = 0; i < ARRAY_SIZE(rx_size); ++i) {
+            simconf.rx_size = rx_size[i];
+            lgw_spi_sim_setconf(&simconf);
+            nb_fail += bench_run("lgw_receive", "size", rx_size[i], 1, do_receive, NULL) ? 1 : 0;
+        }
+        simconf.rx_pkt_rate = 0;
+        lgw_spi_sim_setconf(&simconf);
+    }
+
+    memset(&txpkt, 0, sizeof txpkt);
+    txpkt.freq_hz = 868100000;
+    txpkt.tx_mode = IMMEDIATE;
+    txpkt.rf_chain = 0;
+    txpkt.rf_power = 14;
+    txpkt.modulation = MOD_LORA;
+    txpkt.bandwidth = BW_125KHZ;
+    txpkt.datarate = DR_LORA_SF7;
+    txpkt.coderate = CR_LORA_4_5;
+    txpkt.preamble = 8;
+    txpkt.size = 16;
+    if ((sim == true) || (hw_tx == true)) {
+        /* the wait for the end of the TX is not timed */
+        nb_fail += bench_run("lgw_send", "bytes", txpkt.size, 1, do_send, do_send_wait) ? 1 : 0;
+    }
+    lgw_stop();
+
+    /* --- HOST ONLY FUNCTIONS --- */
+    txpkt.size = 32;
+    for (i = 0; i < ARRAY_SIZE(toa_sf); ++i) {
+        txpkt.datarate = toa_dr[i];
+        nb_fail += bench_run("lgw_time_on_air", "sf", toa_sf[i], BATCH_FAST, do_time_on_air, NULL) ? 1 : 0;
+    }
+
+    gps_ref.systime = time(NULL);
+    gps_ref.count_us = 0;
+    gps_ref.utc.tv_sec = 1500000000;
+    gps_ref.utc.tv_nsec = 0;
+    gps_ref.gps.tv_sec = 1184000000;
+    gps_ref.gps.tv_nsec = 0;
+    gps_ref.xtal_err = 1.0;
+    gps_utc = gps_ref.utc;
+    nb_fail += bench_run("lgw_cnt2utc", "-", 0, BATCH_FAST, do_cnt2utc, NULL) ? 1 : 0;
+    nb_fail += bench_run("lgw_utc2cnt", "-", 0, BATCH_FAST, do_utc2cnt, NULL) ? 1 : 0;
+
+    for (i = 0; i < ARRAY_SIZE(nmea_body); ++i) {
+        x = 0;
+        for (j = 0; nmea_body[i][j] != '\0'; ++j) {
+            x ^= (uint8_t)nmea_body[i][j];
+        }
+        nmea_len = snprintf(nmea_buf, sizeof nmea_buf, "$%s*%02X\r\n", nmea_body[i], x);
+        nb_fail += bench_run(nmea_name[i], "bytes", nmea_len, BATCH_FAST, do_parse_nmea, NULL) ? 1 : 0;
+    }
+
+    /* NAV-TIMEGPS, time of week and week valid */
+    memset(ubx_buf, 0, sizeof ubx_buf);
+    ubx_buf[0] = (char)LGW_GPS_UBX_SYNC_CHAR;
+    ubx_buf[1] = 0x62;
+    ubx_buf[2] = 0x01;
+    ubx_buf[3] = 0x20;
+    ubx_buf[4] = 16;
+    ubx_buf[6] = 0x40; /* iTOW */
+    ubx_buf[7] = 0x42;
+    ubx_buf[8] = 0x0F;
+    ubx_buf[14] = 0xE3; /* week */
+    ubx_buf[15] = 0x07;
+    ubx_buf[16] = 18; /* leap seconds */
+    ubx_buf[17] = 0x07; /* valid */
+    ck_a = 0;
+    ck_b = 0;
+    for (j = 2; j < (6 + 16); ++j) {
+        ck_a += (uint8_t)ubx_buf[j];
+        ck_b += ck_a;
+    }
+    ubx_buf[6 + 16] = (char)ck_a;
+    ubx_buf[6 + 16 + 1] = (char)ck_b;
+    nb_fail += bench_run("lgw_parse_ubx", "bytes", sizeof ubx_buf, BATCH_FAST, do_parse_ubx, NULL) ? 1 : 0;
+
+    if (out_fmt == OUT_JSON) {
+        fprintf(out, "\n]}\n");
+    }
+    fclose(out);
+    free(sample);
+    if (nb_fail != 0) {
+        MSG("ERROR: %u benchmark(s) had errors\n", nb_fail);
+    }
+    return (nb_fail == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,271 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Several threads access registers on different pages and read the counter
+    through the command queue while the main thread receives packets, on the
+    SPI simulator backend. Checks every read returns the last value written by
+    its thread and the packet stream is not disturbed. Then stops the queue
+    while threads keep submitting and checks every command is completed.
+    No concentrator needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset */
+#include <pthread.h>    /* pthread_create pthread_join */
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_spi.h"
+#include "loragw_cmdq.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS & CONSTANTS ------------------------------------------- */
+
+#define REG_THREAD_NB       3
+#define REG_LOOP_NB         2000
+#define CALL_LOOP_NB        500
+#define RX_PKT_NB           20000
+#define RX_PKT_SIZE         16
+#define STOP_THREAD_NB      4
+#define STOP_LOOP_NB        50
+#define STOP_WAIT_MS        1000 /* a command not completed by then was lost by lgw_cmdq_stop */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static const uint16_t reg_id[REG_THREAD_NB] = { LGW_IF_FREQ_0, LGW_TX_OFFSET_I, LGW_CAPTURE_PERIOD }; /* pages 0, 1 and 2 */
+static const int32_t reg_mod[REG_THREAD_NB] = { 4000, 200, 60000 };
+static const int32_t reg_min[REG_THREAD_NB] = { -2000, -100, 0 };
+
+static unsigned nb_error[REG_THREAD_NB + 1];
+static unsigned nb_lost;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* two writes and a read submitted at once, the read must see the second write */
+static void *reg_thread(void *arg) {
+    int k = (int)(intptr_t)arg;
+    struct lgw_cmd_s cmd[3];
+    int32_t v;
+    int i, j;
+
+    for (i = 0; i < REG_LOOP_NB; ++i) {
+        v = reg_min[k] + ((i * 7 + k) % reg_mod[k]);
+        memset(cmd, 0, sizeof cmd);
+        cmd[0].type = LGW_CMD_REG_W;
+        cmd[0].value = reg_min[k];
+        cmd[1].type = LGW_CMD_REG_W;
+        cmd[1].value = v;
+        cmd[2].type = LGW_CMD_REG_R;
+        for (j = 0; j < 3; ++j) {
+            cmd[j].reg_id = reg_id[k];
+            if (lgw_cmdq_submit(&cmd[j]) != LGW_CMDQ_SUCCESS) {
+                nb_error[k] += 1;
+                return NULL;
+            }
+        }
+        for (j = 0; j < 3; ++j) {
+            if ((lgw_cmdq_wait(&cmd[j], -1) != LGW_CMDQ_SUCCESS) || (cmd[j].status != LGW_REG_SUCCESS)) {
+                nb_error[k] += 1;
+            }
+        }
+        if (cmd[2].value != v) {
+            nb_error[k] += 1;
+        }
+    }
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int trigcnt_read(void *arg) {
+    return lgw_get_trigcnt((uint32_t *)arg);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void *call_thread(void *arg) {
+    uint32_t cnt;
+    int i;
+
+    (void)arg;
+    for (i = 0; i < CALL_LOOP_NB; ++i) {
+        if (lgw_cmdq_call(trigcnt_read, &cnt) != LGW_HAL_SUCCESS) {
+            nb_error[REG_THREAD_NB] += 1;
+        }
+    }
+    return NULL;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int noop(void *arg) {
+    (void)arg;
+    return LGW_HAL_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* submit until the queue refuses, every accepted command must be completed */
+static void *stop_thread(void *arg) {
+    struct lgw_cmd_s cmd;
+
+    (void)arg;
+    while (true) {
+        memset(&cmd, 0, sizeof cmd);
+        cmd.type = LGW_CMD_CALL;
+        cmd.fn = noop;
+        if (lgw_cmdq_submit(&cmd) != LGW_CMDQ_SUCCESS) {
+            return NULL;
+        }
+        if (lgw_cmdq_wait(&cmd, STOP_WAIT_MS) != LGW_CMDQ_SUCCESS) {
+            __atomic_fetch_add(&nb_lost, 1, __ATOMIC_RELAXED);
+            return NULL;
+        }
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_spi_sim_conf_s simconf;
+    struct lgw_cmdq_stats_s stats;
+    struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+    pthread_t thread[REG_THREAD_NB + 1];
+    pthread_t stop_th[STOP_THREAD_NB];
+    uint32_t seq, seq_next = 0;
+    unsigned nb_pkt = 0, nb_rx_error = 0, nb_total = 0;
+    uint64_t t0, t_run;
+    int i, j, n;
+
+    printf("Beginning of test for the command queue\n");
+
+    if (lgw_spi_set_backend(&lgw_spi_sim) != LGW_SPI_SUCCESS) {
+        printf("ERROR: failed to select the simulator backend\n");
+        return EXIT_FAILURE;
+    }
+
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 1;
+    lgw_board_setconf(boardconf);
+
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.freq_hz = 868000000;
+    rfconf.rssi_offset = -166.0;
+    rfconf.type = LGW_RADIO_TYPE_SX1257;
+    lgw_rxrf_setconf(0, rfconf);
+    lgw_rxrf_setconf(1, rfconf);
+
+    memset(&ifconf, 0, sizeof ifconf);
+    ifconf.enable = true;
+    ifconf.rf_chain = 0;
+    ifconf.freq_hz = -187500;
+    ifconf.datarate = DR_LORA_MULTI;
+    lgw_rxif_setconf(0, ifconf);
+
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the simulated concentrator\n");
+        return EXIT_FAILURE;
+    }
+
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rx_pkt_rate = LGW_SPI_SIM_RX_FLOOD;
+    simconf.rx_sf = 7;
+    simconf.rx_size = RX_PKT_SIZE;
+    lgw_spi_sim_setconf(&simconf);
+
+    if (lgw_cmdq_start() != LGW_CMDQ_SUCCESS) {
+        printf("ERROR: failed to start the command queue\n");
+        return EXIT_FAILURE;
+    }
+
+    /* --- REGISTER THREADS AND COUNTER THREAD, RX ON THE MAIN THREAD --- */
+    t0 = monotonic_us();
+    for (i = 0; i < REG_THREAD_NB; ++i) {
+        pthread_create(&thread[i], NULL, reg_thread, (void *)(intptr_t)i);
+    }
+    pthread_create(&thread[REG_THREAD_NB], NULL, call_thread, NULL);
+
+    while (nb_pkt < RX_PKT_NB) {
+        n = lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt);
+        if (n == LGW_HAL_ERROR) {
+            nb_rx_error += 1;
+            break;
+        }
+        for (j = 0; j < n; ++j) {
+            seq = rxpkt[j].payload[0] | (rxpkt[j].payload[1] << 8) | (rxpkt[j].payload[2] << 16) | ((uint32_t)rxpkt[j].payload[3] << 24);
+            if ((seq != seq_next) || (rxpkt[j].size != RX_PKT_SIZE) || (rxpkt[j].status != STAT_CRC_OK)) {
+                nb_rx_error += 1;
+            }
+            seq_next = seq + 1;
+            nb_pkt += 1;
+        }
+    }
+    for (i = 0; i <= REG_THREAD_NB; ++i) {
+        pthread_join(thread[i], NULL);
+    }
+    t_run = monotonic_us() - t0;
+
+    lgw_cmdq_get_stats(&stats, false);
+    lgw_cmdq_stop();
+
+    /* --- STOP THE QUEUE WHILE THREADS SUBMIT --- */
+    for (i = 0; i < STOP_LOOP_NB; ++i) {
+        if (lgw_cmdq_start() != LGW_CMDQ_SUCCESS) {
+            printf("ERROR: failed to restart the command queue\n");
+            return EXIT_FAILURE;
+        }
+        for (j = 0; j < STOP_THREAD_NB; ++j) {
+            pthread_create(&stop_th[j], NULL, stop_thread, NULL);
+        }
+        wait_ms(1);
+        lgw_cmdq_stop();
+        for (j = 0; j < STOP_THREAD_NB; ++j) {
+            pthread_join(stop_th[j], NULL);
+        }
+    }
+    lgw_stop();
+
+    for (i = 0; i <= REG_THREAD_NB; ++i) {
+        printf("thread %d: %u error(s)\n", i, nb_error[i]);
+        nb_total += nb_error[i];
+    }
+    printf("%u packets received, %u error(s)\n", nb_pkt, nb_rx_error);
+    printf("%u command(s) lost while stopping the queue\n", nb_lost);
+    printf("%u commands in %u batches (largest %u), %u page groups, %.2f us per command\n", stats.nb_cmd, stats.nb_batch, stats.batch_max, stats.nb_page_group, (stats.nb_cmd > 0) ? (double)t_run / stats.nb_cmd : 0.0);
+    printf("End of test for the command queue\n");
+    return ((nb_total == 0) && (nb_rx_error == 0) && (nb_lost == 0) && (nb_pkt > 0) && (stats.nb_cmd == (REG_THREAD_NB * REG_LOOP_NB * 3 + CALL_LOOP_NB))) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,224 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Drive two simulated concentrators from two threads, each on its own
+    context, and check each one receives its own uninterrupted packet stream
+    and keeps its own GPS time. Check a thread that selected no context cannot
+    connect a concentrator while several contexts exist. No concentrator needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset */
+#include <pthread.h>    /* pthread_create pthread_join */
+
+#include "loragw_hal.h"
+#include "loragw_spi.h"
+#include "loragw_reg.h"
+#include "loragw_ctx.h"
+#include "loragw_aux.h"
+#include "loragw_gps.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS & CONSTANTS ------------------------------------------- */
+
+#define CTX_NB              2
+#define RX_LOOP_NB          1000
+#define RX_PKT_SIZE         20
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct gw_s {
+    struct lgw_context  *ctx;
+    uint32_t            rf_freq;
+    const char          *nmea;      /* RMC sentence parsed by the thread, a different time for each context */
+    unsigned            nb_pkt;
+    unsigned            nb_error;
+    uint32_t            nb_spi;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void *gw_thread(void *arg) {
+    struct gw_s *gw = arg;
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+    struct lgw_spi_stats_s spistats;
+    struct timespec utc_parsed, utc;
+    uint32_t seq, seq_next = 0;
+    int i, j, n;
+
+    lgw_ctx_use(gw->ctx);
+
+    if ((lgw_parse_nmea(gw->nmea, strlen(gw->nmea)) != NMEA_RMC) || (lgw_gps_get(&utc_parsed, NULL, NULL, NULL) != LGW_GPS_SUCCESS)) {
+        printf("ERROR: failed to parse the GPS time at %u Hz\n", gw->rf_freq);
+        gw->nb_error += 1;
+    }
+
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 1;
+    lgw_board_setconf(boardconf);
+
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.freq_hz = gw->rf_freq;
+    rfconf.rssi_offset = -166.0;
+    rfconf.type = LGW_RADIO_TYPE_SX1257;
+    lgw_rxrf_setconf(0, rfconf);
+    lgw_rxrf_setconf(1, rfconf);
+
+    memset(&ifconf, 0, sizeof ifconf);
+    ifconf.enable = true;
+    ifconf.rf_chain = 0;
+    ifconf.freq_hz = -187500;
+    ifconf.datarate = DR_LORA_MULTI;
+    lgw_rxif_setconf(0, ifconf);
+
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the concentrator at %u Hz\n", gw->rf_freq);
+        gw->nb_error += 1;
+        return NULL;
+    }
+
+    for (i = 0; i < RX_LOOP_NB; ++i) {
+        n = lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt);
+        if (n == LGW_HAL_ERROR) {
+            gw->nb_error += 1;
+            break;
+        }
+        for (j = 0; j < n; ++j) {
+            seq = rxpkt[j].payload[0] | (rxpkt[j].payload[1] << 8) | (rxpkt[j].payload[2] << 16) | ((uint32_t)rxpkt[j].payload[3] << 24);
+            if ((seq != seq_next) || (rxpkt[j].size != RX_PKT_SIZE) || (rxpkt[j].status != STAT_CRC_OK)) {
+                gw->nb_error += 1;
+            }
+            if (rxpkt[j].freq_hz != (uint32_t)(gw->rf_freq + ifconf.freq_hz)) {
+                gw->nb_error += 1; /* packet decoded with the configuration of the other context */
+            }
+            seq_next = seq + 1;
+            gw->nb_pkt += 1;
+        }
+    }
+
+    /* the other thread parsed its own time in the meantime */
+    if ((lgw_gps_get(&utc, NULL, NULL, NULL) != LGW_GPS_SUCCESS) || (utc.tv_sec != utc_parsed.tv_sec)) {
+        printf("ERROR: GPS time changed by the other context at %u Hz\n", gw->rf_freq);
+        gw->nb_error += 1;
+    }
+
+    lgw_spi_get_stats(&spistats, false);
+    for (i = 0; i < LGW_SPI_OP_NB; ++i) {
+        gw->nb_spi += spistats.nb[i];
+    }
+    lgw_stop();
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    const char *nmea[CTX_NB] = {
+        "$GPRMC,083559.34,A,4717.11437,N,00833.91522,E,0.004,77.52,091202,,,A*50\r\n",
+        "$GPRMC,101010.00,A,4717.11437,N,00833.91522,E,0.004,77.52,111213,,,A*5D\r\n"
+    };
+    struct gw_s gw[CTX_NB];
+    pthread_t thread[CTX_NB];
+    struct lgw_spi_sim_conf_s simconf;
+    struct lgw_spi_sim_stats_s simstats;
+    unsigned nb_error = 0;
+    uint64_t t0, t_run;
+    int i;
+
+    printf("Beginning of test for concentrator contexts\n");
+
+    if (lgw_spi_set_backend(&lgw_spi_sim) != LGW_SPI_SUCCESS) {
+        printf("ERROR: failed to select the simulator backend\n");
+        return EXIT_FAILURE;
+    }
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rx_pkt_rate = LGW_SPI_SIM_RX_FLOOD;
+    simconf.rx_sf = 7;
+    simconf.rx_size = RX_PKT_SIZE;
+    lgw_spi_sim_setconf(&simconf);
+
+    memset(gw, 0, sizeof gw);
+    for (i = 0; i < CTX_NB; ++i) {
+        gw[i].ctx = lgw_ctx_new(NULL);
+        gw[i].rf_freq = 867000000 + (i * 1000000);
+        gw[i].nmea = nmea[i];
+        if (gw[i].ctx == NULL) {
+            printf("ERROR: failed to create context %d\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    /* this thread never selected a context, it must not fall back on the default one */
+    if ((lgw_ctx_check() != LGW_CTX_ERROR) || (lgw_connect(false, 0) != LGW_REG_ERROR)) {
+        printf("ERROR: a thread with no context selected could connect while several contexts exist\n");
+        nb_error += 1;
+    }
+
+    t0 = monotonic_us();
+    for (i = 0; i < CTX_NB; ++i) {
+        if (pthread_create(&thread[i], NULL, gw_thread, &gw[i]) != 0) {
+            printf("ERROR: failed to create thread %d\n", i);
+            return EXIT_FAILURE;
+        }
+    }
+    for (i = 0; i < CTX_NB; ++i) {
+        pthread_join(thread[i], NULL);
+    }
+    t_run = monotonic_us() - t0;
+
+    for (i = 0; i < CTX_NB; ++i) {
+        printf("context %d: %u packets received, %u error(s), %u SPI transfers\n", i, gw[i].nb_pkt, gw[i].nb_error, gw[i].nb_spi);
+        if ((gw[i].nb_pkt == 0) || (gw[i].nb_error != 0)) {
+            nb_error += 1;
+        }
+        if (lgw_ctx_free(gw[i].ctx) != LGW_CTX_SUCCESS) {
+            printf("ERROR: failed to free context %d\n", i);
+            nb_error += 1;
+        }
+    }
+    if (lgw_ctx_check() != LGW_CTX_SUCCESS) {
+        printf("ERROR: the default context is not used again once the other contexts are freed\n");
+        nb_error += 1;
+    }
+    lgw_spi_sim_get_stats(&simstats);
+    if (simstats.nb_rx_read != (gw[0].nb_pkt + gw[1].nb_pkt)) {
+        nb_error += 1;
+    }
+
+    printf("both concentrators run in %llu us, %u packets read from the simulator\n", (unsigned long long)t_run, simstats.nb_rx_read);
+    printf("End of test for concentrator contexts\n");
+    return (nb_error == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -8,6 +8,9 @@
 
 Description:
     Minimum test program for the loragw_spi 'library'
+    The shadow copy must skip the read of cached registers and never skip it
+    for volatile ones, and a register image must read back the same as field
+    writes, also checked without concentrator with LORAGW_SPI_BACKEND=sim.
 
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Sylvain Miermont
@@ -18,26 +21,66 @@ Maintainer: Sylvain Miermont
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>     /* EXIT_* */
 
 #include "loragw_reg.h"
 
 /* -------------------------------------------------------------------------- */
-/* --- MAIN FUNCTION -------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
 
 #define BURST_TEST_LENGTH    8192
 
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* write a field narrower than a byte twice, check whether the second
+read-modify-write was served by the shadow copy */
+static bool rmw_check(uint16_t register_id, const char *name, int32_t value, bool cached) {
+    uint32_t skipped0, read0, skipped1, read1;
+
+    lgw_reg_w(register_id, value);
+    lgw_reg_cache_stats(&skipped0, &read0);
+    lgw_reg_w(register_id, value);
+    lgw_reg_cache_stats(&skipped1, &read1);
+
+    if (((skipped1 - skipped0) != (cached ? 1u : 0u)) || ((read1 - read0) != (cached ? 0u : 1u))) {
+        printf("ERROR: %s read-modify-write: %u reads skipped, %u reads done, expected %s\n", name, skipped1 - skipped0, read1 - read0, cached ? "cached" : "re-read");
+        return false;
+    }
+    printf("%s read-modify-write %s\n", name, cached ? "served by the shadow copy" : "re-read");
+    return true;
+}
+
+/* read a register back, count a mismatch */
+static bool image_check(uint16_t register_id, const char *name, int32_t value) {
+    int32_t read_value;
+
+    lgw_reg_r(register_id, &read_value);
+    printf("%s = %d (should be %d)\n", name, read_value, value);
+    return (read_value == value);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
 int main()
 {
     int32_t read_value, test_value;
+    uint32_t nb_skipped, nb_read, i_read;
     uint16_t lfsr;
     uint8_t burst_buffout[BURST_TEST_LENGTH];
     uint8_t burst_buffin[BURST_TEST_LENGTH];
+    unsigned nb_error = 0;
     int i;
 
     printf("Beginning of test for loragw_reg.c\n");
 
-    lgw_connect(false, 129E3);
+    if (lgw_connect(false, 129E3) != LGW_REG_SUCCESS) {
+        printf("ERROR: failed to connect to the concentrator\n");
+        return EXIT_FAILURE;
+    }
     /* 2 SPI transactions:
     -> 0x80 0x00        <- 0x00 0x00        forcing page 0
     -> 0x01 0x00        <- 0x00 0x64        checking version
@@ -104,6 +147,46 @@ int main()
     lgw_reg_r(LGW_IF_FREQ_1, &read_value);
     printf("IF_FREQ_1 = %d (should be %d)\n", read_value, test_value);
 
+    /* two fields in the same byte, second write must use the shadow copy */
+    lgw_reg_w(LGW_FRAME_SYNCH_PEAK1_POS, 3);
+    lgw_reg_w(LGW_FRAME_SYNCH_PEAK2_POS, 4);
+    lgw_reg_r(LGW_FRAME_SYNCH_PEAK1_POS, &read_value);
+    printf("FRAME_SYNCH_PEAK1_POS = %d (should be %d)\n", read_value, 3);
+    lgw_reg_r(LGW_FRAME_SYNCH_PEAK2_POS, &read_value);
+    printf("FRAME_SYNCH_PEAK2_POS = %d (should be %d)\n", read_value, 4);
+    lgw_reg_cache_stats(&nb_skipped, &nb_read);
+    printf("read-modify-write: %u reads skipped, %u reads done\n", nb_skipped, nb_read);
+
+    /* registers written by the firmware must be read again at each read-modify-write */
+    nb_error += !rmw_check(LGW_FRAME_SYNCH_PEAK2_POS, "FRAME_SYNCH_PEAK2_POS", 4, true);
+    nb_error += !rmw_check(LGW_IMPLICIT_CRC_EN, "IMPLICIT_CRC_EN", 1, true);
+    nb_error += !rmw_check(LGW_TX_TRIG_DELAYED, "TX_TRIG_DELAYED", 0, false);
+    nb_error += !rmw_check(LGW_CHANN_AGC_GAIN, "CHANN_AGC_GAIN", 7, false);
+    nb_error += !rmw_check(LGW_PA_A_EN, "PA_A_EN", 0, false);
+
+    /* --- REGISTER IMAGE TEST --- */
+
+    /* shadow copy dropped: the byte shared by FRAME_SYNCH_PEAK1_POS and
+    FRAME_SYNCH_PEAK2_POS must be read back, once for its whole range */
+    lgw_reg_cache_enable(true);
+    lgw_reg_cache_stats(&nb_skipped, &nb_read);
+    lgw_reg_image_begin();
+    lgw_reg_w(LGW_FRAME_SYNCH_PEAK1_POS, 6);
+    lgw_reg_w(LGW_PREAMBLE_SYMB1_NB, 4660);
+    lgw_reg_w(LGW_IF_FREQ_2, -1000);
+    lgw_reg_w(LGW_TX_START_DELAY, 1500);
+    lgw_reg_image_end();
+    lgw_reg_cache_stats(&nb_skipped, &i_read);
+    if ((i_read - nb_read) != 1) {
+        printf("ERROR: register image: %u reads done, expected 1\n", i_read - nb_read);
+        ++nb_error;
+    }
+    nb_error += !image_check(LGW_FRAME_SYNCH_PEAK1_POS, "FRAME_SYNCH_PEAK1_POS", 6);
+    nb_error += !image_check(LGW_FRAME_SYNCH_PEAK2_POS, "FRAME_SYNCH_PEAK2_POS", 4);
+    nb_error += !image_check(LGW_PREAMBLE_SYMB1_NB, "PREAMBLE_SYMB1_NB", 4660);
+    nb_error += !image_check(LGW_IF_FREQ_2, "IF_FREQ_2", -1000);
+    nb_error += !image_check(LGW_TX_START_DELAY, "TX_START_DELAY", 1500);
+
     /* --- BURST WRITE AND READ TEST --- */
 
     /* initialize data for SPI test */
@@ -128,7 +211,7 @@ int main()
     /* no SPI transaction */
 
     printf("End of test for loragw_reg.c\n");
-    return 0;
+    return (nb_error == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,155 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Record the SPI traffic of a simulated RX session, replay the trace through
+    the HAL and check the same packets come out, faster than recorded.
+    No concentrator needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset */
+#include <unistd.h>     /* unlink */
+
+#include "loragw_hal.h"
+#include "loragw_spi.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS & CONSTANTS ------------------------------------------- */
+
+#define TRACE_PATH          "/tmp/test_loragw_replay.trc"
+#define RX_LOOP_NB          500
+#define RX_PKT_RATE         20000 /* packets per second generated by the simulator */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* start the HAL, run the RX loop and return a checksum of the packets received */
+static int rx_session(bool live, uint32_t *nb_pkt, uint32_t *sum, uint64_t *t_rx) {
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+    uint64_t t0;
+    int i, j, k, n;
+
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 1;
+    lgw_board_setconf(boardconf);
+
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.freq_hz = 868000000;
+    rfconf.rssi_offset = -166.0;
+    rfconf.type = LGW_RADIO_TYPE_SX1257;
+    lgw_rxrf_setconf(0, rfconf);
+    lgw_rxrf_setconf(1, rfconf);
+
+    memset(&ifconf, 0, sizeof ifconf);
+    ifconf.enable = true;
+    ifconf.rf_chain = 0;
+    ifconf.freq_hz = -187500;
+    ifconf.datarate = DR_LORA_MULTI;
+    lgw_rxif_setconf(0, ifconf);
+
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the concentrator\n");
+        return -1;
+    }
+
+    *nb_pkt = 0;
+    *sum = 0;
+    t0 = monotonic_us();
+    for (i = 0; i < RX_LOOP_NB; ++i) {
+        n = lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt);
+        if (n == LGW_HAL_ERROR) {
+            break;
+        }
+        for (j = 0; j < n; ++j) {
+            *sum = (*sum * 31) + rxpkt[j].count_us + rxpkt[j].size;
+            for (k = 0; k < rxpkt[j].size; ++k) {
+                *sum = (*sum * 31) + rxpkt[j].payload[k];
+            }
+            *nb_pkt += 1;
+        }
+        if (live == true) {
+            wait_ms(1); /* let packets arrive, a replay does not need to wait */
+        }
+    }
+    *t_rx = monotonic_us() - t0;
+
+    lgw_stop();
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    struct lgw_spi_sim_conf_s simconf;
+    struct lgw_spi_replay_conf_s replayconf;
+    struct lgw_spi_replay_stats_s stats;
+    uint32_t nb_rec, sum_rec, nb_play, sum_play;
+    uint64_t t_rec, t_play;
+
+    printf("Beginning of test for SPI trace record and replay\n");
+
+    /* --- RECORD A SIMULATED SESSION --- */
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rx_pkt_rate = RX_PKT_RATE;
+    simconf.rx_sf = 7;
+    simconf.rx_size = 24;
+    lgw_spi_sim_setconf(&simconf);
+    lgw_spi_set_backend(&lgw_spi_sim);
+    if (lgw_spi_trace_start(TRACE_PATH) != LGW_SPI_SUCCESS) {
+        printf("ERROR: failed to create %s\n", TRACE_PATH);
+        return EXIT_FAILURE;
+    }
+    if (rx_session(true, &nb_rec, &sum_rec, &t_rec) != 0) {
+        return EXIT_FAILURE;
+    }
+    lgw_spi_trace_stop();
+    printf("recorded: %u packets in %llu us\n", nb_rec, (unsigned long long)t_rec);
+
+    /* --- REPLAY IT AT FULL SPEED --- */
+    memset(&replayconf, 0, sizeof replayconf);
+    strncpy(replayconf.path, TRACE_PATH, sizeof replayconf.path - 1);
+    replayconf.paced = false;
+    lgw_spi_replay_setconf(&replayconf);
+    lgw_spi_set_backend(&lgw_spi_replay);
+    if (rx_session(false, &nb_play, &sum_play, &t_play) != 0) {
+        return EXIT_FAILURE;
+    }
+    lgw_spi_replay_get_stats(&stats);
+    printf("replayed: %u packets in %llu us, %u records, %u skipped, %u mismatch(es)\n", nb_play, (unsigned long long)t_play, stats.nb_rec, stats.nb_skip, stats.nb_mismatch);
+
+    unlink(TRACE_PATH);
+    printf("End of test for SPI trace record and replay\n");
+    return ((nb_rec > 0) && (nb_play == nb_rec) && (sum_play == sum_rec)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,253 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Drain a simulated concentrator with lgw_receive_ref while holding every
+    packet, until the RX buffer pool is exhausted, then release the packets
+    from another thread and check the payloads were never overwritten.
+    No concentrator needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset */
+#include <pthread.h>    /* pthread_create pthread_join */
+
+#include "loragw_hal.h"
+#include "loragw_spi.h"
+#include "loragw_ctx.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS & CONSTANTS ------------------------------------------- */
+
+#define RX_PKT_SIZE         40
+#define RX_WAIT_MS          100
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE TYPES -------------------------------------------------------- */
+
+struct release_s {
+    struct lgw_pkt_rx_ref_s *pkt;
+    int                     nb_pkt;
+    unsigned                nb_error;
+};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_pkt_rx_ref_s held[LGW_RX_POOL_SIZE];
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static uint32_t pkt_seq(const struct lgw_pkt_rx_ref_s *p) {
+    return p->payload[0] | (p->payload[1] << 8) | (p->payload[2] << 16) | ((uint32_t)p->payload[3] << 24);
+}
+
+/* check the payload still holds what the simulator wrote for that sequence number */
+static bool pkt_intact(const struct lgw_pkt_rx_ref_s *p, uint32_t seq) {
+    int i;
+
+    if ((p->payload == NULL) || (p->size != RX_PKT_SIZE) || (p->status != STAT_CRC_OK) || (pkt_seq(p) != seq)) {
+        return false;
+    }
+    for (i = 4; i < RX_PKT_SIZE; ++i) {
+        if (p->payload[i] != (uint8_t)(seq + i)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* fill held[] from *nb_held up to the pool size, checking the packets follow each other */
+static unsigned drain(int *nb_held, uint32_t *seq_next) {
+    unsigned nb_error = 0;
+    int n, i;
+
+    while (*nb_held < LGW_RX_POOL_SIZE) {
+        n = lgw_receive_ref_wait(LGW_PKT_FIFO_SIZE, &held[*nb_held], RX_WAIT_MS);
+        if (n <= 0) {
+            printf("ERROR: lgw_receive_ref_wait returned %d with %d buffers held\n", n, *nb_held);
+            return nb_error + 1;
+        }
+        for (i = *nb_held; i < *nb_held + n; ++i) {
+            if (!pkt_intact(&held[i], *seq_next)) {
+                nb_error += 1;
+            }
+            *seq_next = pkt_seq(&held[i]) + 1;
+        }
+        *nb_held += n;
+    }
+    return nb_error;
+}
+
+static void *release_thread(void *arg) {
+    struct release_s *rel = arg;
+    int i;
+
+    /* this thread stays on the default context, the packets belong to another one */
+    for (i = 0; i < rel->nb_pkt; ++i) {
+        if ((lgw_rx_ref_release(&rel->pkt[i]) != LGW_HAL_SUCCESS) || (rel->pkt[i].payload != NULL)) {
+            rel->nb_error += 1;
+        }
+    }
+    return NULL;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    struct lgw_context *ctx;
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_spi_sim_conf_s simconf;
+    struct lgw_rx_stats_s rxstats;
+    struct lgw_pkt_rx_ref_s extra, copy;
+    struct release_s rel;
+    pthread_t thread;
+    unsigned nb_error = 0;
+    uint32_t seq_next = 0;
+    int nb_held = 0;
+    int i;
+
+    printf("Beginning of test for zero-copy reception\n");
+
+    if (lgw_spi_set_backend(&lgw_spi_sim) != LGW_SPI_SUCCESS) {
+        printf("ERROR: failed to select the simulator backend\n");
+        return EXIT_FAILURE;
+    }
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rx_pkt_rate = LGW_SPI_SIM_RX_FLOOD;
+    simconf.rx_sf = 7;
+    simconf.rx_size = RX_PKT_SIZE;
+    lgw_spi_sim_setconf(&simconf);
+
+    /* receive on a context of its own, so that releasing from the default one matters */
+    ctx = lgw_ctx_new(NULL);
+    if (ctx == NULL) {
+        printf("ERROR: failed to create a context\n");
+        return EXIT_FAILURE;
+    }
+    lgw_ctx_use(ctx);
+
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 1;
+    lgw_board_setconf(boardconf);
+
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.freq_hz = 868000000;
+    rfconf.rssi_offset = -166.0;
+    rfconf.type = LGW_RADIO_TYPE_SX1257;
+    lgw_rxrf_setconf(0, rfconf);
+    lgw_rxrf_setconf(1, rfconf);
+
+    memset(&ifconf, 0, sizeof ifconf);
+    ifconf.enable = true;
+    ifconf.rf_chain = 0;
+    ifconf.freq_hz = -187500;
+    ifconf.datarate = DR_LORA_MULTI;
+    lgw_rxif_setconf(0, ifconf);
+
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the concentrator\n");
+        return EXIT_FAILURE;
+    }
+
+    /* hold every buffer of the pool */
+    nb_error += drain(&nb_held, &seq_next);
+    lgw_get_rx_stats(&rxstats, true);
+    if ((lgw_receive_ref(1, &extra) != 0) || (lgw_receive_ref_wait(1, &extra, 10) != 0)) {
+        printf("ERROR: a packet was returned while the pool was exhausted\n");
+        nb_error += 1;
+    }
+    lgw_get_rx_stats(&rxstats, false);
+    if (rxstats.nb_pool_empty < 2) {
+        printf("ERROR: %u calls counted on an exhausted pool, expected at least 2\n", rxstats.nb_pool_empty);
+        nb_error += 1;
+    }
+    for (i = 0; i < nb_held; ++i) {
+        if (!pkt_intact(&held[i], pkt_seq(&held[0]) + i)) {
+            printf("ERROR: payload %d was overwritten while held\n", i);
+            nb_error += 1;
+        }
+    }
+    printf("%d buffers held, %u calls on the exhausted pool\n", nb_held, rxstats.nb_pool_empty);
+
+    /* a second reference keeps the buffer when the first one is dropped */
+    copy = held[0];
+    if (lgw_rx_ref_hold(&copy) != LGW_HAL_SUCCESS) {
+        nb_error += 1;
+    }
+    lgw_rx_ref_release(&held[0]);
+    if ((held[0].payload != NULL) || (lgw_receive_ref(1, &extra) != 0) || !pkt_intact(&copy, pkt_seq(&held[1]) - 1)) {
+        printf("ERROR: buffer recycled while a reference was still held\n");
+        nb_error += 1;
+    }
+    if (lgw_rx_ref_release(&held[0]) != LGW_HAL_ERROR) {
+        printf("ERROR: a released descriptor was released again\n");
+        nb_error += 1;
+    }
+    lgw_rx_ref_release(&copy);
+    if ((lgw_receive_ref(1, &extra) != 1) || !pkt_intact(&extra, seq_next)) {
+        printf("ERROR: the last reference did not give the buffer back\n");
+        nb_error += 1;
+    }
+    seq_next += 1;
+    held[0] = extra;
+
+    /* release everything from a thread running on the default context */
+    memset(&rel, 0, sizeof rel);
+    rel.pkt = held;
+    rel.nb_pkt = nb_held;
+    if (pthread_create(&thread, NULL, release_thread, &rel) != 0) {
+        printf("ERROR: failed to create the release thread\n");
+        return EXIT_FAILURE;
+    }
+    pthread_join(thread, NULL);
+    nb_error += rel.nb_error;
+
+    /* the whole pool must be usable again, with no packet lost in between */
+    nb_held = 0;
+    nb_error += drain(&nb_held, &seq_next);
+    printf("%d buffers held again after the release from another thread\n", nb_held);
+    for (i = 0; i < nb_held; ++i) {
+        lgw_rx_ref_release(&held[i]);
+    }
+
+    lgw_stop();
+    if (lgw_ctx_free(ctx) != LGW_CTX_SUCCESS) {
+        printf("ERROR: failed to free the context\n");
+        nb_error += 1;
+    }
+
+    printf("%u error(s)\n", nb_error);
+    printf("End of test for zero-copy reception\n");
+    return (nb_error == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
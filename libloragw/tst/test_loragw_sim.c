@@ -0,0 +1,191 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Run the HAL start, RX and TX paths against the SPI simulator backend, check
+    the packets received and measure the host side cost of each call. Check
+    the TX notification covers the whole packet, default preamble included.
+    No concentrator needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset */
+#include <sys/timerfd.h> /* timerfd_gettime */
+
+#include "loragw_hal.h"
+#include "loragw_spi.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS & CONSTANTS ------------------------------------------- */
+
+#define RX_LOOP_NB          2000
+#define RX_PKT_SIZE         32
+#define TX_LOOP_NB          20
+#define TX_TIME_US          500
+#define TX_NOTIFY_MARGIN_US 20000 /* lgw_send host time, counted in the timer but not in the time on air */
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_spi_sim_conf_s simconf;
+    struct lgw_spi_sim_stats_s simstats;
+    struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+    struct lgw_pkt_tx_s txpkt;
+    uint32_t seq, seq_next = 0;
+    unsigned nb_pkt = 0, nb_error = 0;
+    struct itimerspec its;
+    uint64_t t0, t_start, t_rx, t_tx, left_us, toa_us;
+    int fd;
+    int i, j, n;
+
+    printf("Beginning of test for the SPI simulator backend\n");
+
+    if (lgw_spi_set_backend(&lgw_spi_sim) != LGW_SPI_SUCCESS) {
+        printf("ERROR: failed to select the simulator backend\n");
+        return EXIT_FAILURE;
+    }
+
+    /* --- CONFIGURATION & START --- */
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 1;
+    lgw_board_setconf(boardconf);
+
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.freq_hz = 868000000;
+    rfconf.rssi_offset = -166.0;
+    rfconf.type = LGW_RADIO_TYPE_SX1257;
+    rfconf.tx_enable = true;
+    lgw_rxrf_setconf(0, rfconf);
+    rfconf.tx_enable = false;
+    lgw_rxrf_setconf(1, rfconf);
+
+    memset(&ifconf, 0, sizeof ifconf);
+    ifconf.enable = true;
+    ifconf.rf_chain = 0;
+    ifconf.freq_hz = -187500;
+    ifconf.datarate = DR_LORA_MULTI;
+    lgw_rxif_setconf(0, ifconf);
+
+    t0 = monotonic_us();
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the simulated concentrator\n");
+        return EXIT_FAILURE;
+    }
+    t_start = monotonic_us() - t0;
+
+    /* --- RX: FIFO kept full by the simulator --- */
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rx_pkt_rate = LGW_SPI_SIM_RX_FLOOD;
+    simconf.rx_if_chain = 0;
+    simconf.rx_sf = 9;
+    simconf.rx_size = RX_PKT_SIZE;
+    simconf.tx_time_us = TX_TIME_US;
+    lgw_spi_sim_setconf(&simconf);
+
+    t0 = monotonic_us();
+    for (i = 0; i < RX_LOOP_NB; ++i) {
+        n = lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt);
+        if (n == LGW_HAL_ERROR) {
+            printf("ERROR: lgw_receive failed\n");
+            return EXIT_FAILURE;
+        }
+        for (j = 0; j < n; ++j) {
+            seq = rxpkt[j].payload[0] | (rxpkt[j].payload[1] << 8) | (rxpkt[j].payload[2] << 16) | ((uint32_t)rxpkt[j].payload[3] << 24);
+            if ((seq != seq_next) || (rxpkt[j].size != RX_PKT_SIZE) || (rxpkt[j].status != STAT_CRC_OK) || (rxpkt[j].datarate != DR_LORA_SF9) || (rxpkt[j].if_chain != 0)) {
+                nb_error += 1;
+            }
+            seq_next = seq + 1;
+            nb_pkt += 1;
+        }
+    }
+    t_rx = monotonic_us() - t0;
+    printf("%u packets received, %u error(s), %.2f us per packet\n", nb_pkt, nb_error, (nb_pkt > 0) ? (double)t_rx / nb_pkt : 0.0);
+
+    /* --- TX: immediate packets, each waited for --- */
+    simconf.rx_pkt_rate = 0;
+    lgw_spi_sim_setconf(&simconf);
+    memset(&txpkt, 0, sizeof txpkt);
+    txpkt.freq_hz = 868100000;
+    txpkt.tx_mode = IMMEDIATE;
+    txpkt.rf_chain = 0;
+    txpkt.rf_power = 14;
+    txpkt.modulation = MOD_LORA;
+    txpkt.bandwidth = BW_125KHZ;
+    txpkt.datarate = DR_LORA_SF7;
+    txpkt.coderate = CR_LORA_4_5;
+    txpkt.preamble = 8;
+    txpkt.size = 16;
+
+    t0 = monotonic_us();
+    for (i = 0; i < TX_LOOP_NB; ++i) {
+        if ((lgw_send(txpkt) != LGW_HAL_SUCCESS) || (lgw_send_wait(1000) != LGW_HAL_SUCCESS)) {
+            nb_error += 1;
+        }
+    }
+    t_tx = monotonic_us() - t0;
+    lgw_spi_sim_get_stats(&simstats);
+    if (simstats.nb_tx != TX_LOOP_NB) {
+        nb_error += 1;
+    }
+    printf("%u packets sent, %.2f us per packet\n", simstats.nb_tx, (double)t_tx / TX_LOOP_NB);
+
+    /* --- TX NOTIFICATION: armed at the end of the preamble actually sent, disarmed when unknown --- */
+    fd = lgw_tx_notify_fd();
+    txpkt.datarate = DR_LORA_SF12;
+    txpkt.preamble = 8; /* STD_LORA_PREAMBLE, what lgw_send uses for 0 */
+    toa_us = (uint64_t)lgw_time_on_air(&txpkt) * 1000;
+    txpkt.preamble = 0; /* default preamble, set by lgw_send */
+    if ((fd < 0) || (lgw_send(txpkt) != LGW_HAL_SUCCESS) || (timerfd_gettime(fd, &its) != 0)) {
+        printf("ERROR: failed to send with a TX notification\n");
+        nb_error += 1;
+    } else {
+        left_us = (uint64_t)its.it_value.tv_sec * 1000000 + its.it_value.tv_nsec / 1000;
+        printf("TX notification in %llu us, time on air %llu us\n", (unsigned long long)left_us, (unsigned long long)toa_us);
+        if (left_us + TX_NOTIFY_MARGIN_US < toa_us) {
+            printf("ERROR: TX notification before the end of the packet\n");
+            nb_error += 1;
+        }
+    }
+    txpkt.tx_mode = ON_GPS;
+    if ((lgw_send(txpkt) != LGW_HAL_SUCCESS) || (timerfd_gettime(fd, &its) != 0) || (its.it_value.tv_sec != 0) || (its.it_value.tv_nsec != 0)) {
+        printf("ERROR: TX notification still armed for a packet with an unknown end\n");
+        nb_error += 1;
+    }
+
+    lgw_stop();
+
+    printf("start %llu us, RX %u generated %u read, %u error(s)\n", (unsigned long long)t_start, simstats.nb_rx_gen, simstats.nb_rx_read, nb_error);
+    printf("End of test for the SPI simulator backend\n");
+    return ((nb_error == 0) && (nb_pkt > 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
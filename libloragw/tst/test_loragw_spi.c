@@ -8,7 +8,8 @@
 
 Description:
     Minimum test program for the loragw_spi 'library'
-    Use logic analyser to check the results.
+    Use logic analyser to check the results. The SPI message count of a batched
+    sequence is checked, also without concentrator with LORAGW_SPI_BACKEND=sim.
 
 License: Revised BSD License, see LICENSE.TXT file include in the project
 Maintainer: Sylvain Miermont
@@ -19,7 +20,9 @@ Maintainer: Sylvain Miermont
 /* --- DEPENDANCIES --------------------------------------------------------- */
 
 #include <stdint.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>     /* EXIT_* */
 
 #include "loragw_spi.h"
 
@@ -33,6 +36,30 @@ Maintainer: Sylvain Miermont
 
 #define BURST_TEST_SIZE 2500 /* >> LGW_BURST_CHUNK */
 #define TIMING_REPEAT   1    /* repeat transactions multiple times for timing characterisation */
+#define BATCH_W_NB      16   /* single writes in the batched sequence */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* BATCH_W_NB writes, a small burst write and a read: BATCH_W_NB + 2 messages, or 1 in a batch */
+static uint32_t write_sequence(void *spi_target, uint8_t spi_mux_mode, uint8_t *dataout, bool batch) {
+    uint32_t msg_start = 0, msg_end = 0;
+    uint8_t data;
+    int i;
+
+    lgw_spi_get_msg_cnt(spi_target, &msg_start);
+    if (batch == true)
+        lgw_spi_batch_begin(spi_target);
+    for (i = 0; i < BATCH_W_NB; ++i)
+        lgw_spi_w(spi_target, spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, 0xAA, (uint8_t)i);
+    lgw_spi_wb(spi_target, spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, 0x55, dataout, 4);
+    lgw_spi_r(spi_target, spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, 0x55, &data);
+    if (batch == true)
+        lgw_spi_batch_end(spi_target);
+    lgw_spi_get_msg_cnt(spi_target, &msg_end);
+
+    return msg_end - msg_start;
+}
 
 /* -------------------------------------------------------------------------- */
 /* --- MAIN FUNCTION -------------------------------------------------------- */
@@ -45,6 +72,7 @@ int main()
     uint8_t dataout[BURST_TEST_SIZE];
     uint8_t datain[BURST_TEST_SIZE];
     uint8_t spi_mux_mode = LGW_SPI_MUX_MODE0;
+    uint32_t msg_single, msg_batch;
 
     for (i = 0; i < BURST_TEST_SIZE; ++i) {
         dataout[i] = 0x30 + (i % 10); /* ASCCI code for 0 -> 9 */
@@ -52,7 +80,10 @@ int main()
     }
 
     printf("Beginning of test for loragw_spi.c\n");
-    lgw_spi_open(&spi_target);
+    if (lgw_spi_open(NULL, &spi_target) != LGW_SPI_SUCCESS) {
+        printf("ERROR: failed to open the SPI link\n");
+        return EXIT_FAILURE;
+    }
 
     /* normal R/W test */
     for (i = 0; i < TIMING_REPEAT; ++i)
@@ -72,6 +103,11 @@ int main()
     for (i = 0; i < TIMING_REPEAT; ++i)
         lgw_spi_rb(spi_target, spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, 0x5A, datain, ARRAY_SIZE(datain));
 
+    /* batched writes test, all writes and the final read must go in a single SPI message */
+    msg_single = write_sequence(spi_target, spi_mux_mode, dataout, false);
+    msg_batch = write_sequence(spi_target, spi_mux_mode, dataout, true);
+    printf("SPI messages: %u without batch (expected %u), %u in a batch (expected 1)\n", msg_single, BATCH_W_NB + 2, msg_batch);
+
     /* last read (blocking), just to be sure no to quit before the FTDI buffer is flushed */
     lgw_spi_r(spi_target, spi_mux_mode, LGW_SPI_MUX_TARGET_SX1301, 0x55, &data);
     printf("data received (simple read): %d\n",data);
@@ -79,7 +115,11 @@ int main()
     lgw_spi_close(spi_target);
     printf("End of test for loragw_spi.c\n");
 
-    return 0;
+    if ((msg_single != BATCH_W_NB + 2) || (msg_batch != 1)) {
+        printf("ERROR: the batch did not coalesce the SPI messages\n");
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
 }
 
 /* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,306 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    A writer publishes spectral scan histograms in shared memory as fast as it
+    can while a reader process copies them. Checks every copy the reader gets
+    is a complete publication and the sweeps of a slot never go backwards.
+    Then checks the RSSI levels of random histograms against a scalar
+    computation.
+    No concentrator needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset */
+#include <unistd.h>     /* fork getpid pipe read write */
+#include <sys/mman.h>   /* shm_unlink */
+#include <sys/wait.h>   /* waitpid */
+
+#include "loragw_sscan.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS & CONSTANTS ------------------------------------------- */
+
+#define FREQ_NB             36
+#define SWEEP_NB            20000
+#define LEVEL_HISTO_NB      4000
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static void entry_fill(struct lgw_sscan_entry_s *entry, int index, uint32_t sweep) {
+    int j;
+
+    entry->freq_hz = 863000000 + index * 200000;
+    entry->nb_pts = sweep;
+    entry->sweep = sweep;
+    entry->time_us = sweep;
+    for (j = 0; j < LGW_SSCAN_RSSI_RANGE; ++j) {
+        entry->histo[j] = (uint16_t)(sweep * 7 + j);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static bool entry_check(const struct lgw_sscan_entry_s *entry, int index) {
+    int j;
+
+    if ((entry->freq_hz != (uint32_t)(863000000 + index * 200000)) || (entry->nb_pts != entry->sweep) || (entry->time_us != entry->sweep)) {
+        return false;
+    }
+    for (j = 0; j < LGW_SSCAN_RSSI_RANGE; ++j) {
+        if (entry->histo[j] != (uint16_t)(entry->sweep * 7 + j)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* reads every slot in turn until the writer closes the object */
+static int reader(const char *name, int ready_fd) {
+    struct lgw_sscan_s *sscan;
+    struct lgw_sscan_entry_s entry;
+    uint32_t last[FREQ_NB];
+    unsigned nb_read = 0, nb_empty = 0, nb_error = 0;
+    uint16_t nb_freq;
+    int i, x;
+
+    sscan = lgw_sscan_open(name);
+    if ((sscan == NULL) || (lgw_sscan_info(sscan, &nb_freq, NULL) != LGW_SSCAN_SUCCESS) || (nb_freq != FREQ_NB)) {
+        printf("reader: failed to open %s\n", name);
+        return EXIT_FAILURE;
+    }
+    if (write(ready_fd, "r", 1) != 1) { /* the writer starts once the object is mapped */
+        return EXIT_FAILURE;
+    }
+    memset(last, 0, sizeof last);
+    for (;;) {
+        for (i = 0; i < FREQ_NB; ++i) {
+            x = lgw_sscan_read(sscan, i, &entry);
+            if (x == LGW_SSCAN_EMPTY) {
+                nb_empty += 1;
+                continue;
+            }
+            if (x != LGW_SSCAN_SUCCESS) {
+                break;
+            }
+            if ((entry_check(&entry, i) == false) || (entry.sweep < last[i])) {
+                nb_error += 1;
+            }
+            last[i] = entry.sweep;
+            nb_read += 1;
+        }
+        if (i < FREQ_NB) {
+            break; /* closed by the writer */
+        }
+    }
+    lgw_sscan_close(sscan);
+    printf("reader: %u copies, %u empty, %u error(s), last sweep %u\n", nb_read, nb_empty, nb_error, last[FREQ_NB - 1]);
+    return ((nb_error == 0) && (nb_read > 0)) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* bin by bin, as util_spectral_scan used to print them */
+static void levels_ref(const uint16_t *histo, uint32_t nb_pts, struct lgw_sscan_level_s *level) {
+    static const uint32_t pct[LGW_SSCAN_LEVEL_NB] = LGW_SSCAN_LEVEL_PCT;
+    uint64_t cumu = 0;
+    uint16_t top = 0;
+    int i, k = 0;
+
+    level->nb_pts = 0;
+    level->floor_dbm = LGW_SSCAN_NO_LEVEL;
+    for (i = 0; i < LGW_SSCAN_RSSI_RANGE; i++) {
+        level->nb_pts += histo[i];
+        if (histo[i] > top) {
+            top = histo[i];
+            level->floor_dbm = -i / 2.0;
+        }
+    }
+    if (nb_pts == 0) {
+        nb_pts = level->nb_pts;
+    }
+    for (i = 0; i < LGW_SSCAN_RSSI_RANGE; i++) {
+        cumu += histo[i];
+        while ((nb_pts > 0) && (k < LGW_SSCAN_LEVEL_NB) && (cumu * 100 >= (uint64_t)pct[k] * nb_pts)) {
+            level->pct_dbm[k++] = -i / 2.0;
+        }
+    }
+    while (k < LGW_SSCAN_LEVEL_NB) {
+        level->pct_dbm[k++] = LGW_SSCAN_NO_LEVEL;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* random histograms: a noise bump, sometimes an interferer, sometimes empty or saturated bins */
+static bool levels_check(void) {
+    static uint16_t histo[LEVEL_HISTO_NB * LGW_SSCAN_RSSI_RANGE];
+    static struct lgw_sscan_level_s level[LEVEL_HISTO_NB], ref[LEVEL_HISTO_NB];
+    uint64_t t0, t_vec, t_ref;
+    unsigned nb_error = 0;
+    uint16_t *h;
+    int i, j, k, peak;
+
+    srand(1);
+    memset(histo, 0, sizeof histo);
+    for (i = 0; i < LEVEL_HISTO_NB; ++i) {
+        h = &histo[i * LGW_SSCAN_RSSI_RANGE];
+        if ((i % 97) == 0) {
+            continue; /* empty */
+        }
+        peak = 150 + rand() % 100;
+        for (j = -12; j <= 12; ++j) {
+            if ((peak + j >= 0) && (peak + j < LGW_SSCAN_RSSI_RANGE)) {
+                h[peak + j] = (uint16_t)(rand() % 2000 * (13 - abs(j)) / 13);
+            }
+        }
+        if ((i % 3) == 0) {
+            h[rand() % 120] += (uint16_t)(rand() % 5000);
+        }
+        if ((i % 101) == 0) {
+            h[rand() % LGW_SSCAN_RSSI_RANGE] = 65535;
+        }
+    }
+
+    t0 = monotonic_us();
+    lgw_sscan_levels(histo, LEVEL_HISTO_NB, 0, level);
+    t_vec = monotonic_us() - t0;
+    t0 = monotonic_us();
+    for (i = 0; i < LEVEL_HISTO_NB; ++i) {
+        levels_ref(&histo[i * LGW_SSCAN_RSSI_RANGE], 0, &ref[i]);
+    }
+    t_ref = monotonic_us() - t0;
+
+    for (i = 0; i < LEVEL_HISTO_NB; ++i) {
+        if ((level[i].nb_pts != ref[i].nb_pts) || (level[i].floor_dbm != ref[i].floor_dbm)) {
+            nb_error += 1;
+        }
+        for (k = 0; k < LGW_SSCAN_LEVEL_NB; ++k) {
+            if (level[i].pct_dbm[k] != ref[i].pct_dbm[k]) {
+                nb_error += 1;
+            }
+        }
+    }
+
+    /* fixed number of points, more than some histograms hold */
+    lgw_sscan_levels(histo, LEVEL_HISTO_NB, 30000, level);
+    for (i = 0; i < LEVEL_HISTO_NB; ++i) {
+        levels_ref(&histo[i * LGW_SSCAN_RSSI_RANGE], 30000, &ref[i]);
+        for (k = 0; k < LGW_SSCAN_LEVEL_NB; ++k) {
+            if (level[i].pct_dbm[k] != ref[i].pct_dbm[k]) {
+                nb_error += 1;
+            }
+        }
+    }
+
+    printf("%u histograms: levels in %llu us (%llu us bin by bin), %u error(s)\n", LEVEL_HISTO_NB, (unsigned long long)t_vec, (unsigned long long)t_ref, nb_error);
+    return (nb_error == 0);
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    struct lgw_sscan_s *sscan;
+    struct lgw_sscan_entry_s entry;
+    char name[32];
+    uint32_t sweep;
+    uint16_t nb_freq;
+    pid_t pid;
+    int ready[2];
+    char c;
+    int i, status;
+    bool ok = true;
+
+    printf("Beginning of test for the spectral scan shared memory\n");
+
+    snprintf(name, sizeof name, "/loragw_sscan_test_%d", (int)getpid());
+    sscan = lgw_sscan_create(name, FREQ_NB);
+    if (sscan == NULL) {
+        printf("ERROR: failed to create %s\n", name);
+        return EXIT_FAILURE;
+    }
+    if (lgw_sscan_read(sscan, 0, &entry) != LGW_SSCAN_EMPTY) {
+        printf("ERROR: slot published before the first sweep\n");
+        ok = false;
+    }
+
+    if (pipe(ready) != 0) {
+        printf("ERROR: pipe failed\n");
+        return EXIT_FAILURE;
+    }
+    fflush(stdout); /* or the reader prints it again */
+    pid = fork();
+    if (pid < 0) {
+        printf("ERROR: fork failed\n");
+        return EXIT_FAILURE;
+    }
+    if (pid == 0) {
+        exit(reader(name, ready[1]));
+    }
+    if (read(ready[0], &c, 1) != 1) {
+        printf("ERROR: reader did not start\n");
+        ok = false;
+    }
+
+    for (sweep = 0; sweep < SWEEP_NB; ++sweep) {
+        for (i = 0; i < FREQ_NB; ++i) {
+            entry_fill(&entry, i, sweep);
+            if (lgw_sscan_publish(sscan, i, &entry) != LGW_SSCAN_SUCCESS) {
+                ok = false;
+            }
+        }
+        lgw_sscan_sweep_done(sscan);
+    }
+    if ((lgw_sscan_info(sscan, &nb_freq, &sweep) != LGW_SSCAN_SUCCESS) || (sweep != SWEEP_NB)) {
+        printf("ERROR: %u sweeps counted, %u expected\n", sweep, SWEEP_NB);
+        ok = false;
+    }
+    lgw_sscan_close(sscan);
+
+    waitpid(pid, &status, 0);
+    if (!WIFEXITED(status) || (WEXITSTATUS(status) != EXIT_SUCCESS)) {
+        ok = false;
+    }
+    if (lgw_sscan_open(name) != NULL) {
+        printf("ERROR: object still opened after the writer closed it\n");
+        ok = false;
+    }
+    shm_unlink(name);
+
+    if (levels_check() == false) {
+        ok = false;
+    }
+
+    printf("%u sweeps of %u frequencies published\n", SWEEP_NB, FREQ_NB);
+    printf("End of test for the spectral scan shared memory\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
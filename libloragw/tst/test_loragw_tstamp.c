@@ -0,0 +1,176 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Check the table-driven RX timestamp correction against the arithmetic it
+    replaces, for every modem, bandwidth, SF, CR, CRC and payload size, then
+    time both on a mix of packets. No concentrator needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+
+#include "loragw_hal.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS & CONSTANTS ------------------------------------------- */
+
+#define SET_PPM_ON(bw,dr)   (((bw == BW_125KHZ) && ((dr == DR_LORA_SF11) || (dr == DR_LORA_SF12))) || ((bw == BW_250KHZ) && (dr == DR_LORA_SF12)))
+
+#define BENCH_PKT_NB        4096
+#define BENCH_LOOP_NB       200
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static volatile uint8_t bench_bw = BW_500KHZ; /* read at run time, as the former code read the modem configuration */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+/* per-packet computation formerly done by lgw_receive, kept as reference */
+static uint32_t ref_correction(bool std, uint8_t bandwidth, uint32_t sf, uint32_t cr, uint32_t crc_en, unsigned sz) {
+    uint32_t delay_x, delay_y, delay_z, bw_pow, ppm;
+    const uint8_t dr[13] = { 0, 0, 0, 0, 0, 0, 0, DR_LORA_SF7, DR_LORA_SF8, DR_LORA_SF9, DR_LORA_SF10, DR_LORA_SF11, DR_LORA_SF12 };
+
+    ppm = (SET_PPM_ON((std ? bandwidth : BW_125KHZ), dr[sf])) ? 1 : 0;
+    if (std) {
+        switch (bandwidth) {
+            case BW_125KHZ: delay_x = 64; bw_pow = 1; break;
+            case BW_250KHZ: delay_x = 32; bw_pow = 2; break;
+            case BW_500KHZ: delay_x = 16; bw_pow = 4; break;
+            default: delay_x = 0; bw_pow = 0;
+        }
+    } else {
+        delay_x = 114;
+        bw_pow = 1;
+    }
+    if ((sf >= 6) && (sf <= 12) && (bw_pow > 0)) {
+        if ((2*(sz + 2*crc_en) - (sf-7)) == 0) {
+            delay_y = ( ((1<<(sf-1)) * (sf+1)) + (3 * (1<<(sf-4))) ) / bw_pow;
+            delay_z = 32 * (2*(sz+2*crc_en) + 5) / bw_pow;
+        } else {
+            delay_y = ( ((1<<(sf-1)) * (sf+1)) + ((4 - ppm) * (1<<(sf-4))) ) / bw_pow;
+            delay_z = (16 + 4*cr) * (((2*(sz+2*crc_en)-sf+6) % (sf - 2*ppm)) + 1) / bw_pow;
+        }
+        return delay_x + delay_y + delay_z;
+    }
+    return 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    struct lgw_conf_rxrf_s rfconf = {0};
+    struct lgw_conf_rxif_s ifconf = {0};
+    const uint8_t bw_list[3] = { BW_125KHZ, BW_250KHZ, BW_500KHZ };
+    const uint32_t dr_list[6] = { DR_LORA_SF7, DR_LORA_SF8, DR_LORA_SF9, DR_LORA_SF10, DR_LORA_SF11, DR_LORA_SF12 };
+    static uint8_t pkt_sf[BENCH_PKT_NB], pkt_cr[BENCH_PKT_NB], pkt_crc[BENCH_PKT_NB], pkt_sz[BENCH_PKT_NB];
+    static uint32_t out_ref[BENCH_PKT_NB], out_tab[BENCH_PKT_NB];
+    uint32_t ref, tab;
+    uint32_t rnd = 1;
+    unsigned nb_check = 0, nb_error = 0;
+    uint64_t t0, t_ref, t_tab;
+    int b, d, cr, crc, sz, i, loop;
+
+    printf("Beginning of test for timestamp correction tables\n");
+
+    rfconf.enable = true;
+    rfconf.freq_hz = 868000000;
+    rfconf.type = LGW_RADIO_TYPE_SX1257;
+    lgw_rxrf_setconf(0, rfconf);
+    ifconf.enable = true;
+    ifconf.rf_chain = 0;
+    ifconf.datarate = DR_LORA_MULTI;
+    lgw_rxif_setconf(0, ifconf);
+    ifconf.datarate = 50000;
+    lgw_rxif_setconf(9, ifconf);
+
+    for (b = 0; b < 3; ++b) {
+        ifconf.bandwidth = bw_list[b];
+        ifconf.datarate = DR_LORA_SF7;
+        lgw_rxif_setconf(8, ifconf);
+        lgw_rx_tables_setup();
+
+        /* --- EXHAUSTIVE COMPARISON --- */
+        for (d = 0; d < 6; ++d) {
+            for (cr = CR_LORA_4_5; cr <= CR_LORA_4_8; ++cr) {
+                for (crc = 0; crc < 2; ++crc) {
+                    for (sz = 0; sz < 256; ++sz) {
+                        /* IF chain 0: 'multi' modem, IF chain 8: stand-alone modem */
+                        ref = ref_correction(false, bw_list[b], 7 + d, cr, crc, sz);
+                        tab = lgw_tstamp_correction(0, dr_list[d], cr, crc, sz);
+                        nb_error += (ref != tab) ? 1 : 0;
+                        ref = ref_correction(true, bw_list[b], 7 + d, cr, crc, sz);
+                        tab = lgw_tstamp_correction(8, dr_list[d], cr, crc, sz);
+                        nb_error += (ref != tab) ? 1 : 0;
+                        nb_check += 2;
+                    }
+                }
+            }
+        }
+        ref = ((uint32_t)680000 / 50000) - 20;
+        tab = lgw_tstamp_correction(9, 0, 0, true, 20);
+        nb_error += (ref != tab) ? 1 : 0;
+        nb_check += 1;
+    }
+    printf("%u corrections checked, %u mismatch(es)\n", nb_check, nb_error);
+
+    /* --- MICROBENCHMARK: stand-alone modem at 500kHz, mixed SF, CR, CRC and size --- */
+    for (i = 0; i < BENCH_PKT_NB; ++i) {
+        rnd = rnd * 1103515245 + 12345;
+        pkt_sf[i] = 7 + (rnd >> 16) % 6;
+        pkt_cr[i] = CR_LORA_4_5 + ((rnd >> 8) & 3);
+        pkt_crc[i] = (rnd >> 12) & 1;
+        pkt_sz[i] = rnd >> 24;
+    }
+    t0 = monotonic_us();
+    for (loop = 0; loop < BENCH_LOOP_NB; ++loop) {
+        for (i = 0; i < BENCH_PKT_NB; ++i) {
+            out_ref[i] = ref_correction(true, bench_bw, pkt_sf[i], pkt_cr[i], pkt_crc[i], pkt_sz[i]);
+        }
+    }
+    t_ref = monotonic_us() - t0;
+    t0 = monotonic_us();
+    for (loop = 0; loop < BENCH_LOOP_NB; ++loop) {
+        for (i = 0; i < BENCH_PKT_NB; ++i) {
+            out_tab[i] = lgw_tstamp_correction(8, dr_list[pkt_sf[i] - 7], pkt_cr[i], pkt_crc[i], pkt_sz[i]);
+        }
+    }
+    t_tab = monotonic_us() - t0;
+    printf("%d corrections: arithmetic %.2f ns, tables %.2f ns per packet\n", BENCH_LOOP_NB * BENCH_PKT_NB, 1000.0 * t_ref / (BENCH_LOOP_NB * BENCH_PKT_NB), 1000.0 * t_tab / (BENCH_LOOP_NB * BENCH_PKT_NB));
+    for (i = 0; i < BENCH_PKT_NB; ++i) {
+        if (out_ref[i] != out_tab[i]) {
+            printf("ERROR: packet %d (SF%u, size %u), %u us with arithmetic, %u us with tables\n", i, pkt_sf[i], pkt_sz[i], out_ref[i], out_tab[i]);
+            nb_error += 1;
+        }
+    }
+
+    printf("End of test for timestamp correction tables\n");
+    return (nb_error == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
@@ -0,0 +1,270 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Queue TIMESTAMPED and IMMEDIATE packets on a simulated concentrator and
+    check the order they leave the TX queue in, the packets it refuses or
+    drops, and its counters. No concentrator needed.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf */
+#include <stdlib.h>     /* EXIT_* */
+#include <string.h>     /* memset */
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_spi.h"
+#include "loragw_txq.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS & CONSTANTS ------------------------------------------- */
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+#define TX_LOG_SIZE         16
+#define TX_POLL_MS          1 /* simulator counters polling interval, packets are much longer */
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES ---------------------------------------------------- */
+
+static struct lgw_pkt_tx_s txpkt;
+static uint32_t toa_us;
+
+static uint8_t tx_log[TX_LOG_SIZE]; /* id of the packets triggered, in order */
+static int tx_log_nb;
+static uint32_t tx_log_seen;
+
+static struct lgw_reg_stats_s regstats[LGW_TOTALREGS];
+
+static unsigned nb_error = 0;
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS ---------------------------------------------------- */
+
+static int enqueue(uint8_t id, uint8_t mode, uint32_t count_us) {
+    txpkt.payload[0] = id; /* reported by the simulator as tx_last_id */
+    txpkt.tx_mode = mode;
+    txpkt.count_us = count_us;
+    return lgw_txq_enqueue(&txpkt);
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void expect(const char *what, int result, int expected) {
+    if (result != expected) {
+        printf("ERROR: %s returned %d, expected %d\n", what, result, expected);
+        nb_error += 1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* log the packets triggered in the simulator during duration_ms */
+static void watch(uint32_t duration_ms) {
+    struct lgw_spi_sim_stats_s simstats;
+    uint64_t end_us = monotonic_us() + (uint64_t)duration_ms * 1000;
+
+    tx_log_nb = 0;
+    while (monotonic_us() < end_us) {
+        lgw_spi_sim_get_stats(&simstats);
+        if (simstats.nb_tx != tx_log_seen) {
+            if ((simstats.nb_tx - tx_log_seen) > 1) {
+                printf("ERROR: %u packets triggered between two polls\n", simstats.nb_tx - tx_log_seen);
+                nb_error += 1;
+            }
+            if (tx_log_nb < TX_LOG_SIZE) {
+                tx_log[tx_log_nb++] = simstats.tx_last_id;
+            }
+            tx_log_seen = simstats.nb_tx;
+        }
+        wait_ms(TX_POLL_MS);
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static void expect_order(const char *what, const uint8_t *id, int nb_id) {
+    int i;
+
+    if ((tx_log_nb != nb_id) || (memcmp(tx_log, id, nb_id) != 0)) {
+        printf("ERROR: %s, packets sent in order:", what);
+        for (i = 0; i < tx_log_nb; ++i) {
+            printf(" %u", tx_log[i]);
+        }
+        printf(", expected:");
+        for (i = 0; i < nb_id; ++i) {
+            printf(" %u", id[i]);
+        }
+        printf("\n");
+        nb_error += 1;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main()
+{
+    static const uint8_t order_gap[] = {1, 10, 11, 2, 3};
+    static const uint8_t order_drop[] = {20, 22};
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_spi_sim_conf_s simconf;
+    struct lgw_txq_stats_s txqstats;
+    uint32_t now, slot_us;
+    uint32_t nb_page_switch;
+    int i, x;
+
+    printf("Beginning of test for the TX queue\n");
+
+    if (lgw_spi_set_backend(&lgw_spi_sim) != LGW_SPI_SUCCESS) {
+        printf("ERROR: failed to select the simulator backend\n");
+        return EXIT_FAILURE;
+    }
+
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = 1;
+    lgw_board_setconf(boardconf);
+
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.freq_hz = 868000000;
+    rfconf.rssi_offset = -166.0;
+    rfconf.type = LGW_RADIO_TYPE_SX1257;
+    rfconf.tx_enable = true;
+    lgw_rxrf_setconf(0, rfconf);
+    rfconf.tx_enable = false;
+    lgw_rxrf_setconf(1, rfconf);
+
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        printf("ERROR: failed to start the simulated concentrator\n");
+        return EXIT_FAILURE;
+    }
+
+    memset(&txpkt, 0, sizeof txpkt);
+    txpkt.freq_hz = 868100000;
+    txpkt.rf_chain = 0;
+    txpkt.rf_power = 14;
+    txpkt.modulation = MOD_LORA;
+    txpkt.bandwidth = BW_125KHZ;
+    txpkt.datarate = DR_LORA_SF7;
+    txpkt.coderate = CR_LORA_4_5;
+    txpkt.preamble = 8;
+    txpkt.size = 16;
+    toa_us = lgw_time_on_air(&txpkt) * 1000;
+
+    /* the simulated TX lasts as long as the packet */
+    memset(&simconf, 0, sizeof simconf);
+    simconf.rx_sf = 7;
+    simconf.tx_time_us = toa_us;
+    if (lgw_spi_sim_setconf(&simconf) != LGW_SPI_SUCCESS) {
+        printf("ERROR: failed to configure the simulator\n");
+        return EXIT_FAILURE;
+    }
+
+    if (lgw_txq_start() != LGW_TXQ_SUCCESS) {
+        printf("ERROR: failed to start the TX queue\n");
+        return EXIT_FAILURE;
+    }
+
+    /* --- ordering: TIMESTAMPED first when due, IMMEDIATE in the gaps --- */
+    lgw_reg_get_stats(regstats, &nb_page_switch, true);
+    lgw_get_instcnt(&now);
+    expect("enqueue at +600 ms", enqueue(3, TIMESTAMPED, now + 600000), LGW_TXQ_SUCCESS);
+    expect("enqueue at +40 ms", enqueue(1, TIMESTAMPED, now + 40000), LGW_TXQ_SUCCESS);
+    expect("enqueue at +400 ms", enqueue(2, TIMESTAMPED, now + 400000), LGW_TXQ_SUCCESS);
+    expect("overlapping enqueue", enqueue(9, TIMESTAMPED, now + 400000 + toa_us / 2), LGW_TXQ_COLLISION);
+    expect("late enqueue", enqueue(9, TIMESTAMPED, now + LGW_TXQ_GUARD_US / 2), LGW_TXQ_TOO_LATE);
+    /* no room before the first slot, they must wait for its end */
+    expect("immediate enqueue", enqueue(10, IMMEDIATE, 0), LGW_TXQ_SUCCESS);
+    expect("immediate enqueue", enqueue(11, IMMEDIATE, 0), LGW_TXQ_SUCCESS);
+    watch(800);
+    expect_order("ordering", order_gap, ARRAY_SIZE(order_gap));
+
+    lgw_txq_get_stats(&txqstats, true);
+    printf("queued %u, sent %u, collisions %u, late %u, errors %u, highest depth %u\n", txqstats.nb_pkt_in, txqstats.nb_pkt_sent, txqstats.nb_collision, txqstats.nb_late, txqstats.nb_error, txqstats.depth_max);
+    if ((txqstats.nb_pkt_in != 5) || (txqstats.nb_pkt_sent != 5) || (txqstats.nb_collision != 1) || (txqstats.nb_late != 1) || (txqstats.nb_error != 0) || (txqstats.depth != 0) || (txqstats.depth_max != 5)) {
+        printf("ERROR: unexpected TX queue counters after the ordering test\n");
+        nb_error += 1;
+    }
+
+    /* --- missed window: a TX running too long makes the next packet late --- */
+    simconf.tx_time_us = 200000;
+    lgw_spi_sim_setconf(&simconf);
+    lgw_get_instcnt(&now);
+    expect("enqueue at +100 ms", enqueue(20, TIMESTAMPED, now + 100000), LGW_TXQ_SUCCESS);
+    expect("enqueue at +200 ms", enqueue(21, TIMESTAMPED, now + 200000), LGW_TXQ_SUCCESS);
+    expect("enqueue at +400 ms", enqueue(22, TIMESTAMPED, now + 400000), LGW_TXQ_SUCCESS);
+    watch(600);
+    expect_order("missed window", order_drop, ARRAY_SIZE(order_drop));
+
+    lgw_txq_get_stats(&txqstats, true);
+    printf("queued %u, sent %u, late %u\n", txqstats.nb_pkt_in, txqstats.nb_pkt_sent, txqstats.nb_late);
+    if ((txqstats.nb_pkt_in != 3) || (txqstats.nb_pkt_sent != 2) || (txqstats.nb_late != 1) || (txqstats.depth != 0)) {
+        printf("ERROR: unexpected TX queue counters after the missed window test\n");
+        nb_error += 1;
+    }
+
+    /* the queue extrapolates the counter, GPS event capture is only disabled by the 2 lgw_get_instcnt calls above */
+    lgw_reg_get_stats(regstats, &nb_page_switch, false);
+    printf("GPS event capture disabled %u times\n", regstats[LGW_GPS_EN].nb_w / 2);
+    if (regstats[LGW_GPS_EN].nb_w > (2 * 2 + 2)) {
+        printf("ERROR: GPS event capture disabled by the TX queue polling\n");
+        nb_error += 1;
+    }
+
+    /* --- full queue, far enough in the future for nothing to be sent --- */
+    lgw_get_instcnt(&now);
+    slot_us = toa_us + 2 * LGW_TXQ_GUARD_US;
+    for (i = 0; i < LGW_TXQ_SIZE; ++i) {
+        x = enqueue(30 + i, TIMESTAMPED, now + 5000000 + i * slot_us);
+        if (x != LGW_TXQ_SUCCESS) {
+            printf("ERROR: enqueue %d of %d returned %d\n", i, LGW_TXQ_SIZE, x);
+            nb_error += 1;
+        }
+    }
+    expect("enqueue in a full queue", enqueue(9, TIMESTAMPED, now + 5000000 + LGW_TXQ_SIZE * slot_us), LGW_TXQ_FULL);
+    expect("immediate enqueue in a full queue", enqueue(9, IMMEDIATE, 0), LGW_TXQ_FULL);
+    lgw_txq_get_stats(&txqstats, false);
+    if ((txqstats.depth != LGW_TXQ_SIZE) || (txqstats.nb_pkt_sent != 0)) {
+        printf("ERROR: %u packets waiting and %u sent, expected %d and 0\n", txqstats.depth, txqstats.nb_pkt_sent, LGW_TXQ_SIZE);
+        nb_error += 1;
+    }
+
+    /* stopping discards what was not sent */
+    lgw_txq_stop();
+    lgw_txq_get_stats(&txqstats, false);
+    if (txqstats.depth != 0) {
+        printf("ERROR: %u packets left in the queue after it was stopped\n", txqstats.depth);
+        nb_error += 1;
+    }
+    lgw_stop();
+
+    printf("%u error(s)\n", nb_error);
+    printf("End of test for the TX queue\n");
+    return (nb_error == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
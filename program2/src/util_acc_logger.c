@@ -62,6 +62,7 @@ uint32_t crc32(const uint8_t *buffer, uint32_t length) {
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 #define MSG(args...) fprintf(stderr, args) /* message that is destined to the user */
+#define RX_WAIT_MS 50 /* longest lgw_receive_wait call, keeps the receive windows accurate */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
@@ -73,6 +74,8 @@ uint32_t crc32(const uint8_t *buffer, uint32_t length) {
 #define DEFAULT_FDEV_KHZ            25
 #define DEFAULT_NOTCH_FREQ          129000U /* 129 kHz */
 #define DEFAULT_SX127X_RSSI_OFFSET  -4 /* dB */
+#define CALCACHE_PATH               "/tmp/lgw_calcache.bin" /* radio calibration results, shared by the restarts */
+#define CALCACHE_MAX_AGE_S          3600 /* recalibrate at least every hour */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
@@ -485,7 +488,6 @@ uint8_t parse_bitaddres_to_number(uint8_t n) { //return number of transmitter by
 
 int main(int argc, char **argv) {
 	int i, j;
-	uint8_t status_var;
 	FILE *bfp; /*pointer to binary file*/
 	size_t bfSize = 0;
 	uint8_t *bfBuff;
@@ -494,8 +496,6 @@ int main(int argc, char **argv) {
 	/* configuration file related */
 	const char conf_file_name[] = "conf.json"; /* configuration file */
 
-	struct timespec sleep_time = {0, 3000000}; /* 3 ms */
-
 	/* user entry parameters */
 	int xi = 0;
 	//unsigned int xu = 0;
@@ -533,6 +533,7 @@ int main(int argc, char **argv) {
 	uint8_t clocksource = 1; /* Radio B is source by default */
 	struct lgw_conf_board_s boardconf;
 	struct lgw_conf_lbt_s lbtconf;
+	struct lgw_conf_calcache_s calcacheconf;
 	struct lgw_conf_rxrf_s rfconf;
 	struct lgw_conf_rxif_s ifconf;
 
@@ -691,6 +692,13 @@ int main(int argc, char **argv) {
 	boardconf.clksrc = clocksource;
 	lgw_board_setconf(boardconf);
 
+	/* calibration cache config, restarts on the programming and control frequencies skip the calibration */
+	memset(&calcacheconf, 0, sizeof(calcacheconf));
+	calcacheconf.enable = true;
+	strncpy(calcacheconf.path, CALCACHE_PATH, sizeof(calcacheconf.path) - 1);
+	calcacheconf.max_age_s = CALCACHE_MAX_AGE_S;
+	lgw_calcache_setconf(calcacheconf);
+
 	/* LBT config */
 	if (lbt_enable) {
 		memset(&lbtconf, 0, sizeof(lbtconf));
@@ -956,10 +964,7 @@ int main(int argc, char **argv) {
 				return EXIT_FAILURE;
 			} else {
 				/* wait for packet to finish sending */
-				do {
-					wait_ms(5);
-					lgw_status(TX_STATUS, &status_var); /* get TX status */
-				} while (status_var != TX_FREE);
+				lgw_send_wait(-1);
 				/*printf("OK\n");*/
 			}
 			/* wait inter-packet delay */
@@ -973,13 +978,11 @@ int main(int argc, char **argv) {
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 			if (nb_pkt == LGW_HAL_ERROR) {
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
-			} else if (nb_pkt == 0) {
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			} else {
+			} else if (nb_pkt > 0) {
 				/* local timestamp generation until we get accurate GPS time */
 				//clock_gettime(CLOCK_REALTIME, &fetch_time);
 				//x = gmtime(&(fetch_time.tv_sec));
@@ -1063,10 +1066,7 @@ int main(int argc, char **argv) {
 			return EXIT_FAILURE;
 		} else {
 			/* wait for packet to finish sending */
-			do {
-				wait_ms(5);
-				lgw_status(TX_STATUS, &status_var); /* get TX status */
-			} while (status_var != TX_FREE);
+			lgw_send_wait(-1);
 			printf("OK\n");
 		}
 		/* wait inter-packet delay */
@@ -1080,12 +1080,11 @@ int main(int argc, char **argv) {
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 			if (nb_pkt == LGW_HAL_ERROR) {
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
 			} else if (nb_pkt == 0) {
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
 				//check if 5sec past from last packet receive
 				for (int k = 0; k < 8; ++k) {
 					if ((transmitter_numbers & (1 << k)) == 1 << k) {
@@ -1221,10 +1220,7 @@ int main(int argc, char **argv) {
 			return EXIT_FAILURE;
 		} else {
 			/* wait for packet to finish sending */
-			do {
-				wait_ms(5);
-				lgw_status(TX_STATUS, &status_var); /* get TX status */
-			} while (status_var != TX_FREE);
+			lgw_send_wait(-1);
 			printf("OK\n");
 		}
 		/* wait inter-packet delay */
@@ -1236,13 +1232,11 @@ int main(int argc, char **argv) {
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 			if (nb_pkt == LGW_HAL_ERROR) {
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
-			} else if (nb_pkt == 0) {
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			} else {
+			} else if (nb_pkt > 0) {
 				/* local timestamp generation until we get accurate GPS time */
 				clock_gettime(CLOCK_REALTIME, &fetch_time);
 				x = gmtime(&(fetch_time.tv_sec));
@@ -1304,10 +1298,7 @@ int main(int argc, char **argv) {
 				return EXIT_FAILURE;
 			} else {
 				/* wait for packet to finish sending */
-				do {
-					wait_ms(5);
-					lgw_status(TX_STATUS, &status_var); /* get TX status */
-				} while (status_var != TX_FREE);
+				lgw_send_wait(-1);
 				/*printf("OK\n");*/
 			}
 			/* wait inter-packet delay */
@@ -1324,13 +1315,11 @@ int main(int argc, char **argv) {
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 			if (nb_pkt == LGW_HAL_ERROR) {
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
-			} else if (nb_pkt == 0) {
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			} else {
+			} else if (nb_pkt > 0) {
 				/* local timestamp generation until we get accurate GPS time */
 				clock_gettime(CLOCK_REALTIME, &fetch_time);
 				x = gmtime(&(fetch_time.tv_sec));
@@ -1384,13 +1373,11 @@ int main(int argc, char **argv) {
 			//++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 			if (nb_pkt == LGW_HAL_ERROR) {
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
-			} else if (nb_pkt == 0) {
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			} else {
+			} else if (nb_pkt > 0) {
 				for (i=0; i < nb_pkt; ++i) {
 					p = &rxpkt[i];
 					if (p->status == STAT_CRC_OK) {
@@ -1438,10 +1425,7 @@ int main(int argc, char **argv) {
 			return EXIT_FAILURE;
 		} else {
 			/* wait for packet to finish sending */
-			do {
-				wait_ms(2);
-				lgw_status(TX_STATUS, &status_var); /* get TX status */
-			} while (status_var != TX_FREE);
+			lgw_send_wait(-1);
 			printf("OK\n");
 		}
 		/* wait inter-packet delay */
@@ -1456,13 +1440,11 @@ int main(int argc, char **argv) {
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 			if (nb_pkt == LGW_HAL_ERROR) {
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
-			} else if (nb_pkt == 0) {
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			} else {
+			} else if (nb_pkt > 0) {
 				for (i=0; i < nb_pkt; ++i) {
 					p = &rxpkt[i];
 
@@ -1502,29 +1484,12 @@ int main(int argc, char **argv) {
 		}
 
 
-		//change freq to 869.4MHz (programming)
-		lgw_stop();
-
-		memset(&rfconf, 0, sizeof(rfconf));
-		rfconf.enable = true;
-		rfconf.freq_hz = fprog_target;
-		rfconf.rssi_offset = DEFAULT_RSSI_OFFSET;
-		rfconf.type = radio_type;
-		rfconf.tx_enable = true;
-		rfconf.tx_notch_freq = tx_notch_freq;
-		lgw_rxrf_setconf(0, rfconf);
-
-		/* Start concentrator */
-		cycle_count = 0;
-		while (lgw_start() != LGW_HAL_SUCCESS) {
-			cycle_count++;
-			wait_ms(300); /*RF set config error if no delay)*/
-			if (cycle_count == 10) {
-				MSG("ERROR: failed to start the concentrator\n");
-				return EXIT_FAILURE;
-			}
+		//change freq to 869.4MHz (programming), only the radio PLL is reprogrammed
+		if (lgw_rxrf_retune(0, fprog_target) != LGW_HAL_SUCCESS) {
+			MSG("ERROR: failed to retune the concentrator\n");
+			return EXIT_FAILURE;
 		}
-		MSG("INFO: concentrator started, packet can be sent\n");
+		MSG("INFO: concentrator retuned, packet can be sent\n");
 
 		/* fill-up payload and parameters */
 		memset(&txpkt, 0, sizeof(txpkt));
@@ -1558,10 +1523,7 @@ int main(int argc, char **argv) {
 			return EXIT_FAILURE;
 		} else {
 			/* wait for packet to finish sending */
-			do {
-				wait_ms(5);
-				lgw_status(TX_STATUS, &status_var); /* get TX status */
-			} while (status_var != TX_FREE);
+			lgw_send_wait(-1);
 			printf("OK\n");
 		}
 		/* wait inter-packet delay */
@@ -1576,13 +1538,11 @@ int main(int argc, char **argv) {
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 			if (nb_pkt == LGW_HAL_ERROR) {
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
-			} else if (nb_pkt == 0) {
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			} else {
+			} else if (nb_pkt > 0) {
 				for (i=0; i < nb_pkt; ++i) {
 					p = &rxpkt[i];
 
@@ -1645,10 +1605,7 @@ int main(int argc, char **argv) {
 						return EXIT_FAILURE;
 					} else {
 						/* wait for packet to finish sending */
-						do {
-							wait_ms(2);
-							lgw_status(TX_STATUS, &status_var); /* get TX status */
-						} while (status_var != TX_FREE);
+						lgw_send_wait(-1);
 						printf("Packet %d send OK\n", i/129 - 1);
 					}
 					/* wait inter-packet delay */
@@ -1672,10 +1629,7 @@ int main(int argc, char **argv) {
 			return EXIT_FAILURE;
 		} else {
 			/* wait for packet to finish sending */
-			do {
-				wait_ms(2);
-				lgw_status(TX_STATUS, &status_var); /* get TX status */
-			} while (status_var != TX_FREE);
+			lgw_send_wait(-1);
 			printf("Last packet %d send OK\n", i/129);
 		}
 		/* wait inter-packet delay */
@@ -1690,13 +1644,11 @@ int main(int argc, char **argv) {
       ++cycle_count;
 
       /* fetch packets */
-      nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+      nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
       if (nb_pkt == LGW_HAL_ERROR) {
         MSG("ERROR: failed packet fetch, exiting\n");
         return EXIT_FAILURE;
-      } else if (nb_pkt == 0) {
-        clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-      } else {
+      } else if (nb_pkt > 0) {
         for (i=0; i < nb_pkt; ++i) {
           p = &rxpkt[i];
 
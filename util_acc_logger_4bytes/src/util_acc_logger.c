@@ -37,6 +37,7 @@
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 #define MSG(args...) fprintf(stderr, args) /* message that is destined to the user */
+#define RX_WAIT_MS 50 /* longest lgw_receive_ref_wait call, keeps the receive windows accurate */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
@@ -57,6 +58,9 @@ struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
 static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
 static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
 
+/* packets of the last fetch, their payload stays in the RX buffer pool until the next fetch */
+static int nb_held = 0;
+
 /* configuration variables needed by the application  */
 uint64_t lgwm = 123456789U; /* LoRa gateway MAC address */
 char lgwm_str[17];
@@ -119,6 +123,10 @@ static struct lgw_tx_gain_lut_s txgain_lut =
 
 static void sig_handler(int sigio);
 
+static int receive_pkts(struct lgw_pkt_rx_ref_s *pkt, uint8_t max_pkt);
+
+static void release_pkts(struct lgw_pkt_rx_ref_s *pkt);
+
 void usage (void);
 
 uint16_t time_interval_ms (struct timespec *time_point);
@@ -142,6 +150,31 @@ static void sig_handler(int sigio)
 	}
 }
 
+/* give back the buffers of the previous fetch, then wait for new packets */
+static int receive_pkts(struct lgw_pkt_rx_ref_s *pkt, uint8_t max_pkt)
+{
+	int nb_pkt;
+
+	release_pkts(pkt);
+	nb_pkt = lgw_receive_ref_wait(max_pkt, pkt, RX_WAIT_MS);
+	if (nb_pkt > 0)
+	{
+		nb_held = nb_pkt;
+	}
+	return nb_pkt;
+}
+
+static void release_pkts(struct lgw_pkt_rx_ref_s *pkt)
+{
+	int i;
+
+	for (i = 0; i < nb_held; ++i)
+	{
+		lgw_rx_ref_release(&pkt[i]);
+	}
+	nb_held = 0;
+}
+
 /* describe command line options */
 void usage(void)
 {
@@ -400,13 +433,10 @@ void close_csv_log(void)
 int main(int argc, char **argv)
 {
 	int i, j;
-	uint8_t status_var;
 
 	/* configuration file related */
 	const char conf_file_name[] = "conf.json"; /* configuration file */
 
-	struct timespec sleep_time = {0, 3000000}; /* 3 ms */
-
 	/* user entry parameters */
 	int xi = 0;
 	//unsigned int xu = 0;
@@ -453,8 +483,8 @@ int main(int argc, char **argv)
 	struct lgw_pkt_tx_s txpkt; /* array containing 1 outbound packet + metadata */
 
 	/* allocate memory for packet fetching and processing */
-	struct lgw_pkt_rx_s rxpkt[16]; /* array containing up to 16 inbound packets metadata */
-	struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
+	struct lgw_pkt_rx_ref_s rxpkt[16]; /* array containing up to 16 inbound packets metadata, payloads stay in the HAL RX pool */
+	struct lgw_pkt_rx_ref_s *p; /* pointer on a RX packet */
 	int nb_pkt;
 
 	/* local timestamp variables until we get accurate GPS time */
@@ -874,12 +904,7 @@ int main(int argc, char **argv)
 			else
 			{
 				/* wait for packet to finish sending */
-				do
-				{
-					wait_ms(5);
-					lgw_status(TX_STATUS, &status_var); /* get TX status */
-				}
-				while (status_var != TX_FREE);
+				lgw_send_wait(-1);
 				/*printf("OK\n");*/
 			}
 			/* wait inter-packet delay */
@@ -894,17 +919,13 @@ int main(int argc, char **argv)
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = receive_pkts(rxpkt, ARRAY_SIZE(rxpkt));
 			if (nb_pkt == LGW_HAL_ERROR)
 			{
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
 			}
-			else if (nb_pkt == 0)
-			{
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			}
-			else
+			else if (nb_pkt > 0)
 			{
 				/* local timestamp generation until we get accurate GPS time */
 				//clock_gettime(CLOCK_REALTIME, &fetch_time);
@@ -1001,12 +1022,7 @@ int main(int argc, char **argv)
 		else
 		{
 			/* wait for packet to finish sending */
-			do
-			{
-				wait_ms(5);
-				lgw_status(TX_STATUS, &status_var); /* get TX status */
-			}
-			while (status_var != TX_FREE);
+			lgw_send_wait(-1);
 			printf("OK\n");
 		}
 		/* wait inter-packet delay */
@@ -1021,7 +1037,7 @@ int main(int argc, char **argv)
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = receive_pkts(rxpkt, ARRAY_SIZE(rxpkt));
 			if (nb_pkt == LGW_HAL_ERROR)
 			{
 				MSG("ERROR: failed packet fetch, exiting\n");
@@ -1029,7 +1045,6 @@ int main(int argc, char **argv)
 			}
 			else if (nb_pkt == 0)
 			{
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
 				//check if 5sec past from last packet receive
 				for (int k = 0; k < 8; ++k) {
           if ((transmitter_numbers & (1 << k)) == 1 << k)
@@ -1185,12 +1200,7 @@ int main(int argc, char **argv)
 		else
 		{
 			/* wait for packet to finish sending */
-			do
-			{
-				wait_ms(5);
-				lgw_status(TX_STATUS, &status_var); /* get TX status */
-			}
-			while (status_var != TX_FREE);
+			lgw_send_wait(-1);
 			printf("OK\n");
 		}
 		/* wait inter-packet delay */
@@ -1203,17 +1213,13 @@ int main(int argc, char **argv)
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = receive_pkts(rxpkt, ARRAY_SIZE(rxpkt));
 			if (nb_pkt == LGW_HAL_ERROR)
 			{
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
 			}
-			else if (nb_pkt == 0)
-			{
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			}
-			else
+			else if (nb_pkt > 0)
 			{
 				/* local timestamp generation until we get accurate GPS time */
 				clock_gettime(CLOCK_REALTIME, &fetch_time);
@@ -1289,12 +1295,7 @@ int main(int argc, char **argv)
 			else
 			{
 				/* wait for packet to finish sending */
-				do
-				{
-					wait_ms(5);
-					lgw_status(TX_STATUS, &status_var); /* get TX status */
-				}
-				while (status_var != TX_FREE);
+				lgw_send_wait(-1);
 				/*printf("OK\n");*/
 			}
 			/* wait inter-packet delay */
@@ -1312,17 +1313,13 @@ int main(int argc, char **argv)
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = receive_pkts(rxpkt, ARRAY_SIZE(rxpkt));
 			if (nb_pkt == LGW_HAL_ERROR)
 			{
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
 			}
-			else if (nb_pkt == 0)
-			{
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			}
-			else
+			else if (nb_pkt > 0)
 			{
 				/* local timestamp generation until we get accurate GPS time */
 				clock_gettime(CLOCK_REALTIME, &fetch_time);
@@ -1383,17 +1380,13 @@ int main(int argc, char **argv)
 		++cycle_count;
 
 		/* fetch packets */
-		nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+		nb_pkt = receive_pkts(rxpkt, ARRAY_SIZE(rxpkt));
 		if (nb_pkt == LGW_HAL_ERROR)
 		{
 			MSG("ERROR: failed packet fetch, exiting\n");
 			return EXIT_FAILURE;
 		}
-		else if (nb_pkt == 0)
-		{
-			clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-		}
-		else
+		else if (nb_pkt > 0)
 		{
 			/* local timestamp generation until we get accurate GPS time */
 			clock_gettime(CLOCK_REALTIME, &fetch_time);
@@ -1558,6 +1551,7 @@ int main(int argc, char **argv)
 	}
 
 	/* clean up before leaving */
+	release_pkts(rxpkt);
 	lgw_stop();
 
 	printf("Exiting program\n");
@@ -69,6 +69,7 @@ uint32_t crc32(const uint8_t *buffer, uint32_t length) {
 
 #define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
 #define MSG(args...) fprintf(stderr, args) /* message that is destined to the user */
+#define RX_WAIT_MS 50 /* longest lgw_receive_wait call, keeps the receive windows accurate */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE CONSTANTS ---------------------------------------------------- */
@@ -491,7 +492,6 @@ uint8_t parse_bitaddres_to_number(uint8_t n) { //return number of transmitter by
 
 int main(int argc, char **argv) {
 	int i, j;
-	uint8_t status_var;
 	FILE *bfp; /*pointer to binary file*/
 	size_t bfSize = 0;
 	size_t bfSizeReal = 0;
@@ -501,8 +501,6 @@ int main(int argc, char **argv) {
 	/* configuration file related */
 	const char conf_file_name[] = "conf.json"; /* configuration file */
 
-	struct timespec sleep_time = {0, 3000000}; /* 3 ms */
-
 	/* user entry parameters */
 	int xi = 0;
 	//unsigned int xu = 0;
@@ -962,13 +960,11 @@ int main(int argc, char **argv) {
 			//++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 			if (nb_pkt == LGW_HAL_ERROR) {
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
-			} else if (nb_pkt == 0) {
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			} else {
+			} else if (nb_pkt > 0) {
 				for (i=0; i < nb_pkt; ++i) {
 					p = &rxpkt[i];
 					if (p->status == STAT_CRC_OK) {
@@ -1021,10 +1017,7 @@ int main(int argc, char **argv) {
 			return EXIT_FAILURE;
 		} else {
 			/* wait for packet to finish sending */
-			do {
-				wait_ms(2);
-				lgw_status(TX_STATUS, &status_var); /* get TX status */
-			} while (status_var != TX_FREE);
+			lgw_send_wait(-1);
 			printf("OK\n");
 		}
 		/* wait inter-packet delay */
@@ -1051,13 +1044,11 @@ int main(int argc, char **argv) {
 			time(&now_time);
 			open_raw_data_log();
 			while ((quit_sig != 1) && (exit_sig != 1)) {
-				nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+				nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 				if (nb_pkt == LGW_HAL_ERROR) {
 					MSG("ERROR: failed packet fetch, exiting\n");
 					fclose(rawData_file);
 					return EXIT_FAILURE;
-				} else if (nb_pkt == 0) {
-					clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
 				}
 				for (i=0,j=1; i < nb_pkt; ++i) {
 					p = &rxpkt[i];
@@ -1104,13 +1095,11 @@ int main(int argc, char **argv) {
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 			if (nb_pkt == LGW_HAL_ERROR) {
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
-			} else if (nb_pkt == 0) {
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			} else {
+			} else if (nb_pkt > 0) {
 				for (i=0; i < nb_pkt; ++i) {
 					p = &rxpkt[i];
 
@@ -1151,29 +1140,12 @@ int main(int argc, char **argv) {
 		}
 
 
-		//change freq to 869.4MHz (programming)
-		lgw_stop();
-
-		memset(&rfconf, 0, sizeof(rfconf));
-		rfconf.enable = true;
-		rfconf.freq_hz = fprog_target;
-		rfconf.rssi_offset = DEFAULT_RSSI_OFFSET;
-		rfconf.type = radio_type;
-		rfconf.tx_enable = true;
-		rfconf.tx_notch_freq = tx_notch_freq;
-		lgw_rxrf_setconf(0, rfconf);
-
-		/* Start concentrator */
-		cycle_count = 0;
-		while (lgw_start() != LGW_HAL_SUCCESS) {
-			cycle_count++;
-			wait_ms(300); /*RF set config error if no delay)*/
-			if (cycle_count == 10) {
-				MSG("ERROR: failed to start the concentrator\n");
-				return EXIT_FAILURE;
-			}
+		//change freq to 869.4MHz (programming), only the radio PLL is reprogrammed
+		if (lgw_rxrf_retune(0, fprog_target) != LGW_HAL_SUCCESS) {
+			MSG("ERROR: failed to retune the concentrator\n");
+			return EXIT_FAILURE;
 		}
-		MSG("INFO: concentrator started, packet can be sent\n");
+		MSG("INFO: concentrator retuned, packet can be sent\n");
 
 		/* fill-up payload and parameters */
 		memset(&txpkt, 0, sizeof(txpkt));
@@ -1208,10 +1180,7 @@ int main(int argc, char **argv) {
 			return EXIT_FAILURE;
 		} else {
 			/* wait for packet to finish sending */
-			do {
-				wait_ms(5);
-				lgw_status(TX_STATUS, &status_var); /* get TX status */
-			} while (status_var != TX_FREE);
+			lgw_send_wait(-1);
 			printf("OK\n");
 		}
 		/* wait inter-packet delay */
@@ -1226,13 +1195,11 @@ int main(int argc, char **argv) {
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 			if (nb_pkt == LGW_HAL_ERROR) {
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
-			} else if (nb_pkt == 0) {
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			} else {
+			} else if (nb_pkt > 0) {
 				for (i=0; i < nb_pkt; ++i) {
 					p = &rxpkt[i];
 
@@ -1303,10 +1270,7 @@ int main(int argc, char **argv) {
 				return EXIT_FAILURE;
 			} else {
 				/* wait for packet to finish sending */
-				do {
-					wait_ms(2);
-					lgw_status(TX_STATUS, &status_var); /* get TX status */
-				} while (status_var != TX_FREE);
+				lgw_send_wait(-1);
 				printf("Packet %d send OK\n", sendBuffer[0]);
 				j += PROG_BUF_SIZE - 1;
 				
@@ -1334,13 +1298,11 @@ int main(int argc, char **argv) {
 			++cycle_count;
 
 			/* fetch packets */
-			nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+			nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 			if (nb_pkt == LGW_HAL_ERROR) {
 				MSG("ERROR: failed packet fetch, exiting\n");
 				return EXIT_FAILURE;
-			} else if (nb_pkt == 0) {
-				clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-			} else {
+			} else if (nb_pkt > 0) {
 				for (i=0; i < nb_pkt; ++i) {
 					p = &rxpkt[i];
 
@@ -1407,10 +1369,7 @@ int main(int argc, char **argv) {
 						return EXIT_FAILURE;
 					} else {
 						/* wait for packet to finish sending */
-						do {
-							wait_ms(2);
-							lgw_status(TX_STATUS, &status_var); /* get TX status */
-						} while (status_var != TX_FREE);
+						lgw_send_wait(-1);
 						printf("Packet %d send OK\n", sendBuffer[0]);	
 						
 					 }
@@ -1428,13 +1387,11 @@ int main(int argc, char **argv) {
 				++cycle_count;
 
 				/* fetch packets */
-				nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
+				nb_pkt = lgw_receive_wait(ARRAY_SIZE(rxpkt), rxpkt, RX_WAIT_MS);
 				if (nb_pkt == LGW_HAL_ERROR) {
 					MSG("ERROR: failed packet fetch, exiting\n");
 					return EXIT_FAILURE;
-				} else if (nb_pkt == 0) {
-					clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-				} else {
+				} else if (nb_pkt > 0) {
 					for (i=0; i < nb_pkt; ++i) {
 						p = &rxpkt[i];
 
@@ -0,0 +1,667 @@
+/*
+ / _____)             _              | |
+( (____  _____ ____ _| |_ _____  ____| |__
+ \____ \| ___ |    (_   _) ___ |/ ___)  _ \
+ _____) ) ____| | | || |_| ____( (___| | | |
+(______/|_____)_|_|_| \__)_____)\____)_| |_|
+  (C)2013 Semtech-Cycleo
+
+Description:
+    Run the concentrator in RX for a while, then dump the HAL access
+    statistics: registers sorted by SPI time, page switches, read-modify-write
+    cache efficiency and SPI latency histograms per kind of transfer.
+
+License: Revised BSD License, see LICENSE.TXT file include in the project
+*/
+
+
+/* -------------------------------------------------------------------------- */
+/* --- DEPENDANCIES --------------------------------------------------------- */
+
+/* fix an issue between POSIX and C99 */
+#if __STDC_VERSION__ >= 199901L
+    #define _XOPEN_SOURCE 600
+#else
+    #define _XOPEN_SOURCE 500
+#endif
+
+#include <stdint.h>     /* C99 types */
+#include <stdbool.h>    /* bool type */
+#include <stdio.h>      /* printf fprintf */
+#include <string.h>     /* memset */
+#include <signal.h>     /* sigaction */
+#include <unistd.h>     /* getopt */
+#include <stdlib.h>     /* EXIT_* qsort */
+
+#include "loragw_hal.h"
+#include "loragw_reg.h"
+#include "loragw_spi.h"
+#include "loragw_aux.h"
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE MACROS ------------------------------------------------------- */
+
+#define ARRAY_SIZE(a)   (sizeof(a) / sizeof((a)[0]))
+#define MSG(args...)    fprintf(stderr, args) /* message that is destined to the user */
+#define REG_NAME(r)     [r] = #r
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE CONSTANTS ---------------------------------------------------- */
+
+#define DEFAULT_RSSI_OFFSET     -166.0
+#define DEFAULT_NOTCH_FREQ      129000U
+#define DEFAULT_DURATION_S      10
+#define DEFAULT_TOP_NB          20
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
+
+/* signal handling variables */
+struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
+static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
+static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
+
+static struct lgw_reg_stats_s reg_stats[LGW_TOTALREGS];
+
+static const char *spi_op_name[LGW_SPI_OP_NB] = { "write", "read", "burst write", "burst read", "batch end" };
+
+static const char *reg_name[LGW_TOTALREGS] = {
+    REG_NAME(LGW_PAGE_REG),
+    REG_NAME(LGW_SOFT_RESET),
+    REG_NAME(LGW_VERSION),
+    REG_NAME(LGW_RX_DATA_BUF_ADDR),
+    REG_NAME(LGW_RX_DATA_BUF_DATA),
+    REG_NAME(LGW_TX_DATA_BUF_ADDR),
+    REG_NAME(LGW_TX_DATA_BUF_DATA),
+    REG_NAME(LGW_CAPTURE_RAM_ADDR),
+    REG_NAME(LGW_CAPTURE_RAM_DATA),
+    REG_NAME(LGW_MCU_PROM_ADDR),
+    REG_NAME(LGW_MCU_PROM_DATA),
+    REG_NAME(LGW_RX_PACKET_DATA_FIFO_NUM_STORED),
+    REG_NAME(LGW_RX_PACKET_DATA_FIFO_ADDR_POINTER),
+    REG_NAME(LGW_RX_PACKET_DATA_FIFO_STATUS),
+    REG_NAME(LGW_RX_PACKET_DATA_FIFO_PAYLOAD_SIZE),
+    REG_NAME(LGW_MBWSSF_MODEM_ENABLE),
+    REG_NAME(LGW_CONCENTRATOR_MODEM_ENABLE),
+    REG_NAME(LGW_FSK_MODEM_ENABLE),
+    REG_NAME(LGW_GLOBAL_EN),
+    REG_NAME(LGW_CLK32M_EN),
+    REG_NAME(LGW_CLKHS_EN),
+    REG_NAME(LGW_START_BIST0),
+    REG_NAME(LGW_START_BIST1),
+    REG_NAME(LGW_CLEAR_BIST0),
+    REG_NAME(LGW_CLEAR_BIST1),
+    REG_NAME(LGW_BIST0_FINISHED),
+    REG_NAME(LGW_BIST1_FINISHED),
+    REG_NAME(LGW_MCU_AGC_PROG_RAM_BIST_STATUS),
+    REG_NAME(LGW_MCU_ARB_PROG_RAM_BIST_STATUS),
+    REG_NAME(LGW_CAPTURE_RAM_BIST_STATUS),
+    REG_NAME(LGW_CHAN_FIR_RAM0_BIST_STATUS),
+    REG_NAME(LGW_CHAN_FIR_RAM1_BIST_STATUS),
+    REG_NAME(LGW_CORR0_RAM_BIST_STATUS),
+    REG_NAME(LGW_CORR1_RAM_BIST_STATUS),
+    REG_NAME(LGW_CORR2_RAM_BIST_STATUS),
+    REG_NAME(LGW_CORR3_RAM_BIST_STATUS),
+    REG_NAME(LGW_CORR4_RAM_BIST_STATUS),
+    REG_NAME(LGW_CORR5_RAM_BIST_STATUS),
+    REG_NAME(LGW_CORR6_RAM_BIST_STATUS),
+    REG_NAME(LGW_CORR7_RAM_BIST_STATUS),
+    REG_NAME(LGW_MODEM0_RAM0_BIST_STATUS),
+    REG_NAME(LGW_MODEM1_RAM0_BIST_STATUS),
+    REG_NAME(LGW_MODEM2_RAM0_BIST_STATUS),
+    REG_NAME(LGW_MODEM3_RAM0_BIST_STATUS),
+    REG_NAME(LGW_MODEM4_RAM0_BIST_STATUS),
+    REG_NAME(LGW_MODEM5_RAM0_BIST_STATUS),
+    REG_NAME(LGW_MODEM6_RAM0_BIST_STATUS),
+    REG_NAME(LGW_MODEM7_RAM0_BIST_STATUS),
+    REG_NAME(LGW_MODEM0_RAM1_BIST_STATUS),
+    REG_NAME(LGW_MODEM1_RAM1_BIST_STATUS),
+    REG_NAME(LGW_MODEM2_RAM1_BIST_STATUS),
+    REG_NAME(LGW_MODEM3_RAM1_BIST_STATUS),
+    REG_NAME(LGW_MODEM4_RAM1_BIST_STATUS),
+    REG_NAME(LGW_MODEM5_RAM1_BIST_STATUS),
+    REG_NAME(LGW_MODEM6_RAM1_BIST_STATUS),
+    REG_NAME(LGW_MODEM7_RAM1_BIST_STATUS),
+    REG_NAME(LGW_MODEM0_RAM2_BIST_STATUS),
+    REG_NAME(LGW_MODEM1_RAM2_BIST_STATUS),
+    REG_NAME(LGW_MODEM2_RAM2_BIST_STATUS),
+    REG_NAME(LGW_MODEM3_RAM2_BIST_STATUS),
+    REG_NAME(LGW_MODEM4_RAM2_BIST_STATUS),
+    REG_NAME(LGW_MODEM5_RAM2_BIST_STATUS),
+    REG_NAME(LGW_MODEM6_RAM2_BIST_STATUS),
+    REG_NAME(LGW_MODEM7_RAM2_BIST_STATUS),
+    REG_NAME(LGW_MODEM_MBWSSF_RAM0_BIST_STATUS),
+    REG_NAME(LGW_MODEM_MBWSSF_RAM1_BIST_STATUS),
+    REG_NAME(LGW_MODEM_MBWSSF_RAM2_BIST_STATUS),
+    REG_NAME(LGW_MCU_AGC_DATA_RAM_BIST0_STATUS),
+    REG_NAME(LGW_MCU_AGC_DATA_RAM_BIST1_STATUS),
+    REG_NAME(LGW_MCU_ARB_DATA_RAM_BIST0_STATUS),
+    REG_NAME(LGW_MCU_ARB_DATA_RAM_BIST1_STATUS),
+    REG_NAME(LGW_TX_TOP_RAM_BIST0_STATUS),
+    REG_NAME(LGW_TX_TOP_RAM_BIST1_STATUS),
+    REG_NAME(LGW_DATA_MNGT_RAM_BIST0_STATUS),
+    REG_NAME(LGW_DATA_MNGT_RAM_BIST1_STATUS),
+    REG_NAME(LGW_GPIO_SELECT_INPUT),
+    REG_NAME(LGW_GPIO_SELECT_OUTPUT),
+    REG_NAME(LGW_GPIO_MODE),
+    REG_NAME(LGW_GPIO_PIN_REG_IN),
+    REG_NAME(LGW_GPIO_PIN_REG_OUT),
+    REG_NAME(LGW_MCU_AGC_STATUS),
+    REG_NAME(LGW_MCU_ARB_STATUS),
+    REG_NAME(LGW_CHIP_ID),
+    REG_NAME(LGW_EMERGENCY_FORCE_HOST_CTRL),
+    REG_NAME(LGW_RX_INVERT_IQ),
+    REG_NAME(LGW_MODEM_INVERT_IQ),
+    REG_NAME(LGW_MBWSSF_MODEM_INVERT_IQ),
+    REG_NAME(LGW_RX_EDGE_SELECT),
+    REG_NAME(LGW_MISC_RADIO_EN),
+    REG_NAME(LGW_FSK_MODEM_INVERT_IQ),
+    REG_NAME(LGW_FILTER_GAIN),
+    REG_NAME(LGW_RADIO_SELECT),
+    REG_NAME(LGW_IF_FREQ_0),
+    REG_NAME(LGW_IF_FREQ_1),
+    REG_NAME(LGW_IF_FREQ_2),
+    REG_NAME(LGW_IF_FREQ_3),
+    REG_NAME(LGW_IF_FREQ_4),
+    REG_NAME(LGW_IF_FREQ_5),
+    REG_NAME(LGW_IF_FREQ_6),
+    REG_NAME(LGW_IF_FREQ_7),
+    REG_NAME(LGW_IF_FREQ_8),
+    REG_NAME(LGW_IF_FREQ_9),
+    REG_NAME(LGW_CHANN_OVERRIDE_AGC_GAIN),
+    REG_NAME(LGW_CHANN_AGC_GAIN),
+    REG_NAME(LGW_CORR0_DETECT_EN),
+    REG_NAME(LGW_CORR1_DETECT_EN),
+    REG_NAME(LGW_CORR2_DETECT_EN),
+    REG_NAME(LGW_CORR3_DETECT_EN),
+    REG_NAME(LGW_CORR4_DETECT_EN),
+    REG_NAME(LGW_CORR5_DETECT_EN),
+    REG_NAME(LGW_CORR6_DETECT_EN),
+    REG_NAME(LGW_CORR7_DETECT_EN),
+    REG_NAME(LGW_CORR_SAME_PEAKS_OPTION_SF6),
+    REG_NAME(LGW_CORR_SAME_PEAKS_OPTION_SF7),
+    REG_NAME(LGW_CORR_SAME_PEAKS_OPTION_SF8),
+    REG_NAME(LGW_CORR_SAME_PEAKS_OPTION_SF9),
+    REG_NAME(LGW_CORR_SAME_PEAKS_OPTION_SF10),
+    REG_NAME(LGW_CORR_SAME_PEAKS_OPTION_SF11),
+    REG_NAME(LGW_CORR_SAME_PEAKS_OPTION_SF12),
+    REG_NAME(LGW_CORR_SIG_NOISE_RATIO_SF6),
+    REG_NAME(LGW_CORR_SIG_NOISE_RATIO_SF7),
+    REG_NAME(LGW_CORR_SIG_NOISE_RATIO_SF8),
+    REG_NAME(LGW_CORR_SIG_NOISE_RATIO_SF9),
+    REG_NAME(LGW_CORR_SIG_NOISE_RATIO_SF10),
+    REG_NAME(LGW_CORR_SIG_NOISE_RATIO_SF11),
+    REG_NAME(LGW_CORR_SIG_NOISE_RATIO_SF12),
+    REG_NAME(LGW_CORR_NUM_SAME_PEAK),
+    REG_NAME(LGW_CORR_MAC_GAIN),
+    REG_NAME(LGW_ADJUST_MODEM_START_OFFSET_RDX4),
+    REG_NAME(LGW_ADJUST_MODEM_START_OFFSET_SF12_RDX4),
+    REG_NAME(LGW_DBG_CORR_SELECT_SF),
+    REG_NAME(LGW_DBG_CORR_SELECT_CHANNEL),
+    REG_NAME(LGW_DBG_DETECT_CPT),
+    REG_NAME(LGW_DBG_SYMB_CPT),
+    REG_NAME(LGW_CHIRP_INVERT_RX),
+    REG_NAME(LGW_DC_NOTCH_EN),
+    REG_NAME(LGW_IMPLICIT_CRC_EN),
+    REG_NAME(LGW_IMPLICIT_CODING_RATE),
+    REG_NAME(LGW_IMPLICIT_PAYLOAD_LENGHT),
+    REG_NAME(LGW_FREQ_TO_TIME_INVERT),
+    REG_NAME(LGW_FREQ_TO_TIME_DRIFT),
+    REG_NAME(LGW_PAYLOAD_FINE_TIMING_GAIN),
+    REG_NAME(LGW_PREAMBLE_FINE_TIMING_GAIN),
+    REG_NAME(LGW_TRACKING_INTEGRAL),
+    REG_NAME(LGW_FRAME_SYNCH_PEAK1_POS),
+    REG_NAME(LGW_FRAME_SYNCH_PEAK2_POS),
+    REG_NAME(LGW_PREAMBLE_SYMB1_NB),
+    REG_NAME(LGW_FRAME_SYNCH_GAIN),
+    REG_NAME(LGW_SYNCH_DETECT_TH),
+    REG_NAME(LGW_LLR_SCALE),
+    REG_NAME(LGW_SNR_AVG_CST),
+    REG_NAME(LGW_PPM_OFFSET),
+    REG_NAME(LGW_MAX_PAYLOAD_LEN),
+    REG_NAME(LGW_ONLY_CRC_EN),
+    REG_NAME(LGW_ZERO_PAD),
+    REG_NAME(LGW_DEC_GAIN_OFFSET),
+    REG_NAME(LGW_CHAN_GAIN_OFFSET),
+    REG_NAME(LGW_FORCE_HOST_RADIO_CTRL),
+    REG_NAME(LGW_FORCE_HOST_FE_CTRL),
+    REG_NAME(LGW_FORCE_DEC_FILTER_GAIN),
+    REG_NAME(LGW_MCU_RST_0),
+    REG_NAME(LGW_MCU_RST_1),
+    REG_NAME(LGW_MCU_SELECT_MUX_0),
+    REG_NAME(LGW_MCU_SELECT_MUX_1),
+    REG_NAME(LGW_MCU_CORRUPTION_DETECTED_0),
+    REG_NAME(LGW_MCU_CORRUPTION_DETECTED_1),
+    REG_NAME(LGW_MCU_SELECT_EDGE_0),
+    REG_NAME(LGW_MCU_SELECT_EDGE_1),
+    REG_NAME(LGW_CHANN_SELECT_RSSI),
+    REG_NAME(LGW_RSSI_BB_DEFAULT_VALUE),
+    REG_NAME(LGW_RSSI_DEC_DEFAULT_VALUE),
+    REG_NAME(LGW_RSSI_CHANN_DEFAULT_VALUE),
+    REG_NAME(LGW_RSSI_BB_FILTER_ALPHA),
+    REG_NAME(LGW_RSSI_DEC_FILTER_ALPHA),
+    REG_NAME(LGW_RSSI_CHANN_FILTER_ALPHA),
+    REG_NAME(LGW_IQ_MISMATCH_A_AMP_COEFF),
+    REG_NAME(LGW_IQ_MISMATCH_A_PHI_COEFF),
+    REG_NAME(LGW_IQ_MISMATCH_B_AMP_COEFF),
+    REG_NAME(LGW_IQ_MISMATCH_B_SEL_I),
+    REG_NAME(LGW_IQ_MISMATCH_B_PHI_COEFF),
+    REG_NAME(LGW_TX_TRIG_IMMEDIATE),
+    REG_NAME(LGW_TX_TRIG_DELAYED),
+    REG_NAME(LGW_TX_TRIG_GPS),
+    REG_NAME(LGW_TX_START_DELAY),
+    REG_NAME(LGW_TX_FRAME_SYNCH_PEAK1_POS),
+    REG_NAME(LGW_TX_FRAME_SYNCH_PEAK2_POS),
+    REG_NAME(LGW_TX_RAMP_DURATION),
+    REG_NAME(LGW_TX_OFFSET_I),
+    REG_NAME(LGW_TX_OFFSET_Q),
+    REG_NAME(LGW_TX_MODE),
+    REG_NAME(LGW_TX_ZERO_PAD),
+    REG_NAME(LGW_TX_EDGE_SELECT),
+    REG_NAME(LGW_TX_EDGE_SELECT_TOP),
+    REG_NAME(LGW_TX_GAIN),
+    REG_NAME(LGW_TX_CHIRP_LOW_PASS),
+    REG_NAME(LGW_TX_FCC_WIDEBAND),
+    REG_NAME(LGW_TX_SWAP_IQ),
+    REG_NAME(LGW_MBWSSF_IMPLICIT_HEADER),
+    REG_NAME(LGW_MBWSSF_IMPLICIT_CRC_EN),
+    REG_NAME(LGW_MBWSSF_IMPLICIT_CODING_RATE),
+    REG_NAME(LGW_MBWSSF_IMPLICIT_PAYLOAD_LENGHT),
+    REG_NAME(LGW_MBWSSF_AGC_FREEZE_ON_DETECT),
+    REG_NAME(LGW_MBWSSF_FRAME_SYNCH_PEAK1_POS),
+    REG_NAME(LGW_MBWSSF_FRAME_SYNCH_PEAK2_POS),
+    REG_NAME(LGW_MBWSSF_PREAMBLE_SYMB1_NB),
+    REG_NAME(LGW_MBWSSF_FRAME_SYNCH_GAIN),
+    REG_NAME(LGW_MBWSSF_SYNCH_DETECT_TH),
+    REG_NAME(LGW_MBWSSF_DETECT_MIN_SINGLE_PEAK),
+    REG_NAME(LGW_MBWSSF_DETECT_TRIG_SAME_PEAK_NB),
+    REG_NAME(LGW_MBWSSF_FREQ_TO_TIME_INVERT),
+    REG_NAME(LGW_MBWSSF_FREQ_TO_TIME_DRIFT),
+    REG_NAME(LGW_MBWSSF_PPM_CORRECTION),
+    REG_NAME(LGW_MBWSSF_PAYLOAD_FINE_TIMING_GAIN),
+    REG_NAME(LGW_MBWSSF_PREAMBLE_FINE_TIMING_GAIN),
+    REG_NAME(LGW_MBWSSF_TRACKING_INTEGRAL),
+    REG_NAME(LGW_MBWSSF_ZERO_PAD),
+    REG_NAME(LGW_MBWSSF_MODEM_BW),
+    REG_NAME(LGW_MBWSSF_RADIO_SELECT),
+    REG_NAME(LGW_MBWSSF_RX_CHIRP_INVERT),
+    REG_NAME(LGW_MBWSSF_LLR_SCALE),
+    REG_NAME(LGW_MBWSSF_SNR_AVG_CST),
+    REG_NAME(LGW_MBWSSF_PPM_OFFSET),
+    REG_NAME(LGW_MBWSSF_RATE_SF),
+    REG_NAME(LGW_MBWSSF_ONLY_CRC_EN),
+    REG_NAME(LGW_MBWSSF_MAX_PAYLOAD_LEN),
+    REG_NAME(LGW_TX_STATUS),
+    REG_NAME(LGW_FSK_CH_BW_EXPO),
+    REG_NAME(LGW_FSK_RSSI_LENGTH),
+    REG_NAME(LGW_FSK_RX_INVERT),
+    REG_NAME(LGW_FSK_PKT_MODE),
+    REG_NAME(LGW_FSK_PSIZE),
+    REG_NAME(LGW_FSK_CRC_EN),
+    REG_NAME(LGW_FSK_DCFREE_ENC),
+    REG_NAME(LGW_FSK_CRC_IBM),
+    REG_NAME(LGW_FSK_ERROR_OSR_TOL),
+    REG_NAME(LGW_FSK_RADIO_SELECT),
+    REG_NAME(LGW_FSK_BR_RATIO),
+    REG_NAME(LGW_FSK_REF_PATTERN_LSB),
+    REG_NAME(LGW_FSK_REF_PATTERN_MSB),
+    REG_NAME(LGW_FSK_PKT_LENGTH),
+    REG_NAME(LGW_FSK_TX_GAUSSIAN_EN),
+    REG_NAME(LGW_FSK_TX_GAUSSIAN_SELECT_BT),
+    REG_NAME(LGW_FSK_TX_PATTERN_EN),
+    REG_NAME(LGW_FSK_TX_PREAMBLE_SEQ),
+    REG_NAME(LGW_FSK_TX_PSIZE),
+    REG_NAME(LGW_FSK_NODE_ADRS),
+    REG_NAME(LGW_FSK_BROADCAST),
+    REG_NAME(LGW_FSK_AUTO_AFC_ON),
+    REG_NAME(LGW_FSK_PATTERN_TIMEOUT_CFG),
+    REG_NAME(LGW_SPI_RADIO_A__DATA),
+    REG_NAME(LGW_SPI_RADIO_A__DATA_READBACK),
+    REG_NAME(LGW_SPI_RADIO_A__ADDR),
+    REG_NAME(LGW_SPI_RADIO_A__CS),
+    REG_NAME(LGW_SPI_RADIO_B__DATA),
+    REG_NAME(LGW_SPI_RADIO_B__DATA_READBACK),
+    REG_NAME(LGW_SPI_RADIO_B__ADDR),
+    REG_NAME(LGW_SPI_RADIO_B__CS),
+    REG_NAME(LGW_RADIO_A_EN),
+    REG_NAME(LGW_RADIO_B_EN),
+    REG_NAME(LGW_RADIO_RST),
+    REG_NAME(LGW_LNA_A_EN),
+    REG_NAME(LGW_PA_A_EN),
+    REG_NAME(LGW_LNA_B_EN),
+    REG_NAME(LGW_PA_B_EN),
+    REG_NAME(LGW_PA_GAIN),
+    REG_NAME(LGW_LNA_A_CTRL_LUT),
+    REG_NAME(LGW_PA_A_CTRL_LUT),
+    REG_NAME(LGW_LNA_B_CTRL_LUT),
+    REG_NAME(LGW_PA_B_CTRL_LUT),
+    REG_NAME(LGW_CAPTURE_SOURCE),
+    REG_NAME(LGW_CAPTURE_START),
+    REG_NAME(LGW_CAPTURE_FORCE_TRIGGER),
+    REG_NAME(LGW_CAPTURE_WRAP),
+    REG_NAME(LGW_CAPTURE_PERIOD),
+    REG_NAME(LGW_MODEM_STATUS),
+    REG_NAME(LGW_VALID_HEADER_COUNTER_0),
+    REG_NAME(LGW_VALID_PACKET_COUNTER_0),
+    REG_NAME(LGW_VALID_HEADER_COUNTER_MBWSSF),
+    REG_NAME(LGW_VALID_HEADER_COUNTER_FSK),
+    REG_NAME(LGW_VALID_PACKET_COUNTER_MBWSSF),
+    REG_NAME(LGW_VALID_PACKET_COUNTER_FSK),
+    REG_NAME(LGW_CHANN_RSSI),
+    REG_NAME(LGW_BB_RSSI),
+    REG_NAME(LGW_DEC_RSSI),
+    REG_NAME(LGW_DBG_MCU_DATA),
+    REG_NAME(LGW_DBG_ARB_MCU_RAM_DATA),
+    REG_NAME(LGW_DBG_AGC_MCU_RAM_DATA),
+    REG_NAME(LGW_NEXT_PACKET_CNT),
+    REG_NAME(LGW_ADDR_CAPTURE_COUNT),
+    REG_NAME(LGW_TIMESTAMP),
+    REG_NAME(LGW_DBG_CHANN0_GAIN),
+    REG_NAME(LGW_DBG_CHANN1_GAIN),
+    REG_NAME(LGW_DBG_CHANN2_GAIN),
+    REG_NAME(LGW_DBG_CHANN3_GAIN),
+    REG_NAME(LGW_DBG_CHANN4_GAIN),
+    REG_NAME(LGW_DBG_CHANN5_GAIN),
+    REG_NAME(LGW_DBG_CHANN6_GAIN),
+    REG_NAME(LGW_DBG_CHANN7_GAIN),
+    REG_NAME(LGW_DBG_DEC_FILT_GAIN),
+    REG_NAME(LGW_SPI_DATA_FIFO_PTR),
+    REG_NAME(LGW_PACKET_DATA_FIFO_PTR),
+    REG_NAME(LGW_DBG_ARB_MCU_RAM_ADDR),
+    REG_NAME(LGW_DBG_AGC_MCU_RAM_ADDR),
+    REG_NAME(LGW_SPI_MASTER_CHIP_SELECT_POLARITY),
+    REG_NAME(LGW_SPI_MASTER_CPOL),
+    REG_NAME(LGW_SPI_MASTER_CPHA),
+    REG_NAME(LGW_SIG_GEN_ANALYSER_MUX_SEL),
+    REG_NAME(LGW_SIG_GEN_EN),
+    REG_NAME(LGW_SIG_ANALYSER_EN),
+    REG_NAME(LGW_SIG_ANALYSER_AVG_LEN),
+    REG_NAME(LGW_SIG_ANALYSER_PRECISION),
+    REG_NAME(LGW_SIG_ANALYSER_VALID_OUT),
+    REG_NAME(LGW_SIG_GEN_FREQ),
+    REG_NAME(LGW_SIG_ANALYSER_FREQ),
+    REG_NAME(LGW_SIG_ANALYSER_I_OUT),
+    REG_NAME(LGW_SIG_ANALYSER_Q_OUT),
+    REG_NAME(LGW_GPS_EN),
+    REG_NAME(LGW_GPS_POL),
+    REG_NAME(LGW_SW_TEST_REG1),
+    REG_NAME(LGW_SW_TEST_REG2),
+    REG_NAME(LGW_SW_TEST_REG3),
+    REG_NAME(LGW_DATA_MNGT_STATUS),
+    REG_NAME(LGW_DATA_MNGT_CPT_FRAME_ALLOCATED),
+    REG_NAME(LGW_DATA_MNGT_CPT_FRAME_FINISHED),
+    REG_NAME(LGW_DATA_MNGT_CPT_FRAME_READEN),
+    REG_NAME(LGW_TX_TRIG_ALL),};
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DECLARATION ---------------------------------------- */
+
+static void sig_handler(int sigio);
+
+static int cmp_reg_time(const void *a, const void *b);
+
+static void dump_reg_stats(int top_nb, uint64_t duration_us);
+
+static void dump_spi_stats(void);
+
+void usage(void);
+
+/* -------------------------------------------------------------------------- */
+/* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
+
+static void sig_handler(int sigio) {
+    if (sigio == SIGQUIT) {
+        quit_sig = 1;
+    } else if ((sigio == SIGINT) || (sigio == SIGTERM)) {
+        exit_sig = 1;
+    }
+}
+
+/* sort register numbers by decreasing SPI time, then by decreasing number of bytes */
+static int cmp_reg_time(const void *a, const void *b) {
+    const struct lgw_reg_stats_s *ra = &reg_stats[*(const uint16_t *)a];
+    const struct lgw_reg_stats_s *rb = &reg_stats[*(const uint16_t *)b];
+
+    if (ra->time_us != rb->time_us) {
+        return (ra->time_us < rb->time_us) ? 1 : -1;
+    }
+    if (ra->nb_byte != rb->nb_byte) {
+        return (ra->nb_byte < rb->nb_byte) ? 1 : -1;
+    }
+    return 0;
+}
+
+static void dump_reg_stats(int top_nb, uint64_t duration_us) {
+    uint16_t order[LGW_TOTALREGS];
+    uint64_t total_us = 0;
+    uint32_t nb_page_switch, nb_skipped, nb_read;
+    const struct lgw_reg_stats_s *r;
+    int i;
+
+    lgw_reg_get_stats(reg_stats, &nb_page_switch, false);
+    lgw_reg_cache_stats(&nb_skipped, &nb_read);
+    for (i = 0; i < LGW_TOTALREGS; ++i) {
+        order[i] = (uint16_t)i;
+        total_us += reg_stats[i].time_us;
+    }
+    qsort(order, LGW_TOTALREGS, sizeof order[0], cmp_reg_time);
+
+    printf("### Registers, by SPI time (%llu us in register accesses over %llu us) ###\n", (unsigned long long)total_us, (unsigned long long)duration_us);
+    printf("%-40s %9s %9s %9s %9s %11s %11s %6s\n", "register", "read", "write", "b.read", "b.write", "bytes", "time_us", "%");
+    for (i = 0; (i < top_nb) && (i < LGW_TOTALREGS); ++i) {
+        r = &reg_stats[order[i]];
+        if ((r->nb_r + r->nb_w + r->nb_rb + r->nb_wb) == 0) {
+            break;
+        }
+        printf("%-40s %9u %9u %9u %9u %11llu %11llu %6.2f\n", reg_name[order[i]], r->nb_r, r->nb_w, r->nb_rb, r->nb_wb, (unsigned long long)r->nb_byte, (unsigned long long)r->time_us, (total_us > 0) ? (100.0 * r->time_us / total_us) : 0.0);
+    }
+    printf("page switches: %u\n", nb_page_switch);
+    printf("read-modify-write: %u reads served by the cache, %u sent on the SPI link\n", nb_skipped, nb_read);
+}
+
+static void dump_spi_stats(void) {
+    struct lgw_spi_stats_s s;
+    int op, i, last;
+
+    lgw_spi_get_stats(&s, false);
+    printf("### SPI transfers ###\n");
+    printf("%-12s %10s %12s %12s %10s %10s\n", "transfer", "calls", "bytes", "time_us", "avg_us", "max_us");
+    for (op = 0; op < LGW_SPI_OP_NB; ++op) {
+        printf("%-12s %10u %12llu %12llu %10.2f %10u\n", spi_op_name[op], s.nb[op], (unsigned long long)s.nb_byte[op], (unsigned long long)s.time_us[op], (s.nb[op] > 0) ? ((double)s.time_us[op] / s.nb[op]) : 0.0, s.max_us[op]);
+    }
+    printf("### SPI latency histograms (calls per latency range) ###\n");
+    for (op = 0; op < LGW_SPI_OP_NB; ++op) {
+        if (s.nb[op] == 0) {
+            continue;
+        }
+        for (last = LGW_SPI_HIST_NB - 1; (last > 0) && (s.hist[op][last] == 0); --last);
+        printf("%s:\n", spi_op_name[op]);
+        for (i = 0; i <= last; ++i) {
+            if (i == 0) {
+                printf("  %8s < %-8u us: %u\n", "", 1U, s.hist[op][i]);
+            } else if (i == (LGW_SPI_HIST_NB - 1)) {
+                printf("  %8u <= %-8s us: %u\n", 1U << (i - 1), "", s.hist[op][i]);
+            } else {
+                printf("  %8u .. %-8u us: %u\n", 1U << (i - 1), 1U << i, s.hist[op][i]);
+            }
+        }
+    }
+}
+
+/* describe command line options */
+void usage(void) {
+    printf("Library version information: %s\n", lgw_version_info());
+    printf( "Available options:\n");
+    printf( " -h print this help\n");
+    printf( " -a <float> Radio A RX frequency in MHz\n");
+    printf( " -b <float> Radio B RX frequency in MHz (default: radio A + 0.8 MHz)\n");
+    printf( " -r <int> Radio type (SX1255:1255, SX1257:1257)\n");
+    printf( " -k <int> Concentrator clock source (0: radio_A, 1: radio_B(default))\n");
+    printf( " -d <int> RX duration in seconds (default %d)\n", DEFAULT_DURATION_S);
+    printf( " -n <int> number of registers listed (default %d)\n", DEFAULT_TOP_NB);
+    printf( " -s include the concentrator start in the statistics\n");
+}
+
+/* -------------------------------------------------------------------------- */
+/* --- MAIN FUNCTION -------------------------------------------------------- */
+
+int main(int argc, char **argv)
+{
+    struct lgw_conf_board_s boardconf;
+    struct lgw_conf_rxrf_s rfconf;
+    struct lgw_conf_rxif_s ifconf;
+    struct lgw_pkt_rx_s rxpkt[LGW_PKT_FIFO_SIZE];
+    struct lgw_spi_stats_s spi_stats;
+    uint32_t nb_page_switch;
+    const int32_t if_freq[8] = { -400000, -200000, 0, -400000, -200000, 0, 200000, 400000 };
+    int i, x;
+    double xd;
+    uint32_t fa = 0, fb = 0;
+    enum lgw_radio_type_e radio_type = LGW_RADIO_TYPE_SX1257;
+    uint8_t clocksource = 1;
+    int duration_s = DEFAULT_DURATION_S;
+    int top_nb = DEFAULT_TOP_NB;
+    bool with_start = false;
+    unsigned long nb_pkt = 0;
+    uint64_t t0, duration_us;
+
+    /* parse command line options */
+    while ((i = getopt (argc, argv, "ha:b:r:k:d:n:s")) != -1) {
+        switch (i) {
+            case 'h':
+                usage();
+                return EXIT_FAILURE;
+
+            case 'a': /* <float> Radio A RX frequency in MHz */
+            case 'b': /* <float> Radio B RX frequency in MHz */
+                if (sscanf(optarg, "%lf", &xd) != 1) {
+                    MSG("ERROR: invalid frequency\n");
+                    return EXIT_FAILURE;
+                }
+                if (i == 'a') {
+                    fa = (uint32_t)((xd*1e6) + 0.5); /* .5 Hz offset to get rounding instead of truncating */
+                } else {
+                    fb = (uint32_t)((xd*1e6) + 0.5);
+                }
+                break;
+
+            case 'r': /* <int> Radio type (1255, 1257) */
+                if ((sscanf(optarg, "%i", &x) != 1) || ((x != 1255) && (x != 1257))) {
+                    MSG("ERROR: invalid radio type\n");
+                    return EXIT_FAILURE;
+                }
+                radio_type = (x == 1255) ? LGW_RADIO_TYPE_SX1255 : LGW_RADIO_TYPE_SX1257;
+                break;
+
+            case 'k': /* <int> Clock Source */
+                if ((sscanf(optarg, "%i", &x) != 1) || ((x != 0) && (x != 1))) {
+                    MSG("ERROR: invalid clock source\n");
+                    return EXIT_FAILURE;
+                }
+                clocksource = (uint8_t)x;
+                break;
+
+            case 'd': /* <int> RX duration in seconds */
+                if ((sscanf(optarg, "%i", &duration_s) != 1) || (duration_s < 1)) {
+                    MSG("ERROR: invalid duration\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 'n': /* <int> number of registers listed */
+                if ((sscanf(optarg, "%i", &top_nb) != 1) || (top_nb < 1)) {
+                    MSG("ERROR: invalid number of registers\n");
+                    return EXIT_FAILURE;
+                }
+                break;
+
+            case 's':
+                with_start = true;
+                break;
+
+            default:
+                MSG("ERROR: argument parsing use -h option for help\n");
+                usage();
+                return EXIT_FAILURE;
+        }
+    }
+    if (fa == 0) {
+        MSG("ERROR: missing radio A frequency, use -h option for help\n");
+        return EXIT_FAILURE;
+    }
+    if (fb == 0) {
+        fb = fa + 800000;
+    }
+
+    /* configure signal handling */
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigact.sa_handler = sig_handler;
+    sigaction(SIGQUIT, &sigact, NULL);
+    sigaction(SIGINT, &sigact, NULL);
+    sigaction(SIGTERM, &sigact, NULL);
+
+    /* board, radios and 8 multi-SF channels, as the reference gateway configuration */
+    memset(&boardconf, 0, sizeof boardconf);
+    boardconf.lorawan_public = true;
+    boardconf.clksrc = clocksource;
+    lgw_board_setconf(boardconf);
+
+    memset(&rfconf, 0, sizeof rfconf);
+    rfconf.enable = true;
+    rfconf.freq_hz = fa;
+    rfconf.rssi_offset = DEFAULT_RSSI_OFFSET;
+    rfconf.type = radio_type;
+    rfconf.tx_enable = true;
+    rfconf.tx_notch_freq = DEFAULT_NOTCH_FREQ;
+    lgw_rxrf_setconf(0, rfconf); /* radio A */
+    rfconf.freq_hz = fb;
+    rfconf.tx_enable = false;
+    lgw_rxrf_setconf(1, rfconf); /* radio B */
+
+    memset(&ifconf, 0, sizeof ifconf);
+    ifconf.enable = true;
+    ifconf.datarate = DR_LORA_MULTI;
+    for (i = 0; i < 8; ++i) {
+        ifconf.rf_chain = (i < 3) ? 1 : 0;
+        ifconf.freq_hz = if_freq[i];
+        lgw_rxif_setconf(i, ifconf);
+    }
+
+    if (lgw_start() != LGW_HAL_SUCCESS) {
+        MSG("ERROR: failed to start the concentrator\n");
+        return EXIT_FAILURE;
+    }
+    if (with_start == false) {
+        /* clear the start-up accesses */
+        lgw_reg_get_stats(reg_stats, &nb_page_switch, true);
+        lgw_spi_get_stats(&spi_stats, true);
+    }
+    MSG("INFO: concentrator started, receiving for %d s\n", duration_s);
+
+    /* RX loop, as a packet forwarder would poll */
+    t0 = monotonic_us();
+    while ((quit_sig != 1) && (exit_sig != 1) && ((monotonic_us() - t0) < ((uint64_t)duration_s * 1000000))) {
+        x = lgw_receive(LGW_PKT_FIFO_SIZE, rxpkt);
+        if (x == LGW_HAL_ERROR) {
+            MSG("ERROR: lgw_receive failed\n");
+            break;
+        }
+        nb_pkt += x;
+        if (x == 0) {
+            wait_ms(10);
+        }
+    }
+    duration_us = monotonic_us() - t0;
+
+    dump_reg_stats(top_nb, duration_us);
+    dump_spi_stats();
+    printf("%lu packets received\n", nb_pkt);
+
+    if (quit_sig != 1) {
+        lgw_stop();
+    }
+    return EXIT_SUCCESS;
+}
+
+/* --- EOF ------------------------------------------------------------------ */
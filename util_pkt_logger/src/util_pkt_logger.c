@@ -36,6 +36,7 @@ Maintainer: Sylvain Miermont
 
 #include "parson.h"
 #include "loragw_hal.h"
+#include "loragw_rxq.h"
 #include "mqtt.h"
 #include "posix_sockets.h"
 
@@ -437,7 +438,6 @@ int main(int argc, char **argv)
 {
     int i, j; /* loop and temporary variables */
     char digits[10]; /* for int to string convertion */
-    struct timespec sleep_time = {0, 3000000}; /* 3 ms */
 
     /* clock and log rotation management */
     int log_rotate_interval = 3600; /* by default, rotation every hour */
@@ -451,6 +451,8 @@ int main(int argc, char **argv)
 
     /* allocate memory for packet fetching and processing */
     struct lgw_pkt_rx_s rxpkt[16]; /* array containing up to 16 inbound packets metadata */
+    struct lgw_rx_stats_s rx_stats; /* RX FIFO drain statistics, logged at each log rotation */
+    struct lgw_rxq_stats_s rxq_stats; /* RX ring statistics, logged at each log rotation */
     struct lgw_pkt_rx_s *p; /* pointer on a RX packet */
     int nb_pkt;
 
@@ -530,6 +532,14 @@ int main(int argc, char **argv)
         return EXIT_FAILURE;
     }
 
+    /* drain the concentrator from a dedicated thread, so that slow logging or publishing cannot overflow its FIFO */
+    i = lgw_rxq_start();
+    if (i != LGW_RXQ_SUCCESS) {
+        MSG("ERROR: failed to start the RX thread\n");
+        lgw_stop();
+        return EXIT_FAILURE;
+    }
+
     /* transform the MAC address into a string */
     sprintf(lgwm_str, "%08X%08X", (uint32_t)(lgwm >> 32), (uint32_t)(lgwm & 0xFFFFFFFF));
 
@@ -595,13 +605,11 @@ int main(int argc, char **argv)
     float rssi = -120,snr = -20;
     while ((quit_sig != 1) && (exit_sig != 1)) {
         /* fetch packets */
-        nb_pkt = lgw_receive(ARRAY_SIZE(rxpkt), rxpkt);
-        if (nb_pkt == LGW_HAL_ERROR) {
+        nb_pkt = lgw_rxq_receive(ARRAY_SIZE(rxpkt), rxpkt, 100); /* bounded wait, so that signals and log rotation are still handled */
+        if (nb_pkt == LGW_RXQ_ERROR) {
             MSG("ERROR: failed packet fetch, exiting\n");
             exit_example(EXIT_FAILURE, sockfd, &client_daemon); // return EXIT_FAILURE;
-        } else if (nb_pkt == 0) {
-            clock_nanosleep(CLOCK_MONOTONIC, 0, &sleep_time, NULL); /* wait a short time if no packets */
-        } else {
+        } else if (nb_pkt > 0) {
             /* local timestamp generation until we get accurate GPS time */
             clock_gettime(CLOCK_REALTIME, &fetch_time);
             x = gmtime(&(fetch_time.tv_sec));
@@ -777,12 +785,20 @@ int main(int argc, char **argv)
             if (difftime(now_time, log_start_time) > log_rotate_interval) {
                 fclose(log_file);
                 MSG("INFO: log file %s closed, %lu packet(s) recorded\n", log_file_name, pkt_in_log);
+                lgw_get_rx_stats(&rx_stats, true);
+                if (rx_stats.nb_pkt > 0) {
+                    MSG("INFO: RX FIFO drain: %.1f SPI transaction(s) and %u us per packet, FIFO max %u/%u, found full %u time(s)\n", (float)rx_stats.nb_spi_msg / rx_stats.nb_pkt, rx_stats.time_us / rx_stats.nb_pkt, rx_stats.fifo_max, LGW_PKT_FIFO_SIZE, rx_stats.nb_fifo_full);
+                }
+                lgw_rxq_get_stats(&rxq_stats, true);
+                MSG("INFO: RX ring: %u packet(s) queued, max depth %u/%u, %u overrun(s)\n", rxq_stats.nb_pkt_in, rxq_stats.depth_max, LGW_RXQ_SIZE, rxq_stats.nb_overrun);
                 pkt_in_log = 0;
                 open_log();
             }
         }
     }
 
+    lgw_rxq_stop();
+
     if (exit_sig == 1) {
         /* clean up before leaving */
         i = lgw_stop();
@@ -30,12 +30,14 @@ Maintainer: Michael Coracin
 #include <stdlib.h>     /* EXIT atoi */
 #include <unistd.h>     /* getopt */
 #include <string.h>
+#include <signal.h>     /* sigaction */
 
 #include "loragw_aux.h"
 #include "loragw_reg.h"
 #include "loragw_hal.h"
 #include "loragw_radio.h"
 #include "loragw_fpga.h"
+#include "loragw_sscan.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- MACROS & CONSTANTS --------------------------------------------------- */
@@ -50,7 +52,7 @@ Maintainer: Michael Coracin
 #define DEFAULT_LOG_NAME            "rssi_histogram"
 #define DEFAULT_SX127X_RSSI_OFFSET  -4
 
-#define RSSI_RANGE                  256
+#define RSSI_RANGE                  LGW_SSCAN_RSSI_RANGE
 
 #define MAX_FREQ                    1000000000
 #define MIN_FREQ                    800000000
@@ -63,15 +65,378 @@ Maintainer: Michael Coracin
 #define LBT_DEFAULT_RSSI_PTS    129*129 /* number of RSSI reads, hard-coded in FPGA*/
 #define LBT_MIN_STEP_FREQ       100000
 
+/* Histogram timing */
+#define SX127X_RSSI_RATE_HZ     32000   /* RSSI points read per second, gives the first fill time estimate */
+#define SX127X_PLL_LOCK_MS      10      /* longest time for the SX127x PLL to lock after a frequency hop */
+#define STATUS_POLL_MS          1       /* FPGA status polling period */
+
+/* Binary log, little endian: a header then one record of RSSI_RANGE uint16 per
+   histogram, record r is the frequency r % nb_freq of the header */
+#define BIN_MAGIC               0x42435353 /* "SSCB" */
+#define BIN_VERSION             1
+#define BIN_HEADER_SIZE         32  /* magic, version, range, start, stop, step, rssi_pts, nb_freq, reserved */
+#define BIN_RECORD_SIZE         (RSSI_RANGE * 2)
+
 /* -------------------------------------------------------------------------- */
 /* --- GLOBAL VARIABLES ----------------------------------------------------- */
 
+/* signal handling variables */
+struct sigaction sigact; /* SIGQUIT&SIGINT&SIGTERM signal handling */
+static int exit_sig = 0; /* 1 -> application terminates cleanly (shut down hardware, close open files, etc) */
+static int quit_sig = 0; /* 1 -> application terminates without shutting down the hardware */
+
+/* scan parameters shared by all the frequencies */
+static bool lbt_support = false;
+static uint32_t init_freq = DEFAULT_START_FREQ;
+static int8_t rssi_offset = DEFAULT_SX127X_RSSI_OFFSET;
+static enum lgw_sx127x_rxbw_e channel_bw_khz = DEFAULT_CHAN_BW;
+
+/* sequencing state */
+static bool sx127x_tuned = false; /* SX127x configured and in RX, the next frequency only needs a hop */
+static uint32_t fill_ms; /* expected time to fill a histogram, from the last one measured */
+
+/* -------------------------------------------------------------------------- */
+/* --- SUBFUNCTIONS DECLARATION --------------------------------------------- */
+
+static void sig_handler(int sigio);
+
+static int scan_freq(uint32_t freq, uint32_t next_freq, uint16_t *histo);
+
+static void print_histo(const uint16_t *histo, uint16_t rssi_pts);
+
+static int read_shm(const char *shm_name);
+
+static void write_csv(FILE *file, uint32_t freq, const uint16_t *histo);
+
+static int write_bin_header(FILE *file, uint32_t start_freq, uint32_t stop_freq, uint32_t step_freq, uint16_t rssi_pts, int freq_nb);
+
+static int write_bin(FILE *file, const uint16_t *histo);
+
+static int convert_bin(const char *bin_name, const char *csv_name);
+
+/* -------------------------------------------------------------------------- */
+/* --- SUBFUNCTIONS DEFINITION ---------------------------------------------- */
+
+static void sig_handler(int sigio) {
+    if (sigio == SIGQUIT) {
+        quit_sig = 1;
+    } else if ((sigio == SIGINT) || (sigio == SIGTERM)) {
+        exit_sig = 1;
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* compute the RSSI histogram of one frequency, returns -1 on SX127x failure or if interrupted by a signal.
+   The SX127x hops to next_freq (if not 0) while the histogram RAM is read, so
+   its PLL has locked by the time the next call starts. */
+static int scan_freq(uint32_t freq, uint32_t next_freq, uint16_t *histo) {
+    int i;
+    int x;
+    int32_t reg_val;
+    int freq_idx;
+    uint64_t freq_reg;
+    uint64_t fill_start;
+    uint8_t read_burst[RSSI_RANGE*2];
+
+    if (lbt_support == false) {
+        /* Set SX127x, the full setup (radio reset and RX mode entry) is only needed once */
+        if ((sx127x_tuned == true) && (lgw_sx127x_wait_pll_lock(SX127X_PLL_LOCK_MS) != LGW_REG_SUCCESS)) {
+            printf("WARNING: SX127x PLL did not lock at %u Hz, setting it up again\n", freq);
+            sx127x_tuned = false;
+        }
+        if (sx127x_tuned == false) {
+            x = lgw_setup_sx127x(freq, MOD_FSK, channel_bw_khz, rssi_offset);
+            if( x != 0 )
+            {
+                printf( "ERROR: SX127x setup failed\n" );
+                return -1;
+            }
+            sx127x_tuned = true;
+        }
+
+        /* Start FPGA state machine for spectral scal */
+        lgw_fpga_reg_w(LGW_FPGA_CTRL_FEATURE_START, 1);
+    } else {
+        /* Do Nothing */
+        /* LBT setup has already done the necessary */
+    }
+
+    /* Clean histogram */
+    lgw_fpga_reg_w(LGW_FPGA_CTRL_CLEAR_HISTO_MEM, 1);
+
+    /* Wait for histogram clean to start */
+    do {
+        wait_ms(STATUS_POLL_MS);
+        lgw_fpga_reg_r(LGW_FPGA_STATUS, &reg_val);
+    }
+    while((TAKE_N_BITS_FROM((uint8_t)reg_val, 0, 5)) != 1); /* Clear has started */
+
+    /* Set scan frequency during clear process */
+    if (lbt_support == false) {
+        /* We can directly set the scan frequency */
+        freq_reg = ((uint64_t)freq << 19) / (uint64_t)32000000;
+        lgw_fpga_reg_w(LGW_FPGA_HISTO_SCAN_FREQ, (int32_t)freq_reg);
+    } else {
+        /* The possible scan frequencies are hard-coded in FPGA, we give an offset from init_freq */
+        freq_idx = (freq - init_freq) / LBT_MIN_STEP_FREQ;
+        lgw_fpga_reg_w(LGW_FPGA_SCAN_FREQ_OFFSET, freq_idx);
+    }
+
+    /* Release FPGA state machine */
+    lgw_fpga_reg_w(LGW_FPGA_CTRL_CLEAR_HISTO_MEM, 0);
+    fill_start = monotonic_us();
+
+    /* Wait for histogram ready: sleep most of the expected fill time, then poll */
+    wait_ms(fill_ms - fill_ms / 8);
+    lgw_fpga_reg_r(LGW_FPGA_STATUS, &reg_val);
+    while(((TAKE_N_BITS_FROM((uint8_t)reg_val, 5, 1)) != 1) && (exit_sig == 0) && (quit_sig == 0)) {
+        wait_ms(STATUS_POLL_MS);
+        lgw_fpga_reg_r(LGW_FPGA_STATUS, &reg_val);
+    }
+    fill_ms = (uint32_t)((monotonic_us() - fill_start) / 1000); /* same number of points next time */
+
+    if (lbt_support == false) {
+        /* Stop FPGA state machine for spectral scan */
+        lgw_fpga_reg_w(LGW_FPGA_CTRL_FEATURE_START, 0);
+    } else {
+        /* Do Nothing */
+        /* LBT is running */
+    }
+    if ((exit_sig == 1) || (quit_sig == 1)) {
+        return -1;
+    }
+
+    /* Hop to the next frequency, the PLL locks during the histogram readout */
+    if ((lbt_support == false) && (next_freq != 0)) {
+        if (lgw_sx127x_set_rx_freq(next_freq) != LGW_REG_SUCCESS) {
+            sx127x_tuned = false;
+        }
+    }
+
+    /* Read histogram */
+    lgw_fpga_reg_w(LGW_FPGA_CTRL_ACCESS_HISTO_MEM, 1); /* HOST gets access to FPGA RAM */
+    lgw_fpga_reg_w(LGW_FPGA_HISTO_RAM_ADDR, 0);
+    lgw_fpga_reg_rb(LGW_FPGA_HISTO_RAM_DATA, read_burst, RSSI_RANGE*2);
+    lgw_fpga_reg_w(LGW_FPGA_CTRL_ACCESS_HISTO_MEM, 0); /* FPGA gets access to RAM back */
+
+    for (i = 0; i < RSSI_RANGE; i++) {
+        histo[i] = (uint16_t)read_burst[2*i] | ((uint16_t)read_burst[2*i+1] << 8);
+    }
+    return 0;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* print the RSSI under which 10%, 30%, 50%, 80% and 100% of the points are */
+static void print_histo(const uint16_t *histo, uint16_t rssi_pts) {
+    static const int pct[LGW_SSCAN_LEVEL_NB] = LGW_SSCAN_LEVEL_PCT;
+    struct lgw_sscan_level_s level;
+    int k;
+
+    lgw_sscan_levels(histo, 1, rssi_pts, &level);
+    if (level.nb_pts > rssi_pts) {
+        printf(" - WARNING: number of RSSI points higher than expected (%u,%u)", level.nb_pts, rssi_pts);
+    }
+    for (k = 0; k < LGW_SSCAN_LEVEL_NB; k++) {
+        if (level.pct_dbm[k] != LGW_SSCAN_NO_LEVEL) {
+            printf("  %d%%<%.1f", pct[k], level.pct_dbm[k]);
+        }
+    }
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* print the histograms published by a spectral scan running in monitor mode */
+static int read_shm(const char *shm_name) {
+    struct lgw_sscan_s *sscan;
+    struct lgw_sscan_entry_s entry;
+    uint64_t now;
+    uint32_t sweep;
+    uint16_t nb_freq;
+    int i, x;
+
+    sscan = lgw_sscan_open(shm_name);
+    if ((sscan == NULL) || (lgw_sscan_info(sscan, &nb_freq, &sweep) != LGW_SSCAN_SUCCESS)) {
+        printf("ERROR: no spectral scan running in monitor mode on %s\n", shm_name);
+        return EXIT_FAILURE;
+    }
+    printf("%u frequencies, %u complete sweeps\n", nb_freq, sweep);
+    now = monotonic_us();
+    for (i = 0; i < nb_freq; i++) {
+        x = lgw_sscan_read(sscan, i, &entry);
+        if (x == LGW_SSCAN_EMPTY) {
+            continue;
+        } else if (x != LGW_SSCAN_SUCCESS) {
+            printf("ERROR: spectral scan stopped while reading %s\n", shm_name);
+            lgw_sscan_close(sscan);
+            return EXIT_FAILURE;
+        }
+        printf("%u (sweep %u, %.1fs ago)", entry.freq_hz, entry.sweep, (now - entry.time_us) / 1e6);
+        print_histo(entry.histo, (uint16_t)entry.nb_pts);
+        printf("\n");
+    }
+    lgw_sscan_close(sscan);
+    return EXIT_SUCCESS;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* one line of the CSV log: frequency, then RSSI and number of points of each bin */
+static void write_csv(FILE *file, uint32_t freq, const uint16_t *histo) {
+    int i;
+
+    fprintf(file, "%d", freq);
+    for (i = 0; i < RSSI_RANGE; i++) {
+        fprintf(file, ",%.1f,%d", -i/2.0, histo[i]);
+    }
+    fprintf(file, "\n");
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int write_bin_header(FILE *file, uint32_t start_freq, uint32_t stop_freq, uint32_t step_freq, uint16_t rssi_pts, int freq_nb) {
+    uint8_t buff[BIN_HEADER_SIZE];
+    uint32_t field[6] = {start_freq, stop_freq, step_freq, rssi_pts, freq_nb, 0};
+    int i, j;
+
+    for (j = 0; j < 4; j++) {
+        buff[j] = (uint8_t)(BIN_MAGIC >> (8 * j));
+    }
+    buff[4] = (uint8_t)BIN_VERSION;
+    buff[5] = (uint8_t)(BIN_VERSION >> 8);
+    buff[6] = (uint8_t)RSSI_RANGE;
+    buff[7] = (uint8_t)(RSSI_RANGE >> 8);
+    for (i = 0; i < 6; i++) {
+        for (j = 0; j < 4; j++) {
+            buff[8 + 4*i + j] = (uint8_t)(field[i] >> (8 * j));
+        }
+    }
+    return (fwrite(buff, sizeof buff, 1, file) == 1) ? 0 : -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+static int write_bin(FILE *file, const uint16_t *histo) {
+    uint8_t buff[BIN_RECORD_SIZE];
+    int i;
+
+    for (i = 0; i < RSSI_RANGE; i++) {
+        buff[2*i] = (uint8_t)histo[i];
+        buff[2*i+1] = (uint8_t)(histo[i] >> 8);
+    }
+    return (fwrite(buff, sizeof buff, 1, file) == 1) ? 0 : -1;
+}
+
+/* ~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~ */
+
+/* write the CSV log of a binary log, then print the average noise floor and
+   median RSSI of each frequency over all its histograms */
+static int convert_bin(const char *bin_name, const char *csv_name) {
+    FILE *bin_file, *csv_file;
+    uint8_t buff[BIN_RECORD_SIZE];
+    uint32_t field[6]; /* start, stop, step, rssi_pts, nb_freq, reserved */
+    uint16_t *histo = NULL, *tmp;
+    struct lgw_sscan_level_s *level;
+    uint32_t nb_histo = 0, size = 0;
+    uint32_t nb_floor, nb_median;
+    double sum_floor, sum_median;
+    uint32_t i, j;
+
+    bin_file = fopen(bin_name, "rb");
+    if (bin_file == NULL) {
+        printf("ERROR: impossible to open binary log %s\n", bin_name);
+        return EXIT_FAILURE;
+    }
+    if (fread(buff, BIN_HEADER_SIZE, 1, bin_file) != 1) {
+        printf("ERROR: %s is too short for a binary log\n", bin_name);
+        fclose(bin_file);
+        return EXIT_FAILURE;
+    }
+    for (i = 0; i < 6; i++) {
+        field[i] = 0;
+        for (j = 0; j < 4; j++) {
+            field[i] |= (uint32_t)buff[8 + 4*i + j] << (8 * j);
+        }
+    }
+    if ((buff[0] != (uint8_t)BIN_MAGIC) || (buff[1] != (uint8_t)(BIN_MAGIC >> 8)) || (buff[2] != (uint8_t)(BIN_MAGIC >> 16)) || (buff[3] != (uint8_t)(BIN_MAGIC >> 24))
+        || (buff[4] != BIN_VERSION) || (buff[5] != 0) || ((buff[6] | (buff[7] << 8)) != RSSI_RANGE) || (field[4] == 0)) {
+        printf("ERROR: %s is not a binary log of this version\n", bin_name);
+        fclose(bin_file);
+        return EXIT_FAILURE;
+    }
+
+    csv_file = fopen(csv_name, "w");
+    if (csv_file == NULL) {
+        printf("ERROR: impossible to create log file %s\n", csv_name);
+        fclose(bin_file);
+        return EXIT_FAILURE;
+    }
+    printf("Converting %s (start %u Hz, stop %u Hz, step %u Hz, %u RSSI points) to %s\n", bin_name, field[0], field[1], field[2], field[3], csv_name);
+
+    /* records are kept to compute the levels of all of them at once */
+    while (fread(buff, BIN_RECORD_SIZE, 1, bin_file) == 1) {
+        if (nb_histo == size) {
+            size = (size == 0) ? field[4] : 2 * size;
+            tmp = realloc(histo, (size_t)size * RSSI_RANGE * sizeof *histo);
+            if (tmp == NULL) {
+                printf("ERROR: out of memory after %u histograms\n", nb_histo);
+                break;
+            }
+            histo = tmp;
+        }
+        for (j = 0; j < RSSI_RANGE; j++) {
+            histo[nb_histo * RSSI_RANGE + j] = (uint16_t)buff[2*j] | ((uint16_t)buff[2*j+1] << 8);
+        }
+        write_csv(csv_file, field[0] + (nb_histo % field[4]) * field[2], &histo[nb_histo * RSSI_RANGE]);
+        nb_histo += 1;
+    }
+    if (ferror(bin_file)) {
+        printf("ERROR: failed to read %s\n", bin_name);
+    }
+    fclose(bin_file);
+    fclose(csv_file);
+    printf("%u histograms, %u complete sweeps\n", nb_histo, nb_histo / field[4]);
+
+    level = malloc((size_t)nb_histo * sizeof *level);
+    if ((nb_histo == 0) || (level == NULL) || (lgw_sscan_levels(histo, nb_histo, field[3], level) != LGW_SSCAN_SUCCESS)) {
+        free(level);
+        free(histo);
+        return (nb_histo == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+    for (i = 0; (i < field[4]) && (i < nb_histo); i++) {
+        nb_floor = nb_median = 0;
+        sum_floor = sum_median = 0;
+        for (j = i; j < nb_histo; j += field[4]) {
+            if (level[j].floor_dbm != LGW_SSCAN_NO_LEVEL) {
+                sum_floor += level[j].floor_dbm;
+                nb_floor += 1;
+            }
+            if (level[j].pct_dbm[2] != LGW_SSCAN_NO_LEVEL) {
+                sum_median += level[j].pct_dbm[2];
+                nb_median += 1;
+            }
+        }
+        printf("%u", field[0] + i * field[2]);
+        if (nb_floor > 0) {
+            printf("  floor %.1f", sum_floor / nb_floor);
+        }
+        if (nb_median > 0) {
+            printf("  50%%<%.1f", sum_median / nb_median);
+        }
+        printf("\n");
+    }
+    free(level);
+    free(histo);
+    return EXIT_SUCCESS;
+}
+
 /* -------------------------------------------------------------------------- */
 /* --- MAIN FUNCTION -------------------------------------------------------- */
 
 int main( int argc, char ** argv )
 {
-    int i, j, k; /* loop and temporary variables */
+    int i, j; /* loop and temporary variables */
     int x; /* return code for functions */
     int32_t reg_val;
 
@@ -82,29 +447,30 @@ int main( int argc, char ** argv )
     char arg_s[64];
 
     /* Application parameters */
-    uint32_t init_freq = DEFAULT_START_FREQ;
     uint32_t start_freq = DEFAULT_START_FREQ;
     uint32_t stop_freq = DEFAULT_STOP_FREQ;
     uint32_t step_freq = DEFAULT_STEP_FREQ;
     uint16_t rssi_pts = DEFAULT_RSSI_PTS;
-    int8_t rssi_offset = DEFAULT_SX127X_RSSI_OFFSET;
-    enum lgw_sx127x_rxbw_e channel_bw_khz = DEFAULT_CHAN_BW;
     char log_file_name[64] = DEFAULT_LOG_NAME;
     FILE * log_file = NULL;
+    bool log_bin = false;
+    char conv_name[64] = "";
+    bool monitor = false;
+    bool read_only = false;
+    char shm_name[64] = LGW_SSCAN_NAME;
+    struct lgw_sscan_s *sscan = NULL;
 
     /* Local var */
-    bool lbt_support = false;
-    int freq_idx;
     int freq_nb;
     uint64_t freq_reg;
     uint32_t freq;
-    uint8_t read_burst[RSSI_RANGE*2];
-    uint16_t rssi_histo;
-    uint16_t rssi_cumu;
-    float rssi_thresh[] = {0.1,0.3,0.5,0.8,1};
+    uint16_t rssi_histo[RSSI_RANGE];
+    struct lgw_sscan_entry_s entry;
+    uint32_t sweep;
+    uint64_t sweep_start;
 
     /* Parse command line options */
-    while((i = getopt(argc, argv, "hf:n:b:l:o:")) != -1) {
+    while((i = getopt(argc, argv, "hf:n:b:l:o:Bc:ms:r")) != -1) {
         switch (i) {
         case 'h':
             printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
@@ -114,6 +480,11 @@ int main( int argc, char ** argv )
             printf(" -n <uint>  Total number of RSSI points [1..65535]\n");
             printf(" -o <int>   Offset in dB to be applied to the SX127x RSSI [-128..127]\n");
             printf(" -l <char>  Log file name\n");
+            printf(" -B         Binary log (.bin) instead of CSV, also written in monitor mode\n");
+            printf(" -c <char>  Convert a binary log to the CSV log named by -l, then exit\n");
+            printf(" -m         Monitor mode: sweep until stopped, publish histograms in shared memory\n");
+            printf(" -s <char>  Shared memory name for -m and -r, default %s\n", LGW_SSCAN_NAME);
+            printf(" -r         Print the histograms published by a spectral scan in monitor mode\n");
             printf("~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~~\n");
             return EXIT_SUCCESS;
 
@@ -194,12 +565,57 @@ int main( int argc, char ** argv )
             }
             break;
 
+        case 'B': /* -B  Binary log */
+            log_bin = true;
+            break;
+
+        case 'c': /* -c <char>  Binary log to convert */
+            j = sscanf(optarg, "%63s", conv_name);
+            if (j != 1) {
+                printf("ERROR: argument parsing of -c argument. -h for help.\n");
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'm': /* -m  Monitor mode */
+            monitor = true;
+            break;
+
+        case 's': /* -s <char>  Shared memory name */
+            shm_name[0] = '/'; /* the name of a POSIX shared memory object starts with a slash */
+            j = sscanf(optarg, "%62s", (optarg[0] == '/') ? shm_name : &shm_name[1]);
+            if (j != 1) {
+                printf("ERROR: argument parsing of -s argument. -h for help.\n");
+                return EXIT_FAILURE;
+            }
+            break;
+
+        case 'r': /* -r  Print the histograms published in shared memory */
+            read_only = true;
+            break;
+
         default:
             printf("ERROR: argument parsing options. -h for help.\n");
             return EXIT_FAILURE;
         }
     }
 
+    if (read_only == true) {
+        return read_shm(shm_name);
+    }
+    if (conv_name[0] != '\0') {
+        strcat(log_file_name,".csv");
+        return convert_bin(conv_name, log_file_name);
+    }
+
+    /* configure signal handling */
+    sigemptyset(&sigact.sa_mask);
+    sigact.sa_flags = 0;
+    sigact.sa_handler = sig_handler;
+    sigaction(SIGQUIT, &sigact, NULL);
+    sigaction(SIGINT, &sigact, NULL);
+    sigaction(SIGTERM, &sigact, NULL);
+
     /* Start message */
     printf("+++ Start spectral scan of LoRa gateway channels +++\n");
 
@@ -282,108 +698,106 @@ int main( int argc, char ** argv )
         lgw_fpga_reg_w(LGW_FPGA_HISTO_SCAN_FREQ, (int32_t)freq_reg);
     }
 
-    /* create log file */
-    strcat(log_file_name,".csv");
-    log_file = fopen(log_file_name, "w");
-    if (log_file == NULL) {
-        printf("ERROR: impossible to create log file %s\n", log_file_name);
-        return EXIT_FAILURE;
-    }
-    printf("Writing to file: %s\n", log_file_name);
-
     /* Number of frequency steps */
     freq_nb = (int)((stop_freq - start_freq) / step_freq) + 1;
+    fill_ms = (uint32_t)(((uint64_t)rssi_pts * 1000) / SX127X_RSSI_RATE_HZ);
     printf("Scanning frequencies:\nstart: %d Hz\nstop : %d Hz\nstep : %d Hz\nnb   : %d\n", start_freq, stop_freq, step_freq, freq_nb);
 
-    /* Main loop */
-    for(j = 0; j < freq_nb; j++) {
-        /* Current frequency */
-        freq = start_freq + j * step_freq;
-        printf("%d", freq);
-
-        if (lbt_support == false) {
-            /* Set SX127x */
-            x = lgw_setup_sx127x(freq, MOD_FSK, channel_bw_khz, rssi_offset);
-            if( x != 0 )
-            {
-                printf( "ERROR: SX127x setup failed\n" );
+    if (monitor == true) {
+        /* Publish each histogram in shared memory, sweep after sweep */
+        if (freq_nb > LGW_SSCAN_FREQ_MAX) {
+            printf("ERROR: monitor mode supports up to %d frequencies\n", LGW_SSCAN_FREQ_MAX);
+            return EXIT_FAILURE;
+        }
+        sscan = lgw_sscan_create(shm_name, freq_nb);
+        if (sscan == NULL) {
+            printf("ERROR: impossible to create shared memory %s\n", shm_name);
+            return EXIT_FAILURE;
+        }
+        printf("Publishing to shared memory: %s\n", shm_name);
+        if (log_bin == true) {
+            strcat(log_file_name,".bin");
+            log_file = fopen(log_file_name, "wb");
+            if ((log_file == NULL) || (write_bin_header(log_file, start_freq, stop_freq, step_freq, rssi_pts, freq_nb) != 0)) {
+                printf("ERROR: impossible to create log file %s\n", log_file_name);
+                lgw_sscan_close(sscan);
                 return EXIT_FAILURE;
             }
-
-            /* Start FPGA state machine for spectral scal */
-            lgw_fpga_reg_w(LGW_FPGA_CTRL_FEATURE_START, 1);
-        } else {
-            /* Do Nothing */
-            /* LBT setup has already done the necessary */
+            printf("Writing to file: %s\n", log_file_name);
         }
 
-        /* Clean histogram */
-        lgw_fpga_reg_w(LGW_FPGA_CTRL_CLEAR_HISTO_MEM, 1);
-
-        /* Wait for histogram clean to start */
-        do {
-            wait_ms(10);
-            lgw_fpga_reg_r(LGW_FPGA_STATUS, &reg_val);
+        memset(&entry, 0, sizeof entry);
+        entry.nb_pts = rssi_pts;
+        for (sweep = 0; (exit_sig == 0) && (quit_sig == 0); sweep++) {
+            sweep_start = monotonic_us();
+            entry.sweep = sweep;
+            for (j = 0; j < freq_nb; j++) {
+                entry.freq_hz = start_freq + j * step_freq;
+                freq = (j + 1 < freq_nb) ? entry.freq_hz + step_freq : start_freq; /* wraps to the next sweep */
+                if (scan_freq(entry.freq_hz, freq, entry.histo) != 0) {
+                    break;
+                }
+                entry.time_us = monotonic_us();
+                lgw_sscan_publish(sscan, j, &entry);
+                if ((log_file != NULL) && (write_bin(log_file, entry.histo) != 0)) {
+                    printf("WARNING: failed to write to %s, stop logging\n", log_file_name);
+                    fclose(log_file);
+                    log_file = NULL;
+                }
+            }
+            if (log_file != NULL) {
+                fflush(log_file);
+            }
+            if (j < freq_nb) {
+                break; /* stopped by a signal, or SX127x failure */
+            }
+            lgw_sscan_sweep_done(sscan);
+            printf("INFO: sweep %u done in %.1fs\n", sweep, (entry.time_us - sweep_start) / 1e6);
         }
-        while((TAKE_N_BITS_FROM((uint8_t)reg_val, 0, 5)) != 1); /* Clear has started */
-
-        /* Set scan frequency during clear process */
-        if (lbt_support == false) {
-            /* We can directly set the scan frequency */
-            freq_reg = ((uint64_t)freq << 19) / (uint64_t)32000000;
-            lgw_fpga_reg_w(LGW_FPGA_HISTO_SCAN_FREQ, (int32_t)freq_reg);
-        } else {
-            /* The possible scan frequencies are hard-coded in FPGA, we give an offset from init_freq */
-            freq_idx = (freq - init_freq) / LBT_MIN_STEP_FREQ;
-            printf(" (idx=%i) ", freq_idx);
-            lgw_fpga_reg_w(LGW_FPGA_SCAN_FREQ_OFFSET, freq_idx);
+        lgw_sscan_close(sscan);
+        if (log_file != NULL) {
+            fclose(log_file);
         }
-
-        /* Release FPGA state machine */
-        lgw_fpga_reg_w(LGW_FPGA_CTRL_CLEAR_HISTO_MEM, 0);
-
-        /* Wait for histogram ready */
-        do {
-            wait_ms(1000);
-            lgw_fpga_reg_r(LGW_FPGA_STATUS, &reg_val);
+        if ((exit_sig == 0) && (quit_sig == 0)) {
+            lgw_disconnect();
+            return EXIT_FAILURE;
         }
-        while((TAKE_N_BITS_FROM((uint8_t)reg_val, 5, 1)) != 1);
-
-        if (lbt_support == false) {
-            /* Stop FPGA state machine for spectral scan */
-            lgw_fpga_reg_w(LGW_FPGA_CTRL_FEATURE_START, 0);
-        } else {
-            /* Do Nothing */
-            /* LBT is running */
+    } else {
+        /* create log file */
+        strcat(log_file_name, (log_bin == true) ? ".bin" : ".csv");
+        log_file = fopen(log_file_name, (log_bin == true) ? "wb" : "w");
+        if ((log_file == NULL) || ((log_bin == true) && (write_bin_header(log_file, start_freq, stop_freq, step_freq, rssi_pts, freq_nb) != 0))) {
+            printf("ERROR: impossible to create log file %s\n", log_file_name);
+            return EXIT_FAILURE;
         }
+        printf("Writing to file: %s\n", log_file_name);
+
+        /* Main loop */
+        for(j = 0; j < freq_nb; j++) {
+            /* Current frequency */
+            freq = start_freq + j * step_freq;
+            printf("%d", freq);
+            if (lbt_support == true) {
+                printf(" (idx=%i) ", (int)((freq - init_freq) / LBT_MIN_STEP_FREQ));
+            }
 
-        /* Read histogram */
-        lgw_fpga_reg_w(LGW_FPGA_CTRL_ACCESS_HISTO_MEM, 1); /* HOST gets access to FPGA RAM */
-        lgw_fpga_reg_w(LGW_FPGA_HISTO_RAM_ADDR, 0);
-        lgw_fpga_reg_rb(LGW_FPGA_HISTO_RAM_DATA, read_burst, RSSI_RANGE*2);
-        lgw_fpga_reg_w(LGW_FPGA_CTRL_ACCESS_HISTO_MEM, 0); /* FPGA gets access to RAM back */
-
-        /* Write data to CSV */
-        fprintf(log_file, "%d", freq);
-        rssi_cumu = 0;
-        k = 0;
-        for (i = 0; i < RSSI_RANGE; i++) {
-            rssi_histo = (uint16_t)read_burst[2*i] | ((uint16_t)read_burst[2*i+1] << 8);
-            fprintf(log_file, ",%.1f,%d", -i/2.0, rssi_histo);
-            rssi_cumu += rssi_histo;
-            if (rssi_cumu > rssi_pts) {
-                printf(" - WARNING: number of RSSI points higher than expected (%u,%u)", rssi_cumu, rssi_pts);
-                rssi_cumu = rssi_pts;
+            if (scan_freq(freq, (j + 1 < freq_nb) ? freq + step_freq : 0, rssi_histo) != 0) {
+                fclose(log_file);
+                lgw_disconnect();
+                return EXIT_FAILURE;
             }
-            if (rssi_cumu > rssi_thresh[k]*rssi_pts) {
-                printf("  %d%%<%.1f", (uint16_t)(rssi_thresh[k]*100), -i/2.0);
-                k++;
+
+            /* Write data to log */
+            if (log_bin == true) {
+                write_bin(log_file, rssi_histo);
+            } else {
+                write_csv(log_file, freq, rssi_histo);
             }
+            print_histo(rssi_histo, rssi_pts);
+            printf("\n");
         }
-        fprintf(log_file, "\n");
-        printf("\n");
+        fclose(log_file);
     }
-    fclose(log_file);
 
     /* Close SPI */
     x = lgw_disconnect();
@@ -30,9 +30,13 @@ Maintainer: Sylvain Miermont
 
 #include <signal.h>     /* sigaction */
 #include <unistd.h>     /* getopt access */
-#include <stdlib.h>     /* rand */
+#include <stdlib.h>     /* rand getenv */
+#include <string.h>     /* memcmp */
 
 #include "loragw_reg.h"
+#include "loragw_spi.h"
+#include "loragw_aux.h"
+#include "loragw_ctx.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -48,6 +52,14 @@ Maintainer: Sylvain Miermont
 #define BUFF_SIZE               1024 /* maximum number of bytes that we can write in sx1301 RX data buffer */
 #define DEFAULT_TX_NOTCH_FREQ   129E3
 
+#define TUNE_REG_REPEATS        1000 /* 32 bits register R/W checked at each link setting */
+#define TUNE_BUFF_REPEATS       100 /* data buffer R/W checked and timed at each link setting */
+
+/* link settings tried by the auto-tune mode, the data buffer holds BUFF_SIZE
+bytes so larger chunks cannot be checked */
+static const uint32_t tune_speed[] = { 2000000, 4000000, 6000000, 8000000, 10000000, 12000000, 16000000, 20000000 };
+static const uint16_t tune_chunk[] = { 64, 128, 256, 512, 1024 };
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
 
@@ -63,6 +75,10 @@ static void sig_handler(int sigio);
 
 void usage (void);
 
+static double tune_check(const struct lgw_spi_link_s *link);
+
+static int tune(const char *path, const char *device);
+
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE FUNCTIONS DEFINITION ----------------------------------------- */
 
@@ -79,6 +95,110 @@ void usage(void) {
     MSG( "Available options:\n");
     MSG( " -h print this help\n");
     MSG( " -t <int> specify which test you want to run (1-4)\n");
+    MSG( " -a auto-tune: find the fastest SPI clock with no error and save the one below it\n");
+    MSG( " -f <path> SPI link settings file written by -a (default: $%s or %s)\n", LGW_SPI_LINK_ENV, LGW_SPI_LINK_PATH);
+    MSG( " -d <path> SPI device of the concentrator (default: the backend default)\n");
+}
+
+/* run the 32 bits register and data buffer checks at one link setting,
+return the data buffer throughput in kB/s, 0 if there was any error */
+static double tune_check(const struct lgw_spi_link_s *link) {
+    int32_t test_value;
+    int32_t read_value;
+    int32_t test_addr;
+    uint8_t test_buff[BUFF_SIZE];
+    uint8_t read_buff[BUFF_SIZE];
+    uint64_t t0, t_buff = 0;
+    int i, j;
+
+    if ((lgw_spi_set_link(link) != LGW_SPI_SUCCESS) || (lgw_connect(false, DEFAULT_TX_NOTCH_FREQ) != LGW_REG_SUCCESS)) {
+        return 0.0;
+    }
+
+    for (i = 0; i < TUNE_REG_REPEATS; ++i) {
+        test_value = (rand() & 0x0000FFFF);
+        test_value += (int32_t)(rand() & 0x0000FFFF) << 16;
+        lgw_reg_w(LGW_FSK_REF_PATTERN_LSB, test_value);
+        lgw_reg_r(LGW_FSK_REF_PATTERN_LSB, &read_value);
+        if (read_value != test_value) {
+            lgw_disconnect();
+            return 0.0;
+        }
+    }
+
+    for (i = 0; i < TUNE_BUFF_REPEATS; ++i) {
+        for (j = 0; j < BUFF_SIZE; ++j) {
+            test_buff[j] = rand() & 0xFF;
+        }
+        test_addr = rand() & 0xFFFF;
+        t0 = monotonic_us();
+        lgw_reg_w(LGW_RX_DATA_BUF_ADDR, test_addr);
+        lgw_reg_wb(LGW_RX_DATA_BUF_DATA, test_buff, BUFF_SIZE);
+        lgw_reg_w(LGW_RX_DATA_BUF_ADDR, test_addr);
+        lgw_reg_rb(LGW_RX_DATA_BUF_DATA, read_buff, BUFF_SIZE);
+        t_buff += monotonic_us() - t0;
+        if (memcmp(test_buff, read_buff, BUFF_SIZE) != 0) {
+            lgw_disconnect();
+            return 0.0;
+        }
+    }
+
+    lgw_disconnect();
+    return (t_buff > 0) ? (2.0 * BUFF_SIZE * TUNE_BUFF_REPEATS * 1000.0 / t_buff) : 0.0;
+}
+
+/* sweep the link settings up to the first clock with an error, save the
+fastest chunk size one clock below the fastest clean one: a short check at the
+very edge passes on a good day and fails when the board gets warm */
+static int tune(const char *path, const char *device) {
+    struct lgw_spi_link_s link, best[ARRAY_SIZE(tune_speed)];
+    double kbps, best_kbps[ARRAY_SIZE(tune_speed)];
+    int clean = -1; /* fastest clock with no error at any chunk size */
+    int pick;
+    unsigned i, j;
+    bool speed_clean;
+
+    for (i = 0; (i < ARRAY_SIZE(tune_speed)) && (quit_sig != 1) && (exit_sig != 1); ++i) {
+        speed_clean = true;
+        best_kbps[i] = 0.0;
+        for (j = 0; j < ARRAY_SIZE(tune_chunk); ++j) {
+            link.speed_hz = tune_speed[i];
+            link.burst_chunk = tune_chunk[j];
+            kbps = tune_check(&link);
+            if (kbps > 0.0) {
+                printf("%2u.%u MHz, %4u bytes chunks: %8.1f kB/s\n", link.speed_hz / 1000000, (link.speed_hz / 100000) % 10, link.burst_chunk, kbps);
+            } else {
+                printf("%2u.%u MHz, %4u bytes chunks: error\n", link.speed_hz / 1000000, (link.speed_hz / 100000) % 10, link.burst_chunk);
+                speed_clean = false;
+            }
+            if (kbps > best_kbps[i]) {
+                best_kbps[i] = kbps;
+                best[i] = link;
+            }
+        }
+        if (speed_clean == false) {
+            break; /* the link is at its edge, faster clocks will not do better */
+        }
+        clean = i;
+    }
+    lgw_spi_set_link(NULL);
+
+    if (clean < 0) {
+        MSG("ERROR: no SPI clock without error\n");
+        return EXIT_FAILURE;
+    }
+    pick = (clean > 0) ? (clean - 1) : clean;
+    printf("Fastest clean setting: %u Hz, %u bytes chunks, %.1f kB/s\n", best[clean].speed_hz, best[clean].burst_chunk, best_kbps[clean]);
+    if (pick == clean) {
+        printf("WARNING: no slower clock to keep a margin\n");
+    }
+    printf("Saved setting: %u Hz, %u bytes chunks, %.1f kB/s\n", best[pick].speed_hz, best[pick].burst_chunk, best_kbps[pick]);
+    if (lgw_spi_link_save(path, device, &best[pick]) != LGW_SPI_SUCCESS) {
+        MSG("ERROR: failed to write %s\n", path);
+        return EXIT_FAILURE;
+    }
+    printf("Saved to %s for %s\n", path, (device != NULL) ? device : "the default SPI device");
+    return EXIT_SUCCESS;
 }
 
 /* -------------------------------------------------------------------------- */
@@ -94,6 +214,10 @@ int main(int argc, char **argv)
     int cycle_number = 0;
     int repeats_per_cycle = 1000;
     bool error = false;
+    bool auto_tune = false;
+    const char *link_path = getenv(LGW_SPI_LINK_ENV);
+    const char *spi_path = NULL;
+    struct lgw_context *ctx;
 
     /* in/out variables */
     int32_t test_value;
@@ -106,7 +230,7 @@ int main(int argc, char **argv)
     uint8_t read_buff[BUFF_SIZE];
 
     /* parse command line options */
-    while ((i = getopt (argc, argv, "ht:")) != -1) {
+    while ((i = getopt (argc, argv, "ht:af:d:")) != -1) {
         switch (i) {
             case 'h':
                 usage();
@@ -123,13 +247,27 @@ int main(int argc, char **argv)
                 }
                 break;
 
+            case 'a':
+                auto_tune = true;
+                break;
+
+            case 'f':
+                link_path = optarg;
+                break;
+
+            case 'd':
+                spi_path = optarg;
+                break;
+
             default:
                 MSG("ERROR: argument parsing use -h option for help\n");
                 usage();
                 return EXIT_FAILURE;
         }
     }
-    MSG("INFO: Starting LoRa concentrator SPI stress-test number %i\n", test_number);
+    if ((link_path == NULL) || (link_path[0] == '\0')) {
+        link_path = LGW_SPI_LINK_PATH;
+    }
 
     /* configure signal handling */
     sigemptyset(&sigact.sa_mask);
@@ -139,6 +277,22 @@ int main(int argc, char **argv)
     sigaction(SIGINT, &sigact, NULL);
     sigaction(SIGTERM, &sigact, NULL);
 
+    /* the default context opens the backend default device */
+    if (spi_path != NULL) {
+        ctx = lgw_ctx_new(spi_path);
+        if (ctx == NULL) {
+            MSG("ERROR: failed to create a context for %s\n", spi_path);
+            return EXIT_FAILURE;
+        }
+        lgw_ctx_use(ctx);
+    }
+
+    if (auto_tune == true) {
+        MSG("INFO: Starting LoRa concentrator SPI auto-tune\n");
+        return tune(link_path, spi_path);
+    }
+    MSG("INFO: Starting LoRa concentrator SPI stress-test number %i\n", test_number);
+
     /* start SPI link */
     i = lgw_connect(false, DEFAULT_TX_NOTCH_FREQ);
     if (i != LGW_REG_SUCCESS) {
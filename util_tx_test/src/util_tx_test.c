@@ -37,6 +37,7 @@ Maintainer: Sylvain Miermont
 #include "loragw_hal.h"
 #include "loragw_reg.h"
 #include "loragw_aux.h"
+#include "loragw_txq.h"
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE MACROS ------------------------------------------------------- */
@@ -54,6 +55,7 @@ Maintainer: Sylvain Miermont
 #define DEFAULT_FDEV_KHZ            25
 #define DEFAULT_NOTCH_FREQ          129000U /* 129 kHz */
 #define DEFAULT_SX127X_RSSI_OFFSET  -4 /* dB */
+#define BURST_START_DELAY_US        50000 /* first packet of a burst starts that long after it is queued */
 
 /* -------------------------------------------------------------------------- */
 /* --- PRIVATE VARIABLES (GLOBAL) ------------------------------------------- */
@@ -147,6 +149,7 @@ void usage(void) {
     printf(" -i                 send packet using inverted modulation polarity\n");
     printf(" -t         <uint>  pause between packets (ms)\n");
     printf(" -x         <int>   nb of times the sequence is repeated (-1 loop until stopped)\n");
+    printf(" --burst            queue the packets back-to-back in the HAL TX queue, -t sets the gap between them\n");
     printf(" --lbt-freq         <float> lbt first channel frequency in MHz\n");
     printf(" --lbt-nbch         <uint>  lbt number of channels [1..8]\n");
     printf(" --lbt-sctm         <uint>  lbt scan time in usec to be applied to all channels [128, 5000]\n");
@@ -160,7 +163,6 @@ void usage(void) {
 int main(int argc, char **argv)
 {
     int i;
-    uint8_t status_var;
 
     /* user entry parameters */
     int xi = 0;
@@ -191,6 +193,9 @@ int main(int argc, char **argv)
     uint8_t  lbt_nb_channel = 1;
     uint32_t sx1301_count_us;
     uint32_t tx_notch_freq = DEFAULT_NOTCH_FREQ;
+    bool burst = false;
+    uint32_t slot_us;
+    struct lgw_txq_stats_s txq_stats;
 
     /* RF configuration (TX fail if RF chain is not enabled) */
     enum lgw_radio_type_e radio_type = LGW_RADIO_TYPE_NONE;
@@ -213,6 +218,7 @@ int main(int argc, char **argv)
         {"lbt-rssi", required_argument, 0, 0},
         {"lbt-nbch", required_argument, 0, 0},
         {"lbt-rssi-offset", required_argument, 0, 0},
+        {"burst", no_argument, 0, 0},
         {0, 0, 0, 0}
     };
 
@@ -469,6 +475,8 @@ int main(int argc, char **argv)
                         usage();
                         return EXIT_FAILURE;
                     }
+                } else if( strcmp(long_options[option_index].name, "burst") == 0 ) { /* queue all packets at once */
+                    burst = true;
                 }
                 break;
             default:
@@ -604,6 +612,40 @@ int main(int argc, char **argv)
     txpkt.size = pl_size;
     strcpy((char *)txpkt.payload, "TEST**abcdefghijklmnopqrstuvwxyz#0123456789#ABCDEFGHIJKLMNOPQRSTUVWXYZ#0123456789#abcdefghijklmnopqrstuvwxyz#0123456789#ABCDEFGHIJKLMNOPQRSTUVWXYZ#0123456789#abcdefghijklmnopqrstuvwxyz#0123456789#ABCDEFGHIJKLMNOPQRSTUVWXYZ#0123456789#abcdefghijklmnopqrs#" ); /* abc.. is for padding */
 
+    /* burst mode: the TX queue loads each packet when the previous one is done */
+    if (burst == true) {
+        if (repeat < 1) {
+            MSG("ERROR: burst mode needs a number of packets (-x)\n");
+            lgw_stop();
+            return EXIT_FAILURE;
+        }
+        lgw_txq_start();
+        txpkt.tx_mode = TIMESTAMPED;
+        slot_us = lgw_time_on_air(&txpkt) * 1000 + ((delay * 1000 > LGW_TXQ_GUARD_US) ? delay * 1000 : LGW_TXQ_GUARD_US);
+        lgw_get_instcnt(&sx1301_count_us);
+        sx1301_count_us += BURST_START_DELAY_US;
+        for (cycle_count = 1; (cycle_count <= repeat) && (quit_sig == 0) && (exit_sig == 0); ++cycle_count) {
+            txpkt.payload[4] = (uint8_t)(cycle_count >> 8); /* MSB */
+            txpkt.payload[5] = (uint8_t)(cycle_count & 0x00FF); /* LSB */
+            txpkt.count_us = sx1301_count_us;
+            while ((i = lgw_txq_enqueue(&txpkt)) == LGW_TXQ_FULL) {
+                wait_ms(slot_us / 1000);
+            }
+            if (i != LGW_TXQ_SUCCESS) {
+                printf("Packet number %u refused by the TX queue (%d)\n", cycle_count, i);
+            }
+            sx1301_count_us += slot_us;
+        }
+        do {
+            wait_ms(slot_us / 1000 + 1);
+            lgw_txq_get_stats(&txq_stats, false);
+        } while ((txq_stats.depth > 0) && (quit_sig == 0) && (exit_sig == 0));
+        lgw_txq_stop();
+        lgw_send_wait(-1); /* let the last packet finish */
+        printf("Burst done: %u queued, %u sent, %u late, %u collision(s), %u error(s)\n", txq_stats.nb_pkt_in, txq_stats.nb_pkt_sent, txq_stats.nb_late, txq_stats.nb_collision, txq_stats.nb_error);
+        repeat = 0; /* skip the main loop */
+    }
+
     /* main loop */
     cycle_count = 0;
     while ((repeat == -1) || (cycle_count < repeat)) {
@@ -617,9 +659,7 @@ int main(int argc, char **argv)
             to set a timestamp to the packet */
         if (lbt_enable == true) {
             /* Get the current SX1301 time */
-            lgw_reg_w(LGW_GPS_EN, 0);
-            lgw_get_trigcnt(&sx1301_count_us);
-            lgw_reg_w(LGW_GPS_EN, 1);
+            lgw_get_instcnt(&sx1301_count_us);
 
             /* Set packet timestamp to current time + few milliseconds */
             txpkt.count_us = sx1301_count_us + 50E3;
@@ -635,10 +675,7 @@ int main(int argc, char **argv)
             printf("Failed: Not allowed (LBT)\n");
         } else {
             /* wait for packet to finish sending */
-            do {
-                wait_ms(5);
-                lgw_status(TX_STATUS, &status_var); /* get TX status */
-            } while (status_var != TX_FREE);
+            lgw_send_wait(-1);
             printf("OK\n");
         }
 